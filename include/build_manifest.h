@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "windows_customizations.h"
+
+namespace diskann {
+  // Records the completed stages of a disk index build, with the files each
+  // stage produced, so that an interrupted build can resume after the last
+  // stage it finished. The manifest is a small text file, rewritten (through
+  // a temporary file and a rename) every time a stage completes.
+  //
+  // Every artifact is recorded with its size and a checksum of up to 16
+  // evenly spaced 1MB samples of its contents: enough to tell a truncated or
+  // rewritten file from a finished one without rereading hundreds of GBs. A
+  // directory artifact (a zarr tensor) is recorded with the names and sizes
+  // of its files. Artifacts are synced to disk before the manifest that
+  // records them, and the manifest before its directory entry.
+  class BuildManifest {
+   public:
+    // config describes the build (input, parameters); a manifest written by a
+    // build with another config is discarded. Without resume, any existing
+    // manifest is discarded as well.
+    DISKANN_DLLEXPORT BuildManifest(const std::string &manifest_path,
+                                    const std::string &config, bool resume);
+
+    // true if the stage was recorded complete and all its artifacts are still
+    // there, with the recorded sizes and checksums
+    DISKANN_DLLEXPORT bool is_complete(const std::string &stage) const;
+
+    // records the stage complete with the files it produced; note is free
+    // form text the stage needs when it is skipped (e.g. a count). Recording
+    // a stage again forgets the stages recorded after it, which were built
+    // from its previous artifacts.
+    DISKANN_DLLEXPORT void mark_complete(
+        const std::string &stage, const std::vector<std::string> &artifacts,
+        const std::string &note = "");
+
+    // note recorded with a complete stage, empty if none
+    DISKANN_DLLEXPORT std::string get_note(const std::string &stage) const;
+
+   private:
+    struct Artifact {
+      std::string path;
+      _u64        size;
+      _u64        checksum;
+    };
+    struct Stage {
+      std::string           name;
+      std::string           note;
+      std::vector<Artifact> artifacts;
+    };
+
+    const Stage *find(const std::string &stage) const;
+    void         load();
+    void         save() const;
+
+    static void describe(const std::string &path, bool sync, _u64 &size,
+                         _u64 &sum);
+    static _u64 checksum(const std::string &path, _u64 size);
+
+    std::string        _path;
+    std::string        _config;
+    std::vector<Stage> _stages;
+  };
+}  // namespace diskann
@@ -25,6 +25,7 @@ typedef HANDLE FileHandle;
 typedef int FileHandle;
 #endif
 
+#include "build_manifest.h"
 #include "cached_io.h"
 #include "common_includes.h"
 
@@ -39,6 +40,8 @@ namespace diskann {
   const uint32_t NUM_NODES_TO_CACHE = 250000;
   const uint32_t WARMUP_L = 20;
   const uint32_t NUM_KMEANS_REPS = 12;
+  const size_t   MAX_MERGE_RANGE_BYTES = 64 * 1024 * 1024;
+  const size_t   DISK_LAYOUT_BATCH_BYTES = 64 * 1024 * 1024;
 
   template<typename T>
   class PQFlashIndex;
@@ -86,7 +89,9 @@ namespace diskann {
       std::string base_file, diskann::Metric _compareMetric, unsigned L,
       unsigned R, double sampling_rate, double ram_budget,
       std::string mem_index_path, std::string medoids_file,
-      std::string centroids_file);
+      std::string centroids_file, unsigned num_rnds = 1,
+      std::string    visit_order = "sequential",
+      BuildManifest *manifest = nullptr);
 
   template<typename T>
   DISKANN_DLLEXPORT uint32_t optimize_beamwidth(
@@ -94,17 +99,36 @@ namespace diskann {
       _u64 tuning_sample_num, _u64 tuning_sample_aligned_dim, uint32_t L,
       uint32_t nthreads, uint32_t start_bw = 2);
 
+  // Builds the Vamana graph of base_file in one piece with PQVamanaBuilder,
+  // keeping only the PQ codes and the graph resident.
   template<typename T>
-  DISKANN_DLLEXPORT int build_disk_index(const char *    dataFilePath,
-                                         const char *    indexFilePath,
-                                         const char *    indexBuildParameters,
-                                         diskann::Metric _compareMetric,
-                                         bool            use_opq = false);
-
+  DISKANN_DLLEXPORT int build_pq_vamana_index(
+      const std::string &base_file, const std::string &pq_pivots_path,
+      const std::string &pq_compressed_path, unsigned L, unsigned R,
+      const std::string &mem_index_path);
+
+  // num_rnds > 1 builds the Vamana graph in several passes (the first at
+  // alpha = 1), visit_order is "sequential" or "random". build_with_pq
+  // replaces the sharded in-memory build by build_pq_vamana_index. A
+  // non-empty tensors_prefix writes the points and lists as TensorStore
+  // tensors under that prefix, and the disk index with its metadata only.
+  // Completed stages are recorded in <indexFilePath>_build_manifest.txt;
+  // resume skips the ones a previous run of the same build completed.
+  template<typename T>
+  DISKANN_DLLEXPORT int build_disk_index(
+      const char *dataFilePath, const char *indexFilePath,
+      const char *indexBuildParameters, diskann::Metric _compareMetric,
+      bool use_opq = false, unsigned num_rnds = 1,
+      std::string visit_order = "sequential", bool build_with_pq = false,
+      std::string tensors_prefix = "", bool resume = false);
+
+  // metadata_only writes just the metadata sector, for indexes whose points
+  // are served from TensorStore tensors
   template<typename T>
   DISKANN_DLLEXPORT void create_disk_layout(
       const std::string base_file, const std::string mem_index_file,
       const std::string output_file,
-      const std::string reorder_data_file = std::string(""));
+      const std::string reorder_data_file = std::string(""),
+      bool              metadata_only = false);
 
 }  // namespace diskann
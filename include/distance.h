@@ -1,5 +1,6 @@
 #pragma once
 #include "windows_customizations.h"
+#include "float16.h"
 
 namespace diskann {
   enum Metric { L2 = 0, INNER_PRODUCT = 1, COSINE = 2, FAST_L2 = 3 };
@@ -8,6 +9,15 @@ namespace diskann {
   class Distance {
    public:
     virtual float compare(const T *a, const T *b, uint32_t length) const = 0;
+
+    // distances from a to each of the n vectors in bs; kernels override this
+    // to share the loads of a across a tile of candidates
+    virtual void compare_batch(const T *a, const T *const *bs, uint32_t n,
+                               uint32_t length, float *dists) const {
+      for (uint32_t i = 0; i < n; i++)
+        dists[i] = compare(a, bs[i], length);
+    }
+
     virtual ~Distance() {
     }
   };
@@ -47,6 +57,10 @@ namespace diskann {
                                             uint32_t size) const
         __attribute__((hot));
 #endif
+    DISKANN_DLLEXPORT virtual void compare_batch(const float *        a,
+                                                 const float *const *bs,
+                                                 uint32_t n, uint32_t size,
+                                                 float *dists) const;
   };
 
   class AVXDistanceL2Float : public Distance<float> {
@@ -112,6 +126,13 @@ namespace diskann {
     float compare(const T *a, const T *b, float norm, unsigned size) const;
   };
 
+  template<>
+  float DistanceInnerProduct<float16>::inner_product(const float16 *a,
+                                                     const float16 *b,
+                                                     unsigned size) const;
+  template<>
+  float DistanceFastL2<float16>::norm(const float16 *a, unsigned size) const;
+
   class AVXDistanceInnerProductFloat : public Distance<float> {
    public:
     DISKANN_DLLEXPORT virtual float compare(const float *a, const float *b,
@@ -131,6 +152,37 @@ namespace diskann {
     }
   };
 
+  // float16 kernels widen to float (F16C) and accumulate in float.
+  class DistanceL2Float16 : public Distance<float16> {
+   public:
+    DISKANN_DLLEXPORT virtual float compare(const float16 *a, const float16 *b,
+                                            uint32_t size) const;
+  };
+
+  class DistanceCosineFloat16 : public Distance<float16> {
+   public:
+    DISKANN_DLLEXPORT virtual float compare(const float16 *a, const float16 *b,
+                                            uint32_t length) const;
+  };
+
+  class DistanceInnerProductFloat16 : public Distance<float16> {
+   public:
+    DISKANN_DLLEXPORT virtual float compare(const float16 *a, const float16 *b,
+                                            uint32_t length) const;
+  };
+
+  // Cosine over vectors the index has already normalized.
+  class NormalizedCosineDistanceFloat16 : public Distance<float16> {
+   private:
+    DistanceInnerProductFloat16 _innerProduct;
+
+   public:
+    DISKANN_DLLEXPORT virtual float compare(const float16 *a, const float16 *b,
+                                            uint32_t length) const {
+      return 1.0f + _innerProduct.compare(a, b, length);
+    }
+  };
+
   template<typename T>
   Distance<T> *get_distance_function(Metric m);
 
@@ -0,0 +1,160 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <string>
+
+#include "ann_exception.h"
+#include "segmented_rows.h"
+
+namespace diskann {
+  // Adjacency lists of all points in fixed-stride rows. Every point owns
+  // max_degree() + 1 u32 slots: its degree followed by its neighbor ids, which
+  // is also the per-node layout of the saved vamana graph file, so lists can
+  // be streamed to and from disk without any conversion. Compared to a
+  // vector of vectors this saves one heap allocation and a 24 byte header per
+  // point, and an expansion reads a single cache-friendly run of slots. Rows
+  // live in segments (see SegmentedRows), so adding points never moves the
+  // lists already there.
+  //
+  // Thread-safety: operations on different rows may run in parallel; rows
+  // must be guarded by the caller (Index uses its per-point locks). resize()
+  // and reserve_degree() change the segment table and need exclusive access.
+  class FixedStrideGraph {
+   public:
+    // View of one adjacency list, with the subset of the std::vector
+    // interface the index uses. Cheap to copy; stays valid until the point is
+    // dropped or the stride grows.
+    class Row {
+     public:
+      Row(unsigned *slots, unsigned capacity)
+          : _slots(slots), _capacity(capacity) {
+      }
+
+      size_t size() const {
+        return _slots[0];
+      }
+      bool empty() const {
+        return _slots[0] == 0;
+      }
+      unsigned capacity() const {
+        return _capacity;
+      }
+
+      unsigned *data() const {
+        return _slots + 1;
+      }
+      unsigned *begin() const {
+        return _slots + 1;
+      }
+      unsigned *end() const {
+        return _slots + 1 + _slots[0];
+      }
+      unsigned &operator[](size_t i) const {
+        return _slots[1 + i];
+      }
+
+      // degree followed by the neighbor ids, i.e. size() + 1 slots
+      const unsigned *raw() const {
+        return _slots;
+      }
+
+      void clear() {
+        _slots[0] = 0;
+      }
+      // only sets the degree, used to read neighbor ids in place
+      void resize(size_t new_size) {
+        check_capacity(new_size);
+        _slots[0] = (unsigned) new_size;
+      }
+      void push_back(unsigned id) {
+        check_capacity((size_t) _slots[0] + 1);
+        _slots[1 + _slots[0]++] = id;
+      }
+      void emplace_back(unsigned id) {
+        push_back(id);
+      }
+      void erase(unsigned *pos) {
+        std::memmove(pos, pos + 1, (end() - pos - 1) * sizeof(unsigned));
+        _slots[0]--;
+      }
+      template<typename InputIt>
+      void assign(InputIt first, InputIt last) {
+        size_t n = (size_t) std::distance(first, last);
+        check_capacity(n);
+        std::copy(first, last, _slots + 1);
+        _slots[0] = (unsigned) n;
+      }
+      // exchanges the contents of two rows of the same graph
+      void swap(Row other) {
+        size_t n = (size_t) std::max(_slots[0], other._slots[0]) + 1;
+        std::swap_ranges(_slots, _slots + n, other._slots);
+      }
+
+     private:
+      void check_capacity(size_t n) const {
+        if (n > _capacity)
+          throw diskann::ANNException(
+              "Adjacency list overflow: " + std::to_string(n) +
+                  " neighbors exceed the graph stride of " +
+                  std::to_string(_capacity),
+              -1, __FUNCSIG__, __FILE__, __LINE__);
+      }
+
+      unsigned *_slots;
+      unsigned  _capacity;
+    };
+
+    FixedStrideGraph() = default;
+    FixedStrideGraph(const FixedStrideGraph &) = delete;
+    FixedStrideGraph &operator=(const FixedStrideGraph &) = delete;
+
+    // Set the number of points, keeping the lists of the points that remain
+    // in place. New points start with no neighbors.
+    void resize(size_t num_points) {
+      _rows.resize(num_points);
+    }
+
+    // Make room for at least max_degree neighbors per point, keeping all
+    // lists. Never shrinks the stride; growing it copies every list.
+    void reserve_degree(unsigned max_degree);
+
+    // Back the rows with transparent huge pages from the next allocation
+    // on. Has no effect on Windows.
+    void set_huge_pages(bool huge_pages) {
+      _rows.set_huge_pages(huge_pages);
+    }
+
+    // Release all lists.
+    void clear() {
+      _rows.clear();
+    }
+
+    Row operator[](size_t i) const {
+      return Row(_rows[i], (unsigned) (_rows.row_size() - 1));
+    }
+
+    size_t size() const {
+      return _rows.size();
+    }
+    unsigned max_degree() const {
+      return (unsigned) (_rows.row_size() - 1);
+    }
+    size_t memory_bytes() const {
+      return _rows.memory_bytes();
+    }
+
+    // Bytes of a graph of num_points points and up to max_degree neighbors.
+    static size_t memory_bytes(size_t num_points, unsigned max_degree) {
+      return num_points * ((size_t) max_degree + 1) * sizeof(unsigned);
+    }
+
+   private:
+    SegmentedRows<unsigned> _rows;
+  };
+}  // namespace diskann
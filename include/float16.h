@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+namespace diskann {
+  // IEEE 754 half-precision element type. Only the storage is 16-bit: values
+  // convert implicitly to and from float, and all arithmetic (distances, PQ
+  // training, normalization) happens in float. Storing vectors as float16
+  // halves the in-memory data, the disk node size and the embedding tensor.
+  //
+  // Conversions use the F16C instructions when the build enables them
+  // (-march=native on any AVX2 machine) and fall back to a bit-exact
+  // round-to-nearest-even software path otherwise.
+  struct float16 {
+    uint16_t bits;
+
+    float16() = default;
+    float16(float f) : bits(from_float(f)) {
+    }
+
+    operator float() const {
+      return to_float(bits);
+    }
+
+    float16 &operator+=(float f) {
+      return *this = float16(to_float(bits) + f);
+    }
+    float16 &operator-=(float f) {
+      return *this = float16(to_float(bits) - f);
+    }
+    float16 &operator*=(float f) {
+      return *this = float16(to_float(bits) * f);
+    }
+    float16 &operator/=(float f) {
+      return *this = float16(to_float(bits) / f);
+    }
+
+    static inline uint16_t from_float(float f) {
+#ifdef __F16C__
+      return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+      uint32_t x;
+      std::memcpy(&x, &f, sizeof(float));
+      uint16_t sign = (uint16_t)((x >> 16) & 0x8000);
+      uint32_t absx = x & 0x7fffffff;
+
+      // inf / nan (keep nan quiet)
+      if (absx >= 0x7f800000)
+        return sign | 0x7c00 | (absx > 0x7f800000 ? 0x0200 : 0);
+      // too large for half, rounds to inf
+      if (absx >= 0x47800000)
+        return sign | 0x7c00;
+      // half subnormals (and values rounding to zero)
+      if (absx < 0x38800000) {
+        if (absx < 0x33000000)
+          return sign;
+        uint32_t exp = absx >> 23;
+        uint32_t mant = (absx & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exp;
+        uint32_t h = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rem > halfway || (rem == halfway && (h & 1)))
+          h++;
+        return sign | (uint16_t) h;
+      }
+      // normal range: rebias exponent and round mantissa to 10 bits
+      uint32_t h = (absx >> 13) - (112 << 10);
+      uint32_t rem = absx & 0x1fff;
+      if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+        h++;
+      return sign | (uint16_t) h;
+#endif
+    }
+
+    static inline float to_float(uint16_t h) {
+#ifdef __F16C__
+      return _cvtsh_ss(h);
+#else
+      uint32_t sign = ((uint32_t) h & 0x8000) << 16;
+      uint32_t exp = (h >> 10) & 0x1f;
+      uint32_t mant = h & 0x3ff;
+      uint32_t x;
+      if (exp == 0) {
+        if (mant == 0) {
+          x = sign;
+        } else {
+          // renormalize half subnormal
+          exp = 1;
+          while (!(mant & 0x400)) {
+            mant <<= 1;
+            exp--;
+          }
+          mant &= 0x3ff;
+          x = sign | ((exp + 112) << 23) | (mant << 13);
+        }
+      } else if (exp == 0x1f) {
+        x = sign | 0x7f800000 | (mant << 13);
+      } else {
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+      }
+      float f;
+      std::memcpy(&f, &x, sizeof(float));
+      return f;
+#endif
+    }
+  };
+
+  static_assert(sizeof(float16) == 2, "float16 must be 2 bytes");
+}  // namespace diskann
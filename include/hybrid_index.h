@@ -0,0 +1,182 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tsl/robin_map.h"
+
+#include "aligned_file_reader.h"
+#include "index.h"
+#include "neighbor.h"
+#include "parameters.h"
+#include "pq.h"
+#include "pq_flash_index.h"
+#include "tensorstore_slice_reader.h"
+#include "utils.h"
+#include "windows_customizations.h"
+
+namespace diskann {
+  // A disk index that takes inserts and deletes, after FreshDiskANN. Inserts
+  // go to an in-memory delta Index, deletes tombstone points of the disk
+  // index (PQFlashIndex::delete_point) or lazily delete them from the delta,
+  // and a search runs on the disk index and the deltas concurrently and
+  // merges the results by tag. Inserting a tag that is already in the index
+  // replaces the older point.
+  //
+  // merge() folds the delta into the disk index without rebuilding it. The
+  // active delta is set aside (and still searched) while a fresh one takes
+  // the inserts. Each new point gets its neighbors from a search of the disk
+  // index and its edges in the delta, pruned with alpha, and is linked back
+  // from them. The disk index is then rewritten in a sequential pass over
+  // its sectors, after a first pass that reads the lists of the deleted
+  // points if there are any: edges to deleted points are replaced by the
+  // neighbors of those points, the new back edges are added (pruning lists
+  // that outgrow the degree), and the new points take the slots of deleted
+  // points before being appended. Prunes compare the full-precision vector
+  // of a node to the PQ codes of its candidates, as the full-precision
+  // vectors of the candidates would mean random reads.
+  //
+  // Each merge writes a new generation of the index files, under the prefix
+  // <index_prefix>_gen<N>, and switches to it by renaming a new
+  // <index_prefix>_generation.txt into place, so that a crash leaves one
+  // generation or the other in use. The files of the previous generation
+  // are then deleted, except those of the original index.
+  //
+  // Only L2 disk indexes with the points in the disk index file (no PQ on
+  // disk, reorder data or TensorStore tensors) can be merged. Points of the
+  // disk index are tagged by the _disk.index_tags.bin file of the
+  // generation, written by merge(), or else by their ids. Changes since the
+  // last merge are kept in memory only, except disk deletes that
+  // save_tombstones() persists.
+  template<typename T>
+  class HybridIndex {
+   public:
+    // delta_parameters: R, L, C, alpha and num_threads of the delta indexes,
+    // which start with room for delta_capacity points and grow as needed.
+    // num_threads bounds the concurrent disk searches, merge included.
+    DISKANN_DLLEXPORT HybridIndex(const std::string &index_prefix,
+                                  uint32_t           num_threads,
+                                  const Parameters & delta_parameters,
+                                  size_t             delta_capacity = 100000,
+                                  _u64               num_nodes_to_cache = 0);
+    DISKANN_DLLEXPORT ~HybridIndex();
+
+    // Returns -1 if tag is already in the delta. Throws on tag=0.
+    DISKANN_DLLEXPORT int insert_point(const T *point, const _u32 tag);
+
+    // Returns -1 if tag is not in the index.
+    DISKANN_DLLEXPORT int lazy_delete(const _u32 tag);
+
+    // K nearest tags and their distances; returns how many were found.
+    // L is the search list size of the disk index and of the deltas.
+    DISKANN_DLLEXPORT size_t search(const T *query, const size_t K,
+                                    const unsigned L, const unsigned beam_width,
+                                    _u32 *tags, float *distances);
+
+    // Merge the delta into the disk index. parameters: L (search list size
+    // when linking the new points, default 100), C (max prune candidates,
+    // 500), alpha (1.2), beam_width (4) and num_threads (0 for all cores).
+    // Searches, inserts and deletes go on during the merge.
+    DISKANN_DLLEXPORT void merge(const Parameters &parameters);
+
+    // Merge from a background thread whenever the delta reaches
+    // merge_threshold points (default 1000000), checked every
+    // poll_interval_ms (default 1000). parameters are also passed to merge().
+    DISKANN_DLLEXPORT void start_background_merge(const Parameters &parameters);
+    DISKANN_DLLEXPORT void stop_background_merge();
+
+    // Persist the disk deletes, see PQFlashIndex::save_tombstones
+    DISKANN_DLLEXPORT void save_tombstones();
+
+    DISKANN_DLLEXPORT _u64   get_num_disk_points();
+    DISKANN_DLLEXPORT size_t get_num_delta_points();
+
+   private:
+    // one version of the disk index files, replaced by each merge; the flash
+    // index holds references to its readers
+    struct DiskGeneration {
+      _u64                                    number = 0;
+      std::string                             prefix;
+      std::shared_ptr<AlignedFileReader>      reader;
+      std::shared_ptr<TensorStoreSliceReader> tensor_reader;
+      std::unique_ptr<PQFlashIndex<T>>        index;
+      std::vector<_u32>                       tags;  // by id
+      tsl::robin_map<_u32, _u32>              tag_to_id;
+      _u64                                    num_points = 0;
+    };
+
+    // a prune candidate, at its PQ distance to the point being linked
+    struct Candidate {
+      _u32       id;
+      float      distance;
+      const _u8 *code;
+    };
+
+    // prefix of the files of a generation; 0 is the original index
+    std::string generation_prefix(_u64 number) const;
+    void        read_disk_metadata(const std::string &prefix);
+    std::unique_ptr<DiskGeneration> open_disk_generation(_u64 number);
+    std::unique_ptr<Index<T, _u32>> new_delta();
+
+    // Delete tag from the disk index and the merging delta, and from the
+    // active delta if with_active. Returns true if any of them held it.
+    bool delete_older_copies(const _u32 tag, bool with_active);
+
+    // full-precision point to float, preprocessed for PQ distances
+    void to_pq_query(const T *point, float *out);
+    // Robust prune as in Index::occlude_list, down to the disk degree;
+    // distances between candidates are taken on their inflated PQ codes
+    void prune(std::vector<Candidate> &cands, const unsigned C,
+               const float alpha, std::vector<_u32> &pruned);
+
+    std::string _index_prefix;
+    std::string _generation_file;
+    uint32_t    _num_threads;
+    size_t      _delta_capacity;
+    _u64        _num_nodes_to_cache;
+
+    // parameters of the delta indexes
+    unsigned _delta_L, _delta_R, _delta_C, _delta_num_threads;
+    float    _delta_alpha;
+
+    // disk index layout, changed by merges only in the number of points
+    std::vector<_u64> _disk_metadata;
+    _u64              _dim = 0;
+    _u64              _max_node_len = 0;
+    _u64              _nnodes_per_sector = 0;
+    _u64              _max_degree = 0;
+    // medoids and frozen point: kept when deleted, as searches start there
+    std::vector<_u32> _nav_points;
+    // coordinates of the medoid, the start point of the deltas
+    std::vector<T>    _start_vector;
+    FixedChunkPQTable _pq_table;
+    _u64              _num_pq_chunks = 0;
+
+    // Searches, inserts and deletes hold _switch_lock shared; setting aside
+    // the delta and switching to a merged disk index hold it exclusively.
+    std::shared_timed_mutex         _switch_lock;
+    std::unique_ptr<DiskGeneration> _disk;
+    std::unique_ptr<Index<T, _u32>> _active_delta;
+    std::unique_ptr<Index<T, _u32>> _merging_delta;
+
+    // one merge at a time; deletes during a merge are replayed on its result
+    std::mutex        _merge_lock;
+    std::mutex        _pending_lock;
+    bool              _merge_running = false;
+    std::vector<_u32> _pending_deletes;
+
+    // background merge; _bg_mutex guards the stop flag
+    std::thread             _bg_thread;
+    std::mutex              _bg_mutex;
+    std::condition_variable _bg_cv;
+    bool                    _bg_stop = false;
+  };
+}  // namespace diskann
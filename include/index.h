@@ -5,39 +5,52 @@
 
 #include <atomic>
 #include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
 #include <shared_mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #ifdef EXEC_ENV_OLS
 #include "aligned_file_reader.h"
 #endif
 
 #include "distance.h"
+#include "fixed_stride_graph.h"
 #include "locking.h"
 #include "natural_number_map.h"
 #include "natural_number_set.h"
 #include "neighbor.h"
 #include "parameters.h"
+#include "segmented_rows.h"
 #include "utils.h"
 #include "windows_customizations.h"
 #include "scratch.h"
 
 #define GRAPH_SLACK_FACTOR 1.3
 #define OVERHEAD_FACTOR 1.1
-#define EXPAND_IF_FULL 0
+#define EXPAND_IF_FULL 1
+#define MIN_LOCK_STRIPES 1024
+#define MAX_LOCK_STRIPES 65536
 
 namespace diskann {
+  // adjacency lists may grow to this many neighbors before being pruned back
+  // to the target degree
+  inline unsigned slack_degree(unsigned degree) {
+    return (unsigned) std::ceil(GRAPH_SLACK_FACTOR * degree);
+  }
+
   inline double estimate_ram_usage(_u64 size, _u32 dim, _u32 datasize,
                                    _u32 degree) {
     double size_of_data = ((double) size) * ROUND_UP(dim, 8) * datasize;
-    double size_of_graph =
-        ((double) size) * degree * sizeof(unsigned) * GRAPH_SLACK_FACTOR;
-    double size_of_locks = ((double) size) * sizeof(non_recursive_mutex);
-    double size_of_outer_vector = ((double) size) * sizeof(ptrdiff_t);
+    double size_of_graph = (double) FixedStrideGraph::memory_bytes(
+        size, slack_degree(degree));
+    double size_of_locks = ((double) size) * sizeof(std::atomic<uint32_t>) +
+                           MAX_LOCK_STRIPES * sizeof(non_recursive_mutex);
 
-    return OVERHEAD_FACTOR * (size_of_data + size_of_graph + size_of_locks +
-                              size_of_outer_vector);
+    return OVERHEAD_FACTOR * (size_of_data + size_of_graph + size_of_locks);
   }
 
   struct consolidation_report {
@@ -63,6 +76,19 @@ namespace diskann {
     }
   };
 
+  // Progress of the consolidation thread of start_background_consolidation
+  struct background_consolidation_stats {
+    bool   _running = false;
+    size_t _slices = 0;           // successful consolidate_deletes calls
+    size_t _failed_slices = 0;    // calls that failed, e.g. on a busy lock
+    size_t _slots_released = 0;   // over all slices
+    size_t _pending_deletes = 0;  // delete set size at the last check
+    double _busy_time = 0;        // seconds spent consolidating
+
+    consolidation_report _last_report = consolidation_report(
+        consolidation_report::status_code::SUCCESS, 0, 0, 0, 0, 0, 0);
+  };
+
   template<typename T, typename TagT = uint32_t>
   class Index {
    public:
@@ -88,6 +114,17 @@ namespace diskann {
     DISKANN_DLLEXPORT void save(const char *filename,
                                 bool        compact_before_save = false);
 
+    // Saves the files of save() while searches, inserts and lazy deletes go
+    // on. The locks of save() are held only to freeze the tags, the delete
+    // list and the start point; graph rows are then streamed to disk, and a
+    // row that an insert changes before it is written is copied first. The
+    // vectors stay put because consolidation, compaction and resizing wait
+    // for the snapshot to finish (consolidate_deletes returns LOCK_FAIL).
+    // The index need not be compacted: the files are written compacted,
+    // with lazily deleted points in the delete list.
+    DISKANN_DLLEXPORT void save_snapshot(const char *filename,
+                                         uint32_t    num_threads = 0);
+
     // Load functions
 #ifdef EXEC_ENV_OLS
     DISKANN_DLLEXPORT void load(AlignedFileReader &reader, uint32_t num_threads,
@@ -133,6 +170,8 @@ namespace diskann {
 
     // Added search overload that takes L as parameter, so that we
     // can customize L on a per-query basis without tampering with "Parameters"
+    // Lazily deleted points are traversed but not returned, and do not count
+    // towards L. Slots past the results found are set to the max IDType.
     template<typename IDType>
     DISKANN_DLLEXPORT std::pair<uint32_t, uint32_t> search(
         const T *query, const size_t K, const unsigned L, IDType *indices,
@@ -147,6 +186,19 @@ namespace diskann {
     // Will fail if tag already in the index or if tag=0.
     DISKANN_DLLEXPORT int insert_point(const T *point, const TagT tag);
 
+    // Insert tags.size() points, padded to aligned_dim like the data of
+    // build(), with one reservation of locations and tags for all of them.
+    // The points are linked in rounds: all points of a round search the
+    // graph in parallel, then the reverse links of the round are merged with
+    // a single prune per touched point. Rounds grow with the index, up to
+    // 2% of it. The index first grows if the batch does not fit. Tags
+    // already in the index, or that found no free location, are added to
+    // failed_tags. Throws on tag=0.
+    DISKANN_DLLEXPORT void insert_points(const T *                points,
+                                         const std::vector<TagT> &tags,
+                                         std::vector<TagT> &      failed_tags,
+                                         uint32_t num_threads = 0);
+
     // call this before issuing deletions to sets relevant flags
     DISKANN_DLLEXPORT int enable_delete();
 
@@ -163,9 +215,45 @@ namespace diskann {
     // Returns number of live points left after consolidation
     // If _conc_consolidates is set in the ctor, then this call can be invoked
     // alongside inserts and lazy deletes, else it acquires _update_lock
+    // With reverse_list_cap > 0 in the index parameters, only the in-neighbors
+    // of the deleted points are repaired, so the cost follows the number of
+    // deletes instead of the index size. A full sweep over all points runs
+    // every full_sweep_interval consolidations, or when parameters has
+    // full_sweep set. Deleted points whose in-neighbor list overflowed the cap
+    // force a full sweep if full_sweep_interval is 0, and otherwise stay in
+    // the delete set until the next full sweep.
+    // max_deletes in parameters limits the call to that many of the pending
+    // deletes (0 for all); the rest stay lazily deleted for the next call.
     DISKANN_DLLEXPORT consolidation_report
     consolidate_deletes(const Parameters &parameters);
 
+    // Consolidate from a background thread instead: once the pending deletes
+    // reach delete_ratio (default 0.05) of the points in the index, they are
+    // consolidated in slices of max_deletes (default 10000) until none are
+    // left. After a slice the thread idles long enough to keep its share of
+    // time busy at cpu_budget (default 0.25), and it checks the delete ratio
+    // every poll_interval_ms (default 100). parameters also holds R, C, alpha
+    // and num_threads as for consolidate_deletes. Stop the thread before a
+    // save that compacts the index.
+    // Requires an index created with concurrent_consolidate. Slicing needs
+    // reverse_list_cap > 0: without in-neighbor lists each consolidation
+    // sweeps all points, so all pending deletes go in a single slice.
+    DISKANN_DLLEXPORT void start_background_consolidation(
+        const Parameters &parameters);
+    DISKANN_DLLEXPORT void stop_background_consolidation();
+    DISKANN_DLLEXPORT background_consolidation_stats
+                      get_background_consolidation_stats();
+
+    // Compact the data a bounded step at a time, between updates: moves at
+    // most max_moves points from past the first get_num_points() slots into
+    // free slots among them and returns how many points are left to move.
+    // Takes the index locks for the duration of the call, so searches and
+    // updates wait for one step only. Pending lazy deletes move along; the
+    // data counts as compacted once nothing is left to move and no deletes
+    // are pending.
+    DISKANN_DLLEXPORT size_t compact_data_incremental(size_t   max_moves,
+                                                      uint32_t num_threads = 0);
+
     DISKANN_DLLEXPORT bool is_index_saved();
 
     // repositions frozen points to the end of _data - if they have been moved
@@ -185,6 +273,10 @@ namespace diskann {
 
     DISKANN_DLLEXPORT void count_nodes_at_bfs_levels() const;
 
+    // Number of edges, of the live and frozen points, to free locations. A
+    // consistent graph has none.
+    DISKANN_DLLEXPORT size_t count_dangling_edges();
+
     // This variable MUST be updated if the number of entries in the metadata
     // change.
     DISKANN_DLLEXPORT static const int METADATA_ROWS = 5;
@@ -217,40 +309,117 @@ namespace diskann {
                                               float *               distances,
                                               InMemQueryScratch<T> *scratch);
 
+    // Leaves the closest candidates found in scratch->best_l_nodes(). For
+    // searches (search_invocation), deleted locations are traversed but do
+    // not count towards Lindex, so the list holds Lindex live locations
+    // along with the deleted ones between them.
     std::pair<uint32_t, uint32_t> iterate_to_fixed_point(
         const T *node_coords, const unsigned Lindex,
         const std::vector<unsigned> &init_ids, InMemQueryScratch<T> *scratch,
         bool ret_frozen = true, bool search_invocation = false);
 
+    bool is_deleted(size_t location) const {
+      return (_deleted_bits[location / 64].load(std::memory_order_relaxed) >>
+              (location % 64)) &
+             1;
+    }
+    void set_deleted(size_t location) {
+      _deleted_bits[location / 64].fetch_or((uint64_t) 1 << (location % 64),
+                                            std::memory_order_relaxed);
+    }
+    void clear_deleted(size_t location) {
+      _deleted_bits[location / 64].fetch_and(
+          ~((uint64_t) 1 << (location % 64)), std::memory_order_relaxed);
+    }
+
+    // keep_existing_nbrs: also consider location's current out-neighbors as
+    // prune candidates, used by the later passes of a multi-pass build
     void search_for_point_and_add_links(int location, _u32 Lindex,
-                                        InMemQueryScratch<T> *scratch);
+                                        InMemQueryScratch<T> *scratch,
+                                        bool keep_existing_nbrs = false);
+
+    // The first half of search_for_point_and_add_links: sets the
+    // out-neighbors of location and returns them in pruned_list, without
+    // adding the reverse links
+    void search_for_point_and_set_links(int location, _u32 Lindex,
+                                        InMemQueryScratch<T> * scratch,
+                                        std::vector<unsigned> &pruned_list,
+                                        bool keep_existing_nbrs = false);
 
     void prune_neighbors(const unsigned location, std::vector<Neighbor> &pool,
-                         std::vector<unsigned> &pruned_list);
+                         std::vector<unsigned> &pruned_list,
+                         InMemQueryScratch<T> * scratch);
 
     void prune_neighbors(const unsigned location, std::vector<Neighbor> &pool,
                          const _u32 range, const _u32 max_candidate_size,
-                         const float alpha, std::vector<unsigned> &pruned_list);
+                         const float alpha, std::vector<unsigned> &pruned_list,
+                         InMemQueryScratch<T> *scratch);
 
+    // scratch only provides the pruning buffers, pool may be scratch->pool()
     void occlude_list(std::vector<Neighbor> &pool, const float alpha,
                       const unsigned degree, const unsigned maxc,
-                      std::vector<Neighbor> &result);
+                      std::vector<Neighbor> &result,
+                      InMemQueryScratch<T> * scratch);
 
     // add reverse links from all the visited nodes to node n.
     void inter_insert(unsigned n, std::vector<unsigned> &pruned_list,
-                      const _u32 range);
+                      const _u32 range, InMemQueryScratch<T> *scratch);
 
-    void inter_insert(unsigned n, std::vector<unsigned> &pruned_list);
+    void inter_insert(unsigned n, std::vector<unsigned> &pruned_list,
+                      InMemQueryScratch<T> *scratch);
+
+    // Batched inter_insert: adds the reverse links of all the given points,
+    // grouped by target so that each target is updated and pruned once.
+    void merge_reverse_links(
+        const std::vector<unsigned> &             locations,
+        const std::vector<std::vector<unsigned>> &pruned_lists,
+        uint32_t                                  num_threads);
 
     void link(Parameters &parameters);
 
+    // Copy the adjacency list of location without taking its lock: the copy
+    // is retried until no writer changed the list meanwhile.
+    void copy_neighbors(unsigned location, std::vector<unsigned> &nbrs);
+
+    // Lock serializing the writers of the adjacency and in-neighbor lists of
+    // location, shared with other locations
+    non_recursive_mutex &node_lock(size_t location) {
+      return _locks[location & (_locks.size() - 1)];
+    }
+
+    // Record src as an in-neighbor of dst (of every dst in dsts) in
+    // _reverse_graph. Acquires node_lock(dst), so hold no other node lock.
+    void add_reverse_edge(unsigned src, unsigned dst);
+    void add_reverse_edges(unsigned src, const std::vector<unsigned> &dsts);
+
+    // Whether a rebuild_reverse_graph() overlapped the time since epoch was
+    // read from _reverse_rebuild_epoch. Writers record reverse edges before
+    // publishing the forward ones, and again after if so, as the rebuild may
+    // have dropped the first record before reading the row.
+    bool reverse_rebuilt_since(uint64_t epoch) const {
+      return (epoch & 1) || _reverse_rebuild_epoch.load() != epoch;
+    }
+
+    // Keep the row of location for the save_snapshot() in progress, if it
+    // has not been written yet. Call with node_lock(location) held, before
+    // changing the row.
+    void preserve_snapshot_row(unsigned location);
+
+    // Recompute _reverse_graph from _final_graph, ignoring the out-neighbors
+    // of points in skip_set and of empty slots. Safe alongside inserts, which
+    // check reverse_rebuilt_since() after writing to _final_graph.
+    void rebuild_reverse_graph(
+        const tsl::robin_set<unsigned> &skip_set = tsl::robin_set<unsigned>(),
+        uint32_t                        num_threads = 0);
+
     // Acquire _tag_lock before calling
     int    reserve_location();
     size_t release_location(int location);
     size_t release_locations(tsl::robin_set<unsigned> &locations);
 
-    // Resize the index when no slots are left for insertion.
-    // MUST acquire _num_points_lock and _update_lock before calling.
+    // Grow the index to new_max_points slots, keeping all points in place
+    // but the frozen point. MUST acquire _update_lock and _consolidate_lock
+    // before calling.
     void resize(size_t new_max_points);
 
     // Take an unique lock on _update_lock and _consolidate_lock
@@ -261,8 +430,15 @@ namespace diskann {
     DISKANN_DLLEXPORT void compact_data();
     DISKANN_DLLEXPORT void compact_frozen_point();
 
+    // Move up to max_moves of the points past the first _nd slots into the
+    // free slots below _nd, the farthest points into the lowest slots, and
+    // return how many points past _nd are left. Only the moved points change
+    // ids. Hold all the index locks exclusively.
+    size_t relocate_points(size_t max_moves, uint32_t num_threads = 0);
+
     // Remove deleted nodes from adj list of node i and absorb edges from
-    // deleted neighbors Acquire _locks[i] prior to calling for thread-safety
+    // deleted neighbors. Acquire node_lock(i) prior to calling for
+    // thread-safety
     void process_delete(const tsl::robin_set<unsigned> &old_delete_set,
                         size_t i, const unsigned &range, const unsigned &maxc,
                         const float &alpha);
@@ -295,12 +471,26 @@ namespace diskann {
     Metric       _dist_metric = diskann::L2;
     Distance<T> *_distance = nullptr;
 
-    // Data
-    T *   _data = nullptr;
-    char *_opt_graph;
+    // Data: row i holds the _aligned_dim coordinates of location i
+    SegmentedRows<T> _data;
+    char *           _opt_graph;
 
     // Graph related data structures
-    std::vector<std::vector<unsigned>> _final_graph;
+    FixedStrideGraph _final_graph;
+
+    // Optional in-neighbor lists for localized consolidate_deletes, at most
+    // _reverse_list_cap per point and guarded by node_lock(). The lists may
+    // keep stale entries for edges pruned since or never published, as
+    // writers record an edge before publishing it; a point whose list
+    // overflowed has _reverse_overflow set and its in-neighbors are unknown
+    // until the next rebuild_reverse_graph().
+    FixedStrideGraph     _reverse_graph;
+    std::vector<uint8_t> _reverse_overflow;
+    uint32_t             _reverse_list_cap = 0;
+    // odd while rebuild_reverse_graph() runs
+    std::atomic<uint64_t> _reverse_rebuild_epoch{0};
+    uint32_t             _full_sweep_interval = 0;
+    uint32_t             _consolidations_since_sweep = 0;
 
     // Dimensions
     size_t _dim = 0;
@@ -340,13 +530,24 @@ namespace diskann {
     tsl::robin_set<unsigned>     _delete_set;
     natural_number_set<unsigned> _empty_slots;
 
+    // Bit i % 64 of _deleted_bits[i / 64] is set while location i is deleted
+    // and not yet reused, so that searches skip deleted locations without
+    // taking _delete_lock. Set along with _delete_set, cleared when the
+    // location is handed out again or the data is compacted.
+    SegmentedArray<std::atomic<uint64_t>> _deleted_bits;
+
     bool _lazy_done = false;      // true if lazy deletions have been made
     bool _data_compacted = true;  // true if data has been compacted
     bool _is_saved = false;  // Gopal. Checking if the index is already saved.
     bool _conc_consolidate = false;  // use _lock while searching
 
-    // Per node lock, cardinality=max_points_
-    std::vector<non_recursive_mutex> _locks;
+    // Writers of the adjacency list of location i hold node_lock(i) and keep
+    // _versions[i] odd while they change it (see SeqlockWriteGuard), so that
+    // searches copy lists without locking. The locks are striped, a power of
+    // two of them shared by all locations; a version costs 4 bytes per point
+    // against 40 for a mutex.
+    SegmentedArray<std::atomic<uint32_t>> _versions;
+    std::vector<non_recursive_mutex>      _locks;
 
     // If acquiring multiple locks below, acquire locks in the order below
     std::shared_timed_mutex  // RW mutex between save/load (exclusive lock) and
@@ -358,6 +559,21 @@ namespace diskann {
     std::shared_timed_mutex
         _delete_lock;  // RW Lock on _delete_set and _empty_slots
 
+    // Background consolidation; _bg_mutex guards the stop flag and the stats
+    std::thread                    _bg_thread;
+    std::mutex                     _bg_mutex;
+    std::condition_variable        _bg_cv;
+    bool                           _bg_stop = false;
+    background_consolidation_stats _bg_stats;
+
+    // save_snapshot(): _snapshot_state[i], guarded by node_lock(i), tells if
+    // row i is still to be written or already kept in _snapshot_rows
+    std::mutex                                      _snapshot_mutex;
+    std::atomic<bool>                               _snapshot_active{false};
+    std::vector<uint8_t>                            _snapshot_state;
+    std::mutex                                      _snapshot_rows_mutex;
+    tsl::robin_map<unsigned, std::vector<unsigned>> _snapshot_rows;
+
     static const float INDEX_GROWTH_FACTOR;
   };
 }  // namespace diskann
@@ -1,6 +1,10 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT license.
 
+#pragma once
+
+#include <atomic>
+#include <cstdint>
 #include <mutex>
 
 #ifdef _WINDOWS
@@ -15,4 +19,27 @@ namespace diskann {
   using non_recursive_mutex = std::mutex;
   using LockGuard = std::lock_guard<non_recursive_mutex>;
 #endif
+
+  // Writer side of a seqlock: the version is odd while the data it guards is
+  // being changed, so a reader that saw the same even version before and
+  // after its copy knows the copy is consistent. Writers must be serialized
+  // by a lock of their own.
+  class SeqlockWriteGuard {
+   public:
+    explicit SeqlockWriteGuard(std::atomic<uint32_t> &version)
+        : _version(version) {
+      _version.store(_version.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+    ~SeqlockWriteGuard() {
+      _version.store(_version.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_release);
+    }
+    SeqlockWriteGuard(const SeqlockWriteGuard &) = delete;
+    SeqlockWriteGuard &operator=(const SeqlockWriteGuard &) = delete;
+
+   private:
+    std::atomic<uint32_t> &_version;
+  };
 }  // namespace diskann
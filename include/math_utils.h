@@ -81,7 +81,9 @@ namespace kmeans {
   // the results, else it will assume appriate allocation as closest_docs = new
   // vector<size_t> [num_centers], and closest_center = new size_t[num_points]
   // Final centers are output in centers as row major num_centers * dim
-  //
+  // Skips the distance computations that Hamerly's bounds rule out, with the
+  // same result as repeated lloyds_iter (except that empty clusters keep their
+  // center)
   float run_lloyds(float* data, size_t num_points, size_t dim, float* centers,
                    const size_t num_centers, const size_t max_reps,
                    std::vector<size_t>* closest_docs, uint32_t* closest_center);
@@ -14,6 +14,8 @@ namespace diskann {
     unsigned id;
     float    distance;
     bool     flag;
+    // whether the location was deleted when it entered a search list
+    bool deleted = false;
 
     Neighbor() = default;
     Neighbor(unsigned id, float distance, bool f)
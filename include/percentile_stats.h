@@ -31,6 +31,9 @@ namespace diskann {
     unsigned n_cmps = 0;        // # cmps
     unsigned n_cache_hits = 0;  // # cache_hits
     unsigned n_hops = 0;        // # search hops
+
+    unsigned n_prefetches = 0;     // # nodes speculatively prefetched
+    unsigned n_prefetch_hits = 0;  // # prefetched nodes later expanded
   };
 
   template<typename T>
@@ -116,7 +116,8 @@ namespace diskann {
                                    unsigned num_centers, unsigned num_pq_chunks,
                                    std::string pq_pivots_path,
                                    std::string pq_compressed_vectors_path,
-                                   bool        use_opq = false);
+                                   bool        use_opq = false,
+                                   bool        save_inflated = false);
 
   template<typename T>
   void generate_disk_quantized_data(
@@ -2,7 +2,9 @@
 // Licensed under the MIT license.
 
 #pragma once
+#include <atomic>
 #include <cassert>
+#include <memory>
 #include <sstream>
 #include <stack>
 #include <string>
@@ -21,6 +23,8 @@
 #include "scratch.h"
 
 #define FULL_PRECISION_REORDER_MULTIPLIER 3
+// cached_beam_search widens L by the share of deleted points, at most by this
+#define MAX_DELETED_L_FACTOR 4
 
 namespace diskann {
 
@@ -72,6 +76,46 @@ namespace diskann {
         float *res_dists, const _u64 beam_width, const _u32 io_limit,
         const bool use_reorder_data = false, QueryStats *stats = nullptr);
 
+    // tensors backend only: number of candidates past the current beam whose
+    // nodes are prefetched into the TensorStore cache while the beam is read
+    // (0 disables speculative prefetching)
+    DISKANN_DLLEXPORT void set_tensors_prefetch_width(_u32 width);
+
+    // Deleted points stay in the graph and are still traversed, so that the
+    // points reached through them remain reachable, but they are never
+    // returned. Deletes only set a bit in an in-memory tombstone bitmap and
+    // may run alongside searches; searches widen L by the share of deleted
+    // points to keep returning k results. Returns -1 if id is out of range
+    // or already deleted.
+    DISKANN_DLLEXPORT int delete_point(_u32 id);
+
+    // Tags of the points, in id order, as _u32 in bin format (like the .tags
+    // file of an in-memory index), so that points can be deleted by tag
+    DISKANN_DLLEXPORT void load_tags(const std::string &tags_file);
+    // Returns -1 if the tag is unknown or already deleted
+    DISKANN_DLLEXPORT int delete_tag(_u32 tag);
+
+    // Write the deleted ids to <index_prefix>_disk.index_tombstones.bin,
+    // which load() reads back
+    DISKANN_DLLEXPORT void save_tombstones();
+
+    DISKANN_DLLEXPORT _u64 get_num_deleted() const {
+      return num_deleted.load(std::memory_order_relaxed);
+    }
+    DISKANN_DLLEXPORT bool is_deleted(_u64 id) const {
+      return (tombstones[id / 64].load(std::memory_order_relaxed) >>
+              (id % 64)) &
+             1;
+    }
+
+    DISKANN_DLLEXPORT _u64 get_num_points() const {
+      return num_points;
+    }
+    // the in-memory PQ codes, n_chunks bytes per point in id order
+    DISKANN_DLLEXPORT const _u8 *get_pq_codes() const {
+      return data;
+    }
+
     DISKANN_DLLEXPORT _u32 range_search(const T *query1, const double range,
                                         const _u64          min_l_search,
                                         const _u64          max_l_search,
@@ -121,6 +165,7 @@ namespace diskann {
     std::string index_tensors_prefix;
     bool        use_tensors;
     bool        use_tensors_async;
+    _u32        tensors_prefetch_width = 0;
 
     std::vector<std::pair<_u32, _u32>> node_visit_counter;
 
@@ -162,6 +207,11 @@ namespace diskann {
     T *                       coord_cache_buf = nullptr;
     tsl::robin_map<_u32, T *> coord_cache;
 
+    // deleted points: bit i % 64 of word i / 64 is set if point i is deleted
+    std::unique_ptr<std::atomic<_u64>[]> tombstones;
+    std::atomic<_u64>                    num_deleted{0};
+    tsl::robin_map<_u32, _u32>           tag_to_id;
+
     // thread-specific scratch
     ConcurrentQueue<SSDThreadData<T> *> thread_data;
     _u64                                max_nthreads;
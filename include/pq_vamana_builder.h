@@ -0,0 +1,89 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "distance.h"
+#include "fixed_stride_graph.h"
+#include "locking.h"
+#include "memory_mapper.h"
+#include "neighbor.h"
+#include "pq.h"
+#include "utils.h"
+#include "windows_customizations.h"
+
+namespace diskann {
+  // Builds a Vamana graph (L2) while keeping only the PQ codes of the base
+  // data and the graph itself in memory, so graphs that would not fit in RAM
+  // next to the full-precision vectors can be built on one host without
+  // partitioning into shards and merging.
+  //
+  // The greedy search of every insertion navigates with asymmetric PQ
+  // distances. Full-precision vectors are only read, from the memory-mapped
+  // base file, for the candidates of a prune: their exact distances to the
+  // point and to each other drive the occlusion rule, exactly as in
+  // Index::occlude_list. The saved graph uses the vamana file format of
+  // Index::save and can be fed to create_disk_layout.
+  template<typename T>
+  class PQVamanaBuilder {
+   public:
+    // pq_pivots_path / pq_compressed_path as written by
+    // generate_quantized_data for base_file
+    DISKANN_DLLEXPORT PQVamanaBuilder(const std::string &base_file,
+                                      const std::string &pq_pivots_path,
+                                      const std::string &pq_compressed_path);
+    DISKANN_DLLEXPORT ~PQVamanaBuilder();
+
+    // L: search list size, R: max degree, C: max prune candidates
+    DISKANN_DLLEXPORT void build(unsigned L, unsigned R, unsigned C,
+                                 float alpha, unsigned num_threads);
+
+    // returns the number of bytes written
+    DISKANN_DLLEXPORT _u64 save(const std::string &graph_file);
+
+    // resident bytes of the PQ codes, graph and locks (the base file is only
+    // mapped, its pages can be dropped by the OS at any time)
+    DISKANN_DLLEXPORT size_t memory_bytes() const;
+
+    unsigned get_start() const {
+      return _start;
+    }
+
+   private:
+    struct ThreadScratch;
+
+    void     copy_vector(unsigned id, T *out) const;
+    unsigned calculate_medoid();
+    void     search_and_link(unsigned id, ThreadScratch &scratch);
+    // pool: candidate ids, pruned to at most R neighbors of center_id
+    void prune(unsigned center_id, std::vector<unsigned> &pool,
+               std::vector<unsigned> &pruned, ThreadScratch &scratch);
+    void inter_insert(unsigned id, const std::vector<unsigned> &pruned,
+                      ThreadScratch &scratch);
+
+    // full-precision base data, mapped
+    std::unique_ptr<MemoryMapper> _base_mapper;
+    const T *                     _base = nullptr;
+    size_t                        _num_points = 0;
+    size_t                        _dim = 0;
+    size_t                        _aligned_dim = 0;
+
+    // compressed base data, resident
+    FixedChunkPQTable      _pq_table;
+    std::unique_ptr<_u8[]> _pq_codes;
+    size_t                 _num_pq_chunks = 0;
+
+    FixedStrideGraph                 _graph;
+    std::vector<non_recursive_mutex> _locks;
+    std::unique_ptr<Distance<T>>     _distance;
+
+    unsigned _start = 0;
+    unsigned _L = 0, _R = 0, _C = 0;
+    float    _alpha = 1.2f;
+    unsigned _max_observed_degree = 0;
+  };
+}  // namespace diskann
@@ -67,6 +67,22 @@ namespace diskann {
       return this->_interim_dists;
     }
 
+    // occlude_list buffers: per-candidate occlusion factors and the batch of
+    // still-unoccluded candidates whose distances to a newly selected point
+    // are computed together
+    std::vector<float> &occlude_factor() {
+      return _occlude_factor;
+    }
+    std::vector<unsigned> &occlude_batch_pos() {
+      return _occlude_batch_pos;
+    }
+    std::vector<const T *> &occlude_batch_ptrs() {
+      return _occlude_batch_ptrs;
+    }
+    std::vector<float> &occlude_batch_dists() {
+      return _occlude_batch_dists;
+    }
+
    private:
     std::vector<Neighbor>    _pool;
     tsl::robin_set<unsigned> _visited;
@@ -75,6 +91,11 @@ namespace diskann {
     tsl::robin_set<unsigned> _inserted_into_pool_rs;
     boost::dynamic_bitset<> *_inserted_into_pool_bs;
 
+    std::vector<float>     _occlude_factor;
+    std::vector<unsigned>  _occlude_batch_pos;
+    std::vector<const T *> _occlude_batch_ptrs;
+    std::vector<float>     _occlude_batch_dists;
+
     T *       _aligned_query = nullptr;
     uint32_t *_indices = nullptr;
     float *   _interim_dists = nullptr;
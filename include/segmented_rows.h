@@ -0,0 +1,167 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "windows_customizations.h"
+
+namespace diskann {
+  // Segments hold 2^k rows, with k picked from the first size they are grown
+  // to (so a small index does not pay for a large segment) and capped here.
+  const unsigned MAX_SEGMENT_BITS = 14;
+
+  inline unsigned segment_bits_for(size_t num_rows) {
+    unsigned bits = 0;
+    while (bits < MAX_SEGMENT_BITS && ((size_t) 1 << bits) < num_rows)
+      bits++;
+    return bits;
+  }
+
+  // Zeroed, 64 byte aligned (2MB with huge pages) memory for one segment.
+  // Throws ANNException when the allocation fails.
+  DISKANN_DLLEXPORT void *alloc_segment(size_t bytes, bool huge_pages);
+  DISKANN_DLLEXPORT void  free_segment(void *segment);
+
+  // Rows of row_size() elements kept in fixed-size segments and addressed by
+  // row index. Growing appends segments and shrinking frees trailing ones,
+  // so rows never move: a pointer to a row stays valid until the row is
+  // dropped, and resizing copies nothing. The price is one extra indirection
+  // per row lookup, against the base + i * row_size of a single buffer.
+  //
+  // Thread-safety: rows may be read and written in parallel; resize() and
+  // clear() change the segment table and need exclusive access.
+  template<typename T>
+  class SegmentedRows {
+   public:
+    SegmentedRows() = default;
+    ~SegmentedRows() {
+      clear();
+    }
+    SegmentedRows(const SegmentedRows &) = delete;
+    SegmentedRows &operator=(const SegmentedRows &) = delete;
+
+    // Elements per row; pick it while empty. Rows stay 64 byte aligned if
+    // row_size * sizeof(T) is a multiple of 64.
+    void set_row_size(size_t row_size) {
+      _row_size = row_size;
+    }
+    // Back segments allocated from now on with transparent huge pages. Has
+    // no effect on Windows.
+    void set_huge_pages(bool huge_pages) {
+      _huge_pages = huge_pages;
+    }
+
+    // Set the number of rows. Rows kept are untouched; new rows are zeroed.
+    void resize(size_t num_rows) {
+      if (_segments.empty() && num_rows > 0) {
+        _segment_bits = segment_bits_for(num_rows);
+        _segment_mask = ((size_t) 1 << _segment_bits) - 1;
+      }
+      size_t num_segments = (num_rows + _segment_mask) >> _segment_bits;
+      while (_segments.size() > num_segments) {
+        free_segment(_segments.back());
+        _segments.pop_back();
+      }
+      while (_segments.size() < num_segments)
+        _segments.push_back(
+            (T *) alloc_segment(segment_bytes(), _huge_pages));
+      // rows dropped and re-added within the last segment must come back
+      // zeroed
+      if (num_rows < _num_rows && (num_rows & _segment_mask) != 0)
+        std::memset((*this)[num_rows], 0,
+                    (((size_t) 1 << _segment_bits) -
+                     (num_rows & _segment_mask)) *
+                        _row_size * sizeof(T));
+      _num_rows = num_rows;
+    }
+
+    // Release all segments.
+    void clear() {
+      for (auto segment : _segments)
+        free_segment(segment);
+      _segments.clear();
+      _num_rows = 0;
+    }
+
+    // Exchange the contents (and row sizes) of two instances.
+    void swap(SegmentedRows &other) {
+      std::swap(_segments, other._segments);
+      std::swap(_num_rows, other._num_rows);
+      std::swap(_row_size, other._row_size);
+      std::swap(_segment_bits, other._segment_bits);
+      std::swap(_segment_mask, other._segment_mask);
+      std::swap(_huge_pages, other._huge_pages);
+    }
+
+    T *operator[](size_t i) const {
+      return _segments[i >> _segment_bits] + (i & _segment_mask) * _row_size;
+    }
+
+    size_t size() const {
+      return _num_rows;
+    }
+    size_t row_size() const {
+      return _row_size;
+    }
+    bool huge_pages() const {
+      return _huge_pages;
+    }
+    // rows that fit in the allocated segments
+    size_t capacity() const {
+      return _segments.size() << _segment_bits;
+    }
+    size_t memory_bytes() const {
+      return _segments.size() * segment_bytes();
+    }
+
+   private:
+    size_t segment_bytes() const {
+      return ((size_t) 1 << _segment_bits) * _row_size * sizeof(T);
+    }
+
+    std::vector<T *> _segments;
+    size_t           _num_rows = 0;
+    size_t           _row_size = 1;
+    unsigned         _segment_bits = 0;
+    size_t           _segment_mask = 0;
+    bool             _huge_pages = false;
+  };
+
+  // Value-initialized objects (e.g. atomics, which cannot be moved) kept in
+  // fixed-size segments, so the array grows without moving its elements.
+  // Only grows; same thread-safety as SegmentedRows.
+  template<typename T>
+  class SegmentedArray {
+   public:
+    void resize(size_t size) {
+      if (_segments.empty() && size > 0) {
+        _segment_bits = segment_bits_for(size);
+        _segment_mask = ((size_t) 1 << _segment_bits) - 1;
+      }
+      while ((_segments.size() << _segment_bits) < size)
+        _segments.emplace_back(new T[(size_t) 1 << _segment_bits]());
+      if (size > _size)
+        _size = size;
+    }
+
+    T &operator[](size_t i) const {
+      return _segments[i >> _segment_bits][i & _segment_mask];
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+   private:
+    std::vector<std::unique_ptr<T[]>> _segments;
+    size_t                            _size = 0;
+    unsigned                          _segment_bits = 0;
+    size_t                            _segment_mask = 0;
+  };
+}  // namespace diskann
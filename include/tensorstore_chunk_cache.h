@@ -0,0 +1,145 @@
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tensorstore/context.h"
+#include "tensorstore/kvstore/kvstore.h"
+
+namespace ts = tensorstore;
+
+#pragma once
+#ifndef _WINDOWS
+
+/**
+ * Counters of the local chunk cache since it was created.
+ */
+struct TensorStoreChunkCacheStats {
+  int64_t hits = 0;
+  int64_t misses = 0;
+  int64_t evictions = 0;
+  int64_t fetched_bytes = 0;
+  int64_t cached_bytes = 0;
+};
+
+/**
+ * Persistent local-disk tier for zarr tensors served by a remote http kvstore.
+ *
+ * Chunk files of the remote tensors are mirrored on demand into a local
+ * directory, which the zarr driver then reads through the "file" kvstore; the
+ * in-memory cache pool stays on top of it as the first tier. The mirror
+ * survives restarts but belongs to one process at a time: the LRU index and
+ * the pins are in-memory, so the directory is locked and a second cache on
+ * it fails to open. It is bounded in size with LRU eviction, and a tensor's
+ * local chunks are dropped whenever the remote metadata's etag no longer
+ * matches the mirrored copy. Without an etag only the metadata content is
+ * compared, so a rebuilt remote index with an identical .zarray keeps being
+ * served from the stale local chunks; clear the directory after a rebuild.
+ *
+ * A zarr read must only run while holding a pin(), and after the chunks it
+ * touches were made local with fetch_rows() + wait_chunks(). An evicted chunk
+ * file is deleted once every pin taken before its eviction is released.
+ */
+class TensorStoreChunkCache {
+ public:
+  TensorStoreChunkCache(ts::Context& context, const std::string& remote_addr,
+                        const std::string& cache_dir, size_t capacity_bytes);
+  ~TensorStoreChunkCache();
+
+  // mirror the metadata of remote tensor `tensor_path` (relative to the
+  // remote address) and index its existing local chunks; returns the tensor
+  // id to use in fetch_rows() and sets the local path to open it from
+  // NOTE :: blocking call, not thread-safe w.r.t. other calls
+  size_t attach(const std::string& tensor_path, std::string& local_path);
+
+  // start fetching all chunks covering the given rows that are not local yet;
+  // returns the keys that are still being fetched
+  // NOTE :: non-blocking call
+  std::vector<std::string> fetch_rows(size_t                      tensor_id,
+                                      const std::vector<int64_t>& rows);
+
+  // wait until the given chunks are local, throws if any fetch failed
+  // NOTE :: blocking call
+  void wait_chunks(const std::vector<std::string>& keys);
+
+  // keeps the chunk files evicted after it was taken from being deleted
+  // while zarr reads are in flight
+  class Pin {
+   public:
+    Pin() = default;
+    Pin(Pin&& other) noexcept;
+    Pin& operator=(Pin&& other) noexcept;
+    ~Pin();
+
+   private:
+    friend class TensorStoreChunkCache;
+    Pin(TensorStoreChunkCache* cache, uint64_t epoch);
+    void release();
+
+    TensorStoreChunkCache* cache = nullptr;
+    uint64_t               epoch = 0;
+  };
+
+  Pin pin();
+
+  TensorStoreChunkCacheStats get_stats();
+
+ private:
+  struct TensorMeta {
+    std::string path;
+    std::string separator;
+    int64_t     num_rows;
+    int64_t     chunk_rows;
+    int64_t     num_col_chunks;
+  };
+
+  struct ChunkEntry {
+    size_t                           bytes;
+    std::list<std::string>::iterator lru_it;
+  };
+
+  struct PendingDelete {
+    size_t   bytes;
+    uint64_t epoch;
+  };
+
+  void index_chunk_locked(const std::string& key, size_t bytes);
+  void evict_locked();
+  void unpin(uint64_t epoch);
+  void collect_garbage_locked();
+  void complete_fetch(const std::string&                           key,
+                      const ts::Result<ts::kvstore::ReadResult>& result);
+
+  ts::kvstore::KvStore    remote_store;
+  std::string             cache_dir;
+  size_t                  capacity_bytes;
+  std::vector<TensorMeta> tensors;
+
+  // chunk index, keyed by chunk path relative to cache_dir; the LRU list
+  // holds the most recently used chunk at its front
+  std::mutex                                   index_mutex;
+  std::condition_variable                      fetched_cv;
+  std::list<std::string>                       lru;
+  std::unordered_map<std::string, ChunkEntry>  index;
+  std::unordered_set<std::string>              in_flight;
+  std::unordered_map<std::string, std::string> failed;
+  size_t                                       total_bytes = 0;
+  TensorStoreChunkCacheStats                   stats;
+
+  // evicted chunks whose files may still be read, in eviction order; a pin
+  // and an eviction both take the current epoch, and evictions advance it
+  std::unordered_map<std::string, PendingDelete> pending_deletes;
+  std::deque<std::pair<uint64_t, std::string>>   pending_order;
+  std::map<uint64_t, size_t>                     active_pins;
+  uint64_t                                       epoch = 0;
+
+  int lock_fd = -1;
+};
+
+#endif
@@ -0,0 +1,26 @@
+#include <cstddef>
+#include <string>
+
+#pragma once
+#ifndef _WINDOWS
+
+/**
+ * Writes the zarr tensors of a disk index straight from the vamana graph file
+ * and the bin file holding the points (full vectors, or the disk PQ codes),
+ * without going through the sectors of _disk.index. The tensors are the ones
+ * disk_index_to_tensors makes: <prefix>_embedding, _num_nbrs and _nbrhood, and
+ * _reorder with the full-precision vectors if reorder_data_file is given.
+ *
+ * All tensors are chunked by the same chunk_rows rows (0 picks about 1MB of
+ * embedding per chunk). Writer threads each assemble whole chunks, so no two
+ * writes touch the same chunk, and chunk writes are committed asynchronously
+ * while the next rows are assembled.
+ */
+template<typename T>
+void write_disk_index_tensors(const std::string& data_file,
+                              const std::string& mem_index_file,
+                              const std::string& tensors_filename_prefix,
+                              const std::string& reorder_data_file = "",
+                              size_t             chunk_rows = 0);
+
+#endif
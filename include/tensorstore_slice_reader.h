@@ -1,5 +1,12 @@
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
 #include <vector>
 
+#include "float16.h"
+#include "tensorstore_chunk_cache.h"
+
 #include "tensorstore/context.h"
 #include "tensorstore/open.h"
 #include "tensorstore/index_space/dim_expression.h"
@@ -26,34 +33,150 @@ class TensorStoreANNException : public std::exception {
   }
 };
 
+/**
+ * Zarr dtype string of the embedding tensor for a given element type.
+ */
+template<typename T>
+inline std::string tensors_embedding_dtype() {
+  if constexpr (std::is_same<T, float>::value)
+    return "<f4";
+  else if constexpr (std::is_same<T, diskann::float16>::value)
+    return "<f2";
+  else if constexpr (std::is_same<T, int8_t>::value)
+    return "|i1";
+  else if constexpr (std::is_same<T, uint8_t>::value)
+    return "|u1";
+  else
+    throw TensorStoreANNException("unsupported embedding element type");
+}
+
+/**
+ * TensorStore context & caching configuration of a slice reader. Every tensor
+ * gets a cache pool of its own, since the small neighbor tensors are read on
+ * every hop and are much hotter than the embeddings.
+ */
+struct TensorStoreContextSpec {
+  // cache pool budgets in bytes (0 disables caching for that tensor)
+  size_t embedding_cache_bytes = 5000000000;  // ~5GB
+  size_t num_nbrs_cache_bytes = 5000000000;   // ~5GB
+  size_t nbrhood_cache_bytes = 5000000000;    // ~5GB
+  size_t reorder_cache_bytes = 5000000000;    // ~5GB
+
+  // concurrency limits of the shared context, 0 keeps TensorStore's default
+  size_t data_copy_concurrency = 0;
+  size_t file_io_concurrency = 0;
+  size_t http_request_concurrency = 0;
+
+  // when cached chunks are revalidated: "false", "true" or "open"
+  std::string recheck_cached_data = "false";
+
+  // persistent local-disk tier for remote tensors, disabled if dir is empty
+  std::string local_cache_dir;
+  size_t      local_cache_bytes = 100000000000;  // ~100GB
+};
+
+/**
+ * Cumulative counters of TensorStore's chunk caches (all tensors, process
+ * wide); take the difference of two snapshots for a single run.
+ */
+struct TensorStoreCacheStats {
+  int64_t hits = 0;
+  int64_t misses = 0;
+  int64_t evictions = 0;
+
+  TensorStoreCacheStats operator-(const TensorStoreCacheStats& other) const {
+    return {hits - other.hits, misses - other.misses,
+            evictions - other.evictions};
+  }
+  double hit_rate() const {
+    return hits + misses > 0 ? (double) hits / (double) (hits + misses) : 0.0;
+  }
+};
+
+// embedding_buf receives num_dims elements of the embedding tensor's dtype
 struct TensorsPointSliceRead {
   size_t    pt_idx;
-  float*    embedding_buf;
+  void*     embedding_buf;
   unsigned* num_nbrs_buf;
   unsigned* nbrhood_buf;
 };
 
+/**
+ * In-flight cache-warming reads issued by TensorStoreSliceReader::prefetch.
+ * The results are never copied out; a later read() of the same points hits
+ * the cache pool or joins the pending read. Keep the handle alive for as long
+ * as the prefetched data may be useful, dropping it abandons pending reads.
+ */
+struct TensorsPrefetchHandle {
+  std::vector<ts::Future<ts::Array<ts::Shared<void>>>>     embedding_futures;
+  std::vector<ts::Future<ts::Array<ts::Shared<unsigned>>>> nbrs_futures;
+
+  void clear() {
+    embedding_futures.clear();
+    nbrs_futures.clear();
+  }
+};
+
 class TensorStoreSliceReader {
  private:
-  ts::TensorStore<float>    store_embedding;
+  TensorStoreContextSpec ctx_spec;
+
+  // dtype is only known at open time (float, float16, int8 or uint8; uint8
+  // also holds the codes of a disk-PQ index)
+  ts::TensorStore<>         store_embedding;
   ts::TensorStore<unsigned> store_num_nbrs;
   ts::TensorStore<unsigned> store_nbrhood;
 
+  // full-precision vectors for reranking, only present for disk-PQ indexes
+  // built with reorder data
+  ts::TensorStore<float> store_reorder;
+  bool                   has_reorder = false;
+
+  // local chunk mirror of remote tensors, and the tensors' ids within it
+  std::unique_ptr<TensorStoreChunkCache> chunk_cache;
+  size_t embedding_chunks = 0, num_nbrs_chunks = 0, nbrhood_chunks = 0,
+         reorder_chunks = 0;
+
+  // bring the chunks of given points local, optionally waiting for them
+  void fetch_local_chunks(const std::vector<int64_t>& pt_idxs,
+                          const std::vector<size_t>&  tensor_ids, bool wait);
+
  public:
-  TensorStoreSliceReader();
+  TensorStoreSliceReader(
+      const TensorStoreContextSpec& ctx_spec = TensorStoreContextSpec());
   ~TensorStoreSliceReader();
 
   // Open & close ops
   // Blocking calls
   void open(const std::string& tensors_filename_prefix, size_t num_pts,
             size_t num_dims, size_t max_nbrs_per_pt,
-            const char* use_remote_addr);
+            const char*        use_remote_addr,
+            const std::string& embedding_dtype = "<f4",
+            size_t             num_reorder_dims = 0);
 
   // process batch of tensorstore slices read requests in parallel
   // NOTE :: blocking call
   void read(std::vector<std::vector<TensorsPointSliceRead>>& read_reqs,
             bool async = false, bool skip_embedding = false,
             bool skip_neighbors = false);
+
+  // gather full-precision reorder vectors of all given points in one read;
+  // bufs[i] receives num_reorder_dims floats of pt_idxs[i]
+  // NOTE :: blocking call
+  void read_reorder(const std::vector<int64_t>& pt_idxs,
+                    const std::vector<float*>&  bufs);
+
+  // asynchronously read the given points only to warm the cache pools;
+  // requires non-zero cache budgets to be of any use
+  // NOTE :: non-blocking call
+  void prefetch(const std::vector<int64_t>& pt_idxs,
+                TensorsPrefetchHandle& handle, bool skip_embedding = false);
+
+  // snapshot of TensorStore's cache counters
+  static TensorStoreCacheStats get_cache_stats();
+
+  // counters of the local chunk cache (all zero if not in use)
+  TensorStoreChunkCacheStats get_local_cache_stats();
 };
 
 #endif
@@ -37,6 +37,7 @@ typedef int FileHandle;
 #include "cached_io.h"
 #include "ann_exception.h"
 #include "common_includes.h"
+#include "segmented_rows.h"
 #include "windows_customizations.h"
 #include "tsl/robin_set.h"
 
@@ -572,6 +573,12 @@ namespace diskann {
       unsigned num_queries, std::vector<std::vector<_u32>>& groundtruth,
       std::vector<std::vector<_u32>>& our_results);
 
+  // flushes a file (or, on Linux, a directory entry list) to the device
+  DISKANN_DLLEXPORT void sync_path(const std::string& path, bool directory);
+
+  // directory of path, "." if it has none
+  DISKANN_DLLEXPORT std::string parent_dir(const std::string& path);
+
   template<typename T>
   inline void load_bin(const std::string& bin_file, std::unique_ptr<T[]>& data,
                        size_t& npts, size_t& dim, size_t offset = 0) {
@@ -838,6 +845,26 @@ namespace diskann {
     return bytes_written;
   }
 
+  // the first npts rows of data, without their padding to data.row_size()
+  template<typename T>
+  inline uint64_t save_data_in_base_dimensions(const std::string&      filename,
+                                               const SegmentedRows<T>& data,
+                                               size_t npts, size_t ndims,
+                                               size_t offset = 0) {
+    std::ofstream writer;
+    open_file_to_write(writer, filename);
+    int  npts_i32 = (int) npts, ndims_i32 = (int) ndims;
+    _u64 bytes_written = 2 * sizeof(uint32_t) + npts * ndims * sizeof(T);
+    writer.seekp(offset, writer.beg);
+    writer.write((char*) &npts_i32, sizeof(int));
+    writer.write((char*) &ndims_i32, sizeof(int));
+    for (size_t i = 0; i < npts; i++) {
+      writer.write((char*) data[i], ndims * sizeof(T));
+    }
+    writer.close();
+    return bytes_written;
+  }
+
   template<typename T>
   inline void copy_aligned_data_from_file(const char* bin_file, T*& data,
                                           size_t& npts, size_t& dim,
@@ -868,6 +895,38 @@ namespace diskann {
     }
   }
 
+  // reads the points into the first rows of data, zero-padded to
+  // data.row_size(); data must already have a row for every point
+  template<typename T>
+  inline void copy_aligned_data_from_file(const char*       bin_file,
+                                          SegmentedRows<T>& data, size_t& npts,
+                                          size_t& dim, size_t offset = 0) {
+    std::ifstream reader;
+    reader.exceptions(std::ios::badbit | std::ios::failbit);
+    reader.open(bin_file, std::ios::binary);
+    reader.seekg(offset, reader.beg);
+
+    int npts_i32, dim_i32;
+    reader.read((char*) &npts_i32, sizeof(int));
+    reader.read((char*) &dim_i32, sizeof(int));
+    npts = (unsigned) npts_i32;
+    dim = (unsigned) dim_i32;
+    if (npts > data.size() || dim > data.row_size()) {
+      std::stringstream stream;
+      stream << bin_file << " has " << npts << " points of dimension " << dim
+             << ", more than the " << data.size() << " rows of dimension "
+             << data.row_size() << " allocated for them";
+      throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
+                                  __LINE__);
+    }
+
+    size_t rounded_dim = data.row_size();
+    for (size_t i = 0; i < npts; i++) {
+      reader.read((char*) data[i], dim * sizeof(T));
+      memset(data[i] + dim, 0, (rounded_dim - dim) * sizeof(T));
+    }
+  }
+
   // NOTE :: good efficiency when total_vec_size is integral multiple of 64
   inline void prefetch_vector(const char* vec, size_t vecsize) {
     size_t max_prefetch_size = (vecsize / 64) * 64;
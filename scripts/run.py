@@ -7,6 +7,7 @@ import sys
 
 DISKANN_DIR = os.path.dirname(os.path.dirname(os.path.realpath(__file__)))
 PROG_FVECS_TO_FBIN = f"{DISKANN_DIR}/build/tests/utils/fvecs_to_bin"
+PROG_FLOAT_TO_FLOAT16 = f"{DISKANN_DIR}/build/tests/utils/float_to_float16"
 PROG_BUILD_DISK_INDEX = f"{DISKANN_DIR}/build/tests/build_disk_index"
 PROG_DISK_INDEX_TO_TENSORS = f"{DISKANN_DIR}/build/tests/utils/disk_index_to_tensors"
 PROG_SEARCH_DISK_INDEX = f"{DISKANN_DIR}/build/tests/search_disk_index"
@@ -48,36 +49,69 @@ def handle_to_fbin(sift_base, dataset, max_npts):
     run_program(PROG_FVECS_TO_FBIN, options)
 
 
-def handle_build(dataset):
+def index_name(dataset, data_type):
+    # float16 indexes live next to the float ones under their own prefix
+    name = f"{dataset}_R32_L50_A1.2"
+    return name if data_type == 'float' else f"{name}_{data_type}"
+
+
+def data_bin_path(fbin_path, data_type):
+    # derive (once) the float16 copy of a float bin file
+    if data_type == 'float':
+        return fbin_path
+    f16bin_path = fbin_path[:-len(".fbin")] + ".f16bin"
+    if not os.path.isfile(f16bin_path):
+        check_file_exists(fbin_path)
+        run_program(PROG_FLOAT_TO_FLOAT16, [fbin_path, f16bin_path])
+    return f16bin_path
+
+
+def handle_build(dataset, data_type, num_rnds, visit_order, pq_build,
+                 to_tensors, resume):
     learn_fbin_path = f"{dataset}_learn.fbin"
-    index_path_prefix = f"{dataset}_R32_L50_A1.2"
+    index_path_prefix = index_name(dataset, data_type)
     check_file_exists(learn_fbin_path)
+    learn_bin_path = data_bin_path(learn_fbin_path, data_type)
 
     options = [
-        '--data_type', 'float', '--dist_fn', 'l2', '--data_path',
-        learn_fbin_path, '--index_path_prefix', index_path_prefix, '-R', '32',
-        '-L', '50', '-B', '0.003', '-M', '1'
+        '--data_type', data_type, '--dist_fn', 'l2', '--data_path',
+        learn_bin_path, '--index_path_prefix', index_path_prefix, '-R', '32',
+        '-L', '50', '-B', '0.003', '-M', '1', '--num_rnds',
+        str(num_rnds), '--visit_order', visit_order
     ]
+    if pq_build:
+        options.append('--build_with_pq')
+    # writes the tensors that the convert step would otherwise produce
+    if to_tensors:
+        options += ['--tensors_prefix', f"{index_path_prefix}_tensor"]
+    if resume:
+        options.append('--resume')
     run_program(PROG_BUILD_DISK_INDEX, options)
 
 
-def handle_convert(dataset):
-    disk_index_path = f"{dataset}_R32_L50_A1.2_disk.index"
-    tensors_prefix = f"{dataset}_R32_L50_A1.2_tensor"
+def handle_convert(dataset, data_type):
+    disk_index_path = f"{index_name(dataset, data_type)}_disk.index"
+    tensors_prefix = f"{index_name(dataset, data_type)}_tensor"
     check_file_exists(disk_index_path)
 
-    options = ['float', disk_index_path, tensors_prefix]
+    # disk-PQ indexes store uint8 codes in place of the vectors
+    if os.path.isfile(f"{disk_index_path}_pq_pivots.bin"):
+        data_type = "disk_pq"
+
+    options = [data_type, disk_index_path, tensors_prefix]
     run_program(PROG_DISK_INDEX_TO_TENSORS, options)
 
 
 def handle_query(dataset,
+                 data_type,
                  k_depth,
                  npts_to_cache,
                  use_ts,
                  ts_async,
                  list_sizes,
                  remote_prefix=None,
-                 max_query_num=None):
+                 max_query_num=None,
+                 ts_options=None):
     # we split the address into a url and a relative path
     remote_url, remote_dataset = remote_prefix.rsplit('/', 1) if remote_prefix \
         else (None, None)
@@ -86,22 +120,23 @@ def handle_query(dataset,
                                      and not not remote_url
                                      and not not remote_dataset)
 
-    index_path_prefix = f"{dataset}_R32_L50_A1.2"
-    disk_index_path = f"{dataset}_R32_L50_A1.2_disk.index"
-    tensors_prefix = f"{remote_dataset or dataset}_R32_L50_A1.2_tensor"
+    index_path_prefix = index_name(dataset, data_type)
+    disk_index_path = f"{index_path_prefix}_disk.index"
+    tensors_prefix = f"{index_name(remote_dataset or dataset, data_type)}_tensor"
     query_fbin_path = f"{dataset}_query.fbin"
     gt_file_path = f"{dataset}_query_gt100"
     res_path_prefix = f"{dataset}_query_res"
     check_file_exists(query_fbin_path)
     check_file_exists(disk_index_path)
+    query_bin_path = data_bin_path(query_fbin_path, data_type)
     if not remote_prefix:
         check_dir_exists(f"{tensors_prefix}_embedding.zarr")
         check_dir_exists(f"{tensors_prefix}_num_nbrs.zarr")
         check_dir_exists(f"{tensors_prefix}_nbrhood.zarr")
 
     options = [
-        '--data_type', 'float', '--dist_fn', 'l2', '--index_path_prefix',
-        index_path_prefix, '--query_file', query_fbin_path, '--gt_file',
+        '--data_type', data_type, '--dist_fn', 'l2', '--index_path_prefix',
+        index_path_prefix, '--query_file', query_bin_path, '--gt_file',
         gt_file_path, '-K',
         str(k_depth), '--result_path', res_path_prefix, '--num_nodes_to_cache',
         str(npts_to_cache), '-L'
@@ -115,6 +150,10 @@ def handle_query(dataset,
             options.append('--use_tensors_async')
         if remote_prefix:
             options += ['--use_remote_addr', f'{remote_url}']
+        # TensorStore context tuning, e.g. {'ts_cache_nbrhood_mb': 2000}
+        for opt, val in (ts_options or {}).items():
+            if val is not None:
+                options += [f'--{opt}', f'{val}']
     if max_query_num is not None:
         options += ['--max_query_num', f'{max_query_num}']
     run_program(PROG_SEARCH_DISK_INDEX, options)
@@ -148,6 +187,31 @@ if __name__ == "__main__":
         '--dataset',
         help="dataset name, should be the prefix <this>_learn.fbin",
         required=True)
+    parser_build.add_argument('--data_type',
+                              help="vector element type stored in the index",
+                              choices=['float', 'float16'],
+                              default='float')
+    parser_build.add_argument(
+        '--num_rnds',
+        help="#graph build passes, the first one at alpha 1 if more than one",
+        type=int,
+        default=1)
+    parser_build.add_argument('--visit_order',
+                              help="point insertion order of each pass",
+                              choices=['sequential', 'random'],
+                              default='sequential')
+    parser_build.add_argument(
+        '--pq_build',
+        help="build the graph over PQ codes instead of merging shards",
+        action='store_true')
+    parser_build.add_argument(
+        '--to_tensors',
+        help="write tensors directly, leaving only metadata in _disk.index",
+        action='store_true')
+    parser_build.add_argument(
+        '--resume',
+        help="skip the stages an interrupted build with the same args finished",
+        action='store_true')
 
     parser_convert = subparsers.add_parser(
         'convert', help="convert disk index to zarr format tensors")
@@ -155,6 +219,10 @@ if __name__ == "__main__":
         '--dataset',
         help="dataset name, should be the prefix <this>_learn.fbin",
         required=True)
+    parser_convert.add_argument('--data_type',
+                                help="vector element type of the index",
+                                choices=['float', 'float16'],
+                                default='float')
 
     parser_query = subparsers.add_parser(
         'query', help="run query (search) on index in various modes")
@@ -162,6 +230,10 @@ if __name__ == "__main__":
         '--dataset',
         help="dataset name, should be the prefix <this>_learn.fbin",
         required=True)
+    parser_query.add_argument('--data_type',
+                              help="vector element type of the index",
+                              choices=['float', 'float16'],
+                              default='float')
     parser_query.add_argument('--k_depth',
                               help="how many nearest neighbors to query",
                               type=int,
@@ -191,15 +263,64 @@ if __name__ == "__main__":
                               help="maximum number of queries to run",
                               type=int,
                               default=None)
+    for tensor in ('embedding', 'num_nbrs', 'nbrhood', 'reorder'):
+        parser_query.add_argument(
+            f'--ts_cache_{tensor}_mb',
+            help=f"tensorstore cache pool budget of {tensor} tensor in MB",
+            type=int,
+            default=None)
+    parser_query.add_argument('--ts_data_copy_concurrency',
+                              help="tensorstore data copy concurrency limit",
+                              type=int,
+                              default=None)
+    parser_query.add_argument('--ts_io_concurrency',
+                              help="tensorstore file/http I/O concurrency limit",
+                              type=int,
+                              default=None)
+    parser_query.add_argument(
+        '--ts_local_cache_dir',
+        help="persistent local chunk cache directory for remote tensors",
+        default=None)
+    parser_query.add_argument('--ts_local_cache_mb',
+                              help="size bound of the local chunk cache in MB",
+                              type=int,
+                              default=None)
+    parser_query.add_argument(
+        '--ts_prefetch_width',
+        help="#candidates past the beam to speculatively prefetch per hop",
+        type=int,
+        default=None)
+    parser_query.add_argument('--ts_recheck_cached_data',
+                              help="when tensorstore revalidates cached chunks",
+                              choices=['false', 'true', 'open'],
+                              default=None)
 
     args = parser.parse_args()
     if args.subparser == "to_fbin":
         handle_to_fbin(args.sift_base, args.dataset, args.max_npts)
     elif args.subparser == "build":
-        handle_build(args.dataset)
+        handle_build(args.dataset, args.data_type, args.num_rnds,
+                     args.visit_order, args.pq_build, args.to_tensors,
+                     args.resume)
     elif args.subparser == "convert":
-        handle_convert(args.dataset)
+        handle_convert(args.dataset, args.data_type)
     elif args.subparser == "query":
-        handle_query(args.dataset, args.k_depth, args.npts_to_cache,
-                     args.use_ts, args.ts_async, args.list_sizes,
-                     args.use_remote, args.max_query_num)
+        ts_options = {
+            'ts_cache_embedding_mb': args.ts_cache_embedding_mb,
+            'ts_cache_num_nbrs_mb': args.ts_cache_num_nbrs_mb,
+            'ts_cache_nbrhood_mb': args.ts_cache_nbrhood_mb,
+            'ts_cache_reorder_mb': args.ts_cache_reorder_mb,
+            'ts_data_copy_concurrency': args.ts_data_copy_concurrency,
+            'ts_recheck_cached_data': args.ts_recheck_cached_data,
+            'ts_prefetch_width': args.ts_prefetch_width,
+            'ts_local_cache_dir': args.ts_local_cache_dir,
+            'ts_local_cache_mb': args.ts_local_cache_mb,
+        }
+        # the I/O limit applies to whichever kvstore driver is in use
+        io_opt = 'ts_http_request_concurrency' if args.use_remote \
+            else 'ts_file_io_concurrency'
+        ts_options[io_opt] = args.ts_io_concurrency
+        handle_query(args.dataset, args.data_type, args.k_depth,
+                     args.npts_to_cache, args.use_ts, args.ts_async,
+                     args.list_sizes, args.use_remote, args.max_query_num,
+                     ts_options)
@@ -0,0 +1,260 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#ifndef _WINDOWS
+#include <dirent.h>
+#endif
+
+#include "build_manifest.h"
+#include "logger.h"
+
+namespace {
+  // samples of this many bytes, at most CHECKSUM_SAMPLES of them, are hashed
+  const _u64 CHECKSUM_SAMPLE_BYTES = 1024 * 1024;
+  const _u64 CHECKSUM_SAMPLES = 16;
+
+  std::vector<std::string> split_tabs(const std::string &line) {
+    std::vector<std::string> fields;
+    std::string              field;
+    std::istringstream       stream(line);
+    while (std::getline(stream, field, '\t'))
+      fields.push_back(field);
+    return fields;
+  }
+
+  // the manifest is line and tab separated
+  std::string sanitize(std::string text) {
+    for (auto &c : text)
+      if (c == '\t' || c == '\n' || c == '\r')
+        c = ' ';
+    return text;
+  }
+
+  // files and subdirectories under dir, recursively, as paths relative to it
+  void list_files(const std::string &dir, const std::string &prefix,
+                  std::vector<std::string> &files,
+                  std::vector<std::string> &subdirs) {
+#ifdef _WINDOWS
+    throw diskann::ANNException(
+        "Directory artifacts are not supported on Windows: " + dir, -1,
+        __FUNCSIG__, __FILE__, __LINE__);
+#else
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr)
+      return;
+    while (struct dirent *entry = readdir(d)) {
+      std::string name = entry->d_name;
+      if (name == "." || name == "..")
+        continue;
+      if (file_exists(dir + "/" + name, true)) {
+        subdirs.push_back(prefix + name);
+        list_files(dir + "/" + name, prefix + name + "/", files, subdirs);
+      } else
+        files.push_back(prefix + name);
+    }
+    closedir(d);
+#endif
+  }
+}  // namespace
+
+namespace diskann {
+  BuildManifest::BuildManifest(const std::string &manifest_path,
+                               const std::string &config, bool resume)
+      : _path(manifest_path), _config(sanitize(config)) {
+    if (resume)
+      load();
+    if (_stages.empty())
+      save();
+  }
+
+  void BuildManifest::load() {
+    std::ifstream in(_path);
+    if (!in.is_open()) {
+      diskann::cout << "No build manifest at " << _path
+                    << ", building from scratch" << std::endl;
+      return;
+    }
+
+    std::string line;
+    if (!std::getline(in, line) || line != "config\t" + _config) {
+      diskann::cout << "Build manifest " << _path
+                    << " was written by a build with other parameters, "
+                       "building from scratch"
+                    << std::endl;
+      return;
+    }
+
+    // a line cut short by a crash ends the manifest
+    while (std::getline(in, line)) {
+      auto fields = split_tabs(line);
+      if (fields.size() >= 2 && fields[0] == "stage") {
+        _stages.push_back(
+            Stage{fields[1], fields.size() > 2 ? fields[2] : "", {}});
+      } else if (fields.size() == 4 && fields[0] == "artifact" &&
+                 !_stages.empty()) {
+        Artifact artifact{fields[1], 0, 0};
+        try {
+          artifact.size = std::stoull(fields[2]);
+          artifact.checksum = std::stoull(fields[3], nullptr, 16);
+        } catch (const std::exception &) {
+          break;
+        }
+        _stages.back().artifacts.push_back(artifact);
+      } else {
+        break;
+      }
+    }
+    diskann::cout << "Loaded build manifest " << _path << " with "
+                  << _stages.size() << " completed stages" << std::endl;
+  }
+
+  // The manifest only reaches the disk after the artifacts it records, so a
+  // host crash cannot leave a stage recorded complete whose data was lost.
+  void BuildManifest::save() const {
+    std::string tmp_path = _path + ".tmp";
+    {
+      std::ofstream out;
+      out.exceptions(std::ios::badbit | std::ios::failbit);
+      out.open(tmp_path, std::ios::trunc);
+      out << "config\t" << _config << "\n";
+      for (auto &stage : _stages) {
+        out << "stage\t" << stage.name << "\t" << stage.note << "\n";
+        for (auto &artifact : stage.artifacts)
+          out << "artifact\t" << artifact.path << "\t" << artifact.size << "\t"
+              << std::hex << artifact.checksum << std::dec << "\n";
+      }
+      out.flush();
+    }
+    sync_path(tmp_path, false);
+#ifdef _WINDOWS
+    std::remove(_path.c_str());
+#endif
+    if (std::rename(tmp_path.c_str(), _path.c_str()) != 0)
+      throw diskann::ANNException("Failed to write build manifest " + _path,
+                                  -1, __FUNCSIG__, __FILE__, __LINE__);
+    sync_path(parent_dir(_path), true);
+  }
+
+  const BuildManifest::Stage *BuildManifest::find(
+      const std::string &stage) const {
+    for (auto &s : _stages)
+      if (s.name == stage)
+        return &s;
+    return nullptr;
+  }
+
+  bool BuildManifest::is_complete(const std::string &stage) const {
+    const Stage *s = find(stage);
+    if (s == nullptr)
+      return false;
+    for (auto &artifact : s->artifacts) {
+      _u64 size = 0, sum = 0;
+      bool present = file_exists(artifact.path);
+      if (present)
+        describe(artifact.path, false, size, sum);
+      if (!present || size != artifact.size || sum != artifact.checksum) {
+        diskann::cout << "Artifact " << artifact.path << " of stage " << stage
+                      << " is missing or changed, redoing the stage"
+                      << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void BuildManifest::mark_complete(const std::string &             stage,
+                                    const std::vector<std::string> &artifacts,
+                                    const std::string &             note) {
+    Stage s{sanitize(stage), sanitize(note), {}};
+    for (auto &path : artifacts) {
+      if (!file_exists(path))
+        throw diskann::ANNException("Artifact " + path + " of stage " + stage +
+                                        " does not exist",
+                                    -1, __FUNCSIG__, __FILE__, __LINE__);
+      Artifact artifact{sanitize(path), 0, 0};
+      describe(path, true, artifact.size, artifact.checksum);
+      s.artifacts.push_back(artifact);
+    }
+
+    // stages recorded after an earlier run of this one used its old artifacts
+    for (size_t i = 0; i < _stages.size(); i++) {
+      if (_stages[i].name == s.name) {
+        _stages.resize(i);
+        break;
+      }
+    }
+    _stages.push_back(s);
+    save();
+  }
+
+  std::string BuildManifest::get_note(const std::string &stage) const {
+    const Stage *s = find(stage);
+    return s == nullptr ? "" : s->note;
+  }
+
+  // A file is described by its size and sampled checksum, a directory by the
+  // names and sizes of the files under it; with sync, all of them are synced.
+  void BuildManifest::describe(const std::string &path, bool sync,
+                               _u64 &size, _u64 &sum) {
+    if (!file_exists(path, true)) {
+      if (sync)
+        sync_path(path, false);
+      size = get_file_size(path);
+      sum = checksum(path, size);
+      return;
+    }
+
+    std::vector<std::string> files, subdirs;
+    list_files(path, "", files, subdirs);
+    std::sort(files.begin(), files.end());
+    size = 0;
+    sum = 14695981039346656037ULL;
+    for (auto &file : files) {
+      if (sync)
+        sync_path(path + "/" + file, false);
+      _u64 file_size = get_file_size(path + "/" + file);
+      size += file_size;
+      std::string entry = file + '\0' + std::to_string(file_size) + '\0';
+      for (unsigned char c : entry) {
+        sum ^= c;
+        sum *= 1099511628211ULL;
+      }
+    }
+    if (sync) {
+      for (auto &subdir : subdirs)
+        sync_path(path + "/" + subdir, true);
+      sync_path(path, true);
+    }
+  }
+
+  // FNV-1a over the sampled bytes
+  _u64 BuildManifest::checksum(const std::string &path, _u64 size) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open())
+      return 0;
+
+    _u64 hash = 14695981039346656037ULL;
+    _u64 num_samples = (std::min)(
+        CHECKSUM_SAMPLES, DIV_ROUND_UP(size, CHECKSUM_SAMPLE_BYTES));
+    std::vector<char> buf(CHECKSUM_SAMPLE_BYTES);
+    for (_u64 i = 0; i < num_samples; i++) {
+      _u64 sample_size = (std::min)(CHECKSUM_SAMPLE_BYTES, size);
+      _u64 offset = num_samples == 1 ? 0
+                                     : i * (size - sample_size) /
+                                           (num_samples - 1);
+      in.seekg(offset, std::ios::beg);
+      in.read(buf.data(), sample_size);
+      if ((_u64) in.gcount() != sample_size)
+        return 0;
+      for (_u64 j = 0; j < sample_size; j++) {
+        hash ^= (unsigned char) buf[j];
+        hash *= 1099511628211ULL;
+      }
+    }
+    return hash;
+  }
+}  // namespace diskann
@@ -4,12 +4,20 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <iostream>
 #include <set>
 #include <string>
 #include <vector>
 
+#ifndef _WINDOWS
+#include <sys/resource.h>
+#endif
+
 #if defined(RELEASE_UNUSED_TCMALLOC_MEMORY_AT_CHECKPOINTS) && \
     defined(DISKANN_BUILD)
 #include "gperftools/malloc_extension.h"
@@ -24,6 +32,11 @@
 #include "percentile_stats.h"
 #include "partition.h"
 #include "pq_flash_index.h"
+#include "pq_vamana_builder.h"
+#ifndef _WINDOWS
+#include "tensorstore_index_writer.h"
+#endif
+#include "timer.h"
 #include "tsl/robin_set.h"
 
 namespace diskann {
@@ -243,184 +256,302 @@ namespace diskann {
     reader.close();
   }
 
+  // Merges the vamana graphs of overlapping shards into one graph over the
+  // global ids. The id space is split into ranges sized so that the shard
+  // lists and merged lists of one range take at most MAX_MERGE_RANGE_BYTES.
+  // After one sequential pass per shard that records where each range starts
+  // in its file, waves of ranges are merged in parallel, each thread reading
+  // its slice of every shard with its own reader, and the merged lists are
+  // written at their final offsets in the output graph.
   int merge_shards(const std::string &vamana_prefix,
                    const std::string &vamana_suffix,
                    const std::string &idmaps_prefix,
                    const std::string &idmaps_suffix, const _u64 nshards,
                    unsigned max_degree, const std::string &output_vamana,
                    const std::string &medoids_file) {
+    diskann::Timer     timer;
+    std::exception_ptr error = nullptr;
+    auto               record_error = [&error]() {
+#pragma omp critical
+      if (error == nullptr)
+        error = std::current_exception();
+    };
+
     // Read ID maps
     std::vector<std::string>           vamana_names(nshards);
     std::vector<std::vector<unsigned>> idmaps(nshards);
-    for (_u64 shard = 0; shard < nshards; shard++) {
-      vamana_names[shard] =
-          vamana_prefix + std::to_string(shard) + vamana_suffix;
-      read_idmap(idmaps_prefix + std::to_string(shard) + idmaps_suffix,
-                 idmaps[shard]);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (_s64 shard = 0; shard < (_s64) nshards; shard++) {
+      try {
+        vamana_names[shard] =
+            vamana_prefix + std::to_string(shard) + vamana_suffix;
+        std::string idmap_name =
+            idmaps_prefix + std::to_string(shard) + idmaps_suffix;
+        read_idmap(idmap_name, idmaps[shard]);
+        // ranges map to contiguous local ids only if the map is increasing,
+        // which is how partitioning writes it
+        auto &idmap = idmaps[shard];
+        if (std::adjacent_find(idmap.begin(), idmap.end(),
+                               std::greater_equal<unsigned>()) != idmap.end())
+          throw diskann::ANNException(
+              "ID map " + idmap_name + " is not strictly increasing", -1,
+              __FUNCSIG__, __FILE__, __LINE__);
+      } catch (...) {
+        record_error();
+      }
     }
+    if (error != nullptr)
+      std::rethrow_exception(error);
 
     // find max node id
     _u64 nnodes = 0;
     _u64 nelems = 0;
     for (auto &idmap : idmaps) {
-      for (auto &id : idmap) {
-        nnodes = std::max(nnodes, (_u64) id);
-      }
+      if (!idmap.empty())
+        nnodes = std::max(nnodes, (_u64) idmap.back());
       nelems += idmap.size();
     }
     nnodes++;
     diskann::cout << "# nodes: " << nnodes << ", max. degree: " << max_degree
+                  << ", read ID maps in " << timer.elapsed() / 1000000.0 << "s"
                   << std::endl;
 
-    // compute inverse map: node -> shards
-    std::vector<std::pair<unsigned, unsigned>> node_shard;
-    node_shard.reserve(nelems);
-    for (_u64 shard = 0; shard < nshards; shard++) {
-      diskann::cout << "Creating inverse map -- shard #" << shard << std::endl;
-      for (_u64 idx = 0; idx < idmaps[shard].size(); idx++) {
-        _u64 node_id = idmaps[shard][idx];
-        node_shard.push_back(std::make_pair((_u32) node_id, (_u32) shard));
-      }
-    }
-    std::sort(node_shard.begin(), node_shard.end(),
-              [](const auto &left, const auto &right) {
-                return left.first < right.first || (left.first == right.first &&
-                                                    left.second < right.second);
-              });
-    diskann::cout << "Finished computing node -> shards map" << std::endl;
-
-    // create cached vamana readers
-    std::vector<cached_ifstream> vamana_readers(nshards);
-    for (_u64 i = 0; i < nshards; i++) {
-      vamana_readers[i].open(vamana_names[i], BUFFER_SIZE_FOR_CACHED_IO);
-      size_t expected_file_size;
-      vamana_readers[i].read((char *) &expected_file_size, sizeof(uint64_t));
-    }
-
     size_t vamana_metadata_size =
         sizeof(_u64) + sizeof(_u32) + sizeof(_u32) +
         sizeof(_u64);  // expected file size + max degree + medoid_id +
                        // frozen_point info
 
-    // create cached vamana writers
-    cached_ofstream merged_vamana_writer(output_vamana,
-                                         BUFFER_SIZE_FOR_CACHED_IO);
-
-    size_t merged_index_size =
-        vamana_metadata_size;  // we initialize the size of the merged index to
-                               // the metadata size
-    size_t merged_index_frozen = 0;
-    merged_vamana_writer.write(
-        (char *) &merged_index_size,
-        sizeof(uint64_t));  // we will overwrite the index size at the end
-
-    unsigned output_width = max_degree;
-    unsigned max_input_width = 0;
-    // read width from each vamana to advance buffer by sizeof(unsigned) bytes
-    for (auto &reader : vamana_readers) {
-      unsigned input_width;
-      reader.read((char *) &input_width, sizeof(unsigned));
-      max_input_width =
-          input_width > max_input_width ? input_width : max_input_width;
-    }
-
-    diskann::cout << "Max input width: " << max_input_width
-                  << ", output width: " << output_width << std::endl;
-
-    merged_vamana_writer.write((char *) &output_width, sizeof(unsigned));
+    // read shard headers, write medoids
     std::ofstream medoid_writer(medoids_file.c_str(), std::ios::binary);
     _u32          nshards_u32 = (_u32) nshards;
     _u32          one_val = 1;
     medoid_writer.write((char *) &nshards_u32, sizeof(uint32_t));
     medoid_writer.write((char *) &one_val, sizeof(uint32_t));
 
-    _u64 vamana_index_frozen =
-        0;  // as of now the functionality to merge many overlapping vamana
-            // indices is supported only for bulk indices without frozen point.
-            // Hence the final index will also not have any frozen points.
+    unsigned output_width = max_degree;
+    unsigned max_input_width = 0;
+    unsigned merged_medoid = 0;
     for (_u64 shard = 0; shard < nshards; shard++) {
-      unsigned medoid;
-      // read medoid
-      vamana_readers[shard].read((char *) &medoid, sizeof(unsigned));
-      vamana_readers[shard].read((char *) &vamana_index_frozen, sizeof(_u64));
-      assert(vamana_index_frozen == false);
+      std::ifstream reader;
+      reader.exceptions(std::ios::badbit | std::ios::failbit);
+      reader.open(vamana_names[shard], std::ios::binary);
+      _u64     expected_file_size, vamana_index_frozen;
+      unsigned input_width, medoid;
+      reader.read((char *) &expected_file_size, sizeof(_u64));
+      reader.read((char *) &input_width, sizeof(unsigned));
+      reader.read((char *) &medoid, sizeof(unsigned));
+      reader.read((char *) &vamana_index_frozen, sizeof(_u64));
+      // as of now the functionality to merge many overlapping vamana indices
+      // is supported only for bulk indices without frozen point. Hence the
+      // final index will also not have any frozen points.
+      if (vamana_index_frozen != 0)
+        throw diskann::ANNException(
+            "Cannot merge shard with frozen points: " + vamana_names[shard],
+            -1, __FUNCSIG__, __FILE__, __LINE__);
+      max_input_width = std::max(max_input_width, input_width);
+
       // rename medoid
       medoid = idmaps[shard][medoid];
-
       medoid_writer.write((char *) &medoid, sizeof(uint32_t));
-      // write renamed medoid
-      if (shard == (nshards - 1))  //--> uncomment if running hierarchical
-        merged_vamana_writer.write((char *) &medoid, sizeof(unsigned));
+      merged_medoid = medoid;  // the last shard's medoid starts the search
     }
-    merged_vamana_writer.write((char *) &merged_index_frozen, sizeof(_u64));
     medoid_writer.close();
 
-    diskann::cout << "Starting merge" << std::endl;
+    diskann::cout << "Max input width: " << max_input_width
+                  << ", output width: " << output_width << std::endl;
 
-    // Gopal. random_shuffle() is deprecated.
-    std::random_device rng;
-    std::mt19937       urng(rng());
-
-    std::vector<bool>     nhood_set(nnodes, 0);
-    std::vector<unsigned> final_nhood;
-
-    unsigned nnbrs = 0, shard_nnbrs = 0;
-    unsigned cur_id = 0;
-    for (const auto &id_shard : node_shard) {
-      unsigned node_id = id_shard.first;
-      unsigned shard_id = id_shard.second;
-      if (cur_id < node_id) {
-        // Gopal. random_shuffle() is deprecated.
-        std::shuffle(final_nhood.begin(), final_nhood.end(), urng);
-        nnbrs =
-            (unsigned) (std::min)(final_nhood.size(), (uint64_t) max_degree);
-        // write into merged ofstream
-        merged_vamana_writer.write((char *) &nnbrs, sizeof(unsigned));
-        merged_vamana_writer.write((char *) final_nhood.data(),
-                                   nnbrs * sizeof(unsigned));
-        merged_index_size += (sizeof(unsigned) + nnbrs * sizeof(unsigned));
-        if (cur_id % 499999 == 1) {
-          diskann::cout << "." << std::flush;
+    // split the id space into ranges
+    double replication = (double) nelems / (double) nnodes;
+    _u64   bytes_per_node =
+        (_u64)(replication * (max_input_width + 1) * sizeof(unsigned)) +
+        ((_u64) output_width + 1) * sizeof(unsigned);
+    _u64 range_nodes = std::max(
+        (_u64) 1, (_u64) MAX_MERGE_RANGE_BYTES / std::max(bytes_per_node,
+                                                          (_u64) 1));
+    _u64 num_ranges = DIV_ROUND_UP(nnodes, range_nodes);
+    auto range_begin = [&](_u64 r) {
+      return (unsigned) std::min(r * range_nodes, nnodes);
+    };
+
+    // per shard, the first local id and file offset of every range
+    timer.reset();
+    std::vector<std::vector<_u64>> local_starts(nshards), offsets(nshards);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (_s64 shard = 0; shard < (_s64) nshards; shard++) {
+      try {
+        auto &idmap = idmaps[shard];
+        auto &local_start = local_starts[shard];
+        auto &offset = offsets[shard];
+        local_start.resize(num_ranges + 1);
+        offset.resize(num_ranges + 1);
+        for (_u64 r = 0; r <= num_ranges; r++)
+          local_start[r] =
+              std::lower_bound(idmap.begin(), idmap.end(), range_begin(r)) -
+              idmap.begin();
+
+        cached_ifstream reader(vamana_names[shard], MAX_MERGE_RANGE_BYTES);
+        std::vector<char> header(vamana_metadata_size);
+        reader.read(header.data(), vamana_metadata_size);
+
+        _u64                  cur_offset = vamana_metadata_size;
+        _u64                  r = 0;
+        std::vector<unsigned> nhood;
+        for (_u64 idx = 0; idx < idmap.size(); idx++) {
+          while (r <= num_ranges && local_start[r] == idx)
+            offset[r++] = cur_offset;
+          unsigned nnbrs;
+          reader.read((char *) &nnbrs, sizeof(unsigned));
+          if (nnbrs > 0) {
+            nhood.resize(nnbrs);
+            reader.read((char *) nhood.data(), nnbrs * sizeof(unsigned));
+          }
+          cur_offset += ((_u64) nnbrs + 1) * sizeof(unsigned);
         }
-        cur_id = node_id;
-        nnbrs = 0;
-        for (auto &p : final_nhood)
-          nhood_set[p] = 0;
-        final_nhood.clear();
+        while (r <= num_ranges)
+          offset[r++] = cur_offset;
+      } catch (...) {
+        record_error();
       }
-      // read from shard_id ifstream
-      vamana_readers[shard_id].read((char *) &shard_nnbrs, sizeof(unsigned));
-      std::vector<unsigned> shard_nhood(shard_nnbrs);
-      vamana_readers[shard_id].read((char *) shard_nhood.data(),
-                                    shard_nnbrs * sizeof(unsigned));
-
-      // rename nodes
-      for (_u64 j = 0; j < shard_nnbrs; j++) {
-        if (nhood_set[idmaps[shard_id][shard_nhood[j]]] == 0) {
-          nhood_set[idmaps[shard_id][shard_nhood[j]]] = 1;
-          final_nhood.emplace_back(idmaps[shard_id][shard_nhood[j]]);
+    }
+    if (error != nullptr)
+      std::rethrow_exception(error);
+    diskann::cout << "Indexed " << nshards << " shard files into " << num_ranges
+                  << " ranges of " << range_nodes << " nodes in "
+                  << timer.elapsed() / 1000000.0 << "s" << std::endl;
+
+    // merge one range into its output records
+    std::random_device rng;
+    unsigned           seed = rng();
+    auto merge_range = [&](_u64 r, std::vector<unsigned> &out) {
+      _u64 node_begin = range_begin(r), node_end = range_begin(r + 1);
+      _u64 range_size = node_end - node_begin;
+
+      std::vector<std::vector<unsigned>> shard_lists(nshards);
+      for (_u64 shard = 0; shard < nshards; shard++) {
+        _u64 bytes = offsets[shard][r + 1] - offsets[shard][r];
+        if (bytes == 0)
+          continue;
+        std::ifstream reader;
+        reader.exceptions(std::ios::badbit | std::ios::failbit);
+        reader.open(vamana_names[shard], std::ios::binary);
+        reader.seekg(offsets[shard][r], reader.beg);
+        shard_lists[shard].resize(bytes / sizeof(unsigned));
+        reader.read((char *) shard_lists[shard].data(), bytes);
+      }
+
+      // gather the renamed lists of every node of the range, CSR-style
+      std::vector<_u64>     nhood_starts(range_size + 1, 0);
+      std::vector<unsigned> nhoods;
+      for (int pass = 0; pass < 2; pass++) {
+        std::vector<_u64> fill;
+        if (pass == 1) {
+          for (_u64 i = 0; i < range_size; i++)
+            nhood_starts[i + 1] += nhood_starts[i];
+          fill.assign(nhood_starts.begin(), nhood_starts.end() - 1);
+          nhoods.resize(nhood_starts[range_size]);
+        }
+        for (_u64 shard = 0; shard < nshards; shard++) {
+          auto &idmap = idmaps[shard];
+          auto &list = shard_lists[shard];
+          _u64  pos = 0;
+          for (_u64 idx = local_starts[shard][r];
+               idx < local_starts[shard][r + 1]; idx++) {
+            unsigned nnbrs = list[pos];
+            _u64     node = idmap[idx] - node_begin;
+            if (pass == 0) {
+              nhood_starts[node + 1] += nnbrs;
+            } else {
+              for (unsigned j = 0; j < nnbrs; j++)
+                nhoods[fill[node]++] = idmap[list[pos + 1 + j]];
+            }
+            pos += (_u64) nnbrs + 1;
+          }
         }
       }
+      shard_lists.clear();
+
+      // dedup, shuffle and cap each list into its output record
+      std::mt19937 urng(seed + (unsigned) r);
+      out.clear();
+      for (_u64 i = 0; i < range_size; i++) {
+        auto first = nhoods.begin() + nhood_starts[i];
+        auto last = nhoods.begin() + nhood_starts[i + 1];
+        std::sort(first, last);
+        last = std::unique(first, last);
+        std::shuffle(first, last, urng);
+        unsigned nnbrs = (unsigned) (std::min)((_u64)(last - first),
+                                               (_u64) output_width);
+        out.push_back(nnbrs);
+        out.insert(out.end(), first, first + nnbrs);
+      }
+    };
+
+    // write the header; the index size is overwritten at the end
+    _u64 merged_index_size = vamana_metadata_size;
+    _u64 merged_index_frozen = 0;
+    {
+      std::ofstream writer;
+      writer.exceptions(std::ios::badbit | std::ios::failbit);
+      writer.open(output_vamana, std::ios::binary | std::ios::trunc);
+      writer.write((char *) &merged_index_size, sizeof(uint64_t));
+      writer.write((char *) &output_width, sizeof(unsigned));
+      writer.write((char *) &merged_medoid, sizeof(unsigned));
+      writer.write((char *) &merged_index_frozen, sizeof(_u64));
     }
+    auto write_at = [&output_vamana](_u64 offset, const char *buf,
+                                     _u64 bytes) {
+      std::fstream writer;
+      writer.exceptions(std::ios::badbit | std::ios::failbit);
+      writer.open(output_vamana,
+                  std::ios::binary | std::ios::in | std::ios::out);
+      writer.seekp(offset, writer.beg);
+      writer.write(buf, bytes);
+    };
 
-    // Gopal. random_shuffle() is deprecated.
-    std::shuffle(final_nhood.begin(), final_nhood.end(), urng);
-    nnbrs = (unsigned) (std::min)(final_nhood.size(), (uint64_t) max_degree);
-    // write into merged ofstream
-    merged_vamana_writer.write((char *) &nnbrs, sizeof(unsigned));
-    merged_vamana_writer.write((char *) final_nhood.data(),
-                               nnbrs * sizeof(unsigned));
-    merged_index_size += (sizeof(unsigned) + nnbrs * sizeof(unsigned));
-    for (auto &p : final_nhood)
-      nhood_set[p] = 0;
-    final_nhood.clear();
+    diskann::cout << "Starting merge" << std::endl;
+    timer.reset();
+    _u64 wave_size = 2 * (_u64) omp_get_max_threads();
+    std::vector<std::vector<unsigned>> out_records(wave_size);
+    std::vector<_u64>                  out_offsets(wave_size);
+    for (_u64 wave_begin = 0; wave_begin < num_ranges;
+         wave_begin += wave_size) {
+      _u64 wave_end = std::min(wave_begin + wave_size, num_ranges);
+#pragma omp parallel for schedule(dynamic, 1)
+      for (_s64 r = wave_begin; r < (_s64) wave_end; r++) {
+        try {
+          merge_range(r, out_records[r - wave_begin]);
+        } catch (...) {
+          record_error();
+        }
+      }
+      if (error != nullptr)
+        std::rethrow_exception(error);
 
-    diskann::cout << "Expected size: " << merged_index_size << std::endl;
+      for (_u64 i = 0; i < wave_end - wave_begin; i++) {
+        out_offsets[i] = merged_index_size;
+        merged_index_size += out_records[i].size() * sizeof(unsigned);
+      }
 
-    merged_vamana_writer.reset();
-    merged_vamana_writer.write((char *) &merged_index_size, sizeof(uint64_t));
+#pragma omp parallel for schedule(dynamic, 1)
+      for (_s64 i = 0; i < (_s64)(wave_end - wave_begin); i++) {
+        try {
+          write_at(out_offsets[i], (char *) out_records[i].data(),
+                   out_records[i].size() * sizeof(unsigned));
+          std::vector<unsigned>().swap(out_records[i]);
+        } catch (...) {
+          record_error();
+        }
+      }
+      if (error != nullptr)
+        std::rethrow_exception(error);
+      diskann::cout << "." << std::flush;
+    }
+    write_at(0, (char *) &merged_index_size, sizeof(uint64_t));
 
-    diskann::cout << "Finished merge" << std::endl;
+    diskann::cout << std::endl
+                  << "Expected size: " << merged_index_size << std::endl;
+    diskann::cout << "Finished merge in " << timer.elapsed() / 1000000.0 << "s"
+                  << std::endl;
     return 0;
   }
 
@@ -430,7 +561,9 @@ namespace diskann {
                                 unsigned R, double sampling_rate,
                                 double ram_budget, std::string mem_index_path,
                                 std::string medoids_file,
-                                std::string centroids_file) {
+                                std::string centroids_file, unsigned num_rnds,
+                                std::string visit_order,
+                                BuildManifest *manifest) {
     size_t base_num, base_dim;
     diskann::get_bin_metadata(base_file, base_num, base_dim);
 
@@ -445,7 +578,8 @@ namespace diskann {
       paras.Set<unsigned>("R", (unsigned) R);
       paras.Set<unsigned>("C", 750);
       paras.Set<float>("alpha", 1.2f);
-      paras.Set<unsigned>("num_rnds", 2);
+      paras.Set<unsigned>("num_rnds", num_rnds);
+      paras.Set<std::string>("visit_order", visit_order);
       paras.Set<bool>("saturate_graph", 1);
       paras.Set<std::string>("save_path", mem_index_path);
 
@@ -460,14 +594,38 @@ namespace diskann {
       return 0;
     }
     std::string merged_index_prefix = mem_index_path + "_tempFiles";
-    int         num_parts =
-        partition_with_ram_budget<T>(base_file, sampling_rate, ram_budget,
-                                     2 * R / 3, merged_index_prefix, 2);
-
-    std::string cur_centroid_filepath = merged_index_prefix + "_centroids.bin";
-    std::rename(cur_centroid_filepath.c_str(), centroids_file.c_str());
+    int         num_parts;
+    if (manifest != nullptr && manifest->is_complete("partition")) {
+      num_parts = std::stoi(manifest->get_note("partition"));
+      diskann::cout << "Resuming with the partition into " << num_parts
+                    << " shards of the previous build" << std::endl;
+    } else {
+      num_parts =
+          partition_with_ram_budget<T>(base_file, sampling_rate, ram_budget,
+                                       2 * R / 3, merged_index_prefix, 2);
+
+      std::string cur_centroid_filepath =
+          merged_index_prefix + "_centroids.bin";
+      std::rename(cur_centroid_filepath.c_str(), centroids_file.c_str());
+
+      if (manifest != nullptr) {
+        std::vector<std::string> partition_files{centroids_file};
+        for (int p = 0; p < num_parts; p++)
+          partition_files.push_back(merged_index_prefix + "_subshard-" +
+                                    std::to_string(p) + "_ids_uint32.bin");
+        manifest->mark_complete("partition", partition_files,
+                                std::to_string(num_parts));
+      }
+    }
 
     for (int p = 0; p < num_parts; p++) {
+      std::string shard_stage = "shard-" + std::to_string(p);
+      if (manifest != nullptr && manifest->is_complete(shard_stage)) {
+        diskann::cout << "Resuming with shard " << p
+                      << " built by the previous build" << std::endl;
+        continue;
+      }
+
       std::string shard_base_file =
           merged_index_prefix + "_subshard-" + std::to_string(p) + ".bin";
 
@@ -485,7 +643,8 @@ namespace diskann {
       paras.Set<unsigned>("R", (2 * (R / 3)));
       paras.Set<unsigned>("C", 750);
       paras.Set<float>("alpha", 1.2f);
-      paras.Set<unsigned>("num_rnds", 2);
+      paras.Set<unsigned>("num_rnds", num_rnds);
+      paras.Set<std::string>("visit_order", visit_order);
       paras.Set<bool>("saturate_graph", 0);
       paras.Set<std::string>("save_path", shard_index_file);
 
@@ -498,6 +657,8 @@ namespace diskann {
       _pvamanaIndex->build(shard_base_file.c_str(), shard_base_pts, paras);
       _pvamanaIndex->save(shard_index_file.c_str());
       std::remove(shard_base_file.c_str());
+      if (manifest != nullptr)
+        manifest->mark_complete(shard_stage, {shard_index_file});
     }
 
     diskann::merge_shards(merged_index_prefix + "_subshard-", "_mem.index",
@@ -578,32 +739,152 @@ namespace diskann {
     return best_bw;
   }
 
+  namespace {
+    // File accessed with positional reads and writes, so threads can share
+    // one handle. A writable file is opened for direct I/O when the file
+    // system supports it, in which case offsets, sizes and buffers must be
+    // SECTOR_LEN aligned.
+    class PositionalFile {
+     public:
+      PositionalFile(const std::string &filename, bool write)
+          : _filename(filename) {
+#ifndef _WINDOWS
+        if (write) {
+          int flags = O_WRONLY | O_CREAT | O_TRUNC;
+          _fd = ::open(filename.c_str(), flags | O_DIRECT, 0644);
+          if (_fd == -1 && errno == EINVAL) {
+            diskann::cout << "Direct I/O not supported for " << filename
+                          << ", using buffered writes" << std::endl;
+            _fd = ::open(filename.c_str(), flags, 0644);
+          }
+        } else {
+          _fd = ::open(filename.c_str(), O_RDONLY);
+        }
+        if (_fd == -1)
+          throw_errno("open");
+#else
+        _stream.exceptions(std::ios::badbit | std::ios::failbit);
+        if (write)
+          _stream.open(filename, std::ios::binary | std::ios::out |
+                                     std::ios::trunc);
+        else
+          _stream.open(filename, std::ios::binary | std::ios::in);
+#endif
+      }
+
+      ~PositionalFile() {
+#ifndef _WINDOWS
+        if (_fd != -1)
+          ::close(_fd);
+#endif
+      }
+
+      // reserve the blocks of the whole file up front; a failure is not
+      // fatal, the writes then extend the file
+      void preallocate(_u64 size) {
+#ifndef _WINDOWS
+        int ret = posix_fallocate(_fd, 0, (off_t) size);
+        if (ret != 0)
+          diskann::cout << "fallocate of " << size << "B for " << _filename
+                        << " failed (" << strerror(ret) << "), continuing"
+                        << std::endl;
+#endif
+      }
+
+      void read_at(_u64 offset, char *buf, _u64 bytes) {
+#ifndef _WINDOWS
+        while (bytes > 0) {
+          ssize_t ret = ::pread(_fd, buf, bytes, (off_t) offset);
+          if (ret <= 0)
+            throw_errno(ret == 0 ? "pread (end of file)" : "pread");
+          buf += ret;
+          offset += ret;
+          bytes -= ret;
+        }
+#else
+        std::lock_guard<std::mutex> lock(_stream_mutex);
+        _stream.seekg(offset, _stream.beg);
+        _stream.read(buf, bytes);
+#endif
+      }
+
+      void write_at(_u64 offset, const char *buf, _u64 bytes) {
+#ifndef _WINDOWS
+        while (bytes > 0) {
+          ssize_t ret = ::pwrite(_fd, buf, bytes, (off_t) offset);
+          if (ret <= 0)
+            throw_errno("pwrite");
+          buf += ret;
+          offset += ret;
+          bytes -= ret;
+        }
+#else
+        std::lock_guard<std::mutex> lock(_stream_mutex);
+        _stream.seekp(offset, _stream.beg);
+        _stream.write(buf, bytes);
+#endif
+      }
+
+     private:
+#ifndef _WINDOWS
+      void throw_errno(const std::string &op) {
+        std::stringstream stream;
+        stream << op << " failed on " << _filename << ": "
+               << strerror(errno);
+        throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
+                                    __LINE__);
+      }
+
+      int _fd = -1;
+#else
+      std::fstream _stream;
+      std::mutex   _stream_mutex;
+#endif
+      std::string _filename;
+    };
+  }  // namespace
+
+  // The disk index is written in batches of DISK_LAYOUT_BATCH_BYTES of
+  // sectors. While the sectors of a batch are assembled in parallel, each
+  // thread reading the coordinates of its nodes with positional reads, the
+  // previous batch is being written out and the graph lists of the next one
+  // are read ahead, all with their own threads.
   template<typename T>
   void create_disk_layout(const std::string base_file,
                           const std::string mem_index_file,
                           const std::string output_file,
-                          const std::string reorder_data_file) {
-    unsigned npts, ndims;
+                          const std::string reorder_data_file,
+                          bool              metadata_only) {
+    diskann::Timer     timer;
+    std::exception_ptr error = nullptr;
+    auto               record_error = [&error]() {
+#pragma omp critical
+      if (error == nullptr)
+        error = std::current_exception();
+    };
 
-    // amount to read or write in one shot
-    _u64            read_blk_size = 64 * 1024 * 1024;
-    _u64            write_blk_size = read_blk_size;
-    cached_ifstream base_reader(base_file, read_blk_size);
-    base_reader.read((char *) &npts, sizeof(uint32_t));
-    base_reader.read((char *) &ndims, sizeof(uint32_t));
+    unsigned npts, ndims;
+    {
+      std::ifstream base_reader;
+      base_reader.exceptions(std::ios::badbit | std::ios::failbit);
+      base_reader.open(base_file, std::ios::binary);
+      base_reader.read((char *) &npts, sizeof(uint32_t));
+      base_reader.read((char *) &ndims, sizeof(uint32_t));
+    }
+    PositionalFile base_reader(base_file, false);
 
     size_t npts_64, ndims_64;
     npts_64 = npts;
     ndims_64 = ndims;
 
     // Check if we need to append data for re-ordering
-    bool          append_reorder_data = false;
-    std::ifstream reorder_data_reader;
+    bool append_reorder_data = false;
 
     unsigned npts_reorder_file = 0, ndims_reorder_file = 0;
     if (reorder_data_file != std::string("")) {
       append_reorder_data = true;
-      size_t reorder_data_file_size = get_file_size(reorder_data_file);
+      size_t        reorder_data_file_size = get_file_size(reorder_data_file);
+      std::ifstream reorder_data_reader;
       reorder_data_reader.exceptions(std::ofstream::failbit |
                                      std::ofstream::badbit);
 
@@ -630,8 +911,7 @@ namespace diskann {
     // create cached reader + writer
     size_t actual_file_size = get_file_size(mem_index_file);
     diskann::cout << "Vamana index file size=" << actual_file_size << std::endl;
-    std::ifstream   vamana_reader(mem_index_file, std::ios::binary);
-    cached_ofstream diskann_writer(output_file, write_blk_size);
+    cached_ifstream vamana_reader(mem_index_file, DISK_LAYOUT_BATCH_BYTES);
 
     // metadata: width, medoid
     unsigned width_u32, medoid_u32;
@@ -662,20 +942,19 @@ namespace diskann {
     max_node_len =
         (((_u64) width_u32 + 1) * sizeof(unsigned)) + (ndims_64 * sizeof(T));
     nnodes_per_sector = SECTOR_LEN / max_node_len;
+    if (nnodes_per_sector == 0) {
+      std::stringstream stream;
+      stream << "Node of " << max_node_len << "B does not fit in a sector of "
+             << SECTOR_LEN << "B";
+      throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
+                                  __LINE__);
+    }
 
     diskann::cout << "medoid: " << medoid << "B" << std::endl;
     diskann::cout << "max_node_len: " << max_node_len << "B" << std::endl;
     diskann::cout << "nnodes_per_sector: " << nnodes_per_sector << "B"
                   << std::endl;
 
-    // SECTOR_LEN buffer for each sector
-    std::unique_ptr<char[]> sector_buf = std::make_unique<char[]>(SECTOR_LEN);
-    std::unique_ptr<char[]> node_buf = std::make_unique<char[]>(max_node_len);
-    unsigned &nnbrs = *(unsigned *) (node_buf.get() + ndims_64 * sizeof(T));
-    unsigned *nhood_buf =
-        (unsigned *) (node_buf.get() + (ndims_64 * sizeof(T)) +
-                      sizeof(unsigned));
-
     // number of sectors (1 for meta data)
     _u64 n_sectors = ROUND_UP(npts_64, nnodes_per_sector) / nnodes_per_sector;
     _u64 n_reorder_sectors = 0;
@@ -688,7 +967,8 @@ namespace diskann {
           ROUND_UP(npts_64, n_data_nodes_per_sector) / n_data_nodes_per_sector;
     }
     _u64 disk_index_file_size =
-        (n_sectors + n_reorder_sectors + 1) * SECTOR_LEN;
+        metadata_only ? SECTOR_LEN
+                      : (n_sectors + n_reorder_sectors + 1) * SECTOR_LEN;
 
     std::vector<_u64> output_file_meta;
     output_file_meta.push_back(npts_64);
@@ -706,99 +986,231 @@ namespace diskann {
     }
     output_file_meta.push_back(disk_index_file_size);
 
-    diskann_writer.write(sector_buf.get(), SECTOR_LEN);
+    if (metadata_only) {
+      std::vector<char> sector_buf(SECTOR_LEN, 0);
+      std::ofstream     writer;
+      writer.exceptions(std::ios::badbit | std::ios::failbit);
+      writer.open(output_file, std::ios::binary | std::ios::trunc);
+      writer.write(sector_buf.data(), SECTOR_LEN);
+      writer.close();
+      diskann::save_bin<_u64>(output_file, output_file_meta.data(),
+                              output_file_meta.size(), 1, 0);
+      diskann::cout << "Output disk index metadata written to " << output_file
+                    << std::endl;
+      return;
+    }
 
-    std::unique_ptr<T[]> cur_node_coords = std::make_unique<T[]>(ndims_64);
-    diskann::cout << "# sectors: " << n_sectors << std::endl;
-    _u64 cur_node_id = 0;
-    for (_u64 sector = 0; sector < n_sectors; sector++) {
-      if (sector % 100000 == 0) {
-        diskann::cout << "Sector #" << sector << "written" << std::endl;
+    auto diskann_writer = std::make_unique<PositionalFile>(output_file, true);
+    diskann_writer->preallocate(disk_index_file_size);
+
+    // two of each buffer: one batch is assembled while the previous one is
+    // written and the next one's lists are read
+    _u64 sectors_per_batch = DISK_LAYOUT_BATCH_BYTES / SECTOR_LEN;
+    _u64 nodes_per_batch = sectors_per_batch * nnodes_per_sector;
+    _u64 n_batches = DIV_ROUND_UP(n_sectors, sectors_per_batch);
+    std::unique_ptr<char, decltype(&aligned_free)> batch_bufs[2] = {
+        {nullptr, aligned_free}, {nullptr, aligned_free}};
+    for (auto &buf : batch_bufs) {
+      char *ptr;
+      alloc_aligned((void **) &ptr, sectors_per_batch * SECTOR_LEN,
+                    SECTOR_LEN);
+      buf.reset(ptr);
+    }
+    std::vector<unsigned> batch_nnbrs[2], batch_nhoods[2];
+
+    // lists of the nodes of batch b into buffer b % 2, truncated to width
+    auto read_lists = [&](_u64 batch) {
+      _u64  first_node = batch * nodes_per_batch;
+      _u64  n_nodes = std::min(nodes_per_batch, npts_64 - first_node);
+      auto &nnbrs = batch_nnbrs[batch % 2];
+      auto &nhoods = batch_nhoods[batch % 2];
+      nnbrs.resize(n_nodes);
+      nhoods.resize(n_nodes * width_u32);
+      std::vector<unsigned> excess;
+      for (_u64 i = 0; i < n_nodes; i++) {
+        unsigned k;
+        vamana_reader.read((char *) &k, sizeof(unsigned));
+        unsigned kept = (std::min)(k, width_u32);
+        if (kept > 0)
+          vamana_reader.read((char *) (nhoods.data() + i * width_u32),
+                             kept * sizeof(unsigned));
+        if (k > width_u32) {
+          excess.resize(k - width_u32);
+          vamana_reader.read((char *) excess.data(),
+                             excess.size() * sizeof(unsigned));
+        }
+        nnbrs[i] = kept;
       }
-      memset(sector_buf.get(), 0, SECTOR_LEN);
-      for (_u64 sector_node_id = 0;
-           sector_node_id < nnodes_per_sector && cur_node_id < npts_64;
-           sector_node_id++) {
-        memset(node_buf.get(), 0, max_node_len);
-        // read cur node's nnbrs
-        vamana_reader.read((char *) &nnbrs, sizeof(unsigned));
-
-        // sanity checks on nnbrs
-        assert(nnbrs > 0);
-        assert(nnbrs <= width_u32);
-
-        // read node's nhood
-        vamana_reader.read((char *) nhood_buf,
-                           (std::min)(nnbrs, width_u32) * sizeof(unsigned));
-        if (nnbrs > width_u32) {
-          vamana_reader.seekg((nnbrs - width_u32) * sizeof(unsigned),
-                              vamana_reader.cur);
+    };
+
+    diskann::cout << "# sectors: " << n_sectors << ", in " << n_batches
+                  << " batches" << std::endl;
+    std::future<void> pending_read, pending_write;
+    if (n_batches > 0)
+      pending_read = std::async(std::launch::async, read_lists, 0);
+    for (_u64 batch = 0; batch < n_batches; batch++) {
+      pending_read.get();
+      if (batch + 1 < n_batches)
+        pending_read = std::async(std::launch::async, read_lists, batch + 1);
+      char *     buf = batch_bufs[batch % 2].get();
+      auto &     nnbrs = batch_nnbrs[batch % 2];
+      auto &     nhoods = batch_nhoods[batch % 2];
+      _u64       first_sector = batch * sectors_per_batch;
+      _u64       n_batch_sectors =
+          std::min(sectors_per_batch, n_sectors - first_sector);
+      _u64 first_node = batch * nodes_per_batch;
+      memset(buf, 0, n_batch_sectors * SECTOR_LEN);
+
+      // buf was last used by batch - 2, whose write has completed
+#pragma omp parallel
+      {
+        std::vector<T> coords;
+#pragma omp for schedule(dynamic, 64)
+        for (_s64 s = 0; s < (_s64) n_batch_sectors; s++) {
+          if (error != nullptr)
+            continue;
+          _u64 sector_first = s * nnodes_per_sector;
+          _u64 n_sector_nodes = std::min(
+              nnodes_per_sector, (_u64) nnbrs.size() - sector_first);
+          coords.resize(n_sector_nodes * ndims_64);
+          try {
+            base_reader.read_at(
+                2 * sizeof(uint32_t) +
+                    (first_node + sector_first) * ndims_64 * sizeof(T),
+                (char *) coords.data(), coords.size() * sizeof(T));
+          } catch (...) {
+            record_error();
+            continue;
+          }
+
+          char *sector_buf = buf + s * SECTOR_LEN;
+          for (_u64 j = 0; j < n_sector_nodes; j++) {
+            // coords, then nnbrs, then the nhood
+            char *node_buf = sector_buf + j * max_node_len;
+            _u64  i = sector_first + j;
+            memcpy(node_buf, coords.data() + j * ndims_64,
+                   ndims_64 * sizeof(T));
+            *(unsigned *) (node_buf + ndims_64 * sizeof(T)) = nnbrs[i];
+            memcpy(node_buf + ndims_64 * sizeof(T) + sizeof(unsigned),
+                   nhoods.data() + i * width_u32, nnbrs[i] * sizeof(unsigned));
+          }
         }
+      }
 
-        // write coords of node first
-        //  T *node_coords = data + ((_u64) ndims_64 * cur_node_id);
-        base_reader.read((char *) cur_node_coords.get(), sizeof(T) * ndims_64);
-        memcpy(node_buf.get(), cur_node_coords.get(), ndims_64 * sizeof(T));
-
-        // write nnbrs
-        *(unsigned *) (node_buf.get() + ndims_64 * sizeof(T)) =
-            (std::min)(nnbrs, width_u32);
-
-        // write nhood next
-        memcpy(node_buf.get() + ndims_64 * sizeof(T) + sizeof(unsigned),
-               nhood_buf, (std::min)(nnbrs, width_u32) * sizeof(unsigned));
-
-        // get offset into sector_buf
-        char *sector_node_buf =
-            sector_buf.get() + (sector_node_id * max_node_len);
-
-        // copy node buf into sector_node_buf
-        memcpy(sector_node_buf, node_buf.get(), max_node_len);
-        cur_node_id++;
+      if (error != nullptr) {
+        // let the threads that use the buffers finish first
+        if (pending_read.valid())
+          pending_read.wait();
+        if (pending_write.valid())
+          pending_write.wait();
+        std::rethrow_exception(error);
       }
-      // flush sector to disk
-      diskann_writer.write(sector_buf.get(), SECTOR_LEN);
+      if (pending_write.valid())
+        pending_write.get();
+      pending_write = std::async(
+          std::launch::async, [&diskann_writer, buf, first_sector,
+                               n_batch_sectors]() {
+            diskann_writer->write_at((first_sector + 1) * SECTOR_LEN, buf,
+                                     n_batch_sectors * SECTOR_LEN);
+          });
+      if (batch % 16 == 0)
+        diskann::cout << "Sector #" << first_sector + n_batch_sectors
+                      << " assembled" << std::endl;
     }
+    if (pending_write.valid())
+      pending_write.get();
+    diskann::cout << "Index sectors written in " << timer.elapsed() / 1000000.0
+                  << "s" << std::endl;
+
     if (append_reorder_data) {
       diskann::cout << "Index written. Appending reorder data..." << std::endl;
-
-      auto                    vec_len = ndims_reorder_file * sizeof(float);
-      std::unique_ptr<char[]> vec_buf = std::make_unique<char[]>(vec_len);
-
-      for (_u64 sector = 0; sector < n_reorder_sectors; sector++) {
-        if (sector % 100000 == 0) {
-          diskann::cout << "Reorder data Sector #" << sector << "written"
-                        << std::endl;
+      timer.reset();
+      PositionalFile reorder_data_reader(reorder_data_file, false);
+
+      auto vec_len = ndims_reorder_file * sizeof(float);
+      // chunks of sectors per task, one buffer per thread
+      _u64 sectors_per_chunk = 1024;
+      _u64 n_chunks = DIV_ROUND_UP(n_reorder_sectors, sectors_per_chunk);
+#pragma omp parallel
+      {
+        char *chunk_buf = nullptr;
+        alloc_aligned((void **) &chunk_buf, sectors_per_chunk * SECTOR_LEN,
+                      SECTOR_LEN);
+        std::vector<char> vecs;
+#pragma omp for schedule(dynamic, 1)
+        for (_s64 c = 0; c < (_s64) n_chunks; c++) {
+          if (error != nullptr)
+            continue;
+          _u64 first_sector = c * sectors_per_chunk;
+          _u64 n_chunk_sectors =
+              std::min(sectors_per_chunk, n_reorder_sectors - first_sector);
+          _u64 first_vec = first_sector * n_data_nodes_per_sector;
+          _u64 n_vecs = std::min(n_chunk_sectors * n_data_nodes_per_sector,
+                                 npts_64 - first_vec);
+          vecs.resize(n_vecs * vec_len);
+          try {
+            reorder_data_reader.read_at(
+                2 * sizeof(uint32_t) + first_vec * vec_len, vecs.data(),
+                vecs.size());
+
+            memset(chunk_buf, 0, n_chunk_sectors * SECTOR_LEN);
+            for (_u64 v = 0; v < n_vecs; v++)
+              memcpy(chunk_buf + (v / n_data_nodes_per_sector) * SECTOR_LEN +
+                         (v % n_data_nodes_per_sector) * vec_len,
+                     vecs.data() + v * vec_len, vec_len);
+            diskann_writer->write_at(
+                (n_sectors + 1 + first_sector) * SECTOR_LEN, chunk_buf,
+                n_chunk_sectors * SECTOR_LEN);
+          } catch (...) {
+            record_error();
+          }
         }
-
-        memset(sector_buf.get(), 0, SECTOR_LEN);
-
-        for (_u64 sector_node_id = 0;
-             sector_node_id < n_data_nodes_per_sector &&
-             sector_node_id < npts_64;
-             sector_node_id++) {
-          memset(vec_buf.get(), 0, vec_len);
-          reorder_data_reader.read(vec_buf.get(), vec_len);
-
-          // copy node buf into sector_node_buf
-          memcpy(sector_buf.get() + (sector_node_id * vec_len), vec_buf.get(),
-                 vec_len);
-        }
-        // flush sector to disk
-        diskann_writer.write(sector_buf.get(), SECTOR_LEN);
+        aligned_free(chunk_buf);
       }
+      if (error != nullptr)
+        std::rethrow_exception(error);
+      diskann::cout << "Reorder data written in "
+                    << timer.elapsed() / 1000000.0 << "s" << std::endl;
     }
-    diskann_writer.close();
+    diskann_writer.reset();
+
     diskann::save_bin<_u64>(output_file, output_file_meta.data(),
                             output_file_meta.size(), 1, 0);
     diskann::cout << "Output disk index file written to " << output_file
                   << std::endl;
   }
 
+  template<typename T>
+  int build_pq_vamana_index(const std::string &base_file,
+                            const std::string &pq_pivots_path,
+                            const std::string &pq_compressed_path, unsigned L,
+                            unsigned R, const std::string &mem_index_path) {
+    diskann::Timer timer;
+    diskann::PQVamanaBuilder<T> builder(base_file, pq_pivots_path,
+                                        pq_compressed_path);
+    builder.build(L, R, 750, 1.2f, 0);
+    builder.save(mem_index_path);
+
+    diskann::cout << "PQ-navigated Vamana index built in "
+                  << timer.elapsed() / 1000000.0 << "s, resident index memory "
+                  << builder.memory_bytes() / (1024.0 * 1024 * 1024) << "GiB";
+#ifndef _WINDOWS
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+      diskann::cout << ", peak RSS " << usage.ru_maxrss / (1024.0 * 1024)
+                    << "GiB";
+#endif
+    diskann::cout << std::endl;
+    return 0;
+  }
+
   template<typename T>
   int build_disk_index(const char *dataFilePath, const char *indexFilePath,
                        const char *    indexBuildParameters,
-                       diskann::Metric compareMetric, bool use_opq) {
+                       diskann::Metric compareMetric, bool use_opq,
+                       unsigned num_rnds, std::string visit_order,
+                       bool build_with_pq, std::string tensors_prefix,
+                       bool resume) {
     std::stringstream parser;
     parser << std::string(indexBuildParameters);
     std::string              cur_param;
@@ -869,21 +1281,63 @@ namespace diskann {
     std::string disk_pq_compressed_vectors_path =
         index_prefix_path + "_disk.index_pq_compressed.bin";
 
+    std::string manifest_path = index_prefix_path + "_build_manifest.txt";
+
+    // Everything the build output depends on (not the number of threads): a
+    // build is only resumed from a manifest written with the same config.
+    std::stringstream config;
+    config << base_file << " " << get_file_size(base_file) << " "
+           << sizeof(T) << " " << (int) compareMetric << " " << use_opq << " "
+           << num_rnds << " " << visit_order << " " << build_with_pq << " "
+           << tensors_prefix;
+    for (size_t i = 0; i < param_list.size(); i++)
+      if (i != 4)
+        config << " " << param_list[i];
+    BuildManifest manifest(manifest_path, config.str(), resume);
+
+    // intermediate files, removed once the index is complete
+    auto cleanup = [&]() {
+      std::remove(mem_index_path.c_str());
+      if (use_disk_pq)
+        std::remove(disk_pq_compressed_vectors_path.c_str());
+    };
+    if (manifest.is_complete("done")) {
+      diskann::cout << "Index " << index_prefix_path
+                    << " was already built completely" << std::endl;
+      cleanup();
+      return 0;
+    }
+
+    // The first stage that is not recorded complete with intact artifacts is
+    // redone, and so is every stage after it.
+    bool redo = false;
+    auto skip_stage = [&](const std::string &stage) {
+      redo = redo || !manifest.is_complete(stage);
+      if (!redo)
+        diskann::cout << "Resuming after completed stage " << stage
+                      << std::endl;
+      return !redo;
+    };
+
     // output a new base file which contains extra dimension with sqrt(1 -
     // ||x||^2/M^2) for every x, M is max norm of all points. Extra space on
     // disk needed!
     if (compareMetric == diskann::Metric::INNER_PRODUCT) {
-      std::cout << "Using Inner Product search, so need to pre-process base "
-                   "data into temp file. Please ensure there is additional "
-                   "(n*(d+1)*4) bytes for storing pre-processed base vectors, "
-                   "apart from the intermin indices and final index."
-                << std::endl;
       std::string prepped_base = index_prefix_path + "_prepped_base.bin";
       data_file_to_use = prepped_base;
-      float max_norm_of_base =
-          diskann::prepare_base_for_inner_products<T>(base_file, prepped_base);
-      std::string norm_file = disk_index_path + "_max_base_norm.bin";
-      diskann::save_bin<float>(norm_file, &max_norm_of_base, 1, 1);
+      if (!skip_stage("prep_base")) {
+        std::cout
+            << "Using Inner Product search, so need to pre-process base "
+               "data into temp file. Please ensure there is additional "
+               "(n*(d+1)*4) bytes for storing pre-processed base vectors, "
+               "apart from the intermin indices and final index."
+            << std::endl;
+        float max_norm_of_base = diskann::prepare_base_for_inner_products<T>(
+            base_file, prepped_base);
+        std::string norm_file = disk_index_path + "_max_base_norm.bin";
+        diskann::save_bin<float>(norm_file, &max_norm_of_base, 1, 1);
+        manifest.mark_complete("prep_base", {prepped_base, norm_file});
+      }
     }
 
     unsigned R = (unsigned) atoi(param_list[0].c_str());
@@ -922,10 +1376,12 @@ namespace diskann {
     const double p_val =
         ((double) MAX_PQ_TRAINING_SET_SIZE / (double) points_num);
 
-    if (use_disk_pq) {
+    if (use_disk_pq && !skip_stage("disk_pq")) {
       generate_disk_quantized_data<T>(data_file_to_use, disk_pq_pivots_path,
                                       disk_pq_compressed_vectors_path,
                                       compareMetric, p_val, disk_pq_dims);
+      manifest.mark_complete(
+          "disk_pq", {disk_pq_pivots_path, disk_pq_compressed_vectors_path});
     }
     size_t num_pq_chunks =
         (size_t)(std::floor)(_u64(final_index_ram_limit / points_num));
@@ -938,9 +1394,16 @@ namespace diskann {
     diskann::cout << "Compressing " << dim << "-dimensional data into "
                   << num_pq_chunks << " bytes per vector." << std::endl;
 
-    generate_quantized_data<T>(data_file_to_use, pq_pivots_path,
-                               pq_compressed_vectors_path, compareMetric, p_val,
-                               num_pq_chunks, use_opq);
+    if (!skip_stage("pq")) {
+      generate_quantized_data<T>(data_file_to_use, pq_pivots_path,
+                                 pq_compressed_vectors_path, compareMetric,
+                                 p_val, num_pq_chunks, use_opq);
+      std::vector<std::string> pq_files{pq_pivots_path,
+                                        pq_compressed_vectors_path};
+      if (use_opq)
+        pq_files.push_back(pq_pivots_path + "_rotation_matrix.bin");
+      manifest.mark_complete("pq", pq_files);
+    }
 
 // Gopal. Splitting diskann_dll into separate DLLs for search and build.
 // This code should only be available in the "build" DLL.
@@ -949,34 +1412,93 @@ namespace diskann {
     MallocExtension::instance()->ReleaseFreeMemory();
 #endif
 
-    diskann::build_merged_vamana_index<T>(
-        data_file_to_use.c_str(), diskann::Metric::L2, L, R, p_val,
-        indexing_ram_budget, mem_index_path, medoids_path, centroids_path);
+    if (!skip_stage("vamana")) {
+      if (build_with_pq) {
+        if (num_rnds != 1)
+          diskann::cout << "WARNING: num_rnds is ignored by the PQ-navigated "
+                           "build, which makes a single pass"
+                        << std::endl;
+        diskann::build_pq_vamana_index<T>(data_file_to_use, pq_pivots_path,
+                                          pq_compressed_vectors_path, L, R,
+                                          mem_index_path);
+      } else {
+        diskann::build_merged_vamana_index<T>(
+            data_file_to_use.c_str(), diskann::Metric::L2, L, R, p_val,
+            indexing_ram_budget, mem_index_path, medoids_path, centroids_path,
+            num_rnds, visit_order, &manifest);
+      }
+      std::vector<std::string> vamana_files{mem_index_path};
+      for (auto &path : {medoids_path, centroids_path})
+        if (file_exists(path))
+          vamana_files.push_back(path);
+      manifest.mark_complete("vamana", vamana_files);
+    }
 
-    if (!use_disk_pq) {
-      diskann::create_disk_layout<T>(data_file_to_use.c_str(), mem_index_path,
-                                     disk_index_path);
-    } else {
-      if (!reorder_data)
-        diskann::create_disk_layout<_u8>(disk_pq_compressed_vectors_path,
-                                         mem_index_path, disk_index_path);
+    std::string reorder_data_file = reorder_data ? data_file_to_use : "";
+    bool        write_tensors = !tensors_prefix.empty();
+    if (write_tensors && !skip_stage("tensors")) {
+#ifndef _WINDOWS
+      if (!use_disk_pq)
+        write_disk_index_tensors<T>(data_file_to_use, mem_index_path,
+                                    tensors_prefix);
       else
+        write_disk_index_tensors<_u8>(disk_pq_compressed_vectors_path,
+                                      mem_index_path, tensors_prefix,
+                                      reorder_data_file);
+#else
+      throw diskann::ANNException(
+          "Writing TensorStore tensors is not supported on Windows", -1,
+          __FUNCSIG__, __FILE__, __LINE__);
+#endif
+      // the zarr directories are written through the local file driver
+      std::vector<std::string> tensor_dirs;
+      for (auto suffix :
+           {"_embedding.zarr", "_num_nbrs.zarr", "_nbrhood.zarr"})
+        tensor_dirs.push_back(tensors_prefix + suffix);
+      if (use_disk_pq && !reorder_data_file.empty())
+        tensor_dirs.push_back(tensors_prefix + "_reorder.zarr");
+      manifest.mark_complete("tensors", tensor_dirs);
+    }
+
+    // with tensors, the disk index only holds the metadata sector
+    if (!skip_stage("disk_layout")) {
+      if (!use_disk_pq) {
+        diskann::create_disk_layout<T>(data_file_to_use.c_str(),
+                                       mem_index_path, disk_index_path, "",
+                                       write_tensors);
+      } else {
         diskann::create_disk_layout<_u8>(disk_pq_compressed_vectors_path,
                                          mem_index_path, disk_index_path,
-                                         data_file_to_use.c_str());
+                                         reorder_data_file, write_tensors);
+      }
+      manifest.mark_complete("disk_layout", {disk_index_path});
     }
 
-    double ten_percent_points = std::ceil(points_num * 0.1);
-    double num_sample_points = ten_percent_points > MAX_SAMPLE_POINTS_FOR_WARMUP
-                                   ? MAX_SAMPLE_POINTS_FOR_WARMUP
-                                   : ten_percent_points;
-    double sample_sampling_rate = num_sample_points / points_num;
-    gen_random_slice<T>(data_file_to_use.c_str(), sample_base_prefix,
-                        sample_sampling_rate);
+    if (!skip_stage("sample")) {
+      double ten_percent_points = std::ceil(points_num * 0.1);
+      double num_sample_points =
+          ten_percent_points > MAX_SAMPLE_POINTS_FOR_WARMUP
+              ? MAX_SAMPLE_POINTS_FOR_WARMUP
+              : ten_percent_points;
+      double sample_sampling_rate = num_sample_points / points_num;
+      gen_random_slice<T>(data_file_to_use.c_str(), sample_base_prefix,
+                          sample_sampling_rate);
+      manifest.mark_complete("sample", {sample_base_prefix + "_data.bin",
+                                        sample_base_prefix + "_ids.bin"});
+    }
 
-    std::remove(mem_index_path.c_str());
+    // recorded before the intermediate files go, which a resume would
+    // otherwise miss; the artifacts are what a search loads, so a resume
+    // notices when the finished index itself went missing
+    std::vector<std::string> index_files{
+        disk_index_path, pq_pivots_path, pq_compressed_vectors_path,
+        sample_base_prefix + "_data.bin", sample_base_prefix + "_ids.bin"};
+    if (use_opq)
+      index_files.push_back(pq_pivots_path + "_rotation_matrix.bin");
     if (use_disk_pq)
-      std::remove(disk_pq_compressed_vectors_path.c_str());
+      index_files.push_back(disk_pq_pivots_path);
+    manifest.mark_complete("done", index_files);
+    cleanup();
 
     auto                          e = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> diff = e - s;
@@ -987,13 +1509,20 @@ namespace diskann {
 
   template DISKANN_DLLEXPORT void create_disk_layout<int8_t>(
       const std::string base_file, const std::string mem_index_file,
-      const std::string output_file, const std::string reorder_data_file);
+      const std::string output_file, const std::string reorder_data_file,
+      bool metadata_only);
   template DISKANN_DLLEXPORT void create_disk_layout<uint8_t>(
       const std::string base_file, const std::string mem_index_file,
-      const std::string output_file, const std::string reorder_data_file);
+      const std::string output_file, const std::string reorder_data_file,
+      bool metadata_only);
   template DISKANN_DLLEXPORT void create_disk_layout<float>(
       const std::string base_file, const std::string mem_index_file,
-      const std::string output_file, const std::string reorder_data_file);
+      const std::string output_file, const std::string reorder_data_file,
+      bool metadata_only);
+  template DISKANN_DLLEXPORT void create_disk_layout<float16>(
+      const std::string base_file, const std::string mem_index_file,
+      const std::string output_file, const std::string reorder_data_file,
+      bool metadata_only);
 
   template DISKANN_DLLEXPORT int8_t *load_warmup<int8_t>(
       const std::string &cache_warmup_file, uint64_t &warmup_num,
@@ -1004,6 +1533,9 @@ namespace diskann {
   template DISKANN_DLLEXPORT float *load_warmup<float>(
       const std::string &cache_warmup_file, uint64_t &warmup_num,
       uint64_t warmup_dim, uint64_t warmup_aligned_dim);
+  template DISKANN_DLLEXPORT float16 *load_warmup<float16>(
+      const std::string &cache_warmup_file, uint64_t &warmup_num,
+      uint64_t warmup_dim, uint64_t warmup_aligned_dim);
 
 #ifdef EXEC_ENV_OLS
   template DISKANN_DLLEXPORT int8_t *load_warmup<int8_t>(
@@ -1015,6 +1547,9 @@ namespace diskann {
   template DISKANN_DLLEXPORT float *load_warmup<float>(
       MemoryMappedFiles &files, const std::string &cache_warmup_file,
       uint64_t &warmup_num, uint64_t warmup_dim, uint64_t warmup_aligned_dim);
+  template DISKANN_DLLEXPORT float16 *load_warmup<float16>(
+      MemoryMappedFiles &files, const std::string &cache_warmup_file,
+      uint64_t &warmup_num, uint64_t warmup_dim, uint64_t warmup_aligned_dim);
 #endif
 
   template DISKANN_DLLEXPORT uint32_t optimize_beamwidth<int8_t>(
@@ -1032,33 +1567,71 @@ namespace diskann {
       float *tuning_sample, _u64 tuning_sample_num,
       _u64 tuning_sample_aligned_dim, uint32_t L, uint32_t nthreads,
       uint32_t start_bw);
+  template DISKANN_DLLEXPORT uint32_t optimize_beamwidth<float16>(
+      std::unique_ptr<diskann::PQFlashIndex<float16>> &pFlashIndex,
+      float16 *tuning_sample, _u64 tuning_sample_num,
+      _u64 tuning_sample_aligned_dim, uint32_t L, uint32_t nthreads,
+      uint32_t start_bw);
 
   template DISKANN_DLLEXPORT int build_disk_index<int8_t>(
       const char *dataFilePath, const char *indexFilePath,
       const char *indexBuildParameters, diskann::Metric compareMetric,
-      bool use_opq);
+      bool use_opq, unsigned num_rnds, std::string visit_order,
+      bool build_with_pq, std::string tensors_prefix, bool resume);
   template DISKANN_DLLEXPORT int build_disk_index<uint8_t>(
       const char *dataFilePath, const char *indexFilePath,
       const char *indexBuildParameters, diskann::Metric compareMetric,
-      bool use_opq);
+      bool use_opq, unsigned num_rnds, std::string visit_order,
+      bool build_with_pq, std::string tensors_prefix, bool resume);
   template DISKANN_DLLEXPORT int build_disk_index<float>(
       const char *dataFilePath, const char *indexFilePath,
       const char *indexBuildParameters, diskann::Metric compareMetric,
-      bool use_opq);
-
+      bool use_opq, unsigned num_rnds, std::string visit_order,
+      bool build_with_pq, std::string tensors_prefix, bool resume);
+  template DISKANN_DLLEXPORT int build_disk_index<float16>(
+      const char *dataFilePath, const char *indexFilePath,
+      const char *indexBuildParameters, diskann::Metric compareMetric,
+      bool use_opq, unsigned num_rnds, std::string visit_order,
+      bool build_with_pq, std::string tensors_prefix, bool resume);
+
+  template DISKANN_DLLEXPORT int build_pq_vamana_index<int8_t>(
+      const std::string &base_file, const std::string &pq_pivots_path,
+      const std::string &pq_compressed_path, unsigned L, unsigned R,
+      const std::string &mem_index_path);
+  template DISKANN_DLLEXPORT int build_pq_vamana_index<float>(
+      const std::string &base_file, const std::string &pq_pivots_path,
+      const std::string &pq_compressed_path, unsigned L, unsigned R,
+      const std::string &mem_index_path);
+  template DISKANN_DLLEXPORT int build_pq_vamana_index<uint8_t>(
+      const std::string &base_file, const std::string &pq_pivots_path,
+      const std::string &pq_compressed_path, unsigned L, unsigned R,
+      const std::string &mem_index_path);
+  template DISKANN_DLLEXPORT int build_pq_vamana_index<float16>(
+      const std::string &base_file, const std::string &pq_pivots_path,
+      const std::string &pq_compressed_path, unsigned L, unsigned R,
+      const std::string &mem_index_path);
   template DISKANN_DLLEXPORT int build_merged_vamana_index<int8_t>(
       std::string base_file, diskann::Metric compareMetric, unsigned L,
       unsigned R, double sampling_rate, double ram_budget,
       std::string mem_index_path, std::string medoids_path,
-      std::string centroids_file);
+      std::string centroids_file, unsigned num_rnds, std::string visit_order,
+      BuildManifest *manifest);
   template DISKANN_DLLEXPORT int build_merged_vamana_index<float>(
       std::string base_file, diskann::Metric compareMetric, unsigned L,
       unsigned R, double sampling_rate, double ram_budget,
       std::string mem_index_path, std::string medoids_path,
-      std::string centroids_file);
+      std::string centroids_file, unsigned num_rnds, std::string visit_order,
+      BuildManifest *manifest);
   template DISKANN_DLLEXPORT int build_merged_vamana_index<uint8_t>(
       std::string base_file, diskann::Metric compareMetric, unsigned L,
       unsigned R, double sampling_rate, double ram_budget,
       std::string mem_index_path, std::string medoids_path,
-      std::string centroids_file);
+      std::string centroids_file, unsigned num_rnds, std::string visit_order,
+      BuildManifest *manifest);
+  template DISKANN_DLLEXPORT int build_merged_vamana_index<float16>(
+      std::string base_file, diskann::Metric compareMetric, unsigned L,
+      unsigned R, double sampling_rate, double ram_budget,
+      std::string mem_index_path, std::string medoids_path,
+      std::string centroids_file, unsigned num_rnds, std::string visit_order,
+      BuildManifest *manifest);
 };  // namespace diskann
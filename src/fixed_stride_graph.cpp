@@ -0,0 +1,26 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <cstring>
+
+#include "fixed_stride_graph.h"
+
+namespace diskann {
+  void FixedStrideGraph::reserve_degree(unsigned max_degree) {
+    size_t stride = (size_t) max_degree + 1;
+    if (stride <= _rows.row_size())
+      return;
+
+    SegmentedRows<unsigned> rows;
+    rows.set_row_size(stride);
+    rows.set_huge_pages(_rows.huge_pages());
+    rows.swap(_rows);
+    _rows.set_row_size(stride);
+    _rows.resize(rows.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+      unsigned *old_slots = rows[i];
+      std::memcpy(_rows[i], old_slots,
+                  ((size_t) old_slots[0] + 1) * sizeof(unsigned));
+    }
+  }
+}  // namespace diskann
@@ -0,0 +1,851 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <omp.h>
+
+#include "tsl/robin_set.h"
+
+#include "cached_io.h"
+#include "disk_utils.h"
+#include "hybrid_index.h"
+#include "logger.h"
+#include "math_utils.h"
+#include "timer.h"
+
+#ifdef _WINDOWS
+#include "windows_aligned_file_reader.h"
+#else
+#include "linux_aligned_file_reader.h"
+#endif
+
+namespace {
+  // files of a generation that each merge writes, and that it carries over
+  const char *MERGED_SUFFIXES[] = {"_pq_compressed.bin", "_disk.index",
+                                   "_disk.index_tags.bin",
+                                   "_disk.index_tombstones.bin"};
+  const char *CARRIED_SUFFIXES[] = {
+      "_pq_pivots.bin", "_pq_pivots.bin_rotation_matrix.bin",
+      "_disk.index_medoids.bin", "_disk.index_centroids.bin"};
+
+  std::vector<std::string> generation_files(const std::string &prefix) {
+    std::vector<std::string> files;
+    for (auto suffix : MERGED_SUFFIXES)
+      files.push_back(prefix + suffix);
+    for (auto suffix : CARRIED_SUFFIXES)
+      files.push_back(prefix + suffix);
+    return files;
+  }
+
+  void copy_file(const std::string &from, const std::string &to) {
+    std::ifstream reader;
+    reader.exceptions(std::ios::badbit | std::ios::failbit);
+    reader.open(from, std::ios::binary);
+    std::ofstream writer;
+    writer.exceptions(std::ios::badbit | std::ios::failbit);
+    writer.open(to, std::ios::binary | std::ios::trunc);
+    writer << reader.rdbuf();
+  }
+}  // namespace
+
+namespace diskann {
+  template<typename T>
+  HybridIndex<T>::HybridIndex(const std::string &index_prefix,
+                              uint32_t num_threads,
+                              const Parameters &delta_parameters,
+                              size_t delta_capacity, _u64 num_nodes_to_cache)
+      : _index_prefix(index_prefix),
+        _generation_file(index_prefix + "_generation.txt"),
+        _num_threads(num_threads), _delta_capacity(delta_capacity),
+        _num_nodes_to_cache(num_nodes_to_cache) {
+    _delta_L = delta_parameters.Get<unsigned>("L");
+    _delta_R = delta_parameters.Get<unsigned>("R");
+    _delta_C = delta_parameters.Get<unsigned>("C");
+    _delta_alpha = delta_parameters.Get<float>("alpha");
+    _delta_num_threads = delta_parameters.Get<unsigned>("num_threads", 0);
+    if (_delta_num_threads == 0)
+      _delta_num_threads = num_threads;
+
+    _u64 generation = 0;
+    if (file_exists(_generation_file)) {
+      std::ifstream reader(_generation_file);
+      if (!(reader >> generation))
+        throw ANNException("Failed to read " + _generation_file, -1,
+                           __FUNCSIG__, __FILE__, __LINE__);
+    }
+    read_disk_metadata(generation_prefix(generation));
+    _disk = open_disk_generation(generation);
+    _active_delta = new_delta();
+  }
+
+  template<typename T>
+  HybridIndex<T>::~HybridIndex() {
+    stop_background_merge();
+  }
+
+  template<typename T>
+  std::string HybridIndex<T>::generation_prefix(_u64 number) const {
+    return number == 0 ? _index_prefix
+                       : _index_prefix + "_gen" + std::to_string(number);
+  }
+
+  template<typename T>
+  void HybridIndex<T>::read_disk_metadata(const std::string &prefix) {
+    std::string disk_index_file = prefix + "_disk.index";
+    _u64        file_size = get_file_size(disk_index_file);
+    {
+      std::ifstream reader;
+      reader.exceptions(std::ios::badbit | std::ios::failbit);
+      reader.open(disk_index_file, std::ios::binary);
+      _u32 nr, nc;
+      reader.read((char *) &nr, sizeof(_u32));
+      reader.read((char *) &nc, sizeof(_u32));
+      _disk_metadata.resize(nr);
+      reader.read((char *) _disk_metadata.data(), nr * sizeof(_u64));
+
+      _dim = _disk_metadata[1];
+      _max_node_len = _disk_metadata[3];
+      _nnodes_per_sector = _disk_metadata[4];
+      _max_degree = (_max_node_len - _dim * sizeof(T)) / sizeof(unsigned) - 1;
+
+      // the medoid starts the delta indexes, so that they are searched from
+      // the same region of the space as the disk index
+      _u64 medoid = _disk_metadata[2];
+      _start_vector.assign(ROUND_UP(_dim, 8), 0);
+      reader.seekg((medoid / _nnodes_per_sector + 1) * SECTOR_LEN +
+                   (medoid % _nnodes_per_sector) * _max_node_len);
+      reader.read((char *) _start_vector.data(), _dim * sizeof(T));
+    }
+
+    if (_disk_metadata[7] != 0 || file_size != _disk_metadata.back() ||
+        file_exists(disk_index_file + "_pq_pivots.bin")) {
+      std::stringstream stream;
+      stream << "Disk index " << disk_index_file
+             << " has reorder data, PQ on disk or its points in tensors; such "
+                "indexes can not be merged into";
+      throw ANNException(stream.str(), -1, __FUNCSIG__, __FILE__, __LINE__);
+    }
+
+    std::string medoids_file = disk_index_file + "_medoids.bin";
+    if (file_exists(medoids_file)) {
+      std::unique_ptr<_u32[]> medoids;
+      size_t                  num_medoids, dim;
+      diskann::load_bin<_u32>(medoids_file, medoids, num_medoids, dim);
+      _nav_points.assign(medoids.get(), medoids.get() + num_medoids);
+    } else {
+      _nav_points.push_back((_u32) _disk_metadata[2]);
+    }
+    if (_disk_metadata[5] == 1)
+      _nav_points.push_back((_u32) _disk_metadata[6]);
+
+    size_t npts, nchunks;
+    get_bin_metadata(prefix + "_pq_compressed.bin", npts, nchunks);
+    _num_pq_chunks = nchunks;
+    _pq_table.load_pq_centroid_bin((prefix + "_pq_pivots.bin").c_str(),
+                                   nchunks);
+  }
+
+  template<typename T>
+  std::unique_ptr<typename HybridIndex<T>::DiskGeneration>
+  HybridIndex<T>::open_disk_generation(_u64 number) {
+    std::unique_ptr<DiskGeneration> disk(new DiskGeneration());
+    disk->number = number;
+    disk->prefix = generation_prefix(number);
+#ifdef _WINDOWS
+    disk->reader.reset(new WindowsAlignedFileReader());
+#else
+    disk->reader.reset(new LinuxAlignedFileReader());
+#endif
+    disk->index.reset(
+        new PQFlashIndex<T>(disk->reader, disk->tensor_reader, diskann::L2));
+    if (disk->index->load(_num_threads, disk->prefix.c_str(), "") != 0)
+      throw ANNException("Failed to load disk index " + disk->prefix, -1,
+                         __FUNCSIG__, __FILE__, __LINE__);
+    disk->num_points = disk->index->get_num_points();
+
+    // the frozen point only navigates
+    if (_disk_metadata[5] == 1)
+      disk->index->delete_point((_u32) _disk_metadata[6]);
+
+    std::string tags_file = disk->prefix + "_disk.index_tags.bin";
+    if (file_exists(tags_file)) {
+      std::unique_ptr<_u32[]> tags;
+      size_t                  num_tags, dim;
+      diskann::load_bin<_u32>(tags_file, tags, num_tags, dim);
+      if (num_tags != disk->num_points)
+        throw ANNException("Tags file " + tags_file +
+                               " does not match the disk index",
+                           -1, __FUNCSIG__, __FILE__, __LINE__);
+      disk->tags.assign(tags.get(), tags.get() + num_tags);
+    } else {
+      disk->tags.resize(disk->num_points);
+      for (_u64 id = 0; id < disk->num_points; id++)
+        disk->tags[id] = (_u32) id;
+    }
+    // a deleted slot may still hold the tag of a point updated since
+    disk->tag_to_id.reserve(disk->num_points);
+    for (_u64 id = 0; id < disk->num_points; id++)
+      if (!disk->index->is_deleted(id))
+        disk->tag_to_id[disk->tags[id]] = (_u32) id;
+
+    if (_num_nodes_to_cache > 0) {
+      std::vector<uint32_t> node_list;
+      disk->index->cache_bfs_levels(_num_nodes_to_cache, node_list);
+      disk->index->load_cache_list(node_list);
+    }
+    return disk;
+  }
+
+  template<typename T>
+  std::unique_ptr<Index<T, _u32>> HybridIndex<T>::new_delta() {
+    Parameters params;
+    params.Set<unsigned>("L", _delta_L);
+    params.Set<unsigned>("R", _delta_R);
+    params.Set<unsigned>("C", _delta_C);
+    params.Set<float>("alpha", _delta_alpha);
+    params.Set<bool>("saturate_graph", false);
+    params.Set<unsigned>("num_threads", _delta_num_threads);
+    Parameters search_params;
+    search_params.Set<unsigned>("L", _delta_L);
+    search_params.Set<unsigned>("num_threads", _delta_num_threads);
+
+    std::unique_ptr<Index<T, _u32>> delta(
+        new Index<T, _u32>(diskann::L2, _dim, _delta_capacity, true, params,
+                           search_params, true, true));
+    delta->set_start_point(_start_vector.data());
+    delta->enable_delete();
+    return delta;
+  }
+
+  template<typename T>
+  bool HybridIndex<T>::delete_older_copies(const _u32 tag, bool with_active) {
+    bool found = false;
+    if (with_active && _active_delta->lazy_delete(tag) == 0)
+      found = true;
+    if (_merging_delta != nullptr && _merging_delta->lazy_delete(tag) == 0)
+      found = true;
+    auto iter = _disk->tag_to_id.find(tag);
+    if (iter != _disk->tag_to_id.end() &&
+        _disk->index->delete_point(iter->second) == 0)
+      found = true;
+
+    // the running merge may have read the copy before it was deleted
+    std::lock_guard<std::mutex> guard(_pending_lock);
+    if (_merge_running)
+      _pending_deletes.push_back(tag);
+    return found;
+  }
+
+  template<typename T>
+  int HybridIndex<T>::insert_point(const T *point, const _u32 tag) {
+    std::shared_lock<std::shared_timed_mutex> sl(_switch_lock);
+    if (_active_delta->insert_point(point, tag) != 0)
+      return -1;
+    delete_older_copies(tag, false);
+    return 0;
+  }
+
+  template<typename T>
+  int HybridIndex<T>::lazy_delete(const _u32 tag) {
+    std::shared_lock<std::shared_timed_mutex> sl(_switch_lock);
+    return delete_older_copies(tag, true) ? 0 : -1;
+  }
+
+  template<typename T>
+  size_t HybridIndex<T>::search(const T *query, const size_t K,
+                                const unsigned L, const unsigned beam_width,
+                                _u32 *tags, float *distances) {
+    std::shared_lock<std::shared_timed_mutex> sl(_switch_lock);
+
+    // results of the disk index and the deltas, as Neighbors holding tags
+    std::vector<_u64>     ids(K);
+    std::vector<float>    dists(K);
+    std::vector<Neighbor> results;
+    _disk->index->cached_beam_search(query, K, (std::max)((_u64) L, (_u64) K),
+                                     ids.data(), dists.data(), beam_width);
+    for (size_t i = 0; i < K; i++)
+      if (ids[i] < _disk->num_points)
+        results.emplace_back(_disk->tags[ids[i]], dists[i], true);
+
+    std::vector<_u32>  delta_tags(K);
+    std::vector<float> delta_dists(K);
+    std::vector<T *>   res_vectors;
+    for (auto delta : {_active_delta.get(), _merging_delta.get()}) {
+      if (delta == nullptr || delta->get_num_points() == 0)
+        continue;
+      size_t n = delta->search_with_tags(query, K, L, delta_tags.data(),
+                                         delta_dists.data(), res_vectors);
+      for (size_t i = 0; i < n; i++)
+        results.emplace_back(delta_tags[i], delta_dists[i], true);
+    }
+    std::sort(results.begin(), results.end());
+
+    // an update may briefly leave a tag in two places
+    tsl::robin_set<_u32> seen;
+    size_t               pos = 0;
+    for (auto &result : results) {
+      if (pos == K)
+        break;
+      if (!seen.insert(result.id).second)
+        continue;
+      tags[pos] = result.id;
+      if (distances != nullptr)
+        distances[pos] = result.distance;
+      pos++;
+    }
+    return pos;
+  }
+
+  template<typename T>
+  void HybridIndex<T>::to_pq_query(const T *point, float *out) {
+    for (_u64 d = 0; d < _dim; d++)
+      out[d] = (float) point[d];
+    _pq_table.preprocess_query(out);
+  }
+
+  template<typename T>
+  void HybridIndex<T>::prune(std::vector<Candidate> &cands, const unsigned C,
+                             const float alpha, std::vector<_u32> &pruned) {
+    std::sort(cands.begin(), cands.end(),
+              [](const Candidate &left, const Candidate &right) {
+                return left.distance < right.distance ||
+                       (left.distance == right.distance &&
+                        left.id < right.id);
+              });
+    cands.erase(std::unique(cands.begin(), cands.end(),
+                            [](const Candidate &left, const Candidate &right) {
+                              return left.id == right.id;
+                            }),
+                cands.end());
+    if (cands.size() > C)
+      cands.resize(C);
+
+    std::vector<float> inflated(cands.size() * _dim);
+    for (size_t i = 0; i < cands.size(); i++)
+      _pq_table.inflate_vector((_u8 *) cands[i].code,
+                               inflated.data() + i * _dim);
+
+    std::vector<float> occlude_factor(cands.size(), 0);
+    pruned.clear();
+    float cur_alpha = 1;
+    while (cur_alpha <= alpha && pruned.size() < _max_degree) {
+      for (size_t i = 0; pruned.size() < _max_degree && i < cands.size();
+           i++) {
+        if (occlude_factor[i] > cur_alpha)
+          continue;
+        occlude_factor[i] = std::numeric_limits<float>::max();
+        pruned.push_back(cands[i].id);
+        for (size_t t = i + 1; t < cands.size(); t++) {
+          if (occlude_factor[t] > alpha)
+            continue;
+          float djk = math_utils::calc_distance(inflated.data() + i * _dim,
+                                                inflated.data() + t * _dim,
+                                                _dim);
+          if (djk == 0.0)
+            occlude_factor[t] = std::numeric_limits<float>::max();
+          else
+            occlude_factor[t] =
+                (std::max)(occlude_factor[t], cands[t].distance / djk);
+        }
+      }
+      cur_alpha *= 1.2f;
+    }
+  }
+
+  template<typename T>
+  void HybridIndex<T>::merge(const Parameters &parameters) {
+    const unsigned L = parameters.Get<unsigned>("L", 100);
+    const unsigned C = parameters.Get<unsigned>("C", 500);
+    const float    alpha = parameters.Get<float>("alpha", 1.2f);
+    const unsigned beam_width = parameters.Get<unsigned>("beam_width", 4);
+    unsigned       num_threads = parameters.Get<unsigned>("num_threads", 0);
+    if (num_threads == 0)
+      num_threads = omp_get_num_procs();
+
+    std::lock_guard<std::mutex> merge_guard(_merge_lock);
+    diskann::Timer              timer;
+
+    // Set the delta aside; inserts go to a fresh one from now on. A delta
+    // left aside by a failed merge is merged first.
+    DiskGeneration *disk;
+    {
+      auto fresh_delta = _merging_delta == nullptr ? new_delta() : nullptr;
+      std::unique_lock<std::shared_timed_mutex> sl(_switch_lock);
+      if (fresh_delta != nullptr) {
+        if (_active_delta->get_num_points() == 0 &&
+            _disk->index->get_num_deleted() <= _disk_metadata[5]) {
+          diskann::cout << "Nothing to merge" << std::endl;
+          return;
+        }
+        _merging_delta = std::move(_active_delta);
+        _active_delta = std::move(fresh_delta);
+      }
+      disk = _disk.get();
+      std::lock_guard<std::mutex> guard(_pending_lock);
+      _merge_running = true;
+      _pending_deletes.clear();
+    }
+
+    std::string       delta_file = _index_prefix + "_merge_delta";
+    const char *      delta_exts[] = {"", ".data", ".tags", ".del"};
+    const std::string disk_index_file = disk->prefix + "_disk.index";
+    const _u64        generation = disk->number + 1;
+    const std::string merged_prefix = generation_prefix(generation);
+    try {
+      // the delta as compacted files: points, tags, graph and the locations
+      // of the points deleted from it
+      for (auto ext : delta_exts)
+        std::remove((delta_file + ext).c_str());
+      _merging_delta->save_snapshot(delta_file.c_str(), num_threads);
+
+      std::unique_ptr<T[]>    delta_data;
+      std::unique_ptr<_u32[]> delta_tags;
+      size_t                  delta_npts, delta_dim, num_tags, tags_dim;
+      diskann::load_bin<T>(delta_file + ".data", delta_data, delta_npts,
+                           delta_dim);
+      diskann::load_bin<_u32>(delta_file + ".tags", delta_tags, num_tags,
+                              tags_dim);
+      tsl::robin_set<_u32> delta_deleted;
+      if (file_exists(delta_file + ".del")) {
+        std::unique_ptr<_u32[]> deleted;
+        size_t                  num_deleted, dim;
+        diskann::load_bin<_u32>(delta_file + ".del", deleted, num_deleted,
+                                dim);
+        delta_deleted.insert(deleted.get(), deleted.get() + num_deleted);
+      }
+      std::vector<std::vector<_u32>> delta_graph(delta_npts);
+      {
+        std::ifstream reader;
+        reader.exceptions(std::ios::badbit | std::ios::failbit);
+        reader.open(delta_file, std::ios::binary);
+        reader.seekg(2 * sizeof(_u64) + 2 * sizeof(unsigned));
+        for (auto &nbrs : delta_graph) {
+          unsigned k;
+          reader.read((char *) &k, sizeof(unsigned));
+          nbrs.resize(k);
+          reader.read((char *) nbrs.data(), k * sizeof(unsigned));
+        }
+      }
+
+      // Deleted points of the disk index, except the navigation points, are
+      // removed: edges to them are dropped and the new points take their
+      // slots before being appended.
+      const _u64           npts = disk->num_points;
+      std::vector<bool>    removed(npts, false);
+      std::vector<_u32>    free_slots;
+      tsl::robin_set<_u32> nav_points(_nav_points.begin(), _nav_points.end());
+      std::vector<_u32>    still_deleted;
+      for (_u64 id = 0; id < npts; id++) {
+        if (!disk->index->is_deleted(id))
+          continue;
+        if (nav_points.find((_u32) id) == nav_points.end()) {
+          removed[id] = true;
+          free_slots.push_back((_u32) id);
+        } else {
+          still_deleted.push_back((_u32) id);
+        }
+      }
+
+      std::vector<_u32> new_locs;  // of the new points in the delta
+      for (size_t loc = 0; loc < delta_npts; loc++)
+        if (delta_tags[loc] != 0 && delta_deleted.find((_u32) loc) ==
+                                        delta_deleted.end())
+          new_locs.push_back((_u32) loc);
+      const size_t n_new = new_locs.size();
+      std::vector<_u32> new_ids(n_new);
+      std::vector<_u32> delta_to_id(delta_npts,
+                                    std::numeric_limits<_u32>::max());
+      tsl::robin_map<_u32, _u32> new_point_of;  // id to index in new_locs
+      for (size_t i = 0; i < n_new; i++) {
+        new_ids[i] = i < free_slots.size()
+                         ? free_slots[i]
+                         : (_u32)(npts + i - free_slots.size());
+        delta_to_id[new_locs[i]] = new_ids[i];
+        new_point_of[new_ids[i]] = (_u32) i;
+      }
+      for (size_t i = n_new; i < free_slots.size(); i++)
+        still_deleted.push_back(free_slots[i]);
+      const _u64 new_npts =
+          npts + (n_new > free_slots.size() ? n_new - free_slots.size() : 0);
+      diskann::cout << "Merging " << n_new << " points into " << npts
+                    << " points with " << free_slots.size() << " deleted"
+                    << std::endl;
+
+      // PQ codes of the new points: the nearest center of each chunk
+      std::vector<_u8> new_codes(n_new * _num_pq_chunks);
+#pragma omp parallel num_threads(num_threads)
+      {
+        std::vector<float> vec(_dim);
+        std::vector<float> chunk_dists(256 * _num_pq_chunks);
+#pragma omp for schedule(dynamic, 64)
+        for (_s64 i = 0; i < (_s64) n_new; i++) {
+          to_pq_query(delta_data.get() + new_locs[i] * _dim, vec.data());
+          _pq_table.populate_chunk_distances(vec.data(), chunk_dists.data());
+          for (_u64 c = 0; c < _num_pq_chunks; c++) {
+            float *dists = chunk_dists.data() + 256 * c;
+            new_codes[i * _num_pq_chunks + c] =
+                (_u8)(std::min_element(dists, dists + 256) - dists);
+          }
+        }
+      }
+      const _u8 *old_codes = disk->index->get_pq_codes();
+      auto       code_of = [&](_u32 id) {
+        auto iter = new_point_of.find(id);
+        if (iter != new_point_of.end())
+          return (const _u8 *) new_codes.data() +
+                 (_u64) iter->second * _num_pq_chunks;
+        return old_codes + (_u64) id * _num_pq_chunks;
+      };
+
+      // lists of the removed points, to reconnect their in-neighbors
+      const _u64 old_sectors = DIV_ROUND_UP(npts, _nnodes_per_sector);
+      tsl::robin_map<_u32, std::vector<_u32>> removed_lists;
+      if (!free_slots.empty()) {
+        cached_ifstream   reader(disk_index_file, DISK_LAYOUT_BATCH_BYTES);
+        std::vector<char> sector(SECTOR_LEN);
+        reader.read(sector.data(), SECTOR_LEN);
+        for (_u64 s = 0; s < old_sectors; s++) {
+          reader.read(sector.data(), SECTOR_LEN);
+          for (_u64 j = 0; j < _nnodes_per_sector; j++) {
+            _u64 id = s * _nnodes_per_sector + j;
+            if (id >= npts)
+              break;
+            if (!removed[id])
+              continue;
+            unsigned *nhood = (unsigned *) (sector.data() + j * _max_node_len +
+                                            _dim * sizeof(T));
+            removed_lists[(_u32) id].assign(nhood + 1, nhood + 1 + *nhood);
+          }
+        }
+      }
+
+      // out-neighbors of the new points, from a search of the disk index and
+      // their edges in the delta
+      std::vector<std::vector<_u32>> new_lists(n_new);
+#pragma omp parallel num_threads(num_threads)
+      {
+        std::vector<_u64>      ids(L);
+        std::vector<float>     dists(L);
+        std::vector<float>     center(_dim);
+        std::vector<Candidate> cands;
+#pragma omp for schedule(dynamic, 16)
+        for (_s64 i = 0; i < (_s64) n_new; i++) {
+          const T *point = delta_data.get() + new_locs[i] * _dim;
+          disk->index->cached_beam_search(point, L, L, ids.data(),
+                                          dists.data(), beam_width);
+          to_pq_query(point, center.data());
+          cands.clear();
+          auto add = [&](_u32 id) {
+            if (id == new_ids[i])
+              return;
+            const _u8 *code = code_of(id);
+            cands.push_back(Candidate{
+                id, _pq_table.l2_distance(center.data(), (_u8 *) code),
+                code});
+          };
+          for (unsigned k = 0; k < L; k++)
+            if (ids[k] < npts && !removed[ids[k]])
+              add((_u32) ids[k]);
+          for (auto loc : delta_graph[new_locs[i]])
+            if (loc < delta_npts &&
+                delta_to_id[loc] != std::numeric_limits<_u32>::max())
+              add(delta_to_id[loc]);
+          prune(cands, C, alpha, new_lists[i]);
+        }
+      }
+      tsl::robin_map<_u32, std::vector<_u32>> in_edges;
+      for (size_t i = 0; i < n_new; i++)
+        for (auto nbr : new_lists[i])
+          in_edges[nbr].push_back(new_ids[i]);
+
+      // Rewrite the disk index sector by sector: the new points fill their
+      // slots, removed points lose their lists, and the other lists swap
+      // edges to removed points for the lists of those points and take the
+      // new back edges, pruned if needed. A failed merge may have left files
+      // of the new generation behind.
+      for (auto &file : generation_files(merged_prefix))
+        std::remove(file.c_str());
+      const _u64 new_sectors = DIV_ROUND_UP(new_npts, _nnodes_per_sector);
+      std::vector<_u64> metadata = _disk_metadata;
+      metadata[0] = new_npts;
+      metadata.back() = (new_sectors + 1) * SECTOR_LEN;
+      {
+        cached_ifstream reader(disk_index_file, DISK_LAYOUT_BATCH_BYTES);
+        cached_ofstream writer(merged_prefix + "_disk.index",
+                               DISK_LAYOUT_BATCH_BYTES);
+        const _u64 sectors_per_batch = DISK_LAYOUT_BATCH_BYTES / SECTOR_LEN;
+        std::vector<char> buf(sectors_per_batch * SECTOR_LEN, 0);
+        // the metadata sector is written last
+        reader.read(buf.data(), SECTOR_LEN);
+        std::memset(buf.data(), 0, SECTOR_LEN);
+        writer.write(buf.data(), SECTOR_LEN);
+
+        for (_u64 first = 0; first < new_sectors; first += sectors_per_batch) {
+          _u64 n_batch = (std::min)(sectors_per_batch, new_sectors - first);
+          _u64 n_read =
+              first < old_sectors ? (std::min)(n_batch, old_sectors - first)
+                                  : 0;
+          std::memset(buf.data(), 0, n_batch * SECTOR_LEN);
+          if (n_read > 0)
+            reader.read(buf.data(), n_read * SECTOR_LEN);
+
+#pragma omp parallel num_threads(num_threads)
+          {
+            std::vector<float>     center(_dim);
+            std::vector<_u32>      list;
+            std::vector<Candidate> cands;
+#pragma omp for schedule(dynamic, 64)
+            for (_s64 s = 0; s < (_s64) n_batch; s++) {
+              for (_u64 j = 0; j < _nnodes_per_sector; j++) {
+                _u64 id = (first + s) * _nnodes_per_sector + j;
+                if (id >= new_npts)
+                  break;
+                char *node = buf.data() + s * SECTOR_LEN + j * _max_node_len;
+                unsigned *nhood = (unsigned *) (node + _dim * sizeof(T));
+
+                bool must_prune = false;
+                list.clear();
+                auto new_iter = new_point_of.find((_u32) id);
+                if (new_iter != new_point_of.end()) {
+                  std::memcpy(node,
+                              delta_data.get() +
+                                  new_locs[new_iter->second] * _dim,
+                              _dim * sizeof(T));
+                  list = new_lists[new_iter->second];
+                } else if (removed[id]) {
+                  *nhood = 0;
+                  continue;
+                } else {
+                  for (unsigned k = 0; k < *nhood; k++) {
+                    _u32 nbr = nhood[1 + k];
+                    if (nbr >= npts)
+                      continue;
+                    if (!removed[nbr]) {
+                      list.push_back(nbr);
+                      continue;
+                    }
+                    must_prune = true;
+                    auto removed_iter = removed_lists.find(nbr);
+                    for (auto nbr_nbr : removed_iter->second)
+                      if (nbr_nbr != id && nbr_nbr < npts && !removed[nbr_nbr])
+                        list.push_back(nbr_nbr);
+                  }
+                }
+                auto in_iter = in_edges.find((_u32) id);
+                if (in_iter != in_edges.end())
+                  list.insert(list.end(), in_iter->second.begin(),
+                              in_iter->second.end());
+                std::sort(list.begin(), list.end());
+                list.erase(std::unique(list.begin(), list.end()), list.end());
+
+                if (must_prune || list.size() > _max_degree) {
+                  to_pq_query((T *) node, center.data());
+                  cands.clear();
+                  for (auto nbr : list) {
+                    const _u8 *code = code_of(nbr);
+                    cands.push_back(Candidate{
+                        nbr, _pq_table.l2_distance(center.data(), (_u8 *) code),
+                        code});
+                  }
+                  prune(cands, C, alpha, list);
+                }
+                *nhood = (unsigned) list.size();
+                std::memcpy(nhood + 1, list.data(),
+                            list.size() * sizeof(unsigned));
+              }
+            }
+          }
+          writer.write(buf.data(), n_batch * SECTOR_LEN);
+        }
+      }
+      diskann::save_bin<_u64>(merged_prefix + "_disk.index", metadata.data(),
+                              metadata.size(), 1, 0);
+
+      // PQ codes, tags and tombstones of the merged index
+      {
+        std::ofstream writer;
+        writer.exceptions(std::ios::badbit | std::ios::failbit);
+        writer.open(merged_prefix + "_pq_compressed.bin",
+                    std::ios::binary | std::ios::trunc);
+        int npts_i32 = (int) new_npts, nchunks_i32 = (int) _num_pq_chunks;
+        writer.write((char *) &npts_i32, sizeof(int));
+        writer.write((char *) &nchunks_i32, sizeof(int));
+        const _u64       block_size = 1 << 20;
+        std::vector<_u8> block;
+        for (_u64 first = 0; first < new_npts; first += block_size) {
+          _u64 n_block = (std::min)(block_size, new_npts - first);
+          block.resize(n_block * _num_pq_chunks);
+          for (_u64 id = first; id < first + n_block; id++)
+            std::memcpy(block.data() + (id - first) * _num_pq_chunks,
+                        code_of((_u32) id), _num_pq_chunks);
+          writer.write((char *) block.data(), block.size());
+        }
+      }
+      std::vector<_u32> merged_tags(disk->tags);
+      merged_tags.resize(new_npts);
+      for (size_t i = 0; i < n_new; i++)
+        merged_tags[new_ids[i]] = delta_tags[new_locs[i]];
+      // a slot left deleted may hold the tag of a point updated since
+      for (auto id : still_deleted)
+        merged_tags[id] = 0;
+      diskann::save_bin<_u32>(merged_prefix + "_disk.index_tags.bin",
+                              merged_tags.data(), merged_tags.size(), 1);
+      if (!still_deleted.empty())
+        diskann::save_bin<_u32>(merged_prefix + "_disk.index_tombstones.bin",
+                                still_deleted.data(), still_deleted.size(), 1);
+      for (auto suffix : CARRIED_SUFFIXES)
+        if (file_exists(disk->prefix + suffix))
+          copy_file(disk->prefix + suffix, merged_prefix + suffix);
+
+      // The new generation reaches the disk before the generation file
+      // that points to it, which is replaced by a rename; the old files stay
+      // in use by the searches going to the old index until the switch.
+      for (auto &file : generation_files(merged_prefix))
+        if (file_exists(file))
+          sync_path(file, false);
+      sync_path(parent_dir(merged_prefix), true);
+      auto merged = open_disk_generation(generation);
+
+      std::string tmp_file = _generation_file + ".tmp";
+      {
+        std::ofstream writer;
+        writer.exceptions(std::ios::badbit | std::ios::failbit);
+        writer.open(tmp_file, std::ios::trunc);
+        writer << generation << std::endl;
+      }
+      sync_path(tmp_file, false);
+#ifdef _WINDOWS
+      std::remove(_generation_file.c_str());
+#endif
+      if (std::rename(tmp_file.c_str(), _generation_file.c_str()) != 0)
+        throw ANNException("Failed to replace " + _generation_file, -1,
+                           __FUNCSIG__, __FILE__, __LINE__);
+
+      std::unique_ptr<DiskGeneration> old_disk;
+      std::unique_ptr<Index<T, _u32>> merged_delta;
+      {
+        std::unique_lock<std::shared_timed_mutex> sl(_switch_lock);
+        old_disk = std::move(_disk);
+        _disk = std::move(merged);
+        _disk_metadata = metadata;
+        merged_delta = std::move(_merging_delta);
+        std::lock_guard<std::mutex> guard(_pending_lock);
+        for (auto tag : _pending_deletes) {
+          auto iter = _disk->tag_to_id.find(tag);
+          if (iter != _disk->tag_to_id.end())
+            _disk->index->delete_point(iter->second);
+        }
+        _pending_deletes.clear();
+        _merge_running = false;
+      }
+      sync_path(parent_dir(_generation_file), true);
+      save_tombstones();
+
+      // no search reads the old generation any more
+      const _u64 old_generation = old_disk->number;
+      old_disk.reset();
+      if (old_generation > 0)
+        for (auto &file : generation_files(generation_prefix(old_generation)))
+          std::remove(file.c_str());
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(_pending_lock);
+      _merge_running = false;
+      _pending_deletes.clear();
+      throw;
+    }
+    for (auto ext : delta_exts)
+      std::remove((delta_file + ext).c_str());
+    diskann::cout << "Merge done in " << timer.elapsed() / 1000000.0
+                  << " seconds, the disk index has " << get_num_disk_points()
+                  << " points" << std::endl;
+  }
+
+  template<typename T>
+  void HybridIndex<T>::start_background_merge(const Parameters &parameters) {
+    if (_bg_thread.joinable())
+      throw diskann::ANNException("Background merge already running", -1,
+                                  __FUNCSIG__, __FILE__, __LINE__);
+
+    const unsigned L = parameters.Get<unsigned>("L", 100);
+    const unsigned C = parameters.Get<unsigned>("C", 500);
+    const float    alpha = parameters.Get<float>("alpha", 1.2f);
+    const unsigned beam_width = parameters.Get<unsigned>("beam_width", 4);
+    const unsigned num_threads = parameters.Get<unsigned>("num_threads", 0);
+    const size_t   merge_threshold =
+        parameters.Get<unsigned>("merge_threshold", 1000000);
+    const std::chrono::milliseconds poll_interval(
+        parameters.Get<unsigned>("poll_interval_ms", 1000));
+
+    {
+      std::lock_guard<std::mutex> guard(_bg_mutex);
+      _bg_stop = false;
+    }
+
+    _bg_thread = std::thread([=]() {
+      std::unique_lock<std::mutex> guard(_bg_mutex);
+      while (!_bg_stop) {
+        if (get_num_delta_points() < merge_threshold) {
+          _bg_cv.wait_for(guard, poll_interval, [this] { return _bg_stop; });
+          continue;
+        }
+
+        guard.unlock();
+        Parameters merge_params;
+        merge_params.Set<unsigned>("L", L);
+        merge_params.Set<unsigned>("C", C);
+        merge_params.Set<float>("alpha", alpha);
+        merge_params.Set<unsigned>("beam_width", beam_width);
+        merge_params.Set<unsigned>("num_threads", num_threads);
+        bool failed = false;
+        try {
+          merge(merge_params);
+        } catch (const std::exception &e) {
+          diskann::cerr << "Background merge failed: " << e.what()
+                        << std::endl;
+          failed = true;
+        }
+        guard.lock();
+        if (failed)
+          _bg_cv.wait_for(guard, poll_interval, [this] { return _bg_stop; });
+      }
+    });
+  }
+
+  template<typename T>
+  void HybridIndex<T>::stop_background_merge() {
+    {
+      std::lock_guard<std::mutex> guard(_bg_mutex);
+      _bg_stop = true;
+    }
+    _bg_cv.notify_all();
+    if (_bg_thread.joinable())
+      _bg_thread.join();
+  }
+
+  template<typename T>
+  void HybridIndex<T>::save_tombstones() {
+    std::shared_lock<std::shared_timed_mutex> sl(_switch_lock);
+    _disk->index->save_tombstones();
+  }
+
+  template<typename T>
+  _u64 HybridIndex<T>::get_num_disk_points() {
+    std::shared_lock<std::shared_timed_mutex> sl(_switch_lock);
+    return _disk->num_points - _disk->index->get_num_deleted();
+  }
+
+  template<typename T>
+  size_t HybridIndex<T>::get_num_delta_points() {
+    std::shared_lock<std::shared_timed_mutex> sl(_switch_lock);
+    return _active_delta->get_num_points() +
+           (_merging_delta == nullptr ? 0 : _merging_delta->get_num_points());
+  }
+
+  template DISKANN_DLLEXPORT class HybridIndex<float>;
+  template DISKANN_DLLEXPORT class HybridIndex<int8_t>;
+  template DISKANN_DLLEXPORT class HybridIndex<uint8_t>;
+}  // namespace diskann
@@ -32,6 +32,12 @@
 
 #define MAX_POINTS_FOR_USING_BITSET 10000000
 
+// states of a row in _snapshot_state
+#define SNAPSHOT_PENDING 1
+#define SNAPSHOT_PRESERVED 2
+// save_snapshot() threads assemble this many rows before writing them
+#define SNAPSHOT_BLOCK_ROWS 65536
+
 namespace diskann {
   // Initialize an index with metric m, load the data of type T with filename
   // (bin), and initialize max_points
@@ -54,6 +60,18 @@ namespace diskann {
 
     initialize_query_scratch(num_scratch_spaces, search_l, _indexingQueueSize,
                              _indexingRange, dim);
+
+    _final_graph.set_huge_pages(
+        indexParams.Get<bool>("graph_huge_pages", false));
+    _final_graph.reserve_degree(slack_degree(_indexingRange));
+
+    _reverse_list_cap = indexParams.Get<uint32_t>("reverse_list_cap", 0);
+    _full_sweep_interval = indexParams.Get<uint32_t>("full_sweep_interval", 0);
+    if (_reverse_list_cap > 0) {
+      _reverse_graph.resize(_final_graph.size());
+      _reverse_graph.reserve_degree(_reverse_list_cap);
+      _reverse_overflow.assign(_final_graph.size(), 0);
+    }
   }
 
   template<typename T, typename TagT>
@@ -81,10 +99,8 @@ namespace diskann {
     }
     const size_t total_internal_points = _max_points + _num_frozen_pts;
 
-    alloc_aligned(((void **) &_data),
-                  total_internal_points * _aligned_dim * sizeof(T),
-                  8 * sizeof(T));
-    std::memset(_data, 0, total_internal_points * _aligned_dim * sizeof(T));
+    _data.set_row_size(_aligned_dim);
+    _data.resize(total_internal_points);
 
     _start = (unsigned) _max_points;
 
@@ -97,11 +113,26 @@ namespace diskann {
       diskann::cout << "Normalizing vectors and using L2 for cosine "
                        "AVXNormalizedCosineDistanceFloat()."
                     << std::endl;
+    } else if (m == diskann::Metric::COSINE &&
+               std::is_same<T, float16>::value) {
+      // Likewise, T is float16 here.
+      this->_distance =
+          (Distance<T> *) new NormalizedCosineDistanceFloat16();
+      this->_normalize_vecs = true;
+      diskann::cout << "Normalizing vectors and using inner product for "
+                       "cosine NormalizedCosineDistanceFloat16()."
+                    << std::endl;
     } else {
       this->_distance = get_distance_function<T>(m);
     }
 
-    _locks = std::vector<non_recursive_mutex>(total_internal_points);
+    _versions.resize(total_internal_points);
+    _deleted_bits.resize(DIV_ROUND_UP(total_internal_points, 64));
+    size_t num_lock_stripes = MIN_LOCK_STRIPES;
+    while (num_lock_stripes < total_internal_points &&
+           num_lock_stripes < MAX_LOCK_STRIPES)
+      num_lock_stripes *= 2;
+    _locks = std::vector<non_recursive_mutex>(num_lock_stripes);
 
     if (enable_tags) {
       _location_to_tag.reserve(total_internal_points);
@@ -111,24 +142,23 @@ namespace diskann {
 
   template<typename T, typename TagT>
   Index<T, TagT>::~Index() {
+    stop_background_consolidation();
+
     // Ensure that no other activity is happening before dtor()
     std::unique_lock<std::shared_timed_mutex> ul(_update_lock);
     std::unique_lock<std::shared_timed_mutex> cl(_consolidate_lock);
     std::unique_lock<std::shared_timed_mutex> tl(_tag_lock);
     std::unique_lock<std::shared_timed_mutex> dl(_delete_lock);
 
-    for (auto &lock : _locks) {
-      LockGuard lg(lock);
+    for (size_t i = 0; i < _locks.size(); i++) {
+      LockGuard lg(_locks[i]);
     }
 
     if (this->_distance != nullptr) {
       delete this->_distance;
       this->_distance = nullptr;
     }
-    if (this->_data != nullptr) {
-      aligned_free(this->_data);
-      this->_data = nullptr;
-    }
+    this->_data.clear();
 
     ScratchStoreManager<InMemQueryScratch<T>> manager(_query_scratch);
     manager.destroy();
@@ -178,7 +208,7 @@ namespace diskann {
   template<typename T, typename TagT>
   _u64 Index<T, TagT>::save_data(std::string data_file) {
     return save_data_in_base_dimensions(data_file, _data, _nd + _num_frozen_pts,
-                                        _dim, _aligned_dim);
+                                        _dim);
   }
 
   // save the graph index on a file as an adjacency list. For each point,
@@ -199,12 +229,11 @@ namespace diskann {
     out.write((char *) &ep_u32, sizeof(unsigned));
     out.write((char *) &_num_frozen_pts, sizeof(_u64));
     for (unsigned i = 0; i < _nd + _num_frozen_pts; i++) {
-      unsigned GK = (unsigned) _final_graph[i].size();
-      out.write((char *) &GK, sizeof(unsigned));
-      out.write((char *) _final_graph[i].data(), GK * sizeof(unsigned));
-      max_degree = _final_graph[i].size() > max_degree
-                       ? (_u32) _final_graph[i].size()
-                       : max_degree;
+      // the arena row is already laid out as degree + neighbor ids
+      auto     nbrs = _final_graph[i];
+      unsigned GK = (unsigned) nbrs.size();
+      out.write((char *) nbrs.raw(), (GK + 1) * sizeof(unsigned));
+      max_degree = GK > max_degree ? GK : max_degree;
       index_size += (_u64)(sizeof(unsigned) * (GK + 1));
     }
     out.seekp(file_offset, out.beg);
@@ -273,11 +302,211 @@ namespace diskann {
     }
 
     reposition_frozen_point_to_end();
+    // compaction renumbered the points
+    if (compact_before_save)
+      rebuild_reverse_graph();
 
     diskann::cout << "Time taken for save: " << timer.elapsed() / 1000000.0
                   << "s." << std::endl;
   }
 
+  template<typename T, typename TagT>
+  void Index<T, TagT>::save_snapshot(const char *filename,
+                                     uint32_t    num_threads) {
+    diskann::Timer timer;
+    if (_save_as_one_file) {
+      diskann::cout << "Save index in a single file currently not supported. "
+                       "Not saving the index."
+                    << std::endl;
+      return;
+    }
+    if (num_threads == 0)
+      num_threads = omp_get_max_threads();
+
+    std::lock_guard<std::mutex> snapshot_guard(_snapshot_mutex);
+
+    // Held until the files are written, so that no point of the snapshot is
+    // moved or has its slot reused
+    std::shared_lock<std::shared_timed_mutex> cl(_consolidate_lock,
+                                                 std::defer_lock);
+
+    std::vector<unsigned> old_location;  // of the points, in snapshot order
+    std::vector<unsigned> new_location;  // UINT32_MAX if not in the snapshot
+    std::vector<TagT>     tags;
+    std::vector<_u32>     delete_list;
+    unsigned              start;
+    double                freeze_secs;
+    {
+      // wait out a running consolidation without holding off searches
+      std::unique_lock<std::shared_timed_mutex> ul(_update_lock,
+                                                   std::defer_lock);
+      while (true) {
+        ul.lock();
+        if (cl.try_lock())
+          break;
+        ul.unlock();
+        std::shared_lock<std::shared_timed_mutex> wait(_consolidate_lock);
+      }
+      std::shared_lock<std::shared_timed_mutex> tl(_tag_lock);
+      std::shared_lock<std::shared_timed_mutex> dl(_delete_lock);
+      diskann::Timer freeze_timer;
+
+      const size_t total_points = _max_points + _num_frozen_pts;
+      new_location.assign(total_points, UINT32_MAX);
+      old_location.reserve(_nd + _num_frozen_pts);
+      for (unsigned i = 0; i < _max_points; i++) {
+        if (_empty_slots.is_empty() ? i < _nd : !_empty_slots.is_in_set(i)) {
+          new_location[i] = (unsigned) old_location.size();
+          old_location.push_back(i);
+        }
+      }
+      if (old_location.size() != _nd)
+        throw ANNException("Found " + std::to_string(old_location.size()) +
+                               " used slots for " + std::to_string(_nd) +
+                               " points, can not save snapshot",
+                           -1, __FUNCSIG__, __FILE__, __LINE__);
+      for (size_t i = _max_points; i < total_points; i++) {
+        new_location[i] = (unsigned) old_location.size();
+        old_location.push_back((unsigned) i);
+      }
+      start = new_location[_start];
+
+      // lazily deleted points keep their slots but have no tags
+      if (_enable_tags) {
+        tags.resize(old_location.size());
+        for (size_t i = 0; i < _nd; i++)
+          _location_to_tag.try_get(old_location[i], tags[i]);
+      }
+      for (auto loc : _delete_set)
+        if (new_location[loc] != UINT32_MAX)
+          delete_list.push_back(new_location[loc]);
+      std::sort(delete_list.begin(), delete_list.end());
+
+      _snapshot_rows.clear();
+      _snapshot_state.assign(total_points, 0);
+      for (auto loc : old_location)
+        _snapshot_state[loc] = SNAPSHOT_PENDING;
+      _snapshot_active = true;
+      freeze_secs = freeze_timer.elapsed() / 1000000.0;
+    }
+
+    std::string graph_file = std::string(filename);
+    std::string tags_file = std::string(filename) + ".tags";
+    std::string data_file = std::string(filename) + ".data";
+    std::string delete_list_file = std::string(filename) + ".del";
+
+    // row of a point as it was frozen
+    auto take_row = [&](unsigned loc, std::vector<unsigned> &row) {
+      LockGuard guard(node_lock(loc));
+      if (_snapshot_state[loc] == SNAPSHOT_PRESERVED) {
+        std::lock_guard<std::mutex> rows_guard(_snapshot_rows_mutex);
+        auto                        iter = _snapshot_rows.find(loc);
+        row.swap(iter.value());
+        _snapshot_rows.erase(iter);
+      } else {
+        auto nbrs = _final_graph[loc];
+        row.assign(nbrs.begin(), nbrs.end());
+      }
+      _snapshot_state[loc] = 0;
+    };
+
+    std::exception_ptr eptr = nullptr;
+    try {
+      delete_file(graph_file);
+      delete_file(data_file);
+      std::ofstream graph_out, data_out;
+      open_file_to_write(graph_out, graph_file);
+      open_file_to_write(data_out, data_file);
+
+      // the graph header is rewritten with the final size and degree
+      _u64 index_size = 24;
+      _u32 max_degree = 0;
+      _u64 num_frozen = _num_frozen_pts;
+      graph_out.write((char *) &index_size, sizeof(_u64));
+      graph_out.write((char *) &max_degree, sizeof(_u32));
+      graph_out.write((char *) &start, sizeof(unsigned));
+      graph_out.write((char *) &num_frozen, sizeof(_u64));
+      int npts_i32 = (int) old_location.size(), ndims_i32 = (int) _dim;
+      data_out.write((char *) &npts_i32, sizeof(int));
+      data_out.write((char *) &ndims_i32, sizeof(int));
+
+      // Threads assemble blocks of rows and write them in order
+      const _s64 num_blocks =
+          (_s64) DIV_ROUND_UP(old_location.size(), SNAPSHOT_BLOCK_ROWS);
+#pragma omp parallel for num_threads(num_threads) schedule(static, 1) ordered
+      for (_s64 b = 0; b < num_blocks; b++) {
+        std::vector<unsigned> graph_buf, row;
+        std::vector<T>        data_buf;
+        _u32                  block_max_degree = 0;
+        size_t                block_start = (size_t) b * SNAPSHOT_BLOCK_ROWS;
+        size_t                block_end = (std::min)(
+            block_start + SNAPSHOT_BLOCK_ROWS, old_location.size());
+        data_buf.resize((block_end - block_start) * _dim);
+        for (size_t i = block_start; i < block_end; i++) {
+          auto loc = old_location[i];
+          take_row(loc, row);
+          size_t degree_pos = graph_buf.size();
+          graph_buf.push_back(0);
+          for (auto nbr : row)
+            if (new_location[nbr] != UINT32_MAX)
+              graph_buf.push_back(new_location[nbr]);
+          _u32 degree = (_u32)(graph_buf.size() - degree_pos - 1);
+          graph_buf[degree_pos] = degree;
+          block_max_degree = (std::max)(block_max_degree, degree);
+
+          memcpy(data_buf.data() + (i - block_start) * _dim,
+                 _data[loc], _dim * sizeof(T));
+        }
+#pragma omp ordered
+        {
+          try {
+            if (eptr == nullptr) {
+              graph_out.write((char *) graph_buf.data(),
+                              graph_buf.size() * sizeof(unsigned));
+              data_out.write((char *) data_buf.data(),
+                             data_buf.size() * sizeof(T));
+              index_size += graph_buf.size() * sizeof(unsigned);
+              max_degree = (std::max)(max_degree, block_max_degree);
+            }
+          } catch (...) {
+            eptr = std::current_exception();
+          }
+        }
+      }
+      if (eptr)
+        std::rethrow_exception(eptr);
+
+      graph_out.seekp(0, graph_out.beg);
+      graph_out.write((char *) &index_size, sizeof(_u64));
+      graph_out.write((char *) &max_degree, sizeof(_u32));
+      graph_out.close();
+      data_out.close();
+
+      if (_enable_tags) {
+        delete_file(tags_file);
+        save_bin<TagT>(tags_file, tags.data(), tags.size(), 1);
+      }
+      delete_file(delete_list_file);
+      if (delete_list.size() > 0)
+        save_bin<_u32>(delete_list_file, delete_list.data(),
+                       delete_list.size(), 1);
+    } catch (...) {
+      eptr = std::current_exception();
+    }
+
+    _snapshot_active = false;
+    {
+      std::lock_guard<std::mutex> rows_guard(_snapshot_rows_mutex);
+      _snapshot_rows.clear();
+    }
+    if (eptr)
+      std::rethrow_exception(eptr);
+
+    diskann::cout << "Snapshot of " << old_location.size() - _num_frozen_pts
+                  << " points frozen in " << freeze_secs << "s, saved in "
+                  << timer.elapsed() / 1000000.0 << "s." << std::endl;
+  }
+
 #ifdef EXEC_ENV_OLS
   template<typename T, typename TagT>
   size_t Index<T, TagT>::load_tags(AlignedFileReader &reader) {
@@ -345,7 +574,7 @@ namespace diskann {
       stream << "ERROR: data file " << filename << " does not exist."
              << std::endl;
       diskann::cerr << stream.str() << std::endl;
-      aligned_free(_data);
+      _data.clear();
       throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
                                   __LINE__);
     }
@@ -360,7 +589,7 @@ namespace diskann {
       stream << "ERROR: Driver requests loading " << _dim << " dimension,"
              << "but file has " << file_dim << " dimension." << std::endl;
       diskann::cerr << stream.str() << std::endl;
-      aligned_free(_data);
+      _data.clear();
       throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
                                   __LINE__);
     }
@@ -371,11 +600,18 @@ namespace diskann {
     }
 
 #ifdef EXEC_ENV_OLS
-    copy_aligned_data_from_file<T>(reader, _data, file_num_points, file_dim,
+    // the reader fills one contiguous buffer, which is then split into rows
+    T *buf = nullptr;
+    alloc_aligned((void **) &buf, file_num_points * _aligned_dim * sizeof(T),
+                  8 * sizeof(T));
+    copy_aligned_data_from_file<T>(reader, buf, file_num_points, file_dim,
                                    _aligned_dim);
+    for (size_t i = 0; i < file_num_points; i++)
+      memcpy(_data[i], buf + i * _aligned_dim, _aligned_dim * sizeof(T));
+    aligned_free(buf);
 #else
     copy_aligned_data_from_file<T>(filename.c_str(), _data, file_num_points,
-                                   file_dim, _aligned_dim);
+                                   file_dim);
 #endif
     return file_num_points;
   }
@@ -398,6 +634,7 @@ namespace diskann {
     assert(ndim == 1);
     for (uint32_t i = 0; i < npts; i++) {
       _delete_set.insert(delete_list[i]);
+      set_deleted(delete_list[i]);
     }
     return npts;
   }
@@ -452,7 +689,7 @@ namespace diskann {
              << " tags, with num_frozen_pts being set to " << _num_frozen_pts
              << " in constructor." << std::endl;
       diskann::cerr << stream.str() << std::endl;
-      aligned_free(_data);
+      _data.clear();
       throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
                                   __LINE__);
     }
@@ -467,6 +704,7 @@ namespace diskann {
     _lazy_done = _delete_set.size() != 0;
 
     reposition_frozen_point_to_end();
+    rebuild_reverse_graph(_delete_set);
     diskann::cout << "Num frozen points:" << _num_frozen_pts << " _nd: " << _nd
                   << " _start: " << _start
                   << " size(_location_to_tag): " << _location_to_tag.size()
@@ -540,7 +778,7 @@ namespace diskann {
                << std::endl;
       }
       diskann::cerr << stream.str() << std::endl;
-      aligned_free(_data);
+      _data.clear();
       throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
                                   __LINE__);
     }
@@ -561,6 +799,10 @@ namespace diskann {
       _final_graph.resize(expected_num_points + _num_frozen_pts);
       _max_points = expected_num_points;
     }
+    // a dynamic index keeps inserting, so leave room for the build slack
+    _final_graph.reserve_degree(
+        std::max(_max_observed_degree,
+                 _dynamic_index ? slack_degree(_indexingRange) : 0));
 #ifdef EXEC_ENV_OLS
     _u32 nodes_read = 0;
     _u64 cc = 0;
@@ -569,12 +811,11 @@ namespace diskann {
       _u32 k;
       read_value(reader, k, graph_offset);
       graph_offset += sizeof(_u32);
-      std::vector<_u32> tmp(k);
-      tmp.reserve(k);
-      read_array(reader, tmp.data(), k, graph_offset);
+      auto nbrs = _final_graph[nodes_read];
+      nbrs.resize(k);
+      read_array(reader, nbrs.data(), k, graph_offset);
       graph_offset += k * sizeof(_u32);
       cc += k;
-      _final_graph[nodes_read].swap(tmp);
       nodes_read++;
       if (nodes_read % 1000000 == 0) {
         diskann::cout << "." << std::flush;
@@ -598,10 +839,9 @@ namespace diskann {
 
       cc += k;
       ++nodes_read;
-      std::vector<unsigned> tmp(k);
-      tmp.reserve(k);
-      in.read((char *) tmp.data(), k * sizeof(unsigned));
-      _final_graph[nodes_read - 1].swap(tmp);
+      auto nbrs = _final_graph[nodes_read - 1];
+      nbrs.resize(k);
+      in.read((char *) nbrs.data(), k * sizeof(unsigned));
       bytes_read += sizeof(uint32_t) * ((_u64) k + 1);
       if (nodes_read % 10000000 == 0)
         diskann::cout << "." << std::flush;
@@ -625,7 +865,7 @@ namespace diskann {
     }
 
     size_t location = _tag_to_location[tag];
-    memcpy((void *) vec, (void *) (_data + location * _aligned_dim),
+    memcpy((void *) vec, (void *) _data[location],
            (size_t) _dim * sizeof(T));
     return 0;
   }
@@ -639,7 +879,7 @@ namespace diskann {
 
     for (size_t i = 0; i < _nd; i++)
       for (size_t j = 0; j < _aligned_dim; j++)
-        center[j] += (float) _data[i * _aligned_dim + j];
+        center[j] += (float) _data[i][j];
 
     for (size_t j = 0; j < _aligned_dim; j++)
       center[j] /= (float) _nd;
@@ -650,7 +890,7 @@ namespace diskann {
     for (_s64 i = 0; i < (_s64) _nd; i++) {
       // extract point and distance reference
       float &  dist = distances[i];
-      const T *cur_vec = _data + (i * (size_t) _aligned_dim);
+      const T *cur_vec = _data[i];
       dist = 0;
       float diff = 0;
       for (size_t j = 0; j < _aligned_dim; j++) {
@@ -690,9 +930,10 @@ namespace diskann {
     T *aligned_query = scratch->aligned_query();
     memcpy(aligned_query, query, _dim * sizeof(T));
     if (_normalize_vecs) {
-      normalize((float *) aligned_query, _dim);
+      normalize(aligned_query, _dim);
     }
 
+    best_L_nodes.resize(Lsize + 1);
     for (unsigned i = 0; i < Lsize + 1; i++) {
       best_L_nodes[i].distance = std::numeric_limits<float>::max();
     }
@@ -701,8 +942,12 @@ namespace diskann {
                          __FUNCSIG__, __FILE__, __LINE__);
     }
 
-    unsigned l = 0;
+    // l candidates in best_L_nodes, num_deleted of them flagged deleted
+    unsigned l = 0, num_deleted = 0;
     Neighbor nn;
+    auto     counts_as_deleted = [&](unsigned id) {
+      return search_invocation && id < _max_points && is_deleted(id);
+    };
 
     bool fast_iterate =
         (_max_points + _num_frozen_pts) <= MAX_POINTS_FOR_USING_BITSET;
@@ -727,21 +972,25 @@ namespace diskann {
             __FILE__, __LINE__);
       }
       nn = Neighbor(id,
-                    _distance->compare(_data + _aligned_dim * (size_t) id,
-                                       aligned_query, (unsigned) _aligned_dim),
+                    _distance->compare(_data[id], aligned_query,
+                                       (unsigned) _aligned_dim),
                     true);
       if (fast_iterate) {
         if (inserted_into_pool_bs[id] == 0) {
           inserted_into_pool_bs[id] = 1;
+          nn.deleted = counts_as_deleted(id);
+          num_deleted += nn.deleted;
           best_L_nodes[l++] = nn;
         }
       } else {
         if (inserted_into_pool_rs.find(id) == inserted_into_pool_rs.end()) {
           inserted_into_pool_rs.insert(id);
+          nn.deleted = counts_as_deleted(id);
+          num_deleted += nn.deleted;
           best_L_nodes[l++] = nn;
         }
       }
-      if (l == Lsize)
+      if (l - num_deleted == Lsize)
         break;
     }
 
@@ -765,30 +1014,30 @@ namespace diskann {
         }
 
         des.clear();
+        auto nbrs = _final_graph[n];
         if (_dynamic_index) {
-          LockGuard guard(_locks[n]);
-          for (unsigned m = 0; m < _final_graph[n].size(); m++) {
-            if (_final_graph[n][m] >= _max_points + _num_frozen_pts) {
+          copy_neighbors(n, des);
+          for (auto id : des) {
+            if (id >= _max_points + _num_frozen_pts) {
               std::stringstream msg;
-              msg << "Out of range edge " << _final_graph[n][m]
-                  << " found at vertex " << n << std::endl;
+              msg << "Out of range edge " << id << " found at vertex " << n
+                  << std::endl;
               throw diskann::ANNException(msg.str(), -1, __FUNCSIG__, __FILE__,
                                           __LINE__);
             }
-            des.emplace_back(_final_graph[n][m]);
           }
         } else {
-          for (unsigned m = 0; m < _final_graph[n].size(); m++) {
-            if (_final_graph[n][m] >= _max_points + _num_frozen_pts) {
+          for (unsigned m = 0; m < nbrs.size(); m++) {
+            if (nbrs[m] >= _max_points + _num_frozen_pts) {
               std::stringstream msg;
-              msg << "Out of range edge " << _final_graph[n][m]
+              msg << "Out of range edge " << nbrs[m]
                   << " found at vertex " << n << std::endl;
               msg << " max pts, num_frozen = " << _max_points << ", "
                   << _num_frozen_pts << std::endl;
               throw diskann::ANNException(msg.str(), -1, __FUNCSIG__, __FILE__,
                                           __LINE__);
             }
-            des.emplace_back(_final_graph[n][m]);
+            des.emplace_back(nbrs[m]);
           }
         }
 
@@ -805,23 +1054,32 @@ namespace diskann {
             }
             if (m + 1 < des.size()) {
               auto nextn = des[m + 1];
-              diskann::prefetch_vector(
-                  (const char *) _data + _aligned_dim * (size_t) nextn,
-                  sizeof(T) * _aligned_dim);
+              diskann::prefetch_vector((const char *) _data[nextn],
+                                       sizeof(T) * _aligned_dim);
             }
 
             cmps++;
-            float dist = _distance->compare(aligned_query,
-                                            _data + _aligned_dim * (size_t) id,
+            float dist = _distance->compare(aligned_query, _data[id],
                                             (unsigned) _aligned_dim);
 
-            if (dist >= best_L_nodes[l - 1].distance && (l == Lsize))
+            // a full list ends with its Lsize-th live candidate
+            if (dist >= best_L_nodes[l - 1].distance &&
+                (l - num_deleted == Lsize))
               continue;
 
             Neighbor nn(id, dist, true);
+            nn.deleted = counts_as_deleted(id);
+            num_deleted += nn.deleted;
             unsigned inserted_position = InsertIntoPool(best_L_nodes, l, nn);
-            if (l < Lsize)
-              ++l;
+            ++l;
+            // drop the candidates past the Lsize-th live one, as counted when
+            // they entered the list, so concurrent deletes cannot skew it
+            while (l - num_deleted > Lsize ||
+                   (l - num_deleted == Lsize && best_L_nodes[l - 1].deleted)) {
+              --l;
+              if (best_L_nodes[l].deleted)
+                --num_deleted;
+            }
             if (inserted_position < best_inserted_position)
               best_inserted_position = inserted_position;
           }
@@ -833,17 +1091,29 @@ namespace diskann {
           ++best_unchanged;
       }
     }
+    best_L_nodes.resize(l);
     return std::make_pair(hops, cmps);
   }
 
   template<typename T, typename TagT>
   void Index<T, TagT>::search_for_point_and_add_links(
-      int location, _u32 Lindex, InMemQueryScratch<T> *scratch) {
+      int location, _u32 Lindex, InMemQueryScratch<T> *scratch,
+      bool keep_existing_nbrs) {
+    std::vector<unsigned> pruned_list;
+    search_for_point_and_set_links(location, Lindex, scratch, pruned_list,
+                                   keep_existing_nbrs);
+    inter_insert(location, pruned_list, scratch);
+  }
+
+  template<typename T, typename TagT>
+  void Index<T, TagT>::search_for_point_and_set_links(
+      int location, _u32 Lindex, InMemQueryScratch<T> *scratch,
+      std::vector<unsigned> &pruned_list, bool keep_existing_nbrs) {
     std::vector<unsigned> init_ids;
     init_ids.emplace_back(_start);
 
-    iterate_to_fixed_point(_data + _aligned_dim * location, Lindex, init_ids,
-                           scratch, true, false);
+    iterate_to_fixed_point(_data[location], Lindex, init_ids, scratch, true,
+                           false);
 
     auto &pool = scratch->pool();
 
@@ -851,29 +1121,56 @@ namespace diskann {
       if (pool[i].id == (unsigned) location) {
         pool.erase(pool.begin() + i);
         i--;
-      } else if (_delete_set.find(pool[i].id) != _delete_set.end()) {
+      } else if (is_deleted(pool[i].id)) {
         pool.erase(pool.begin() + i);
         i--;
       }
     }
 
-    std::vector<unsigned> pruned_list;
-    prune_neighbors(location, pool, pruned_list);
+    // later build passes refine the graph of the previous pass, so the
+    // current out-neighbors compete with the search results in the prune
+    if (keep_existing_nbrs) {
+      auto &in_pool = scratch->visited();
+      in_pool.clear();
+      for (auto &nbr : pool)
+        in_pool.insert(nbr.id);
+
+      std::vector<unsigned> existing_nbrs;
+      {
+        LockGuard guard(node_lock(location));
+        auto nbrs = _final_graph[location];
+        existing_nbrs.assign(nbrs.begin(), nbrs.end());
+      }
+      for (auto id : existing_nbrs) {
+        if (id == (unsigned) location || in_pool.find(id) != in_pool.end())
+          continue;
+        in_pool.insert(id);
+        float dist = _distance->compare(_data[location], _data[id],
+                                        (unsigned) _aligned_dim);
+        pool.emplace_back(Neighbor(id, dist, true));
+      }
+    }
+
+    prune_neighbors(location, pool, pruned_list, scratch);
 
     assert(!pruned_list.empty());
     assert(_final_graph.size() == _max_points + _num_frozen_pts);
 
+    // Before the edges are published, so that a localized consolidate that
+    // releases a neighbor after they are finds location among its
+    // in-neighbors; entries for links skipped below are tolerated as stale.
+    uint64_t epoch = _reverse_rebuild_epoch.load();
+    add_reverse_edges(location, pruned_list);
     {
       std::shared_lock<std::shared_timed_mutex> tlock(_tag_lock,
                                                       std::defer_lock);
       if (_conc_consolidate)
         tlock.lock();
 
-      LockGuard guard(_locks[location]);
+      LockGuard guard(node_lock(location));
+      preserve_snapshot_row(location);
+      SeqlockWriteGuard version_guard(_versions[location]);
       _final_graph[location].clear();
-      _final_graph[location].shrink_to_fit();
-      _final_graph[location].reserve(
-          (_u64)(_indexingRange * GRAPH_SLACK_FACTOR * 1.05));
 
       for (auto link : pruned_list) {
         if (_conc_consolidate)
@@ -887,53 +1184,75 @@ namespace diskann {
     }
 
     assert(_final_graph[location].size() <= _indexingRange);
-    inter_insert(location, pruned_list);
+    if (reverse_rebuilt_since(epoch))
+      add_reverse_edges(location, pruned_list);
   }
 
   template<typename T, typename TagT>
   void Index<T, TagT>::occlude_list(std::vector<Neighbor> &pool,
                                     const float alpha, const unsigned degree,
                                     const unsigned         maxc,
-                                    std::vector<Neighbor> &result) {
+                                    std::vector<Neighbor> &result,
+                                    InMemQueryScratch<T> * scratch) {
     if (pool.size() == 0)
       return;
 
     assert(std::is_sorted(pool.begin(), pool.end()));
     if (pool.size() > maxc)
       pool.resize(maxc);
-    std::vector<float> occlude_factor(pool.size(), 0);
 
+    auto &occlude_factor = scratch->occlude_factor();
+    auto &batch_pos = scratch->occlude_batch_pos();
+    auto &batch_ptrs = scratch->occlude_batch_ptrs();
+    auto &batch_dists = scratch->occlude_batch_dists();
+    occlude_factor.assign(pool.size(), 0);
+
+    // Each candidate's distance to a selected point is computed exactly once,
+    // when that point gets selected, as one batch over all candidates after
+    // it that are not yet occluded beyond alpha. The factors accumulated this
+    // way carry over to the later, larger-alpha rounds.
     float cur_alpha = 1;
     while (cur_alpha <= alpha && result.size() < degree) {
       // used for MIPS, where we store a value of eps in cur_alpha to
       // denote pruned out entries which we can skip in later rounds.
       float eps = cur_alpha + 0.01f;
 
-      for (auto iter = pool.begin();
-           result.size() < degree && iter != pool.end(); ++iter) {
-        if (occlude_factor[iter - pool.begin()] > cur_alpha) {
+      for (size_t i = 0; result.size() < degree && i < pool.size(); ++i) {
+        if (occlude_factor[i] > cur_alpha) {
           continue;
         }
-        occlude_factor[iter - pool.begin()] = std::numeric_limits<float>::max();
-        result.push_back(*iter);
-        for (auto iter2 = iter + 1; iter2 != pool.end(); iter2++) {
-          auto t = iter2 - pool.begin();
+        occlude_factor[i] = std::numeric_limits<float>::max();
+        result.push_back(pool[i]);
+
+        batch_pos.clear();
+        batch_ptrs.clear();
+        for (size_t t = i + 1; t < pool.size(); t++) {
           if (occlude_factor[t] > alpha)
             continue;
-          float djk =
-              _distance->compare(_data + _aligned_dim * (size_t) iter2->id,
-                                 _data + _aligned_dim * (size_t) iter->id,
-                                 (unsigned) _aligned_dim);
+          batch_pos.push_back((unsigned) t);
+          batch_ptrs.push_back(_data[pool[t].id]);
+        }
+        if (batch_pos.empty())
+          continue;
+
+        batch_dists.resize(batch_pos.size());
+        _distance->compare_batch(_data[pool[i].id],
+                                 batch_ptrs.data(), (uint32_t) batch_pos.size(),
+                                 (unsigned) _aligned_dim, batch_dists.data());
+
+        for (size_t k = 0; k < batch_pos.size(); k++) {
+          auto  t = batch_pos[k];
+          float djk = batch_dists[k];
           if (_dist_metric == diskann::Metric::L2 ||
               _dist_metric == diskann::Metric::COSINE) {
             if (djk == 0.0)
               occlude_factor[t] = std::numeric_limits<float>::max();
             else
               occlude_factor[t] =
-                  std::max(occlude_factor[t], iter2->distance / djk);
+                  std::max(occlude_factor[t], pool[t].distance / djk);
           } else if (_dist_metric == diskann::Metric::INNER_PRODUCT) {
             // Improvization for flipping max and min dist for MIPS
-            float x = -iter2->distance;
+            float x = -pool[t].distance;
             float y = -djk;
             if (y > cur_alpha * x) {
               occlude_factor[t] = std::max(occlude_factor[t], eps);
@@ -948,9 +1267,10 @@ namespace diskann {
   template<typename T, typename TagT>
   void Index<T, TagT>::prune_neighbors(const unsigned         location,
                                        std::vector<Neighbor> &pool,
-                                       std::vector<unsigned> &pruned_list) {
+                                       std::vector<unsigned> &pruned_list,
+                                       InMemQueryScratch<T> * scratch) {
     prune_neighbors(location, pool, _indexingRange, _indexingMaxC,
-                    _indexingAlpha, pruned_list);
+                    _indexingAlpha, pruned_list, scratch);
   }
 
   template<typename T, typename TagT>
@@ -959,7 +1279,8 @@ namespace diskann {
                                        const _u32             range,
                                        const _u32  max_candidate_size,
                                        const float alpha,
-                                       std::vector<unsigned> &pruned_list) {
+                                       std::vector<unsigned> &pruned_list,
+                                       InMemQueryScratch<T> * scratch) {
     if (pool.size() == 0) {
       std::stringstream ss;
       ss << "Thread loc:" << std::this_thread::get_id()
@@ -977,7 +1298,7 @@ namespace diskann {
     std::vector<Neighbor> result;
     result.reserve(range);
 
-    occlude_list(pool, alpha, range, max_candidate_size, result);
+    occlude_list(pool, alpha, range, max_candidate_size, result, scratch);
 
     pruned_list.clear();
     assert(result.size() <= range);
@@ -999,7 +1320,8 @@ namespace diskann {
   template<typename T, typename TagT>
   void Index<T, TagT>::inter_insert(unsigned               n,
                                     std::vector<unsigned> &pruned_list,
-                                    const _u32             range) {
+                                    const _u32             range,
+                                    InMemQueryScratch<T> * scratch) {
     const auto &src_pool = pruned_list;
 
     assert(!src_pool.empty());
@@ -1010,20 +1332,31 @@ namespace diskann {
       // des_pool contains the neighbors of the neighbors of n
       std::vector<unsigned> copy_of_neighbors;
       bool                  prune_needed = false;
+      bool                  appended = false;
+      // recorded before the edge is published, as in
+      // search_for_point_and_set_links; stale if the prune drops it
+      uint64_t epoch = _reverse_rebuild_epoch.load();
+      add_reverse_edge(des, n);
       {
-        LockGuard guard(_locks[des]);
-        auto &    des_pool = _final_graph[des];
+        LockGuard guard(node_lock(des));
+        auto      des_pool = _final_graph[des];
         if (std::find(des_pool.begin(), des_pool.end(), n) == des_pool.end()) {
           if (des_pool.size() < (_u64)(GRAPH_SLACK_FACTOR * range)) {
+            preserve_snapshot_row(des);
+            SeqlockWriteGuard version_guard(_versions[des]);
             des_pool.emplace_back(n);
+            appended = true;
             prune_needed = false;
           } else {
-            copy_of_neighbors = des_pool;
+            copy_of_neighbors.assign(des_pool.begin(), des_pool.end());
             prune_needed = true;
           }
         }
       }  // des lock is released by this point
 
+      if (appended && reverse_rebuilt_since(epoch))
+        add_reverse_edge(des, n);
+
       if (prune_needed) {
         copy_of_neighbors.push_back(n);
         tsl::robin_set<unsigned> dummy_visited(0);
@@ -1037,32 +1370,262 @@ namespace diskann {
         for (auto cur_nbr : copy_of_neighbors) {
           if (dummy_visited.find(cur_nbr) == dummy_visited.end() &&
               cur_nbr != des) {
-            float dist =
-                _distance->compare(_data + _aligned_dim * (size_t) des,
-                                   _data + _aligned_dim * (size_t) cur_nbr,
-                                   (unsigned) _aligned_dim);
+            float dist = _distance->compare(_data[des], _data[cur_nbr],
+                                            (unsigned) _aligned_dim);
             dummy_pool.emplace_back(Neighbor(cur_nbr, dist, true));
             dummy_visited.insert(cur_nbr);
           }
         }
         std::vector<unsigned> new_out_neighbors;
-        prune_neighbors(des, dummy_pool, new_out_neighbors);
+        prune_neighbors(des, dummy_pool, new_out_neighbors, scratch);
+        epoch = _reverse_rebuild_epoch.load();
+        add_reverse_edges(des, new_out_neighbors);
         {
-          LockGuard guard(_locks[des]);
+          LockGuard guard(node_lock(des));
+          preserve_snapshot_row(des);
+          SeqlockWriteGuard version_guard(_versions[des]);
 
           _final_graph[des].clear();
           for (auto new_nbr : new_out_neighbors) {
             _final_graph[des].emplace_back(new_nbr);
           }
         }
+        if (reverse_rebuilt_since(epoch))
+          add_reverse_edges(des, new_out_neighbors);
       }
     }
   }
 
+  template<typename T, typename TagT>
+  void Index<T, TagT>::merge_reverse_links(
+      const std::vector<unsigned> &             locations,
+      const std::vector<std::vector<unsigned>> &pruned_lists,
+      uint32_t                                  num_threads) {
+    // (target, source) pairs, grouped by target
+    std::vector<std::pair<unsigned, unsigned>> links;
+    for (size_t i = 0; i < locations.size(); i++)
+      for (auto des : pruned_lists[i])
+        links.emplace_back(des, locations[i]);
+    std::sort(links.begin(), links.end());
+
+    std::vector<size_t> group_starts;
+    for (size_t k = 0; k < links.size(); k++)
+      if (k == 0 || links[k].first != links[k - 1].first)
+        group_starts.push_back(k);
+    group_starts.push_back(links.size());
+
+    const _u64 max_unpruned = (_u64)(GRAPH_SLACK_FACTOR * _indexingRange);
+    std::exception_ptr error = nullptr;
+#pragma omp parallel num_threads(num_threads)
+    {
+      std::vector<unsigned> new_srcs, copy_of_neighbors, new_out_neighbors;
+      std::vector<Neighbor> dummy_pool;
+      tsl::robin_set<unsigned> dummy_visited;
+
+#pragma omp for schedule(dynamic, 64)
+      for (_s64 g = 0; g < (_s64) group_starts.size() - 1; g++) {
+        try {
+          unsigned des = links[group_starts[g]].first;
+          bool     prune_needed = false;
+          // reverse edges go in before the forward ones are published, as
+          // in inter_insert
+          new_srcs.clear();
+          for (size_t k = group_starts[g]; k < group_starts[g + 1]; k++)
+            new_srcs.push_back(links[k].second);
+          uint64_t epoch = _reverse_rebuild_epoch.load();
+          add_reverse_edges(des, new_srcs);
+          {
+            LockGuard guard(node_lock(des));
+            auto      des_pool = _final_graph[des];
+            new_srcs.erase(
+                std::remove_if(new_srcs.begin(), new_srcs.end(),
+                               [&](unsigned src) {
+                                 return std::find(des_pool.begin(),
+                                                  des_pool.end(),
+                                                  src) != des_pool.end();
+                               }),
+                new_srcs.end());
+            if (des_pool.size() + new_srcs.size() <= max_unpruned) {
+              if (!new_srcs.empty())
+                preserve_snapshot_row(des);
+              SeqlockWriteGuard version_guard(_versions[des]);
+              for (auto src : new_srcs)
+                des_pool.emplace_back(src);
+            } else {
+              copy_of_neighbors.assign(des_pool.begin(), des_pool.end());
+              copy_of_neighbors.insert(copy_of_neighbors.end(),
+                                       new_srcs.begin(), new_srcs.end());
+              prune_needed = true;
+            }
+          }  // des lock is released by this point
+
+          if (!prune_needed) {
+            if (reverse_rebuilt_since(epoch))
+              add_reverse_edges(des, new_srcs);
+            continue;
+          }
+
+          dummy_visited.clear();
+          dummy_pool.clear();
+          for (auto cur_nbr : copy_of_neighbors) {
+            if (dummy_visited.find(cur_nbr) == dummy_visited.end() &&
+                cur_nbr != des) {
+              float dist = _distance->compare(_data[des], _data[cur_nbr],
+                                              (unsigned) _aligned_dim);
+              dummy_pool.emplace_back(Neighbor(cur_nbr, dist, true));
+              dummy_visited.insert(cur_nbr);
+            }
+          }
+          {
+            ScratchStoreManager<InMemQueryScratch<T>> manager(_query_scratch);
+            prune_neighbors(des, dummy_pool, new_out_neighbors,
+                            manager.scratch_space());
+          }
+          epoch = _reverse_rebuild_epoch.load();
+          add_reverse_edges(des, new_out_neighbors);
+          {
+            LockGuard guard(node_lock(des));
+            preserve_snapshot_row(des);
+            SeqlockWriteGuard version_guard(_versions[des]);
+            _final_graph[des].assign(new_out_neighbors.begin(),
+                                     new_out_neighbors.end());
+          }
+          if (reverse_rebuilt_since(epoch))
+            add_reverse_edges(des, new_out_neighbors);
+        } catch (...) {
+#pragma omp critical
+          if (error == nullptr)
+            error = std::current_exception();
+        }
+      }
+    }
+    if (error != nullptr)
+      std::rethrow_exception(error);
+  }
+
+  template<typename T, typename TagT>
+  void Index<T, TagT>::preserve_snapshot_row(unsigned location) {
+    if (!_snapshot_active || _snapshot_state[location] != SNAPSHOT_PENDING)
+      return;
+    auto                  nbrs = _final_graph[location];
+    std::vector<unsigned> row(nbrs.begin(), nbrs.end());
+    {
+      std::lock_guard<std::mutex> guard(_snapshot_rows_mutex);
+      _snapshot_rows[location] = std::move(row);
+    }
+    _snapshot_state[location] = SNAPSHOT_PRESERVED;
+  }
+
+  // Seqlock read: the degree may be caught mid-write, hence the clamp; the
+  // copy only counts if the version was even and unchanged around it.
+  template<typename T, typename TagT>
+  void Index<T, TagT>::copy_neighbors(unsigned               location,
+                                      std::vector<unsigned> &nbrs) {
+    auto  row = _final_graph[location];
+    auto &version = _versions[location];
+    while (true) {
+      uint32_t before = version.load(std::memory_order_acquire);
+      if (before & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      size_t degree =
+          (std::min)((size_t) row.raw()[0], (size_t) row.capacity());
+      nbrs.resize(degree);
+      std::memcpy(nbrs.data(), row.data(), degree * sizeof(unsigned));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (version.load(std::memory_order_relaxed) == before)
+        return;
+    }
+  }
+
+  template<typename T, typename TagT>
+  void Index<T, TagT>::add_reverse_edge(unsigned src, unsigned dst) {
+    if (dst >= _reverse_graph.size())
+      return;
+
+    LockGuard guard(node_lock(dst));
+    if (_reverse_overflow[dst])
+      return;
+    auto in_nbrs = _reverse_graph[dst];
+    if (std::find(in_nbrs.begin(), in_nbrs.end(), src) != in_nbrs.end())
+      return;
+    if (in_nbrs.size() < _reverse_list_cap)
+      in_nbrs.push_back(src);
+    else
+      _reverse_overflow[dst] = 1;
+  }
+
+  template<typename T, typename TagT>
+  void Index<T, TagT>::add_reverse_edges(unsigned                     src,
+                                         const std::vector<unsigned> &dsts) {
+    if (_reverse_graph.size() == 0)
+      return;
+    for (auto dst : dsts)
+      add_reverse_edge(src, dst);
+  }
+
+  // Two passes: every list is emptied before any is refilled. An insert
+  // records its edges before writing them to _final_graph; if the second
+  // pass read the row before that write, the epoch bumped at the start tells
+  // the insert to record them again.
+  template<typename T, typename TagT>
+  void Index<T, TagT>::rebuild_reverse_graph(
+      const tsl::robin_set<unsigned> &skip_set, uint32_t num_threads) {
+    if (_reverse_list_cap == 0)
+      return;
+
+    diskann::Timer timer;
+    if (_reverse_graph.size() != _final_graph.size()) {
+      _reverse_graph.resize(_final_graph.size());
+      _reverse_overflow.assign(_final_graph.size(), 0);
+    }
+    _reverse_graph.reserve_degree(_reverse_list_cap);
+    if (num_threads == 0)
+      num_threads = omp_get_max_threads();
+    _reverse_rebuild_epoch++;
+
+    const _s64 num_locations = (_s64) _final_graph.size();
+#pragma omp parallel for num_threads(num_threads) schedule(static, 65536)
+    for (_s64 loc = 0; loc < num_locations; loc++) {
+      LockGuard guard(node_lock(loc));
+      _reverse_graph[loc].clear();
+      _reverse_overflow[loc] = 0;
+    }
+
+#pragma omp parallel num_threads(num_threads)
+    {
+      std::vector<unsigned> out_nbrs;
+#pragma omp for schedule(dynamic, 8192)
+      for (_s64 loc = 0; loc < num_locations; loc++) {
+        if (loc < (_s64) _max_points &&
+            (_empty_slots.is_in_set((_u32) loc) ||
+             skip_set.find((_u32) loc) != skip_set.end()))
+          continue;
+        {
+          LockGuard guard(node_lock(loc));
+          auto      nbrs = _final_graph[loc];
+          out_nbrs.assign(nbrs.begin(), nbrs.end());
+        }
+        add_reverse_edges((unsigned) loc, out_nbrs);
+      }
+    }
+    _reverse_rebuild_epoch++;
+
+    size_t num_overflowed = 0;
+    for (auto flag : _reverse_overflow)
+      num_overflowed += flag;
+    diskann::cout << "Rebuilt in-neighbor lists in "
+                  << timer.elapsed() / 1000000.0 << "s, " << num_overflowed
+                  << " points exceed the cap of " << _reverse_list_cap
+                  << std::endl;
+  }
+
   template<typename T, typename TagT>
   void Index<T, TagT>::inter_insert(unsigned               n,
-                                    std::vector<unsigned> &pruned_list) {
-    inter_insert(n, pruned_list, _indexingRange);
+                                    std::vector<unsigned> &pruned_list,
+                                    InMemQueryScratch<T> * scratch) {
+    inter_insert(n, pruned_list, _indexingRange, scratch);
   }
 
   template<typename T, typename TagT>
@@ -1081,10 +1644,23 @@ namespace diskann {
     _indexingMaxC = parameters.Get<unsigned>("C");
     _indexingAlpha = parameters.Get<float>("alpha");
 
+    // Multi-pass build: with num_rnds > 1 the first pass runs at alpha = 1 to
+    // quickly lay down a sparse graph, and every later pass re-searches each
+    // point on the improved graph at the target alpha.
+    const unsigned    num_rnds = parameters.Get<unsigned>("num_rnds", 1);
+    const std::string visit_order_type =
+        parameters.Get<std::string>("visit_order", "sequential");
+    if (num_rnds == 0)
+      throw diskann::ANNException("num_rnds must be at least 1", -1,
+                                  __FUNCSIG__, __FILE__, __LINE__);
+    if (visit_order_type != "sequential" && visit_order_type != "random")
+      throw diskann::ANNException(
+          "visit_order must be one of sequential/random, got " +
+              visit_order_type,
+          -1, __FUNCSIG__, __FILE__, __LINE__);
+
     /* visit_order is a vector that is initialized to the entire graph */
-    std::vector<unsigned>          visit_order;
-    std::vector<diskann::Neighbor> pool, tmp;
-    tsl::robin_set<unsigned>       visited;
+    std::vector<unsigned> visit_order;
     visit_order.reserve(_nd + _num_frozen_pts);
     for (unsigned i = 0; i < (unsigned) _nd; i++) {
       visit_order.emplace_back(i);
@@ -1099,64 +1675,114 @@ namespace diskann {
     else
       _start = calculate_entry_point();
 
-    for (uint64_t p = 0; p < _nd; p++) {
-      _final_graph[p].reserve(
-          (size_t)(std::ceil(_indexingRange * GRAPH_SLACK_FACTOR * 1.05)));
-    }
-
-    std::vector<unsigned> init_ids;
-    init_ids.emplace_back(_start);
+    // lists may grow past R by the slack factor before they are pruned
+    _final_graph.set_huge_pages(
+        parameters.Get<bool>("graph_huge_pages", false));
+    _final_graph.reserve_degree(slack_degree(_indexingRange));
+    diskann::cout << "Graph arena: "
+                  << _final_graph.memory_bytes() / (1024.0 * 1024 * 1024)
+                  << "GiB for " << _final_graph.size()
+                  << " points of max degree " << _final_graph.max_degree()
+                  << std::endl;
 
-    diskann::Timer link_timer;
+    // a random order spreads the early insertions (and their lock traffic)
+    // away from the neighborhood of the start point
+    std::random_device rd;
+    std::mt19937       gen(rd());
+
+    const float    target_alpha = _indexingAlpha;
+    diskann::Timer build_timer;
+    for (unsigned rnd = 0; rnd < num_rnds; rnd++) {
+      _indexingAlpha = (num_rnds > 1 && rnd == 0) ? 1.0f : target_alpha;
+      if (visit_order_type == "random")
+        std::shuffle(visit_order.begin(), visit_order.end(), gen);
+
+      diskann::cout << "Pass " << rnd + 1 << "/" << num_rnds
+                    << " (alpha: " << _indexingAlpha
+                    << ", visit order: " << visit_order_type << ")"
+                    << std::endl;
+      diskann::Timer link_timer;
 
+      std::exception_ptr error = nullptr;
 #pragma omp parallel for schedule(dynamic, 2048)
-    for (_s64 node_ctr = 0; node_ctr < (_s64)(visit_order.size()); node_ctr++) {
-      auto node = visit_order[node_ctr];
+      for (_s64 node_ctr = 0; node_ctr < (_s64)(visit_order.size());
+           node_ctr++) {
+        try {
+          auto node = visit_order[node_ctr];
 
-      ScratchStoreManager<InMemQueryScratch<T>> manager(_query_scratch);
-      auto scratch = manager.scratch_space();
+          ScratchStoreManager<InMemQueryScratch<T>> manager(_query_scratch);
+          auto scratch = manager.scratch_space();
 
-      search_for_point_and_add_links(node, _indexingQueueSize, scratch);
+          search_for_point_and_add_links(node, _indexingQueueSize, scratch,
+                                         rnd > 0);
 
-      if (node_ctr % 2000 == 0) {
-        diskann::cout << "\r" << (100.0 * node_ctr) / (visit_order.size())
-                      << "\% of index build completed." << std::flush;
+          if (node_ctr % 2000 == 0) {
+            diskann::cout << "\r" << (100.0 * node_ctr) / (visit_order.size())
+                          << "\% of pass completed." << std::flush;
+          }
+        } catch (...) {
+#pragma omp critical
+          if (error == nullptr)
+            error = std::current_exception();
+        }
       }
-    }
+      if (error != nullptr)
+        std::rethrow_exception(error);
+      double search_time = (double) link_timer.elapsed() / (double) 1000000;
 
-    if (_nd > 0) {
-      diskann::cout << "Starting final cleanup.." << std::flush;
-    }
+      if (_nd > 0) {
+        diskann::cout << "Starting final cleanup.." << std::flush;
+      }
+      diskann::Timer cleanup_timer;
 #pragma omp parallel for schedule(dynamic, 2048)
-    for (_s64 node_ctr = 0; node_ctr < (_s64)(visit_order.size()); node_ctr++) {
-      auto node = visit_order[node_ctr];
-      if (_final_graph[node].size() > _indexingRange) {
-        tsl::robin_set<unsigned> dummy_visited(0);
-        std::vector<Neighbor>    dummy_pool(0);
-        std::vector<unsigned>    new_out_neighbors;
+      for (_s64 node_ctr = 0; node_ctr < (_s64)(visit_order.size());
+           node_ctr++) {
+        try {
+          auto node = visit_order[node_ctr];
+          if (_final_graph[node].size() > _indexingRange) {
+            tsl::robin_set<unsigned> dummy_visited(0);
+            std::vector<Neighbor>    dummy_pool(0);
+            std::vector<unsigned>    new_out_neighbors;
+
+            for (auto cur_nbr : _final_graph[node]) {
+              if (dummy_visited.find(cur_nbr) == dummy_visited.end() &&
+                  cur_nbr != node) {
+                float dist = _distance->compare(_data[node], _data[cur_nbr],
+                                                (unsigned) _aligned_dim);
+                dummy_pool.emplace_back(Neighbor(cur_nbr, dist, true));
+                dummy_visited.insert(cur_nbr);
+              }
+            }
+            ScratchStoreManager<InMemQueryScratch<T>> manager(_query_scratch);
+            prune_neighbors(node, dummy_pool, new_out_neighbors,
+                            manager.scratch_space());
 
-        for (auto cur_nbr : _final_graph[node]) {
-          if (dummy_visited.find(cur_nbr) == dummy_visited.end() &&
-              cur_nbr != node) {
-            float dist =
-                _distance->compare(_data + _aligned_dim * (size_t) node,
-                                   _data + _aligned_dim * (size_t) cur_nbr,
-                                   (unsigned) _aligned_dim);
-            dummy_pool.emplace_back(Neighbor(cur_nbr, dist, true));
-            dummy_visited.insert(cur_nbr);
+            _final_graph[node].clear();
+            for (auto id : new_out_neighbors)
+              _final_graph[node].emplace_back(id);
           }
+        } catch (...) {
+#pragma omp critical
+          if (error == nullptr)
+            error = std::current_exception();
         }
-        prune_neighbors(node, dummy_pool, new_out_neighbors);
-
-        _final_graph[node].clear();
-        for (auto id : new_out_neighbors)
-          _final_graph[node].emplace_back(id);
+      }
+      if (error != nullptr)
+        std::rethrow_exception(error);
+      if (_nd > 0) {
+        diskann::cout << "done. Pass " << rnd + 1
+                      << " search+link time: " << search_time
+                      << "s, cleanup time: "
+                      << ((double) cleanup_timer.elapsed() / (double) 1000000)
+                      << "s" << std::endl;
       }
     }
-    if (_nd > 0) {
-      diskann::cout << "done. Link time: "
-                    << ((double) link_timer.elapsed() / (double) 1000000) << "s"
-                    << std::endl;
+    _indexingAlpha = target_alpha;
+
+    if (_nd > 0 && num_rnds > 1) {
+      diskann::cout << "Link time over " << num_rnds << " passes: "
+                    << ((double) build_timer.elapsed() / (double) 1000000)
+                    << "s" << std::endl;
     }
   }
 
@@ -1168,7 +1794,7 @@ namespace diskann {
       throw ANNException("Can not set starting point for a non-empty index", -1,
                          __FUNCSIG__, __FILE__, __LINE__);
 
-    memcpy(_data + _aligned_dim * _max_points, data, _aligned_dim * sizeof(T));
+    memcpy(_data[_max_points], data, _aligned_dim * sizeof(T));
     _has_built = true;
     diskann::cout << "Index start point set" << std::endl;
   }
@@ -1210,7 +1836,7 @@ namespace diskann {
              << "but tags vector is of size " << tags.size() << "."
              << std::endl;
       diskann::cerr << stream.str() << std::endl;
-      aligned_free(_data);
+      _data.clear();
       throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
                                   __LINE__);
     }
@@ -1231,11 +1857,16 @@ namespace diskann {
     }
 
     generate_frozen_point();
+
+    // the in-neighbor lists are computed once after the build instead of
+    // being updated on every edge the passes add and prune
+    _reverse_graph.clear();
     link(parameters);
+    rebuild_reverse_graph();
 
     size_t max = 0, min = SIZE_MAX, total = 0, cnt = 0;
     for (size_t i = 0; i < _nd; i++) {
-      auto &pool = _final_graph[i];
+      auto pool = _final_graph[i];
       max = std::max(max, pool.size());
       min = std::min(min, pool.size());
       total += pool.size();
@@ -1260,11 +1891,13 @@ namespace diskann {
 
     _nd = num_points_to_load;
 
-    memcpy((char *) _data, (char *) data, _aligned_dim * _nd * sizeof(T));
+    for (size_t i = 0; i < _nd; i++)
+      memcpy((char *) _data[i], (char *) (data + i * _aligned_dim),
+             _aligned_dim * sizeof(T));
 
     if (_normalize_vecs) {
       for (uint64_t i = 0; i < num_points_to_load; i++) {
-        normalize(_data + _aligned_dim * i, _aligned_dim);
+        normalize(_data[i], _aligned_dim);
       }
     }
 
@@ -1304,7 +1937,7 @@ namespace diskann {
              << "index can support only " << _max_points
              << " points as specified in constructor." << std::endl;
 
-      aligned_free(_data);
+      _data.clear();
       throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
                                   __LINE__);
     }
@@ -1315,7 +1948,7 @@ namespace diskann {
              << " points and file has only " << file_num_points << " points."
              << std::endl;
 
-      aligned_free(_data);
+      _data.clear();
       throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
                                   __LINE__);
     }
@@ -1326,17 +1959,17 @@ namespace diskann {
              << "but file has " << file_dim << " dimension." << std::endl;
       diskann::cerr << stream.str() << std::endl;
 
-      aligned_free(_data);
+      _data.clear();
       throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
                                   __LINE__);
     }
 
     {
-      copy_aligned_data_from_file<T>(filename, _data, file_num_points, file_dim,
-                                     _aligned_dim);
+      copy_aligned_data_from_file<T>(filename, _data, file_num_points,
+                                     file_dim);
       if (_normalize_vecs) {
         for (uint64_t i = 0; i < file_num_points; i++) {
-          normalize(_data + _aligned_dim * i, _aligned_dim);
+          normalize(_data[i], _aligned_dim);
         }
       }
     }
@@ -1416,11 +2049,11 @@ namespace diskann {
     auto retval =
         iterate_to_fixed_point(query, L, init_ids, scratch, true, true);
 
-    auto best_L_nodes = scratch->best_l_nodes();
+    auto &best_L_nodes = scratch->best_l_nodes();
 
     size_t pos = 0;
-    for (auto it : best_L_nodes) {
-      if (it.id < _max_points) {
+    for (auto &it : best_L_nodes) {
+      if (it.id < _max_points && !is_deleted(it.id)) {
         indices[pos] =
             (IdType) it.id;  // safe because our indices are always uint32_t and
                              // IDType will be uint32_t or uint64_t
@@ -1438,6 +2071,11 @@ namespace diskann {
       if (pos == K)
         break;
     }
+    for (; pos < K; pos++) {
+      indices[pos] = std::numeric_limits<IdType>::max();
+      if (distances != nullptr)
+        distances[pos] = std::numeric_limits<float>::max();
+    }
     return retval;
   }
 
@@ -1470,8 +2108,7 @@ namespace diskann {
         tags[pos] = tag;
 
         if (res_vectors.size() > 0) {
-          memcpy(res_vectors[pos], _data + ((size_t) indices[i]) * _aligned_dim,
-                 _dim * sizeof(T));
+          memcpy(res_vectors[pos], _data[indices[i]], _dim * sizeof(T));
         }
 
         if (distances != nullptr) {
@@ -1513,8 +2150,7 @@ namespace diskann {
     }
     size_t res = calculate_entry_point();
 
-    memcpy(_data + _max_points * _aligned_dim, _data + res * _aligned_dim,
-           _aligned_dim * sizeof(T));
+    memcpy(_data[_max_points], _data[res], _aligned_dim * sizeof(T));
 
     return 0;
   }
@@ -1546,6 +2182,7 @@ namespace diskann {
     tsl::robin_set<unsigned> candidate_set;
     std::vector<Neighbor>    expanded_nghrs;
     std::vector<Neighbor>    result;
+    std::vector<unsigned>    ngh_nbrs;
 
     bool modify = false;
 
@@ -1553,14 +2190,12 @@ namespace diskann {
       if (old_delete_set.find(ngh) != old_delete_set.end()) {
         modify = true;
 
-        // Add outgoing links from
-        if (_conc_consolidate)
-          _locks[ngh].lock();
-        for (auto j : _final_graph[ngh])
+        // Add outgoing links from; node_lock(ngh) may be the lock of i,
+        // held by the caller
+        copy_neighbors(ngh, ngh_nbrs);
+        for (auto j : ngh_nbrs)
           if (old_delete_set.find(j) == old_delete_set.end())
             candidate_set.insert(j);
-        if (_conc_consolidate)
-          _locks[ngh].unlock();
       } else {
         candidate_set.insert(ngh);
       }
@@ -1569,14 +2204,15 @@ namespace diskann {
       for (auto j : candidate_set) {
         expanded_nghrs.push_back(
             Neighbor(j,
-                     _distance->compare(_data + _aligned_dim * i,
-                                        _data + _aligned_dim * (size_t) j,
+                     _distance->compare(_data[i], _data[j],
                                         (unsigned) _aligned_dim),
                      true));
       }
 
       std::sort(expanded_nghrs.begin(), expanded_nghrs.end());
-      occlude_list(expanded_nghrs, alpha, range, maxc, result);
+      ScratchStoreManager<InMemQueryScratch<T>> manager(_query_scratch);
+      occlude_list(expanded_nghrs, alpha, range, maxc, result,
+                   manager.scratch_space());
 
       {
         _final_graph[i].clear();
@@ -1642,10 +2278,21 @@ namespace diskann {
 
     diskann::cout << "Starting consolidate_deletes... ";
 
+    const size_t max_deletes = params.Get<unsigned>("max_deletes", 0);
+
     tsl::robin_set<unsigned> old_delete_set;
     {
       std::unique_lock<std::shared_timed_mutex> dl(_delete_lock);
-      _delete_set.swap(old_delete_set);
+      if (max_deletes == 0 || _delete_set.size() <= max_deletes) {
+        _delete_set.swap(old_delete_set);
+      } else {
+        old_delete_set.reserve(max_deletes);
+        auto iter = _delete_set.begin();
+        while (old_delete_set.size() < max_deletes) {
+          old_delete_set.insert(*iter);
+          iter = _delete_set.erase(iter);
+        }
+      }
     }
 
     const unsigned range = params.Get<unsigned>("R");
@@ -1656,22 +2303,137 @@ namespace diskann {
                                      : params.Get<unsigned>("num_threads");
 
     diskann::Timer timer;
+
+    // Only the in-neighbors of deleted points have edges to repair. Collect
+    // them from the in-neighbor lists unless a full sweep is due or asked
+    // for. The in-neighbors of a point whose list overflowed are unknown:
+    // without periodic sweeps that forces a full sweep, with them the point
+    // stays lazily deleted until the next one.
+    bool                     full_sweep = true;
+    std::vector<unsigned>    to_process;
+    tsl::robin_set<unsigned> deferred;
+    if (_reverse_graph.size() > 0) {
+      full_sweep = params.Get<bool>("full_sweep", false) ||
+                   (_full_sweep_interval > 0 &&
+                    ++_consolidations_since_sweep >= _full_sweep_interval);
+      for (auto del : old_delete_set) {
+        if (full_sweep)
+          break;
+        LockGuard guard(node_lock(del));
+        if (_reverse_overflow[del]) {
+          if (_full_sweep_interval == 0)
+            full_sweep = true;
+          else
+            deferred.insert(del);
+        }
+      }
+      if (!full_sweep && !deferred.empty()) {
+        for (auto del : deferred)
+          old_delete_set.erase(del);
+        std::unique_lock<std::shared_timed_mutex> dl(_delete_lock);
+        _delete_set.insert(deferred.begin(), deferred.end());
+      }
+      // Deferred points stay in the graph, so their edges to the deletes
+      // released here are repaired like those of live points.
+      tsl::robin_set<unsigned> in_nbrs_of_deleted;
+      for (auto del : old_delete_set) {
+        if (full_sweep)
+          break;
+        LockGuard guard(node_lock(del));
+        for (auto src : _reverse_graph[del])
+          if (src < _max_points &&
+              old_delete_set.find(src) == old_delete_set.end())
+            in_nbrs_of_deleted.insert(src);
+      }
+      if (!full_sweep) {
+        to_process.assign(in_nbrs_of_deleted.begin(),
+                          in_nbrs_of_deleted.end());
+        // stale entries may name slots that were released since
+        to_process.erase(std::remove_if(to_process.begin(), to_process.end(),
+                                        [this](unsigned loc) {
+                                          return _empty_slots.is_in_set(loc);
+                                        }),
+                         to_process.end());
+      }
+    }
+
+    if (full_sweep) {
+      std::exception_ptr error = nullptr;
 #pragma omp parallel for num_threads(num_threads) schedule(dynamic, 8192)
-    for (_s64 loc = 0; loc < (_s64) _max_points; loc++) {
-      if (old_delete_set.find((_u32) loc) == old_delete_set.end() &&
-          !_empty_slots.is_in_set((_u32) loc)) {
-        if (_conc_consolidate) {
-          LockGuard adj_list_lock(_locks[loc]);
-          process_delete(old_delete_set, loc, range, maxc, alpha);
-        } else {
-          process_delete(old_delete_set, loc, range, maxc, alpha);
+      for (_s64 loc = 0; loc < (_s64) _max_points; loc++) {
+        try {
+          if (old_delete_set.find((_u32) loc) == old_delete_set.end() &&
+              !_empty_slots.is_in_set((_u32) loc)) {
+            if (_conc_consolidate) {
+              LockGuard         adj_list_lock(node_lock(loc));
+              SeqlockWriteGuard version_guard(_versions[loc]);
+              process_delete(old_delete_set, loc, range, maxc, alpha);
+            } else {
+              process_delete(old_delete_set, loc, range, maxc, alpha);
+            }
+          }
+        } catch (...) {
+#pragma omp critical
+          if (error == nullptr)
+            error = std::current_exception();
         }
       }
+      if (error != nullptr)
+        std::rethrow_exception(error);
+    } else {
+      diskann::cout << "repairing " << to_process.size()
+                    << " in-neighbors of the deleted points, deferring "
+                    << deferred.size() << " deletes to the next full sweep... ";
+      std::exception_ptr error = nullptr;
+#pragma omp parallel num_threads(num_threads)
+      {
+        std::vector<unsigned> new_nbrs;
+#pragma omp for schedule(dynamic, 64)
+        for (_s64 i = 0; i < (_s64) to_process.size(); i++) {
+          try {
+            auto loc = to_process[i];
+            {
+              LockGuard         adj_list_lock(node_lock(loc));
+              SeqlockWriteGuard version_guard(_versions[loc]);
+              process_delete(old_delete_set, loc, range, maxc, alpha);
+              auto nbrs = _final_graph[loc];
+              new_nbrs.assign(nbrs.begin(), nbrs.end());
+            }
+            add_reverse_edges(loc, new_nbrs);
+          } catch (...) {
+#pragma omp critical
+            if (error == nullptr)
+              error = std::current_exception();
+          }
+        }
+      }
+      if (error != nullptr)
+        std::rethrow_exception(error);
     }
     for (_s64 loc = _max_points; loc < (_s64)(_max_points + _num_frozen_pts);
          loc++) {
-      LockGuard adj_list_lock(_locks[loc]);
-      process_delete(old_delete_set, loc, range, maxc, alpha);
+      std::vector<unsigned> new_nbrs;
+      {
+        LockGuard         adj_list_lock(node_lock(loc));
+        SeqlockWriteGuard version_guard(_versions[loc]);
+        process_delete(old_delete_set, loc, range, maxc, alpha);
+        auto nbrs = _final_graph[loc];
+        new_nbrs.assign(nbrs.begin(), nbrs.end());
+      }
+      add_reverse_edges((unsigned) loc, new_nbrs);
+    }
+
+    if (_reverse_graph.size() > 0) {
+      if (full_sweep) {
+        rebuild_reverse_graph(old_delete_set, num_threads);
+        _consolidations_since_sweep = 0;
+      }
+      // the released slots start over without in-neighbors
+      for (auto del : old_delete_set) {
+        LockGuard guard(node_lock(del));
+        _reverse_graph[del].clear();
+        _reverse_overflow[del] = 0;
+      }
     }
 
     std::unique_lock<std::shared_timed_mutex> tl(_tag_lock);
@@ -1692,6 +2454,124 @@ namespace diskann {
         _delete_set.size(), duration);
   }
 
+  template<typename T, typename TagT>
+  void Index<T, TagT>::start_background_consolidation(
+      const Parameters &parameters) {
+    if (!_enable_tags)
+      throw diskann::ANNException("Point tag array not instantiated", -1,
+                                  __FUNCSIG__, __FILE__, __LINE__);
+    if (_bg_thread.joinable())
+      throw diskann::ANNException("Background consolidation already running",
+                                  -1, __FUNCSIG__, __FILE__, __LINE__);
+    // otherwise every slice holds _update_lock and stalls all searches
+    if (!_conc_consolidate)
+      throw diskann::ANNException(
+          "Background consolidation needs an index created with "
+          "concurrent_consolidate",
+          -1, __FUNCSIG__, __FILE__, __LINE__);
+
+    const unsigned range = parameters.Get<unsigned>("R");
+    const unsigned maxc = parameters.Get<unsigned>("C");
+    const float    alpha = parameters.Get<float>("alpha");
+    const unsigned num_threads = parameters.Get<unsigned>("num_threads", 0);
+    const float    delete_ratio = parameters.Get<float>("delete_ratio", 0.05f);
+    // Without in-neighbor lists every slice sweeps all points, so slicing
+    // would only multiply the work: all pending deletes go in one slice.
+    const unsigned max_deletes =
+        _reverse_list_cap > 0 ? parameters.Get<unsigned>("max_deletes", 10000)
+                              : 0;
+    const float    cpu_budget = parameters.Get<float>("cpu_budget", 0.25f);
+    const std::chrono::milliseconds poll_interval(
+        parameters.Get<unsigned>("poll_interval_ms", 100));
+    if (cpu_budget <= 0 || cpu_budget > 1)
+      throw diskann::ANNException("cpu_budget must be in (0, 1]", -1,
+                                  __FUNCSIG__, __FILE__, __LINE__);
+
+    {
+      std::lock_guard<std::mutex> guard(_bg_mutex);
+      _bg_stop = false;
+      _bg_stats = background_consolidation_stats();
+      _bg_stats._running = true;
+    }
+
+    _bg_thread = std::thread([=]() {
+      // once the ratio is crossed, keep consolidating until no delete is left
+      bool                         draining = false;
+      std::unique_lock<std::mutex> guard(_bg_mutex);
+      while (!_bg_stop) {
+        size_t pending, num_points;
+        {
+          std::shared_lock<std::shared_timed_mutex> tl(_tag_lock);
+          std::shared_lock<std::shared_timed_mutex> dl(_delete_lock);
+          pending = _delete_set.size();
+          num_points = _nd;
+        }
+        _bg_stats._pending_deletes = pending;
+        draining = pending > 0 &&
+                   (draining || pending >= delete_ratio * num_points);
+        if (!draining) {
+          _bg_cv.wait_for(guard, poll_interval, [this] { return _bg_stop; });
+          continue;
+        }
+
+        guard.unlock();
+        Parameters slice_params;
+        slice_params.Set<unsigned>("R", range);
+        slice_params.Set<unsigned>("C", maxc);
+        slice_params.Set<float>("alpha", alpha);
+        slice_params.Set<unsigned>("num_threads", num_threads);
+        slice_params.Set<unsigned>("max_deletes", max_deletes);
+        diskann::Timer       timer;
+        consolidation_report report(consolidation_report::status_code::FAIL,
+                                    0, 0, 0, 0, 0, 0);
+        try {
+          report = consolidate_deletes(slice_params);
+        } catch (const std::exception &e) {
+          diskann::cerr << "Background consolidation failed: " << e.what()
+                        << std::endl;
+        }
+        double busy = timer.elapsed() / 1000000.0;
+        guard.lock();
+
+        _bg_stats._busy_time += busy;
+        _bg_stats._last_report = report;
+        if (report._status != consolidation_report::status_code::SUCCESS) {
+          _bg_stats._failed_slices++;
+          _bg_cv.wait_for(guard, poll_interval, [this] { return _bg_stop; });
+          continue;
+        }
+        _bg_stats._slices++;
+        _bg_stats._slots_released += report._slots_released;
+        _bg_stats._pending_deletes = report._delete_set_size;
+
+        // idle so that busy / (busy + idle) stays at cpu_budget
+        _bg_cv.wait_for(guard,
+                        std::chrono::duration<double>(busy * (1 - cpu_budget) /
+                                                      cpu_budget),
+                        [this] { return _bg_stop; });
+      }
+      _bg_stats._running = false;
+    });
+  }
+
+  template<typename T, typename TagT>
+  void Index<T, TagT>::stop_background_consolidation() {
+    {
+      std::lock_guard<std::mutex> guard(_bg_mutex);
+      _bg_stop = true;
+    }
+    _bg_cv.notify_all();
+    if (_bg_thread.joinable())
+      _bg_thread.join();
+  }
+
+  template<typename T, typename TagT>
+  background_consolidation_stats
+  Index<T, TagT>::get_background_consolidation_stats() {
+    std::lock_guard<std::mutex> guard(_bg_mutex);
+    return _bg_stats;
+  }
+
   template<typename T, typename TagT>
   void Index<T, TagT>::compact_frozen_point() {
     if (_nd < _max_points) {
@@ -1707,10 +2587,8 @@ namespace diskann {
           _final_graph[_nd].clear();
           _final_graph[_nd].swap(_final_graph[_max_points]);
 
-          memcpy((void *) (_data + _aligned_dim * _nd),
-                 _data + (size_t) _aligned_dim * _max_points, sizeof(T) * _dim);
-          memset((_data + (size_t) _aligned_dim * _max_points), 0,
-                 sizeof(T) * _aligned_dim);
+          memcpy((void *) _data[_nd], _data[_max_points], sizeof(T) * _dim);
+          memset(_data[_max_points], 0, sizeof(T) * _aligned_dim);
         }
       } else if (_num_frozen_pts > 1) {
         throw ANNException("Case not implemented.", -1, __FUNCSIG__, __FILE__,
@@ -1744,103 +2622,201 @@ namespace diskann {
     }
 
     diskann::Timer timer;
+    relocate_points(std::numeric_limits<size_t>::max());
+    for (size_t i = 0; i < _deleted_bits.size(); i++)
+      _deleted_bits[i].store(0, std::memory_order_relaxed);
 
-    std::vector<unsigned> new_location =
-        std::vector<unsigned>(_max_points + _num_frozen_pts, (_u32) UINT32_MAX);
+    _data_compacted = true;
+    diskann::cout << "Time taken for compact_data: "
+                  << timer.elapsed() / 1000000. << "s." << std::endl;
+  }
 
-    _u32           new_counter = 0;
-    std::set<_u32> empty_locations;
-    for (_u32 old_location = 0; old_location < _max_points; old_location++) {
-      if (_location_to_tag.contains(old_location)) {
-        new_location[old_location] = new_counter;
-        new_counter++;
-      } else {
-        empty_locations.insert(old_location);
-      }
-    }
-    for (_u32 old_location = _max_points;
-         old_location < _max_points + _num_frozen_pts; old_location++) {
-      new_location[old_location] = old_location;
-    }
+  template<typename T, typename TagT>
+  size_t Index<T, TagT>::compact_data_incremental(size_t   max_moves,
+                                                  uint32_t num_threads) {
+    if (!_dynamic_index)
+      throw ANNException("Can not compact a non-dynamic index", -1, __FUNCSIG__,
+                         __FILE__, __LINE__);
 
-    // If cur node is removed, replace it.
-    if (_delete_set.find(_start) != _delete_set.end()) {
-      diskann::cerr << "Replacing cur node which has been deleted... "
-                    << std::flush;
-      auto old_ep = _start;
-      // First active neighbor of old cur node is new cur node
-      for (auto iter : _final_graph[_start])
-        if (_delete_set.find(iter) != _delete_set.end()) {
-          _start = iter;
-          break;
-        }
-      if (_start == old_ep) {
-        throw diskann::ANNException(
-            "ERROR: Did not find a replacement for cur node.", -1, __FUNCSIG__,
-            __FILE__, __LINE__);
-      } else {
-        assert(_delete_set.find(_start) == _delete_set.end());
-      }
-    }
-
-    size_t num_dangling = 0;
-    for (unsigned old = 0; old < _max_points + _num_frozen_pts; ++old) {
-      if ((new_location[old] < _max_points)  // If point continues to exist
-          || (old >= _max_points && old < _max_points + _num_frozen_pts)) {
-        for (size_t i = 0; i < _final_graph[old].size(); ++i) {
-          if (empty_locations.find(_final_graph[old][i]) !=
-              empty_locations.end()) {
-            ++num_dangling;
-            diskann::cerr << "Error in compact_data(). _final_graph[" << old
-                          << "][" << i << "] = " << _final_graph[old][i]
-                          << " which is a location not associated with any tag."
-                          << std::endl;
-            _final_graph[old].erase(_final_graph[old].begin() + i);
-            i--;
-          } else {
-            _final_graph[old][i] = new_location[_final_graph[old][i]];
-          }
-        }
+    std::unique_lock<std::shared_timed_mutex> ul(_update_lock);
+    std::unique_lock<std::shared_timed_mutex> cl(_consolidate_lock);
+    std::unique_lock<std::shared_timed_mutex> tl(_tag_lock);
+    std::unique_lock<std::shared_timed_mutex> dl(_delete_lock);
+    if (_data_compacted)
+      return 0;
 
-        // Move the data and adj list to the correct position
-        if (new_location[old] != old) {
-          assert(new_location[old] < old);
-          _final_graph[new_location[old]].swap(_final_graph[old]);
+    diskann::Timer timer;
+    size_t         num_left = relocate_points(max_moves, num_threads);
+    if (num_left == 0 && _delete_set.empty())
+      _data_compacted = true;
+    diskann::cout << "Compaction step took " << timer.elapsed() / 1000000.
+                  << "s, " << num_left << " points left to move" << std::endl;
+    return num_left;
+  }
 
-          memcpy((void *) (_data + _aligned_dim * (size_t) new_location[old]),
-                 (void *) (_data + _aligned_dim * (size_t) old),
-                 _aligned_dim * sizeof(T));
+  // The free slots below _nd and the points past it come in equal numbers.
+  // Both are listed in id order with a prefix sum over per-block counts, and
+  // the moves run in parallel: the rows written (below _nd) and read (past
+  // it) are disjoint. The ids of moved points are then rewritten in every
+  // adjacency list in one parallel pass, and the tag maps, delete set and
+  // free slots are patched for the moved points only.
+  template<typename T, typename TagT>
+  size_t Index<T, TagT>::relocate_points(size_t   max_moves,
+                                         uint32_t num_threads) {
+    if (num_threads == 0)
+      num_threads = omp_get_max_threads();
+    const size_t nd = _nd;
+    const size_t block_size = 65536;
+    const size_t num_blocks = DIV_ROUND_UP(_max_points, block_size);
+
+    // per block: free slots below nd, points past nd, free slots past nd
+    std::vector<size_t> hole_offsets(num_blocks + 1, 0);
+    std::vector<size_t> tail_offsets(num_blocks + 1, 0);
+    std::vector<size_t> free_offsets(num_blocks + 1, 0);
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+    for (_s64 b = 0; b < (_s64) num_blocks; b++) {
+      size_t end = (std::min)((size_t)(b + 1) * block_size, _max_points);
+      for (size_t loc = (size_t) b * block_size; loc < end; loc++) {
+        bool is_free = _empty_slots.is_in_set((unsigned) loc);
+        if (loc < nd)
+          hole_offsets[b + 1] += is_free;
+        else if (is_free)
+          free_offsets[b + 1]++;
+        else
+          tail_offsets[b + 1]++;
+      }
+    }
+    std::partial_sum(hole_offsets.begin(), hole_offsets.end(),
+                     hole_offsets.begin());
+    std::partial_sum(tail_offsets.begin(), tail_offsets.end(),
+                     tail_offsets.begin());
+    std::partial_sum(free_offsets.begin(), free_offsets.end(),
+                     free_offsets.begin());
+    if (hole_offsets.back() != tail_offsets.back()) {
+      std::stringstream stream;
+      stream << "Found " << hole_offsets.back() << " free slots below _nd="
+             << nd << " but " << tail_offsets.back() << " points past it";
+      throw ANNException(stream.str(), -1, __FUNCSIG__, __FILE__, __LINE__);
+    }
+
+    std::vector<unsigned> holes(hole_offsets.back());
+    std::vector<unsigned> tails(tail_offsets.back());
+    std::vector<unsigned> free_past_nd(free_offsets.back());
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic, 1)
+    for (_s64 b = 0; b < (_s64) num_blocks; b++) {
+      size_t end = (std::min)((size_t)(b + 1) * block_size, _max_points);
+      size_t hole = hole_offsets[b], tail = tail_offsets[b],
+             free = free_offsets[b];
+      for (size_t loc = (size_t) b * block_size; loc < end; loc++) {
+        bool is_free = _empty_slots.is_in_set((unsigned) loc);
+        if (loc < nd) {
+          if (is_free)
+            holes[hole++] = (unsigned) loc;
+        } else if (is_free) {
+          free_past_nd[free++] = (unsigned) loc;
+        } else {
+          tails[tail++] = (unsigned) loc;
         }
-      } else {
-        _final_graph[old].clear();
       }
     }
-    diskann::cerr << "#dangling references after data compaction: "
-                  << num_dangling << std::endl;
 
-    _tag_to_location.clear();
-    for (auto pos = _location_to_tag.find_first(); pos.is_valid();
-         pos = _location_to_tag.find_next(pos)) {
-      const auto tag = _location_to_tag.get(pos);
-      _tag_to_location[tag] = new_location[pos._key];
-    }
-    _location_to_tag.clear();
-    for (auto iter : _tag_to_location) {
-      _location_to_tag.set(iter.second, iter.first);
+    // the farthest points move to the lowest free slots
+    const size_t num_moves = (std::min)(max_moves, holes.size());
+    std::vector<unsigned> moved_to(_max_points - nd,
+                                   std::numeric_limits<unsigned>::max());
+    for (size_t i = 0; i < num_moves; i++)
+      moved_to[tails[tails.size() - 1 - i] - nd] = holes[i];
+
+#pragma omp parallel for num_threads(num_threads) schedule(static, 4096)
+    for (_s64 i = 0; i < (_s64) num_moves; i++) {
+      unsigned src = tails[tails.size() - 1 - i], dst = holes[i];
+      auto     nbrs = _final_graph[src];
+      _final_graph[dst].assign(nbrs.begin(), nbrs.end());
+      _final_graph[src].clear();
+      if (dst < _reverse_graph.size()) {
+        auto in_nbrs = _reverse_graph[src];
+        _reverse_graph[dst].assign(in_nbrs.begin(), in_nbrs.end());
+        _reverse_graph[src].clear();
+        _reverse_overflow[dst] = _reverse_overflow[src];
+        _reverse_overflow[src] = 0;
+      }
+      memcpy((void *) _data[dst], _data[src], sizeof(T) * _aligned_dim);
+      memset(_data[src], 0, sizeof(T) * _aligned_dim);
+
+      // the slot may keep the bit of the point deleted there before
+      clear_deleted(dst);
+      if (is_deleted(src)) {
+        set_deleted(dst);
+        clear_deleted(src);
+      }
     }
 
-    for (_u64 old = _nd; old < _max_points; ++old) {
-      _final_graph[old].clear();
-    }
-    _delete_set.clear();
-    _empty_slots.clear();
-    for (auto i = _nd; i < _max_points; i++) {
-      _empty_slots.insert((uint32_t) i);
+    // Rewrite the ids of the moved points, drop edges to free slots, which
+    // no list should hold, and empty the lists left in free slots. The free
+    // slots below filled_end were filled above and hold moved points now.
+    const size_t filled_end = num_moves > 0 ? holes[num_moves - 1] + 1 : 0;
+    size_t     num_dangling = 0;
+    auto       new_id = [&](unsigned id) {
+      return id >= nd && id < _max_points &&
+                     moved_to[id - nd] != std::numeric_limits<unsigned>::max()
+                       ? moved_to[id - nd]
+                       : id;
+    };
+    const _s64 num_rows = (_s64) _final_graph.size();
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic, 8192) \
+    reduction(+ : num_dangling)
+    for (_s64 loc = 0; loc < num_rows; loc++) {
+      auto nbrs = _final_graph[loc];
+      if (loc < (_s64) _max_points && (size_t) loc >= filled_end &&
+          _empty_slots.is_in_set((unsigned) loc)) {
+        nbrs.clear();
+        if (loc < (_s64) _reverse_graph.size())
+          _reverse_graph[loc].clear();
+        continue;
+      }
+      for (size_t j = 0; j < nbrs.size(); j++) {
+        unsigned id = nbrs[j];
+        if (id < _max_points && _empty_slots.is_in_set(id)) {
+          num_dangling++;
+          nbrs.erase(nbrs.begin() + j);
+          j--;
+        } else {
+          nbrs[j] = new_id(id);
+        }
+      }
+      if (loc < (_s64) _reverse_graph.size())
+        for (auto &in_nbr : _reverse_graph[loc])
+          in_nbr = new_id(in_nbr);
+    }
+    if (num_dangling > 0)
+      diskann::cerr << "#dangling references after data compaction: "
+                    << num_dangling << std::endl;
+
+    for (size_t i = 0; i < num_moves; i++) {
+      unsigned src = tails[tails.size() - 1 - i], dst = holes[i];
+      TagT     tag;
+      if (_location_to_tag.try_get(src, tag)) {
+        _location_to_tag.erase(src);
+        _location_to_tag.set(dst, tag);
+        _tag_to_location[tag] = dst;
+      }
+      if (_delete_set.erase(src) > 0)
+        _delete_set.insert(dst);
     }
+    _start = new_id(_start);
 
-    _data_compacted = true;
-    diskann::cout << "Time taken for compact_data: "
-                  << timer.elapsed() / 1000000. << "s." << std::endl;
+    // Free slots past _nd go first, so that inserts fill the slots left
+    // below _nd before them.
+    _empty_slots.clear();
+    _empty_slots.reserve(_max_points - nd);
+    for (size_t i = 0; i < num_moves; i++)
+      _empty_slots.insert(tails[tails.size() - 1 - i]);
+    for (auto slot : free_past_nd)
+      _empty_slots.insert(slot);
+    for (size_t i = num_moves; i < holes.size(); i++)
+      _empty_slots.insert(holes[i]);
+
+    return holes.size() - num_moves;
   }
 
   template<typename T, typename TagT>
@@ -1863,6 +2839,7 @@ namespace diskann {
 
       location = _empty_slots.pop_any();
       _delete_set.erase(location);
+      clear_deleted(location);
     }
 
     ++_nd;
@@ -1904,22 +2881,35 @@ namespace diskann {
   template<typename T, typename TagT>
   void Index<T, TagT>::reposition_point(unsigned old_location,
                                         unsigned new_location) {
-    for (unsigned i = 0; i < _nd; i++)
-      for (unsigned j = 0; j < _final_graph[i].size(); j++)
-        if (_final_graph[i][j] == old_location)
-          _final_graph[i][j] = (unsigned) new_location;
-
-    _final_graph[new_location].clear();
-    for (unsigned k = 0; k < _final_graph[_nd].size(); k++)
-      _final_graph[new_location].emplace_back(_final_graph[old_location][k]);
+    // live points may sit past _nd until the data is compacted
+#pragma omp parallel for schedule(static, 65536)
+    for (_s64 i = 0; i < (_s64) _final_graph.size(); i++)
+      for (auto &nbr : _final_graph[i])
+        if (nbr == old_location)
+          nbr = new_location;
+
+    auto old_nbrs = _final_graph[old_location];
+    _final_graph[new_location].assign(old_nbrs.begin(), old_nbrs.end());
+
+    // the in-neighbors move along, and the out-neighbors learn the new id
+    if (new_location < _reverse_graph.size()) {
+      auto old_in_nbrs = _reverse_graph[old_location];
+      _reverse_graph[new_location].assign(old_in_nbrs.begin(),
+                                          old_in_nbrs.end());
+      _reverse_graph[old_location].clear();
+      _reverse_overflow[new_location] = _reverse_overflow[old_location];
+      _reverse_overflow[old_location] = 0;
+      for (auto nbr : old_nbrs)
+        for (auto &in_nbr : _reverse_graph[nbr])
+          if (in_nbr == old_location)
+            in_nbr = new_location;
+    }
 
     _final_graph[old_location].clear();
 
-    memcpy((void *) (_data + (size_t) _aligned_dim * new_location),
-           _data + (size_t) _aligned_dim * old_location,
-           sizeof(T) * _aligned_dim);
-    memset((_data + (size_t) _aligned_dim * old_location), 0,
+    memcpy((void *) _data[new_location], _data[old_location],
            sizeof(T) * _aligned_dim);
+    memset(_data[old_location], 0, sizeof(T) * _aligned_dim);
   }
 
   template<typename T, typename TagT>
@@ -1937,33 +2927,29 @@ namespace diskann {
     _start = (_u32) _max_points;
   }
 
+  // Segments are appended for the new locations, so nothing stored moves
+  // but the frozen point, which goes to the new end.
   template<typename T, typename TagT>
   void Index<T, TagT>::resize(size_t new_max_points) {
     auto start = std::chrono::high_resolution_clock::now();
-    assert(_empty_slots.size() ==
-           0);  // should not resize if there are empty slots.
-#ifndef _WINDOWS
-    T *new_data;
-    alloc_aligned((void **) &new_data,
-                  (new_max_points + 1) * _aligned_dim * sizeof(T),
-                  8 * sizeof(T));
-    memcpy(new_data, _data, (_max_points + 1) * _aligned_dim * sizeof(T));
-    aligned_free(_data);
-    _data = new_data;
-#else
-    realloc_aligned((void **) &_data,
-                    (new_max_points + 1) * _aligned_dim * sizeof(T),
-                    8 * sizeof(T));
-#endif
+    // the slots already free stay free; without any, [_nd, _max_points) is
+    // either full or handed out in order
+    size_t first_new_slot = _empty_slots.is_empty() ? _nd : _max_points;
+    _data.resize(new_max_points + 1);
     _final_graph.resize(new_max_points + 1);
-    _locks = std::vector<non_recursive_mutex>(new_max_points + 1);
+    _versions.resize(new_max_points + 1);
+    _deleted_bits.resize(DIV_ROUND_UP(new_max_points + 1, 64));
+    if (_reverse_graph.size() != 0) {
+      _reverse_graph.resize(new_max_points + 1);
+      _reverse_overflow.resize(new_max_points + 1, 0);
+    }
 
     reposition_point((_u32) _max_points, (_u32) new_max_points);
     _max_points = new_max_points;
     _start = (_u32) new_max_points;
 
     _empty_slots.reserve(_max_points);
-    for (auto i = _nd; i < _max_points; i++) {
+    for (auto i = first_new_slot; i < _max_points; i++) {
       _empty_slots.insert((uint32_t) i);
     }
 
@@ -1994,7 +2980,19 @@ namespace diskann {
       shared_ul.unlock();
 
       {
-        std::unique_lock<std::shared_timed_mutex> ul(_update_lock);
+        // resizing moves the frozen point, so wait for a snapshot being
+        // written without holding off searches and inserts meanwhile
+        std::unique_lock<std::shared_timed_mutex> ul(_update_lock,
+                                                     std::defer_lock);
+        std::unique_lock<std::shared_timed_mutex> cl(_consolidate_lock,
+                                                     std::defer_lock);
+        while (true) {
+          ul.lock();
+          if (cl.try_lock())
+            break;
+          ul.unlock();
+          std::shared_lock<std::shared_timed_mutex> wait(_consolidate_lock);
+        }
         tl.lock();
 
         if (_nd >= _max_points) {
@@ -2003,6 +3001,7 @@ namespace diskann {
         }
 
         tl.unlock();
+        cl.unlock();
         ul.unlock();
       }
 
@@ -2033,12 +3032,12 @@ namespace diskann {
     tl.unlock();
 
     // Copy the vector in to the data array
-    auto offset_data = _data + (size_t) _aligned_dim * location;
+    auto offset_data = _data[location];
     memset((void *) offset_data, 0, sizeof(T) * _aligned_dim);
     memcpy((void *) offset_data, point, sizeof(T) * _dim);
 
     if (_normalize_vecs) {
-      normalize((float *) offset_data, _dim);
+      normalize(offset_data, _dim);
     }
 
     // Find and add appropriate graph edges
@@ -2050,6 +3049,136 @@ namespace diskann {
     return 0;
   }
 
+  template<typename T, typename TagT>
+  void Index<T, TagT>::insert_points(const T *                points,
+                                     const std::vector<TagT> &tags,
+                                     std::vector<TagT> &      failed_tags,
+                                     uint32_t                 num_threads) {
+    assert(_has_built);
+    if (failed_tags.size() > 0) {
+      throw ANNException("failed_tags should be passed as an empty list", -1,
+                         __FUNCSIG__, __FILE__, __LINE__);
+    }
+    for (auto tag : tags) {
+      if (tag == static_cast<TagT>(0)) {
+        throw diskann::ANNException(
+            "Do not insert point with tag 0. That is reserved for points "
+            "hidden from the user.",
+            -1, __FUNCSIG__, __FILE__, __LINE__);
+      }
+    }
+    if (num_threads == 0)
+      num_threads = omp_get_max_threads();
+
+    std::shared_lock<std::shared_timed_mutex> shared_ul(_update_lock);
+
+#if EXPAND_IF_FULL
+    // grow once for the whole batch; points that still find no slot, e.g.
+    // after concurrent inserts took the new ones, fail as usual
+    bool batch_fits;
+    {
+      std::shared_lock<std::shared_timed_mutex> tl(_tag_lock);
+      batch_fits = _nd + tags.size() <= _max_points;
+    }
+    if (!batch_fits) {
+      shared_ul.unlock();
+      {
+        // as in insert_point, wait for a snapshot being written without
+        // holding _update_lock
+        std::unique_lock<std::shared_timed_mutex> ul(_update_lock,
+                                                     std::defer_lock);
+        std::unique_lock<std::shared_timed_mutex> cl(_consolidate_lock,
+                                                     std::defer_lock);
+        while (true) {
+          ul.lock();
+          if (cl.try_lock())
+            break;
+          ul.unlock();
+          std::shared_lock<std::shared_timed_mutex> wait(_consolidate_lock);
+        }
+        std::unique_lock<std::shared_timed_mutex> tl(_tag_lock);
+        if (_nd + tags.size() > _max_points)
+          resize((std::max)((size_t)(_max_points * INDEX_GROWTH_FACTOR),
+                            _nd + tags.size()));
+      }
+      shared_ul.lock();
+    }
+#endif
+
+    // Reserve the locations and tags of the whole batch at once
+    std::vector<unsigned> locations;
+    std::vector<size_t>   batch_ids;
+    locations.reserve(tags.size());
+    batch_ids.reserve(tags.size());
+    size_t graph_size;
+    {
+      std::unique_lock<std::shared_timed_mutex> tl(_tag_lock);
+      for (size_t i = 0; i < tags.size(); i++) {
+        if (_enable_tags &&
+            _tag_to_location.find(tags[i]) != _tag_to_location.end()) {
+          failed_tags.push_back(tags[i]);
+          continue;
+        }
+        auto location = reserve_location();
+        if (location == -1) {
+          failed_tags.push_back(tags[i]);
+          continue;
+        }
+        if (_enable_tags) {
+          _tag_to_location[tags[i]] = location;
+          _location_to_tag.set(location, tags[i]);
+        }
+        locations.push_back((unsigned) location);
+        batch_ids.push_back(i);
+      }
+      graph_size = _nd - locations.size();
+    }
+
+#pragma omp parallel for num_threads(num_threads) schedule(static)
+    for (_s64 i = 0; i < (_s64) locations.size(); i++) {
+      auto offset_data = _data[locations[i]];
+      memset((void *) offset_data, 0, sizeof(T) * _aligned_dim);
+      memcpy((void *) offset_data, points + _aligned_dim * batch_ids[i],
+             sizeof(T) * _dim);
+      if (_normalize_vecs) {
+        normalize(offset_data, _dim);
+      }
+    }
+
+    // Points of one round do not see each other while they search, so a
+    // round is at most as large as the graph linked so far (doubling from
+    // an empty index) and at most 2% of the final index.
+    const size_t max_round =
+        std::max((size_t) 1, (graph_size + locations.size()) / 50);
+    for (size_t done = 0; done < locations.size();) {
+      size_t round_size = std::min(graph_size + done, max_round);
+      round_size = std::min(locations.size() - done,
+                            std::max((size_t) 1, round_size));
+      std::vector<unsigned> round_locations(
+          locations.begin() + done, locations.begin() + done + round_size);
+      std::vector<std::vector<unsigned>> pruned_lists(round_size);
+
+      std::exception_ptr error = nullptr;
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic, 16)
+      for (_s64 i = 0; i < (_s64) round_size; i++) {
+        try {
+          ScratchStoreManager<InMemQueryScratch<T>> manager(_query_scratch);
+          search_for_point_and_set_links(round_locations[i], _indexingQueueSize,
+                                         manager.scratch_space(),
+                                         pruned_lists[i]);
+        } catch (...) {
+#pragma omp critical
+          if (error == nullptr)
+            error = std::current_exception();
+        }
+      }
+      if (error != nullptr)
+        std::rethrow_exception(error);
+      merge_reverse_links(round_locations, pruned_lists, num_threads);
+      done += round_size;
+    }
+  }
+
   template<typename T, typename TagT>
   int Index<T, TagT>::lazy_delete(const TagT &tag) {
     std::shared_lock<std::shared_timed_mutex> ul(_update_lock);
@@ -2066,6 +3195,7 @@ namespace diskann {
 
     const auto location = _tag_to_location[tag];
     _delete_set.insert(location);
+    set_deleted(location);
     _location_to_tag.erase(location);
     _tag_to_location.erase(tag);
 
@@ -2091,6 +3221,7 @@ namespace diskann {
       } else {
         const auto location = _tag_to_location[tag];
         _delete_set.insert(location);
+        set_deleted(location);
         _location_to_tag.erase(location);
         _tag_to_location.erase(tag);
       }
@@ -2131,6 +3262,36 @@ namespace diskann {
                   << std::endl;
   }
 
+  template<typename T, typename TagT>
+  size_t Index<T, TagT>::count_dangling_edges() {
+    std::shared_lock<std::shared_timed_mutex> ul(_update_lock);
+    std::shared_lock<std::shared_timed_mutex> tl(_tag_lock);
+    auto is_free = [&](size_t loc) {
+      if (loc >= _max_points)
+        return false;
+      return _empty_slots.is_empty() ? loc >= _nd
+                                     : _empty_slots.is_in_set((unsigned) loc);
+    };
+
+    size_t                num_dangling = 0;
+    std::vector<unsigned> nbrs;
+    for (size_t loc = 0; loc < _max_points + _num_frozen_pts; loc++) {
+      if (is_free(loc))
+        continue;
+      nbrs.clear();
+      if (_dynamic_index) {
+        copy_neighbors((unsigned) loc, nbrs);
+      } else {
+        auto row = _final_graph[loc];
+        for (size_t j = 0; j < row.size(); j++)
+          nbrs.push_back(row[j]);
+      }
+      for (auto nbr : nbrs)
+        num_dangling += is_free(nbr);
+    }
+    return num_dangling;
+  }
+
   template<typename T, typename TagT>
   void Index<T, TagT>::count_nodes_at_bfs_levels() const {
     boost::dynamic_bitset<> visited(_max_points + _num_frozen_pts);
@@ -2180,9 +3341,9 @@ namespace diskann {
     DistanceFastL2<T> *dist_fast = (DistanceFastL2<T> *) _distance;
     for (unsigned i = 0; i < _nd; i++) {
       char *cur_node_offset = _opt_graph + i * _node_size;
-      float cur_norm = dist_fast->norm(_data + i * _aligned_dim, _aligned_dim);
+      float cur_norm = dist_fast->norm(_data[i], _aligned_dim);
       std::memcpy(cur_node_offset, &cur_norm, sizeof(float));
-      std::memcpy(cur_node_offset + sizeof(float), _data + i * _aligned_dim,
+      std::memcpy(cur_node_offset + sizeof(float), _data[i],
                   _data_len - sizeof(float));
 
       cur_node_offset += _data_len;
@@ -2190,10 +3351,8 @@ namespace diskann {
       std::memcpy(cur_node_offset, &k, sizeof(unsigned));
       std::memcpy(cur_node_offset + sizeof(unsigned), _final_graph[i].data(),
                   k * sizeof(unsigned));
-      std::vector<unsigned>().swap(_final_graph[i]);
     }
     _final_graph.clear();
-    _final_graph.shrink_to_fit();
   }
 
   template<typename T, typename TagT>
@@ -2301,15 +3460,19 @@ namespace diskann {
   template DISKANN_DLLEXPORT class Index<float, int32_t>;
   template DISKANN_DLLEXPORT class Index<int8_t, int32_t>;
   template DISKANN_DLLEXPORT class Index<uint8_t, int32_t>;
+  template DISKANN_DLLEXPORT class Index<float16, int32_t>;
   template DISKANN_DLLEXPORT class Index<float, uint32_t>;
   template DISKANN_DLLEXPORT class Index<int8_t, uint32_t>;
   template DISKANN_DLLEXPORT class Index<uint8_t, uint32_t>;
+  template DISKANN_DLLEXPORT class Index<float16, uint32_t>;
   template DISKANN_DLLEXPORT class Index<float, int64_t>;
   template DISKANN_DLLEXPORT class Index<int8_t, int64_t>;
   template DISKANN_DLLEXPORT class Index<uint8_t, int64_t>;
+  template DISKANN_DLLEXPORT class Index<float16, int64_t>;
   template DISKANN_DLLEXPORT class Index<float, uint64_t>;
   template DISKANN_DLLEXPORT class Index<int8_t, uint64_t>;
   template DISKANN_DLLEXPORT class Index<uint8_t, uint64_t>;
+  template DISKANN_DLLEXPORT class Index<float16, uint64_t>;
 
   template DISKANN_DLLEXPORT std::pair<uint32_t, uint32_t>
                              Index<float, uint64_t>::search<uint64_t>(const float *query, const size_t K,
@@ -2337,6 +3500,14 @@ namespace diskann {
                              Index<int8_t, uint64_t>::search<uint32_t>(const int8_t *query, const size_t K,
                                             const unsigned L, uint32_t *indices,
                                             float *distances);
+  template DISKANN_DLLEXPORT std::pair<uint32_t, uint32_t>
+                             Index<float16, uint64_t>::search<uint64_t>(
+          const float16 *query, const size_t K, const unsigned L,
+          uint64_t *indices, float *distances);
+  template DISKANN_DLLEXPORT std::pair<uint32_t, uint32_t>
+                             Index<float16, uint64_t>::search<uint32_t>(
+          const float16 *query, const size_t K, const unsigned L,
+          uint32_t *indices, float *distances);
   // TagT==uint32_t
   template DISKANN_DLLEXPORT std::pair<uint32_t, uint32_t>
                              Index<float, uint32_t>::search<uint64_t>(const float *query, const size_t K,
@@ -2364,5 +3535,13 @@ namespace diskann {
                              Index<int8_t, uint32_t>::search<uint32_t>(const int8_t *query, const size_t K,
                                             const unsigned L, uint32_t *indices,
                                             float *distances);
+  template DISKANN_DLLEXPORT std::pair<uint32_t, uint32_t>
+                             Index<float16, uint32_t>::search<uint64_t>(
+          const float16 *query, const size_t K, const unsigned L,
+          uint64_t *indices, float *distances);
+  template DISKANN_DLLEXPORT std::pair<uint32_t, uint32_t>
+                             Index<float16, uint32_t>::search<uint32_t>(
+          const float16 *query, const size_t K, const unsigned L,
+          uint32_t *indices, float *distances);
 
 }  // namespace diskann
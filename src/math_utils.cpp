@@ -1,6 +1,7 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT license.
 
+#include <cmath>
 #include <limits>
 #include <malloc.h>
 #include <math_utils.h>
@@ -299,6 +300,73 @@ namespace kmeans {
     return residual;
   }
 
+  namespace {
+    // caps the point-to-center distance matrix of one assignment block at 16MB
+    // whatever the number of centers
+    const size_t ASSIGN_BLOCK_FLOATS = (size_t) 1 << 22;
+
+    // Assigns the points ids[0..num_ids) to their closest center, found with
+    // one sgemm per block of points, and sets their Hamerly bounds: upper to
+    // the distance to the closest center, lower to the distance to the second
+    // closest. Bounds are plain (not squared) L2 distances, as they rely on
+    // the triangle inequality.
+    void assign_with_bounds(float* data, size_t dim, float* centers,
+                            size_t num_centers, const float* docs_l2sq,
+                            const float* centers_l2sq, const uint32_t* ids,
+                            size_t num_ids, uint32_t* closest_center,
+                            float* upper, float* lower) {
+      size_t block_size = (std::max)(
+          (size_t) 1,
+          (std::min)(num_ids, ASSIGN_BLOCK_FLOATS / num_centers));
+      std::vector<float> block_data(block_size * dim);
+      std::vector<float> dots(block_size * num_centers);
+
+      for (size_t begin = 0; begin < num_ids; begin += block_size) {
+        size_t cur_size = (std::min)(block_size, num_ids - begin);
+#pragma omp parallel for schedule(static, 8192)
+        for (int64_t i = 0; i < (_s64) cur_size; i++)
+          std::memcpy(block_data.data() + i * dim,
+                      data + (size_t) ids[begin + i] * dim,
+                      dim * sizeof(float));
+
+        cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasTrans,
+                    (MKL_INT) cur_size, (MKL_INT) num_centers, (MKL_INT) dim,
+                    1.0f, block_data.data(), (MKL_INT) dim, centers,
+                    (MKL_INT) dim, 0.0f, dots.data(), (MKL_INT) num_centers);
+
+#pragma omp parallel for schedule(static, 1024)
+        for (int64_t i = 0; i < (_s64) cur_size; i++) {
+          size_t       id = ids[begin + i];
+          const float* row = dots.data() + i * num_centers;
+          float        best = std::numeric_limits<float>::max();
+          float        second = std::numeric_limits<float>::max();
+          uint32_t     best_id = 0, second_id = 0;
+          for (size_t c = 0; c < num_centers; c++) {
+            float dist = docs_l2sq[id] + centers_l2sq[c] - 2.0f * row[c];
+            if (dist < best) {
+              second = best;
+              second_id = best_id;
+              best = dist;
+              best_id = (uint32_t) c;
+            } else if (dist < second) {
+              second = dist;
+              second_id = (uint32_t) c;
+            }
+          }
+          // the sgemm only ranks the centers, the bounds use exact distances
+          closest_center[id] = best_id;
+          upper[id] = std::sqrt(math_utils::calc_distance(
+              data + id * dim, centers + (size_t) best_id * dim, dim));
+          lower[id] = num_centers > 1
+                          ? std::sqrt(math_utils::calc_distance(
+                                data + id * dim,
+                                centers + (size_t) second_id * dim, dim))
+                          : std::numeric_limits<float>::max();
+        }
+      }
+    }
+  }  // namespace
+
   // Run Lloyds until max_reps or stopping criterion
   // If you pass NULL for closest_docs and closest_center, it will NOT return
   // the
@@ -306,6 +374,12 @@ namespace kmeans {
   // vector<size_t> [num_centers], and closest_center = new size_t[num_points]
   // Final centers are output in centers as row major num_centers * dim
   //
+  // Iterations are exact Lloyd iterations, accelerated with Hamerly's bounds:
+  // every point keeps an upper bound on the distance to its center and a lower
+  // bound on the distance to any other center, loosened by how far the centers
+  // moved. Only points whose bounds overlap, or that are not closer to their
+  // center than half its distance to the nearest other center, are compared
+  // to all the centers again. A center whose cluster empties keeps its place.
   float run_lloyds(float* data, size_t num_points, size_t dim, float* centers,
                    const size_t num_centers, const size_t max_reps,
                    std::vector<size_t>* closest_docs,
@@ -325,16 +399,99 @@ namespace kmeans {
     float* docs_l2sq = new float[num_points];
     math_utils::compute_vecs_l2sq(docs_l2sq, data, num_points, dim);
 
+    std::vector<float>    upper(num_points), lower(num_points);
+    std::vector<float>    centers_l2sq(num_centers);
+    std::vector<float>    half_sep(num_centers), moved(num_centers);
+    std::vector<float>    old_centers(num_centers * dim);
+    std::vector<uint32_t> to_assign(num_points);
+    size_t                num_to_assign = num_points;
+    for (size_t i = 0; i < num_points; i++)
+      to_assign[i] = (uint32_t) i;
+
     float old_residual;
     // Timer timer;
     for (size_t i = 0; i < max_reps; ++i) {
       old_residual = residual;
 
-      residual = lloyds_iter(data, num_points, dim, centers, num_centers,
-                             docs_l2sq, closest_docs, closest_center);
+      if (i != 0) {
+        // half the distance from each center to its nearest other center:
+        // a point closer than that to its center cannot be closer to another
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int64_t c = 0; c < (_s64) num_centers; c++) {
+          float min_dist = std::numeric_limits<float>::max();
+          for (size_t o = 0; o < num_centers; o++)
+            if (o != (size_t) c)
+              min_dist = (std::min)(
+                  min_dist, math_utils::calc_distance(centers + c * dim,
+                                                      centers + o * dim, dim));
+          half_sep[c] = 0.5f * std::sqrt(min_dist);
+        }
+
+        num_to_assign = 0;
+        for (size_t p = 0; p < num_points; p++)
+          if (upper[p] > (std::max)(half_sep[closest_center[p]], lower[p]))
+            to_assign[num_to_assign++] = (uint32_t) p;
+      }
+
+      math_utils::compute_vecs_l2sq(centers_l2sq.data(), centers, num_centers,
+                                    dim);
+      assign_with_bounds(data, dim, centers, num_centers, docs_l2sq,
+                         centers_l2sq.data(), to_assign.data(), num_to_assign,
+                         closest_center, upper.data(), lower.data());
+
+      for (size_t c = 0; c < num_centers; ++c)
+        closest_docs[c].clear();
+      for (size_t p = 0; p < num_points; p++)
+        closest_docs[closest_center[p]].push_back(p);
+
+      std::memcpy(old_centers.data(), centers,
+                  num_centers * dim * sizeof(float));
+#pragma omp parallel for schedule(static, 1)
+      for (int64_t c = 0; c < (_s64) num_centers; ++c) {
+        float* center = centers + (size_t) c * (size_t) dim;
+        if (closest_docs[c].size() > 0) {
+          std::vector<double> cluster_sum(dim, 0.0);
+          for (size_t p : closest_docs[c]) {
+            float* current = data + p * dim;
+            for (size_t j = 0; j < dim; j++)
+              cluster_sum[j] += (double) current[j];
+          }
+          for (size_t j = 0; j < dim; j++)
+            center[j] =
+                (float) (cluster_sum[j] / ((double) closest_docs[c].size()));
+        }
+        moved[c] = std::sqrt(math_utils::calc_distance(
+            center, old_centers.data() + (size_t) c * dim, dim));
+      }
+
+      // the lower bound of a point drops by the largest move of any center
+      // other than its own
+      size_t farthest = 0;
+      for (size_t c = 1; c < num_centers; c++)
+        if (moved[c] > moved[farthest])
+          farthest = c;
+      float second_farthest = 0;
+      for (size_t c = 0; c < num_centers; c++)
+        if (c != farthest)
+          second_farthest = (std::max)(second_farthest, moved[c]);
+
+      // the residual needs the exact distance of every point to its center,
+      // which also makes all the upper bounds tight
+      double total = 0;
+#pragma omp parallel for schedule(static, 8192) reduction(+ : total)
+      for (int64_t p = 0; p < (_s64) num_points; p++) {
+        uint32_t c = closest_center[p];
+        float    dist = math_utils::calc_distance(
+            data + p * dim, centers + (size_t) c * dim, dim);
+        total += dist;
+        upper[p] = std::sqrt(dist);
+        lower[p] -= (c == farthest) ? second_farthest : moved[farthest];
+      }
+      residual = (float) total;
 
       if (((i != 0) && ((old_residual - residual) / residual) < 0.00001) ||
           (residual < std::numeric_limits<float>::epsilon())) {
+#pragma omp critical
         diskann::cout << "Residuals unchanged: " << old_residual << " becomes "
                       << residual << ". Early termination." << std::endl;
         break;
@@ -372,17 +529,14 @@ namespace kmeans {
     }
   }
 
+  // k-means++ seeding. The squared distance of every point to its closest
+  // pivot is updated in parallel blocks of points after each pick, which also
+  // sum up the block totals. The next pivot is drawn by locating the dart in
+  // the block totals first, and then inside the one block it falls in.
   void kmeanspp_selecting_pivots(float* data, size_t num_points, size_t dim,
                                  float* pivot_data, size_t num_centers) {
-    if (num_points > 1 << 23) {
-      diskann::cout << "ERROR: n_pts " << num_points
-                    << " currently not supported for k-means++, maximum is "
-                       "8388608. Falling back to random pivot "
-                       "selection."
-                    << std::endl;
-      selecting_pivots(data, num_points, dim, pivot_data, num_centers);
-      return;
-    }
+    const size_t SEED_BLOCK_SIZE = 8192;
+    size_t       num_blocks = DIV_ROUND_UP(num_points, SEED_BLOCK_SIZE);
 
     std::vector<size_t>                   picked;
     std::random_device                    rd;
@@ -396,13 +550,24 @@ namespace kmeans {
     picked.push_back(init_id);
     std::memcpy(pivot_data, data + init_id * dim, dim * sizeof(float));
 
-    float* dist = new float[num_points];
+    float*              dist = new float[num_points];
+    std::vector<double> block_sums(num_blocks, 0.0);
 
-#pragma omp parallel for schedule(static, 8192)
-    for (int64_t i = 0; i < (_s64) num_points; i++) {
-      dist[i] =
-          math_utils::calc_distance(data + i * dim, data + init_id * dim, dim);
-    }
+    auto update_dists = [&](size_t pivot, bool first) {
+#pragma omp parallel for schedule(static, 1)
+      for (int64_t b = 0; b < (_s64) num_blocks; b++) {
+        double sum = 0;
+        size_t end = (std::min)(num_points, (b + 1) * SEED_BLOCK_SIZE);
+        for (size_t i = b * SEED_BLOCK_SIZE; i < end; i++) {
+          float cur = math_utils::calc_distance(data + i * dim,
+                                                data + pivot * dim, dim);
+          dist[i] = first ? cur : (std::min)(dist[i], cur);
+          sum += dist[i];
+        }
+        block_sums[b] = sum;
+      }
+    };
+    update_dists(init_id, true);
 
     double dart_val;
     size_t tmp_pivot;
@@ -412,8 +577,8 @@ namespace kmeans {
       dart_val = distribution(generator);
 
       double sum = 0;
-      for (size_t i = 0; i < num_points; i++) {
-        sum = sum + dist[i];
+      for (size_t b = 0; b < num_blocks; b++) {
+        sum = sum + block_sums[b];
       }
       if (sum == 0)
         sum_flag = true;
@@ -421,7 +586,14 @@ namespace kmeans {
       dart_val *= sum;
 
       double prefix_sum = 0;
-      for (size_t i = 0; i < (num_points); i++) {
+      size_t block = 0;
+      for (; block + 1 < num_blocks; block++) {
+        if (dart_val < prefix_sum + block_sums[block])
+          break;
+        prefix_sum += block_sums[block];
+      }
+      size_t block_end = (std::min)(num_points, (block + 1) * SEED_BLOCK_SIZE);
+      for (size_t i = block * SEED_BLOCK_SIZE; i < block_end; i++) {
         tmp_pivot = i;
         if (dart_val >= prefix_sum && dart_val < prefix_sum + dist[i]) {
           break;
@@ -437,12 +609,7 @@ namespace kmeans {
       std::memcpy(pivot_data + num_picked * dim, data + tmp_pivot * dim,
                   dim * sizeof(float));
 
-#pragma omp parallel for schedule(static, 8192)
-      for (int64_t i = 0; i < (_s64) num_points; i++) {
-        dist[i] = (std::min)(
-            dist[i], math_utils::calc_distance(data + i * dim,
-                                               data + tmp_pivot * dim, dim));
-      }
+      update_dists(tmp_pivot, false);
       num_picked++;
     }
     delete[] dist;
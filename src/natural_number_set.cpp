@@ -61,7 +61,8 @@ namespace diskann {
 
   template<typename T>
   bool natural_number_set<T>::is_in_set(T id) const {
-    return _values_bitset->test(id);
+    // the bitset only extends to the largest id ever inserted
+    return id < _values_bitset->size() && _values_bitset->test(id);
   }
 
   // Instantiate used templates.
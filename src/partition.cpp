@@ -632,6 +632,9 @@ template void DISKANN_DLLEXPORT gen_random_slice<uint8_t>(
 template void DISKANN_DLLEXPORT
 gen_random_slice<float>(const std::string base_file,
                         const std::string output_prefix, double sampling_rate);
+template void DISKANN_DLLEXPORT gen_random_slice<diskann::float16>(
+    const std::string base_file, const std::string output_prefix,
+    double sampling_rate);
 
 template void DISKANN_DLLEXPORT
                                 gen_random_slice<float>(const float *inputdata, size_t npts, size_t ndims,
@@ -642,6 +645,9 @@ template void DISKANN_DLLEXPORT gen_random_slice<uint8_t>(
 template void DISKANN_DLLEXPORT gen_random_slice<int8_t>(
     const int8_t *inputdata, size_t npts, size_t ndims, double p_val,
     float *&sampled_data, size_t &slice_size);
+template void DISKANN_DLLEXPORT gen_random_slice<diskann::float16>(
+    const diskann::float16 *inputdata, size_t npts, size_t ndims, double p_val,
+    float *&sampled_data, size_t &slice_size);
 
 template void DISKANN_DLLEXPORT gen_random_slice<float>(
     const std::string data_file, double p_val, float *&sampled_data,
@@ -652,6 +658,9 @@ template void DISKANN_DLLEXPORT gen_random_slice<uint8_t>(
 template void DISKANN_DLLEXPORT gen_random_slice<int8_t>(
     const std::string data_file, double p_val, float *&sampled_data,
     size_t &slice_size, size_t &ndims);
+template void DISKANN_DLLEXPORT gen_random_slice<diskann::float16>(
+    const std::string data_file, double p_val, float *&sampled_data,
+    size_t &slice_size, size_t &ndims);
 
 template DISKANN_DLLEXPORT int partition<int8_t>(
     const std::string data_file, const float sampling_rate, size_t num_centers,
@@ -662,6 +671,9 @@ template DISKANN_DLLEXPORT int partition<uint8_t>(
 template DISKANN_DLLEXPORT int partition<float>(
     const std::string data_file, const float sampling_rate, size_t num_centers,
     size_t max_k_means_reps, const std::string prefix_path, size_t k_base);
+template DISKANN_DLLEXPORT int partition<diskann::float16>(
+    const std::string data_file, const float sampling_rate, size_t num_centers,
+    size_t max_k_means_reps, const std::string prefix_path, size_t k_base);
 
 template DISKANN_DLLEXPORT int partition_with_ram_budget<int8_t>(
     const std::string data_file, const double sampling_rate, double ram_budget,
@@ -672,6 +684,9 @@ template DISKANN_DLLEXPORT int partition_with_ram_budget<uint8_t>(
 template DISKANN_DLLEXPORT int partition_with_ram_budget<float>(
     const std::string data_file, const double sampling_rate, double ram_budget,
     size_t graph_degree, const std::string prefix_path, size_t k_base);
+template DISKANN_DLLEXPORT int partition_with_ram_budget<diskann::float16>(
+    const std::string data_file, const double sampling_rate, double ram_budget,
+    size_t graph_degree, const std::string prefix_path, size_t k_base);
 
 template DISKANN_DLLEXPORT int retrieve_shard_data_from_ids<float>(
     const std::string data_file, std::string idmap_filename,
@@ -681,4 +696,7 @@ template DISKANN_DLLEXPORT int retrieve_shard_data_from_ids<uint8_t>(
     std::string data_filename);
 template DISKANN_DLLEXPORT int retrieve_shard_data_from_ids<int8_t>(
     const std::string data_file, std::string idmap_filename,
-    std::string data_filename);
\ No newline at end of file
+    std::string data_filename);
+template DISKANN_DLLEXPORT int retrieve_shard_data_from_ids<diskann::float16>(
+    const std::string data_file, std::string idmap_filename,
+    std::string data_filename);
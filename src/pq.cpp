@@ -2,14 +2,20 @@
 // Licensed under the MIT license.
 
 #include "mkl.h"
+#include <future>
+#include <immintrin.h>
+#include <omp.h>
 
 #include "pq.h"
 #include "partition.h"
 #include "math_utils.h"
+#include "timer.h"
 #include "tsl/robin_map.h"
 
 // block size for reading/processing large files and matrices in blocks
 #define BLOCK_SIZE 5000000
+// bytes of base data read per block when encoding it with PQ
+#define PQ_ENCODE_BLOCK_BYTES ((size_t) 256 * 1024 * 1024)
 
 namespace diskann {
   FixedChunkPQTable::FixedChunkPQTable() {
@@ -289,6 +295,12 @@ namespace diskann {
     }
   }
 
+  // k-means of PQ chunks run concurrently (each single-threaded) only when
+  // there are enough chunks to occupy all the threads
+  static bool train_chunks_in_parallel(size_t num_pq_chunks) {
+    return num_pq_chunks >= (size_t) omp_get_max_threads();
+  }
+
   // given training data in train_data of dimensions num_train * dim, generate
   // PQ pivots using k-means algorithm to partition the co-ordinates into
   // num_pq_chunks (if it divides dimension, else rounded) chunks, and runs
@@ -398,43 +410,56 @@ namespace diskann {
 
     full_pivot_data.reset(new float[num_centers * dim]);
 
-    for (size_t i = 0; i < num_pq_chunks; i++) {
-      size_t cur_chunk_size = chunk_offsets[i + 1] - chunk_offsets[i];
+    // the chunks are independent k-means problems over a few dimensions each
+    bool parallel_chunks = train_chunks_in_parallel(num_pq_chunks);
+    std::exception_ptr error = nullptr;
+#pragma omp parallel for schedule(dynamic, 1) if (parallel_chunks)
+    for (int64_t i = 0; i < (_s64) num_pq_chunks; i++) {
+      try {
+        size_t cur_chunk_size = chunk_offsets[i + 1] - chunk_offsets[i];
 
-      if (cur_chunk_size == 0)
-        continue;
-      std::unique_ptr<float[]> cur_pivot_data =
-          std::make_unique<float[]>(num_centers * cur_chunk_size);
-      std::unique_ptr<float[]> cur_data =
-          std::make_unique<float[]>(num_train * cur_chunk_size);
-      std::unique_ptr<uint32_t[]> closest_center =
-          std::make_unique<uint32_t[]>(num_train);
-
-      diskann::cout << "Processing chunk " << i << " with dimensions ["
-                    << chunk_offsets[i] << ", " << chunk_offsets[i + 1] << ")"
-                    << std::endl;
+        if (cur_chunk_size == 0)
+          continue;
+        std::unique_ptr<float[]> cur_pivot_data =
+            std::make_unique<float[]>(num_centers * cur_chunk_size);
+        std::unique_ptr<float[]> cur_data =
+            std::make_unique<float[]>(num_train * cur_chunk_size);
+        std::unique_ptr<uint32_t[]> closest_center =
+            std::make_unique<uint32_t[]>(num_train);
+
+#pragma omp critical
+        diskann::cout << "Processing chunk " << i << " with dimensions ["
+                      << chunk_offsets[i] << ", " << chunk_offsets[i + 1] << ")"
+                      << std::endl;
 
 #pragma omp parallel for schedule(static, 65536)
-      for (int64_t j = 0; j < (_s64) num_train; j++) {
-        std::memcpy(cur_data.get() + j * cur_chunk_size,
-                    train_data.get() + j * dim + chunk_offsets[i],
-                    cur_chunk_size * sizeof(float));
-      }
+        for (int64_t j = 0; j < (_s64) num_train; j++) {
+          std::memcpy(cur_data.get() + j * cur_chunk_size,
+                      train_data.get() + j * dim + chunk_offsets[i],
+                      cur_chunk_size * sizeof(float));
+        }
 
-      kmeans::kmeanspp_selecting_pivots(cur_data.get(), num_train,
-                                        cur_chunk_size, cur_pivot_data.get(),
-                                        num_centers);
+        kmeans::kmeanspp_selecting_pivots(cur_data.get(), num_train,
+                                          cur_chunk_size, cur_pivot_data.get(),
+                                          num_centers);
 
-      kmeans::run_lloyds(cur_data.get(), num_train, cur_chunk_size,
-                         cur_pivot_data.get(), num_centers, max_k_means_reps,
-                         NULL, closest_center.get());
+        kmeans::run_lloyds(cur_data.get(), num_train, cur_chunk_size,
+                           cur_pivot_data.get(), num_centers, max_k_means_reps,
+                           NULL, closest_center.get());
 
-      for (uint64_t j = 0; j < num_centers; j++) {
-        std::memcpy(full_pivot_data.get() + j * dim + chunk_offsets[i],
-                    cur_pivot_data.get() + j * cur_chunk_size,
-                    cur_chunk_size * sizeof(float));
+        for (uint64_t j = 0; j < num_centers; j++) {
+          std::memcpy(full_pivot_data.get() + j * dim + chunk_offsets[i],
+                      cur_pivot_data.get() + j * cur_chunk_size,
+                      cur_chunk_size * sizeof(float));
+        }
+      } catch (...) {
+#pragma omp critical
+        if (error == nullptr)
+          error = std::current_exception();
       }
     }
+    if (error != nullptr)
+      std::rethrow_exception(error);
 
     std::vector<size_t> cumul_bytes(4, 0);
     cumul_bytes[0] = METADATA_SIZE;
@@ -571,62 +596,75 @@ namespace diskann {
                   train_data.get(), (MKL_INT) dim, rotmat_tr.get(),
                   (MKL_INT) dim, 0.0f, rotated_train_data.get(), (MKL_INT) dim);
 
-      // compute the PQ pivots on the rotated space
-      for (size_t i = 0; i < num_pq_chunks; i++) {
-        size_t cur_chunk_size = chunk_offsets[i + 1] - chunk_offsets[i];
-
-        if (cur_chunk_size == 0)
-          continue;
-        std::unique_ptr<float[]> cur_pivot_data =
-            std::make_unique<float[]>(num_centers * cur_chunk_size);
-        std::unique_ptr<float[]> cur_data =
-            std::make_unique<float[]>(num_train * cur_chunk_size);
-        std::unique_ptr<uint32_t[]> closest_center =
-            std::make_unique<uint32_t[]>(num_train);
-
-        diskann::cout << "Processing chunk " << i << " with dimensions ["
-                      << chunk_offsets[i] << ", " << chunk_offsets[i + 1] << ")"
-                      << std::endl;
+      // compute the PQ pivots on the rotated space, chunks in parallel as in
+      // generate_pq_pivots
+      bool parallel_chunks = train_chunks_in_parallel(num_pq_chunks);
+      std::exception_ptr error = nullptr;
+#pragma omp parallel for schedule(dynamic, 1) if (parallel_chunks)
+      for (int64_t i = 0; i < (_s64) num_pq_chunks; i++) {
+        try {
+          size_t cur_chunk_size = chunk_offsets[i + 1] - chunk_offsets[i];
+
+          if (cur_chunk_size == 0)
+            continue;
+          std::unique_ptr<float[]> cur_pivot_data =
+              std::make_unique<float[]>(num_centers * cur_chunk_size);
+          std::unique_ptr<float[]> cur_data =
+              std::make_unique<float[]>(num_train * cur_chunk_size);
+          std::unique_ptr<uint32_t[]> closest_center =
+              std::make_unique<uint32_t[]>(num_train);
+
+#pragma omp critical
+          diskann::cout << "Processing chunk " << i << " with dimensions ["
+                        << chunk_offsets[i] << ", " << chunk_offsets[i + 1]
+                        << ")" << std::endl;
 
 #pragma omp parallel for schedule(static, 65536)
-        for (int64_t j = 0; j < (_s64) num_train; j++) {
-          std::memcpy(cur_data.get() + j * cur_chunk_size,
-                      rotated_train_data.get() + j * dim + chunk_offsets[i],
-                      cur_chunk_size * sizeof(float));
-        }
+          for (int64_t j = 0; j < (_s64) num_train; j++) {
+            std::memcpy(cur_data.get() + j * cur_chunk_size,
+                        rotated_train_data.get() + j * dim + chunk_offsets[i],
+                        cur_chunk_size * sizeof(float));
+          }
+
+          if (rnd == 0) {
+            kmeans::kmeanspp_selecting_pivots(
+                cur_data.get(), num_train, cur_chunk_size,
+                cur_pivot_data.get(), num_centers);
+
+          } else {
+            for (uint64_t j = 0; j < num_centers; j++) {
+              std::memcpy(cur_pivot_data.get() + j * cur_chunk_size,
+                          full_pivot_data.get() + j * dim + chunk_offsets[i],
+                          cur_chunk_size * sizeof(float));
+            }
+          }
 
-        if (rnd == 0) {
-          kmeans::kmeanspp_selecting_pivots(cur_data.get(), num_train,
-                                            cur_chunk_size,
-                                            cur_pivot_data.get(), num_centers);
+          _u32 num_lloyds_iters = 8;
+          kmeans::run_lloyds(cur_data.get(), num_train, cur_chunk_size,
+                             cur_pivot_data.get(), num_centers,
+                             num_lloyds_iters, NULL, closest_center.get());
 
-        } else {
           for (uint64_t j = 0; j < num_centers; j++) {
-            std::memcpy(cur_pivot_data.get() + j * cur_chunk_size,
-                        full_pivot_data.get() + j * dim + chunk_offsets[i],
+            std::memcpy(full_pivot_data.get() + j * dim + chunk_offsets[i],
+                        cur_pivot_data.get() + j * cur_chunk_size,
                         cur_chunk_size * sizeof(float));
           }
-        }
-
-        _u32 num_lloyds_iters = 8;
-        kmeans::run_lloyds(cur_data.get(), num_train, cur_chunk_size,
-                           cur_pivot_data.get(), num_centers, num_lloyds_iters,
-                           NULL, closest_center.get());
-
-        for (uint64_t j = 0; j < num_centers; j++) {
-          std::memcpy(full_pivot_data.get() + j * dim + chunk_offsets[i],
-                      cur_pivot_data.get() + j * cur_chunk_size,
-                      cur_chunk_size * sizeof(float));
-        }
 
-        for (_u64 j = 0; j < num_train; j++) {
-          std::memcpy(
-              rotated_and_quantized_train_data.get() + j * dim +
-                  chunk_offsets[i],
-              cur_pivot_data.get() + (_u64) closest_center[j] * cur_chunk_size,
-              cur_chunk_size * sizeof(float));
+          for (_u64 j = 0; j < num_train; j++) {
+            std::memcpy(rotated_and_quantized_train_data.get() + j * dim +
+                            chunk_offsets[i],
+                        cur_pivot_data.get() +
+                            (_u64) closest_center[j] * cur_chunk_size,
+                        cur_chunk_size * sizeof(float));
+          }
+        } catch (...) {
+#pragma omp critical
+          if (error == nullptr)
+            error = std::current_exception();
         }
       }
+      if (error != nullptr)
+        std::rethrow_exception(error);
 
       // compute the correlation matrix between the original data and the
       // quantized data to compute the new rotation
@@ -682,21 +720,114 @@ namespace diskann {
     return 0;
   }
 
+  // Index of the pivot closest (L2) to the chunk_size floats of vec, where
+  // pivots_tr holds the chunk's pivots dimension-major (pivots_tr[d *
+  // num_centers + c] is dimension d of pivot c). Compares a vector register of
+  // pivots at a time; ties go to the lowest index.
+  static uint32_t closest_pivot(const float* vec, const float* pivots_tr,
+                                size_t chunk_size, size_t num_centers) {
+    float    best = std::numeric_limits<float>::max();
+    uint32_t best_id = 0;
+    size_t   c = 0;
+#if defined(__AVX512F__)
+    if (num_centers >= 16) {
+      __m512  best_v = _mm512_set1_ps(best);
+      __m512i best_ids = _mm512_setzero_si512();
+      __m512i ids = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+                                      13, 14, 15);
+      for (; c + 16 <= num_centers; c += 16) {
+        __m512 dist = _mm512_setzero_ps();
+        for (size_t d = 0; d < chunk_size; d++) {
+          __m512 diff =
+              _mm512_sub_ps(_mm512_set1_ps(vec[d]),
+                            _mm512_loadu_ps(pivots_tr + d * num_centers + c));
+          dist = _mm512_fmadd_ps(diff, diff, dist);
+        }
+        __mmask16 closer = _mm512_cmp_ps_mask(dist, best_v, _CMP_LT_OQ);
+        best_v = _mm512_mask_mov_ps(best_v, closer, dist);
+        best_ids = _mm512_mask_mov_epi32(best_ids, closer, ids);
+        ids = _mm512_add_epi32(ids, _mm512_set1_epi32(16));
+      }
+      float    lane_best[16];
+      uint32_t lane_ids[16];
+      _mm512_storeu_ps(lane_best, best_v);
+      _mm512_storeu_si512(lane_ids, best_ids);
+      for (size_t l = 0; l < 16; l++) {
+        if (lane_best[l] < best ||
+            (lane_best[l] == best && lane_ids[l] < best_id)) {
+          best = lane_best[l];
+          best_id = lane_ids[l];
+        }
+      }
+    }
+#elif defined(USE_AVX2)
+    if (num_centers >= 8) {
+      __m256  best_v = _mm256_set1_ps(best);
+      __m256i best_ids = _mm256_setzero_si256();
+      __m256i ids = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+      for (; c + 8 <= num_centers; c += 8) {
+        __m256 dist = _mm256_setzero_ps();
+        for (size_t d = 0; d < chunk_size; d++) {
+          __m256 diff =
+              _mm256_sub_ps(_mm256_set1_ps(vec[d]),
+                            _mm256_loadu_ps(pivots_tr + d * num_centers + c));
+          dist = _mm256_fmadd_ps(diff, diff, dist);
+        }
+        __m256 closer = _mm256_cmp_ps(dist, best_v, _CMP_LT_OQ);
+        best_v = _mm256_blendv_ps(best_v, dist, closer);
+        best_ids = _mm256_castps_si256(_mm256_blendv_ps(
+            _mm256_castsi256_ps(best_ids), _mm256_castsi256_ps(ids), closer));
+        ids = _mm256_add_epi32(ids, _mm256_set1_epi32(8));
+      }
+      float    lane_best[8];
+      uint32_t lane_ids[8];
+      _mm256_storeu_ps(lane_best, best_v);
+      _mm256_storeu_si256((__m256i*) lane_ids, best_ids);
+      for (size_t l = 0; l < 8; l++) {
+        if (lane_best[l] < best ||
+            (lane_best[l] == best && lane_ids[l] < best_id)) {
+          best = lane_best[l];
+          best_id = lane_ids[l];
+        }
+      }
+    }
+#endif
+    for (; c < num_centers; c++) {
+      float dist = 0;
+      for (size_t d = 0; d < chunk_size; d++) {
+        float diff = vec[d] - pivots_tr[d * num_centers + c];
+        dist += diff * diff;
+      }
+      if (dist < best) {
+        best = dist;
+        best_id = (uint32_t) c;
+      }
+    }
+    return best_id;
+  }
+
   // streams the base file (data_file), and computes the closest centers in each
   // chunk to generate the compressed data_file and stores it in
   // pq_compressed_vectors_path.
   // If the numbber of centers is < 256, it stores as byte vector, else as
   // 4-byte vector in binary format.
+  // Reading the next block and writing the codes of the previous one overlap
+  // with encoding the current block, whose points are encoded in parallel.
+  // With save_inflated, the decoded vectors are also written to
+  // <pq_compressed_vectors_path>_inflated.bin.
   template<typename T>
   int generate_pq_data_from_pivots(const std::string data_file,
                                    unsigned num_centers, unsigned num_pq_chunks,
                                    std::string pq_pivots_path,
                                    std::string pq_compressed_vectors_path,
-                                   bool        use_opq) {
-    _u64            read_blk_size = 64 * 1024 * 1024;
-    cached_ifstream base_reader(data_file, read_blk_size);
-    _u32            npts32;
-    _u32            basedim32;
+                                   bool        use_opq,
+                                   bool        save_inflated) {
+    Timer         timer;
+    std::ifstream base_reader;
+    base_reader.exceptions(std::ios::badbit | std::ios::failbit);
+    base_reader.open(data_file, std::ios::binary);
+    _u32 npts32;
+    _u32 basedim32;
     base_reader.read((char*) &npts32, sizeof(uint32_t));
     base_reader.read((char*) &basedim32, sizeof(uint32_t));
     size_t num_points = npts32;
@@ -779,135 +910,145 @@ namespace diskann {
       diskann::cout << "Loaded PQ pivot information" << std::endl;
     }
 
-    std::ofstream compressed_file_writer(pq_compressed_vectors_path,
-                                         std::ios::binary);
-    _u32          num_pq_chunks_u32 = num_pq_chunks;
+    // pivots transposed to dimension-major, so that the pivots of chunk i are
+    // the rows [chunk_offsets[i], chunk_offsets[i + 1]) of num_centers floats
+    std::unique_ptr<float[]> pivots_tr =
+        std::make_unique<float[]>(dim * num_centers);
+    for (size_t c = 0; c < num_centers; c++)
+      for (size_t d = 0; d < dim; d++)
+        pivots_tr[d * num_centers + c] = full_pivot_data[c * dim + d];
+
+    std::ofstream compressed_file_writer;
+    compressed_file_writer.exceptions(std::ios::badbit | std::ios::failbit);
+    compressed_file_writer.open(pq_compressed_vectors_path, std::ios::binary);
+    _u32 num_pq_chunks_u32 = num_pq_chunks;
 
     compressed_file_writer.write((char*) &num_points, sizeof(uint32_t));
     compressed_file_writer.write((char*) &num_pq_chunks_u32, sizeof(uint32_t));
 
-    size_t block_size = num_points <= BLOCK_SIZE ? num_points : BLOCK_SIZE;
-
-#ifdef SAVE_INFLATED_PQ
-    std::ofstream inflated_file_writer(inflated_pq_file, std::ios::binary);
-    inflated_file_writer.write((char*) &num_points, sizeof(uint32_t));
-    inflated_file_writer.write((char*) &basedim32, sizeof(uint32_t));
-
-    std::unique_ptr<float[]> block_inflated_base =
-        std::make_unique<float[]>(block_size * dim);
-    std::memset(block_inflated_base.get(), 0, block_size * dim * sizeof(float));
-#endif
-
-    std::unique_ptr<_u32[]> block_compressed_base =
-        std::make_unique<_u32[]>(block_size * (_u64) num_pq_chunks);
-    std::memset(block_compressed_base.get(), 0,
-                block_size * (_u64) num_pq_chunks * sizeof(uint32_t));
-
-    std::unique_ptr<T[]> block_data_T = std::make_unique<T[]>(block_size * dim);
-    std::unique_ptr<float[]> block_data_float =
-        std::make_unique<float[]>(block_size * dim);
-    std::unique_ptr<float[]> block_data_tmp =
-        std::make_unique<float[]>(block_size * dim);
+    std::ofstream inflated_file_writer;
+    if (save_inflated) {
+      inflated_file_writer.exceptions(std::ios::badbit | std::ios::failbit);
+      inflated_file_writer.open(inflated_pq_file, std::ios::binary);
+      inflated_file_writer.write((char*) &num_points, sizeof(uint32_t));
+      inflated_file_writer.write((char*) &basedim32, sizeof(uint32_t));
+    }
 
+    size_t block_size = (std::max)(
+        (size_t) 1, (std::min)({num_points, (size_t) BLOCK_SIZE,
+                                PQ_ENCODE_BLOCK_BYTES / (dim * sizeof(T))}));
     size_t num_blocks = DIV_ROUND_UP(num_points, block_size);
+    size_t code_size = num_centers > 256 ? sizeof(uint32_t) : sizeof(uint8_t);
+
+    // Blocks are double buffered: block b + 1 is read and the codes of block
+    // b - 1 are written while block b is encoded.
+    std::unique_ptr<T[]>       block_data_T[2];
+    std::unique_ptr<uint8_t[]> block_codes[2];
+    for (size_t i = 0; i < 2; i++) {
+      block_data_T[i] = std::make_unique<T[]>(block_size * dim);
+      block_codes[i] =
+          std::make_unique<uint8_t[]>(block_size * num_pq_chunks * code_size);
+    }
+    // the rotated block for OPQ and the decoded block are only needed if used
+    std::unique_ptr<float[]> block_data_float, block_data_tmp;
+    if (use_opq) {
+      block_data_float = std::make_unique<float[]>(block_size * dim);
+      block_data_tmp = std::make_unique<float[]>(block_size * dim);
+    }
+    std::unique_ptr<float[]> block_inflated_base;
+    if (save_inflated)
+      block_inflated_base = std::make_unique<float[]>(block_size * dim);
+
+    auto read_block = [&](size_t block) {
+      size_t cur_blk_size =
+          (std::min)((block + 1) * block_size, num_points) - block * block_size;
+      base_reader.read((char*) block_data_T[block % 2].get(),
+                       sizeof(T) * cur_blk_size * dim);
+    };
+    std::future<void> pending_read =
+        std::async(std::launch::async, read_block, 0);
+    std::future<void> pending_write;
 
     for (size_t block = 0; block < num_blocks; block++) {
       size_t start_id = block * block_size;
       size_t end_id = (std::min)((block + 1) * block_size, num_points);
       size_t cur_blk_size = end_id - start_id;
 
-      base_reader.read((char*) (block_data_T.get()),
-                       sizeof(T) * (cur_blk_size * dim));
-      diskann::convert_types<T, float>(block_data_T.get(), block_data_tmp.get(),
-                                       cur_blk_size, dim);
+      pending_read.get();
+      if (block + 1 < num_blocks)
+        pending_read = std::async(std::launch::async, read_block, block + 1);
 
       diskann::cout << "Processing points  [" << start_id << ", " << end_id
                     << ").." << std::flush;
 
-      for (uint64_t p = 0; p < cur_blk_size; p++) {
-        for (uint64_t d = 0; d < dim; d++) {
-          block_data_tmp[p * dim + d] -= centroid[d];
-        }
-      }
-
-      for (uint64_t p = 0; p < cur_blk_size; p++) {
-        for (uint64_t d = 0; d < dim; d++) {
-          block_data_float[p * dim + d] = block_data_tmp[p * dim + d];
-        }
-      }
+      const T* cur_data_T = block_data_T[block % 2].get();
+      uint8_t* cur_codes = block_codes[block % 2].get();
 
       if (use_opq) {
         // rotate the current block with the trained rotation matrix before PQ
+#pragma omp parallel for schedule(static, 8192)
+        for (int64_t p = 0; p < (_s64) cur_blk_size; p++)
+          for (uint64_t d = 0; d < dim; d++)
+            block_data_tmp[p * dim + d] =
+                (float) cur_data_T[p * dim + d] - centroid[d];
         cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
                     (MKL_INT) cur_blk_size, (MKL_INT) dim, (MKL_INT) dim, 1.0f,
-                    block_data_float.get(), (MKL_INT) dim, rotmat_tr.get(),
-                    (MKL_INT) dim, 0.0f, block_data_tmp.get(), (MKL_INT) dim);
-        std::memcpy(block_data_float.get(), block_data_tmp.get(),
-                    cur_blk_size * dim * sizeof(float));
+                    block_data_tmp.get(), (MKL_INT) dim, rotmat_tr.get(),
+                    (MKL_INT) dim, 0.0f, block_data_float.get(), (MKL_INT) dim);
       }
 
-      for (size_t i = 0; i < num_pq_chunks; i++) {
-        size_t cur_chunk_size = chunk_offsets[i + 1] - chunk_offsets[i];
-        if (cur_chunk_size == 0)
-          continue;
-
-        std::unique_ptr<float[]> cur_pivot_data =
-            std::make_unique<float[]>(num_centers * cur_chunk_size);
-        std::unique_ptr<float[]> cur_data =
-            std::make_unique<float[]>(cur_blk_size * cur_chunk_size);
-        std::unique_ptr<uint32_t[]> closest_center =
-            std::make_unique<uint32_t[]>(cur_blk_size);
-
-#pragma omp parallel for schedule(static, 8192)
-        for (int64_t j = 0; j < (_s64) cur_blk_size; j++) {
-          for (uint64_t k = 0; k < cur_chunk_size; k++)
-            cur_data[j * cur_chunk_size + k] =
-                block_data_float[j * dim + chunk_offsets[i] + k];
-        }
-
-#pragma omp parallel for schedule(static, 1)
-        for (int64_t j = 0; j < (_s64) num_centers; j++) {
-          std::memcpy(cur_pivot_data.get() + j * cur_chunk_size,
-                      full_pivot_data.get() + j * dim + chunk_offsets[i],
-                      cur_chunk_size * sizeof(float));
-        }
-
-        math_utils::compute_closest_centers(
-            cur_data.get(), cur_blk_size, cur_chunk_size, cur_pivot_data.get(),
-            num_centers, 1, closest_center.get());
+#pragma omp parallel
+      {
+        std::vector<float> vec(use_opq ? 0 : dim);
+#pragma omp for schedule(static, 8192)
+        for (int64_t p = 0; p < (_s64) cur_blk_size; p++) {
+          const float* cur_vec;
+          if (use_opq) {
+            cur_vec = block_data_float.get() + p * dim;
+          } else {
+            for (uint64_t d = 0; d < dim; d++)
+              vec[d] = (float) cur_data_T[p * dim + d] - centroid[d];
+            cur_vec = vec.data();
+          }
 
-#pragma omp parallel for schedule(static, 8192)
-        for (int64_t j = 0; j < (_s64) cur_blk_size; j++) {
-          block_compressed_base[j * num_pq_chunks + i] = closest_center[j];
-#ifdef SAVE_INFLATED_PQ
-          for (uint64_t k = 0; k < cur_chunk_size; k++)
-            block_inflated_base[j * dim + chunk_offsets[i] + k] =
-                cur_pivot_data[closest_center[j] * cur_chunk_size + k] +
-                centroid[chunk_offsets[i] + k];
-#endif
+          for (size_t i = 0; i < num_pq_chunks; i++) {
+            size_t cur_chunk_size = chunk_offsets[i + 1] - chunk_offsets[i];
+            if (cur_chunk_size == 0)
+              continue;
+
+            uint32_t code = closest_pivot(
+                cur_vec + chunk_offsets[i],
+                pivots_tr.get() + chunk_offsets[i] * num_centers,
+                cur_chunk_size, num_centers);
+            if (code_size == sizeof(uint8_t))
+              cur_codes[p * num_pq_chunks + i] = (uint8_t) code;
+            else
+              ((uint32_t*) cur_codes)[p * num_pq_chunks + i] = code;
+
+            if (save_inflated)
+              for (uint64_t k = 0; k < cur_chunk_size; k++)
+                block_inflated_base[p * dim + chunk_offsets[i] + k] =
+                    full_pivot_data[code * dim + chunk_offsets[i] + k] +
+                    centroid[chunk_offsets[i] + k];
+          }
         }
       }
 
-      if (num_centers > 256) {
-        compressed_file_writer.write(
-            (char*) (block_compressed_base.get()),
-            cur_blk_size * num_pq_chunks * sizeof(uint32_t));
-      } else {
-        std::unique_ptr<uint8_t[]> pVec =
-            std::make_unique<uint8_t[]>(cur_blk_size * num_pq_chunks);
-        diskann::convert_types<uint32_t, uint8_t>(block_compressed_base.get(),
-                                                  pVec.get(), cur_blk_size,
-                                                  num_pq_chunks);
-        compressed_file_writer.write(
-            (char*) (pVec.get()),
-            cur_blk_size * num_pq_chunks * sizeof(uint8_t));
-      }
-#ifdef SAVE_INFLATED_PQ
-      inflated_file_writer.write((char*) (block_inflated_base.get()),
-                                 cur_blk_size * dim * sizeof(float));
-#endif
+      if (pending_write.valid())
+        pending_write.get();
+      pending_write = std::async(
+          std::launch::async, [&compressed_file_writer, cur_codes, cur_blk_size,
+                               num_pq_chunks, code_size]() {
+            compressed_file_writer.write(
+                (char*) cur_codes, cur_blk_size * num_pq_chunks * code_size);
+          });
+      if (save_inflated)
+        inflated_file_writer.write((char*) (block_inflated_base.get()),
+                                   cur_blk_size * dim * sizeof(float));
       diskann::cout << ".done." << std::endl;
     }
+    if (pending_write.valid())
+      pending_write.get();
 // Gopal. Splitting diskann_dll into separate DLLs for search and build.
 // This code should only be available in the "build" DLL.
 #if defined(RELEASE_UNUSED_TCMALLOC_MEMORY_AT_CHECKPOINTS) && \
@@ -915,9 +1056,11 @@ namespace diskann {
     MallocExtension::instance()->ReleaseFreeMemory();
 #endif
     compressed_file_writer.close();
-#ifdef SAVE_INFLATED_PQ
-    inflated_file_writer.close();
-#endif
+    if (save_inflated)
+      inflated_file_writer.close();
+    diskann::cout << "Encoded " << num_points << " points into "
+                  << num_pq_chunks << " PQ chunks in "
+                  << timer.elapsed() / 1000000.0 << "s" << std::endl;
     return 0;
   }
 
@@ -998,15 +1141,19 @@ namespace diskann {
   template DISKANN_DLLEXPORT int generate_pq_data_from_pivots<int8_t>(
       const std::string data_file, unsigned num_centers, unsigned num_pq_chunks,
       std::string pq_pivots_path, std::string pq_compressed_vectors_path,
-      bool use_opq);
+      bool use_opq, bool save_inflated);
   template DISKANN_DLLEXPORT int generate_pq_data_from_pivots<uint8_t>(
       const std::string data_file, unsigned num_centers, unsigned num_pq_chunks,
       std::string pq_pivots_path, std::string pq_compressed_vectors_path,
-      bool use_opq);
+      bool use_opq, bool save_inflated);
   template DISKANN_DLLEXPORT int generate_pq_data_from_pivots<float>(
       const std::string data_file, unsigned num_centers, unsigned num_pq_chunks,
       std::string pq_pivots_path, std::string pq_compressed_vectors_path,
-      bool use_opq);
+      bool use_opq, bool save_inflated);
+  template DISKANN_DLLEXPORT int generate_pq_data_from_pivots<float16>(
+      const std::string data_file, unsigned num_centers, unsigned num_pq_chunks,
+      std::string pq_pivots_path, std::string pq_compressed_vectors_path,
+      bool use_opq, bool save_inflated);
 
   template DISKANN_DLLEXPORT void generate_disk_quantized_data<int8_t>(
       const std::string data_file_to_use, const std::string disk_pq_pivots_path,
@@ -1023,6 +1170,11 @@ namespace diskann {
       const std::string disk_pq_compressed_vectors_path,
       diskann::Metric compareMetric, const double p_val, size_t& disk_pq_dims);
 
+  template DISKANN_DLLEXPORT void generate_disk_quantized_data<float16>(
+      const std::string data_file_to_use, const std::string disk_pq_pivots_path,
+      const std::string disk_pq_compressed_vectors_path,
+      diskann::Metric compareMetric, const double p_val, size_t& disk_pq_dims);
+
   template DISKANN_DLLEXPORT void generate_quantized_data<int8_t>(
       const std::string data_file_to_use, const std::string pq_pivots_path,
       const std::string pq_compressed_vectors_path,
@@ -1040,4 +1192,10 @@ namespace diskann {
       const std::string pq_compressed_vectors_path,
       diskann::Metric compareMetric, const double p_val,
       const size_t num_pq_chunks, const bool use_opq);
+
+  template DISKANN_DLLEXPORT void generate_quantized_data<float16>(
+      const std::string data_file_to_use, const std::string pq_pivots_path,
+      const std::string pq_compressed_vectors_path,
+      diskann::Metric compareMetric, const double p_val,
+      const size_t num_pq_chunks, const bool use_opq);
 }  // namespace diskann
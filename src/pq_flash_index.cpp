@@ -62,7 +62,8 @@ namespace diskann {
       std::shared_ptr<TensorStoreSliceReader> &tensorReader, diskann::Metric m)
       : reader(fileReader), tensor_reader(tensorReader), metric(m) {
     if (m == diskann::Metric::COSINE || m == diskann::Metric::INNER_PRODUCT) {
-      if (std::is_floating_point<T>::value) {
+      if (std::is_floating_point<T>::value ||
+          std::is_same<T, float16>::value) {
         diskann::cout << "Cosine metric chosen for (normalized) float data."
                          "Changing distance to L2 to boost accuracy."
                       << std::endl;
@@ -210,8 +211,7 @@ namespace diskann {
         for (_u64 node_idx = start_idx; node_idx < end_idx; node_idx++) {
           read_reqs[block].push_back(TensorsPointSliceRead{
               .pt_idx = node_list[node_idx],
-              .embedding_buf = reinterpret_cast<float *>(
-                  coord_cache_buf + node_idx * aligned_dim),
+              .embedding_buf = coord_cache_buf + node_idx * aligned_dim,
               .num_nbrs_buf = new unsigned,
               .nbrhood_buf = nhood_cache_buf + node_idx *(max_degree + 1)});
         }
@@ -531,6 +531,10 @@ namespace diskann {
 
     } else {
       // if using tensorstore backend
+      // embeddings come back in T (or as disk PQ codes), so stage them before
+      // widening to float
+      std::vector<T> medoids_coords(num_medoids * data_dim);
+
       std::vector<std::vector<TensorsPointSliceRead>> read_reqs;
       read_reqs.reserve(num_medoids);
 
@@ -538,12 +542,24 @@ namespace diskann {
         read_reqs.emplace_back();
         read_reqs[cur_m].push_back(TensorsPointSliceRead{
             .pt_idx = medoids[cur_m],
-            .embedding_buf = &centroid_data[cur_m * aligned_dim],
+            .embedding_buf = &medoids_coords[cur_m * data_dim],
             .num_nbrs_buf = nullptr,
             .nbrhood_buf = nullptr});
       }
 
       tensor_reader->read(read_reqs, use_tensors_async, false, true);
+
+      for (uint64_t cur_m = 0; cur_m < num_medoids; cur_m++) {
+        if (!use_disk_index_pq) {
+          for (uint32_t i = 0; i < data_dim; i++)
+            centroid_data[cur_m * aligned_dim + i] =
+                medoids_coords[cur_m * data_dim + i];
+        } else {
+          disk_pq_table.inflate_vector(
+              (_u8 *) &medoids_coords[cur_m * data_dim],
+              (centroid_data + cur_m * aligned_dim));
+        }
+      }
     }
   }
 
@@ -605,6 +621,9 @@ namespace diskann {
 
     this->num_points = npts_u64;
     this->n_chunks = nchunks_u64;
+    this->tombstones.reset(
+        new std::atomic<_u64>[DIV_ROUND_UP(this->num_points, 64)]());
+    this->num_deleted = 0;
 
 #ifdef EXEC_ENV_OLS
     pq_table.load_pq_centroid_bin(files, pq_table_bin.c_str(), nchunks_u64);
@@ -629,10 +648,6 @@ namespace diskann {
 
     std::string disk_pq_pivots_path = this->disk_index_file + "_pq_pivots.bin";
     if (file_exists(disk_pq_pivots_path)) {
-      if (use_tensors)
-        throw TensorStoreANNException(
-            "use_disk_index_pq mode is currently incompatible with tensors "
-            "backend");
       use_disk_index_pq = true;
 #ifdef EXEC_ENV_OLS
       // giving 0 chunks to make the pq_table infer from the
@@ -744,11 +759,17 @@ namespace diskann {
     this->max_nthreads = num_threads;
 
     this->max_nbrs_per_pt =
-        (max_node_len - disk_ndims * sizeof(T) - sizeof(unsigned)) /
+        (max_node_len - disk_bytes_per_point - sizeof(unsigned)) /
         sizeof(unsigned);
     if (use_tensors) {
-      tensor_reader->open(index_tensors_prefix, disk_nnodes, disk_ndims,
-                          this->max_nbrs_per_pt, use_remote_addr);
+      // a disk-PQ index stores its uint8 codes in the embedding tensor and
+      // keeps the full-precision reorder vectors in a tensor of their own
+      tensor_reader->open(
+          index_tensors_prefix, disk_nnodes, disk_ndims, this->max_nbrs_per_pt,
+          use_remote_addr,
+          use_disk_index_pq ? tensors_embedding_dtype<_u8>()
+                            : tensors_embedding_dtype<T>(),
+          this->reorder_data_exists ? this->ndims_reorder_vecs : 0);
     }
 
 #endif
@@ -822,10 +843,71 @@ namespace diskann {
                 << this->max_base_norm << std::endl;
       delete[] norm_val;
     }
+
+    std::string tombstones_file =
+        std::string(disk_index_file) + "_tombstones.bin";
+    if (file_exists(tombstones_file)) {
+      std::unique_ptr<_u32[]> deleted_ids;
+      size_t                  num_deleted_ids, dumc;
+      diskann::load_bin<_u32>(tombstones_file, deleted_ids, num_deleted_ids,
+                              dumc);
+      for (size_t i = 0; i < num_deleted_ids; i++)
+        delete_point(deleted_ids[i]);
+      diskann::cout << "Loaded " << get_num_deleted() << " deleted points from "
+                    << tombstones_file << std::endl;
+    }
     diskann::cout << "done.." << std::endl;
     return 0;
   }
 
+  template<typename T>
+  int PQFlashIndex<T>::delete_point(_u32 id) {
+    if (id >= this->num_points)
+      return -1;
+    _u64 bit = (_u64) 1 << (id % 64);
+    if (this->tombstones[id / 64].fetch_or(bit) & bit)
+      return -1;
+    this->num_deleted++;
+    return 0;
+  }
+
+  template<typename T>
+  void PQFlashIndex<T>::load_tags(const std::string &tags_file) {
+    std::unique_ptr<_u32[]> tags;
+    size_t                  num_tags, dim;
+    diskann::load_bin<_u32>(tags_file, tags, num_tags, dim);
+    if (num_tags != this->num_points || dim != 1) {
+      std::stringstream stream;
+      stream << "Tags file " << tags_file << " has " << num_tags << "x" << dim
+             << " entries, the index has " << this->num_points << " points"
+             << std::endl;
+      throw ANNException(stream.str(), -1, __FUNCSIG__, __FILE__, __LINE__);
+    }
+    this->tag_to_id.clear();
+    this->tag_to_id.reserve(num_tags);
+    for (size_t i = 0; i < num_tags; i++)
+      this->tag_to_id[tags[i]] = (_u32) i;
+  }
+
+  template<typename T>
+  int PQFlashIndex<T>::delete_tag(_u32 tag) {
+    auto iter = this->tag_to_id.find(tag);
+    if (iter == this->tag_to_id.end())
+      return -1;
+    return delete_point(iter->second);
+  }
+
+  template<typename T>
+  void PQFlashIndex<T>::save_tombstones() {
+    std::vector<_u32> deleted_ids;
+    deleted_ids.reserve(get_num_deleted());
+    for (_u64 id = 0; id < this->num_points; id++)
+      if (is_deleted(id))
+        deleted_ids.push_back((_u32) id);
+    diskann::save_bin<_u32>(std::string(disk_index_file) + "_tombstones.bin",
+                            deleted_ids.data(), deleted_ids.size(), 1);
+  }
+
 #ifdef USE_BING_INFRA
   bool getNextCompletedRequest(const IOContext &ctx, size_t size,
                                int &completedIndex) {
@@ -868,11 +950,27 @@ namespace diskann {
                        use_reorder_data, stats);
   }
 
+  template<typename T>
+  void PQFlashIndex<T>::set_tensors_prefetch_width(_u32 width) {
+    this->tensors_prefetch_width = width;
+  }
+
   template<typename T>
   void PQFlashIndex<T>::cached_beam_search(
-      const T *query1, const _u64 k_search, const _u64 l_search, _u64 *indices,
-      float *distances, const _u64 beam_width, const _u32 io_limit,
-      const bool use_reorder_data, QueryStats *stats) {
+      const T *query1, const _u64 k_search, const _u64 requested_l_search,
+      _u64 *indices, float *distances, const _u64 beam_width,
+      const _u32 io_limit, const bool use_reorder_data, QueryStats *stats) {
+    // deleted points are traversed but not returned, so widen the search to
+    // still find about as many live points as asked for
+    _u64 l_search = requested_l_search;
+    _u64 num_deleted_now = get_num_deleted();
+    if (num_deleted_now > 0) {
+      _u64 num_live = this->num_points - num_deleted_now;
+      l_search = requested_l_search * MAX_DELETED_L_FACTOR;
+      if (num_live * MAX_DELETED_L_FACTOR > this->num_points)
+        l_search =
+            DIV_ROUND_UP(requested_l_search * this->num_points, num_live);
+    }
     if (beam_width > MAX_N_SECTOR_READS)
       throw ANNException("Beamwidth can not be higher than MAX_N_SECTOR_READS",
                          -1, __FUNCSIG__, __FILE__, __LINE__);
@@ -989,6 +1087,13 @@ namespace diskann {
         cached_nhoods;
     cached_nhoods.reserve(2 * beam_width);
 
+    // speculative prefetch state (tensors backend); pending reads are dropped
+    // when the query returns
+    bool do_prefetch = use_tensors && tensors_prefetch_width > 0;
+    TensorsPrefetchHandle prefetch_handle;
+    tsl::robin_set<_u32>  prefetched;
+    std::vector<int64_t>  prefetch_ids;
+
     while (k < cur_list_size && num_ios < io_limit) {
       auto nk = cur_list_size;
       // clear iteration state
@@ -1014,6 +1119,9 @@ namespace diskann {
             }
           } else {
             frontier.push_back(retset[marker].id);
+            if (do_prefetch && stats != nullptr &&
+                prefetched.find(retset[marker].id) != prefetched.end())
+              stats->n_prefetch_hits++;
           }
           retset[marker].flag = false;
           if (this->count_visited_nodes) {
@@ -1025,6 +1133,26 @@ namespace diskann {
         marker++;
       }
 
+      // warm the cache with the best unexpanded candidates past this beam, as
+      // they are likely to form the next one; this overlaps with the round
+      // trip of reading the current beam
+      if (do_prefetch) {
+        prefetch_ids.clear();
+        for (_u32 m = marker; m < cur_list_size &&
+                              prefetch_ids.size() < tensors_prefetch_width;
+             m++) {
+          auto id = retset[m].id;
+          if (retset[m].flag && nhood_cache.find(id) == nhood_cache.end() &&
+              prefetched.insert(id).second)
+            prefetch_ids.push_back(id);
+        }
+        if (!prefetch_ids.empty()) {
+          tensor_reader->prefetch(prefetch_ids, prefetch_handle);
+          if (stats != nullptr)
+            stats->n_prefetches += (unsigned) prefetch_ids.size();
+        }
+      }
+
       // read nhoods of frontier ids
       if (!frontier.empty()) {
         if (stats != nullptr)
@@ -1067,11 +1195,11 @@ namespace diskann {
             frontier_tensors_read_reqs.emplace_back();
             frontier_tensors_read_reqs[i].push_back(TensorsPointSliceRead{
                 .pt_idx = id,
-                .embedding_buf = reinterpret_cast<float *>(node_scratch_start),
+                .embedding_buf = node_scratch_start,
                 .num_nbrs_buf = reinterpret_cast<unsigned *>(
-                    node_scratch_start + disk_data_dim * sizeof(float)),
+                    node_scratch_start + disk_bytes_per_point),
                 .nbrhood_buf = reinterpret_cast<unsigned *>(
-                    node_scratch_start + disk_data_dim * sizeof(float) +
+                    node_scratch_start + disk_bytes_per_point +
                     sizeof(unsigned))});
 
             sector_scratch_idx++;
@@ -1111,8 +1239,9 @@ namespace diskann {
                 disk_pq_table.l2_distance(  // disk_pq does not support OPQ yet
                     query_float, (_u8 *) node_fp_coords_copy);
         }
-        full_retset.push_back(
-            Neighbor((unsigned) cached_nhood.first, cur_expanded_dist, true));
+        if (num_deleted_now == 0 || !is_deleted(cached_nhood.first))
+          full_retset.push_back(
+              Neighbor((unsigned) cached_nhood.first, cur_expanded_dist, true));
 
         _u64      nnbrs = cached_nhood.second.first;
         unsigned *node_nbrs = cached_nhood.second.second;
@@ -1187,8 +1316,9 @@ namespace diskann {
             cur_expanded_dist = disk_pq_table.l2_distance(
                 query_float, (_u8 *) node_fp_coords_copy);
         }
-        full_retset.push_back(
-            Neighbor(frontier_nhood.first, cur_expanded_dist, true));
+        if (num_deleted_now == 0 || !is_deleted(frontier_nhood.first))
+          full_retset.push_back(
+              Neighbor(frontier_nhood.first, cur_expanded_dist, true));
         unsigned *node_nbrs = (node_buf + 1);
         // compute node_nbrs <-> query dist in PQ space
         cpu_timer.reset();
@@ -1261,33 +1391,65 @@ namespace diskann {
             full_retset.begin() + k_search * FULL_PRECISION_REORDER_MULTIPLIER,
             full_retset.end());
 
-      for (size_t i = 0; i < full_retset.size(); ++i) {
-        vec_read_reqs.emplace_back(
-            VECTOR_SECTOR_NO(((size_t) full_retset[i].id)) * SECTOR_LEN,
-            SECTOR_LEN, sector_scratch + i * SECTOR_LEN);
+      if (!use_tensors) {
+        // if not using tensorstore backend
+        for (size_t i = 0; i < full_retset.size(); ++i) {
+          vec_read_reqs.emplace_back(
+              VECTOR_SECTOR_NO(((size_t) full_retset[i].id)) * SECTOR_LEN,
+              SECTOR_LEN, sector_scratch + i * SECTOR_LEN);
+
+          if (stats != nullptr) {
+            stats->n_4k++;
+            stats->n_ios++;
+          }
+        }
+
+        io_timer.reset();
+#ifdef USE_BING_INFRA
+        reader->read(vec_read_reqs, ctx, false);  // sync reader windows.
+#else
+        reader->read(vec_read_reqs, ctx);  // synchronous IO linux
+#endif
+        if (stats != nullptr) {
+          stats->io_us += io_timer.elapsed();
+        }
+
+        for (size_t i = 0; i < full_retset.size(); ++i) {
+          auto id = full_retset[i].id;
+          auto location =
+              (sector_scratch + i * SECTOR_LEN) + VECTOR_SECTOR_OFFSET(id);
+          full_retset[i].distance = dist_cmp->compare(
+              aligned_query_T, (T *) location, this->data_dim);
+        }
 
+      } else {
+        // if using tensorstore backend
+        // gather all candidates' full-precision vectors in a single read
+        std::vector<int64_t> reorder_idxs;
+        std::vector<float *> reorder_bufs;
+        reorder_idxs.reserve(full_retset.size());
+        reorder_bufs.reserve(full_retset.size());
+        for (size_t i = 0; i < full_retset.size(); ++i) {
+          reorder_idxs.push_back(full_retset[i].id);
+          reorder_bufs.push_back(
+              reinterpret_cast<float *>(sector_scratch + i * SECTOR_LEN));
+        }
         if (stats != nullptr) {
           stats->n_4k++;
           stats->n_ios++;
         }
-      }
 
-      io_timer.reset();
-#ifdef USE_BING_INFRA
-      reader->read(vec_read_reqs, ctx, false);  // sync reader windows.
-#else
-      reader->read(vec_read_reqs, ctx);  // synchronous IO linux
-#endif
-      if (stats != nullptr) {
-        stats->io_us += io_timer.elapsed();
-      }
+        io_timer.reset();
+        tensor_reader->read_reorder(reorder_idxs, reorder_bufs);
+        if (stats != nullptr) {
+          stats->io_us += io_timer.elapsed();
+        }
 
-      for (size_t i = 0; i < full_retset.size(); ++i) {
-        auto id = full_retset[i].id;
-        auto location =
-            (sector_scratch + i * SECTOR_LEN) + VECTOR_SECTOR_OFFSET(id);
-        full_retset[i].distance =
-            dist_cmp->compare(aligned_query_T, (T *) location, this->data_dim);
+        for (size_t i = 0; i < full_retset.size(); ++i) {
+          full_retset[i].distance =
+              dist_cmp->compare(aligned_query_T, (T *) reorder_bufs[i],
+                                this->data_dim);
+        }
       }
 
       std::sort(full_retset.begin(), full_retset.end(),
@@ -1296,6 +1458,12 @@ namespace diskann {
                 });
     }
 
+    // with most of the visited points deleted there may be fewer than
+    // k_search results; pad with invalid ids at the largest distance
+    while (full_retset.size() < k_search)
+      full_retset.push_back(Neighbor(std::numeric_limits<unsigned>::max(),
+                                     std::numeric_limits<float>::max(), true));
+
     // copy k_search values
     for (_u64 i = 0; i < k_search; i++) {
       indices[i] = full_retset[i].id;
@@ -1387,5 +1555,6 @@ namespace diskann {
   template class PQFlashIndex<_u8>;
   template class PQFlashIndex<_s8>;
   template class PQFlashIndex<float>;
+  template class PQFlashIndex<float16>;
 
 }  // namespace diskann
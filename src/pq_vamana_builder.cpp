@@ -0,0 +1,481 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <omp.h>
+
+#include "tsl/robin_set.h"
+
+#include "index.h"
+#include "logger.h"
+#include "pq_vamana_builder.h"
+#include "timer.h"
+
+namespace diskann {
+  template<typename T>
+  struct PQVamanaBuilder<T>::ThreadScratch {
+    T *    query = nullptr;        // [aligned_dim], vector being inserted
+    float *query_float = nullptr;  // [aligned_dim], PQ-preprocessed query
+    float *pq_dists = nullptr;     // [256 * num_pq_chunks]
+
+    // full-precision copies of the prune candidates
+    T *    cand_vecs = nullptr;  // [cand_capacity * aligned_dim]
+    size_t cand_capacity = 0;
+    size_t aligned_dim = 0;
+
+    std::vector<Neighbor>    best_l;
+    std::vector<unsigned>    expanded;
+    tsl::robin_set<unsigned> visited;
+    std::vector<unsigned>    nbr_ids;
+    std::vector<_u8>         nbr_codes;
+    std::vector<float>       nbr_dists;
+
+    std::vector<unsigned> pool, pruned;
+    std::vector<unsigned> des_pool, des_pruned;
+
+    std::vector<Neighbor>  cands;
+    std::vector<float>     occlude_factor;
+    std::vector<const T *> batch_ptrs;
+    std::vector<unsigned>  batch_pos;
+    std::vector<float>     batch_dists;
+
+    ThreadScratch(size_t aligned_dim, size_t num_pq_chunks, unsigned L,
+                  unsigned max_degree)
+        : aligned_dim(aligned_dim) {
+      alloc_aligned((void **) &query, aligned_dim * sizeof(T), 8 * sizeof(T));
+      alloc_aligned((void **) &query_float, aligned_dim * sizeof(float),
+                    8 * sizeof(float));
+      alloc_aligned((void **) &pq_dists, 256 * num_pq_chunks * sizeof(float),
+                    256);
+      std::memset(query, 0, aligned_dim * sizeof(T));
+      std::memset(query_float, 0, aligned_dim * sizeof(float));
+      reserve_candidates(2 * (size_t) L);
+
+      best_l.resize((size_t) L + 1);
+      visited.reserve(20 * (size_t) L);
+      nbr_codes.resize((size_t) max_degree * num_pq_chunks);
+      nbr_dists.resize(max_degree);
+    }
+
+    ~ThreadScratch() {
+      aligned_free(query);
+      aligned_free(query_float);
+      aligned_free(pq_dists);
+      aligned_free(cand_vecs);
+    }
+
+    void reserve_candidates(size_t n) {
+      if (n <= cand_capacity)
+        return;
+      aligned_free(cand_vecs);
+      alloc_aligned((void **) &cand_vecs, n * aligned_dim * sizeof(T),
+                    8 * sizeof(T));
+      // zero padding beyond the true dimension stays zero
+      std::memset(cand_vecs, 0, n * aligned_dim * sizeof(T));
+      cand_capacity = n;
+    }
+  };
+
+  template<typename T>
+  PQVamanaBuilder<T>::PQVamanaBuilder(const std::string &base_file,
+                                      const std::string &pq_pivots_path,
+                                      const std::string &pq_compressed_path) {
+    if (!file_exists(base_file))
+      throw diskann::ANNException("Base file not found: " + base_file, -1,
+                                  __FUNCSIG__, __FILE__, __LINE__);
+    get_bin_metadata(base_file, _num_points, _dim);
+    _aligned_dim = ROUND_UP(_dim, 8);
+
+    _base_mapper = std::make_unique<MemoryMapper>(base_file);
+    if (_base_mapper->getFileSize() <
+        2 * sizeof(int) + _num_points * _dim * sizeof(T)) {
+      std::stringstream stream;
+      stream << "Base file " << base_file << " is smaller than its header ("
+             << _num_points << " x " << _dim << ") implies";
+      throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
+                                  __LINE__);
+    }
+    _base = (const T *) (_base_mapper->getBuf() + 2 * sizeof(int));
+
+    size_t num_pq_pts;
+    load_bin<_u8>(pq_compressed_path, _pq_codes, num_pq_pts, _num_pq_chunks);
+    if (num_pq_pts != _num_points) {
+      std::stringstream stream;
+      stream << "PQ compressed file has " << num_pq_pts
+             << " points but the base file has " << _num_points;
+      throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
+                                  __LINE__);
+    }
+#ifdef EXEC_ENV_OLS
+    throw diskann::ANNException(
+        "PQ-navigated build is not supported in this environment", -1,
+        __FUNCSIG__, __FILE__, __LINE__);
+#else
+    _pq_table.load_pq_centroid_bin(pq_pivots_path.c_str(), _num_pq_chunks);
+#endif
+
+    _distance.reset(get_distance_function<T>(diskann::Metric::L2));
+  }
+
+  template<typename T>
+  PQVamanaBuilder<T>::~PQVamanaBuilder() {
+  }
+
+  template<typename T>
+  void PQVamanaBuilder<T>::copy_vector(unsigned id, T *out) const {
+    std::memcpy(out, _base + (size_t) id * _dim, _dim * sizeof(T));
+  }
+
+  // the base point closest to the centroid, one streaming pass over the
+  // mapped base file
+  template<typename T>
+  unsigned PQVamanaBuilder<T>::calculate_medoid() {
+    std::vector<double> centroid(_dim, 0);
+#pragma omp parallel
+    {
+      std::vector<double> local(_dim, 0);
+#pragma omp for schedule(static, 65536)
+      for (_s64 i = 0; i < (_s64) _num_points; i++) {
+        const T *vec = _base + (size_t) i * _dim;
+        for (size_t d = 0; d < _dim; d++)
+          local[d] += (double) vec[d];
+      }
+#pragma omp critical
+      for (size_t d = 0; d < _dim; d++)
+        centroid[d] += local[d];
+    }
+    for (size_t d = 0; d < _dim; d++)
+      centroid[d] /= (double) _num_points;
+
+    unsigned best_id = 0;
+    double   best_dist = std::numeric_limits<double>::max();
+#pragma omp parallel
+    {
+      unsigned local_id = 0;
+      double   local_dist = std::numeric_limits<double>::max();
+#pragma omp for schedule(static, 65536)
+      for (_s64 i = 0; i < (_s64) _num_points; i++) {
+        const T *vec = _base + (size_t) i * _dim;
+        double   dist = 0;
+        for (size_t d = 0; d < _dim; d++) {
+          double diff = (double) vec[d] - centroid[d];
+          dist += diff * diff;
+        }
+        if (dist < local_dist) {
+          local_dist = dist;
+          local_id = (unsigned) i;
+        }
+      }
+#pragma omp critical
+      if (local_dist < best_dist) {
+        best_dist = local_dist;
+        best_id = local_id;
+      }
+    }
+    return best_id;
+  }
+
+  template<typename T>
+  void PQVamanaBuilder<T>::build(unsigned L, unsigned R, unsigned C,
+                                 float alpha, unsigned num_threads) {
+    if (L == 0 || R == 0 || C == 0)
+      throw diskann::ANNException("L, R and C must be positive", -1,
+                                  __FUNCSIG__, __FILE__, __LINE__);
+    _L = L;
+    _R = R;
+    _C = C;
+    _alpha = alpha;
+    if (num_threads != 0)
+      omp_set_num_threads(num_threads);
+
+    _graph.resize(_num_points);
+    _graph.reserve_degree(slack_degree(_R));
+    _locks = std::vector<non_recursive_mutex>(_num_points);
+
+    diskann::Timer timer;
+    _start = calculate_medoid();
+    diskann::cout << "PQ-navigated build of " << _num_points << " points ("
+                  << _num_pq_chunks << " PQ bytes each), start point "
+                  << _start << ", resident memory "
+                  << memory_bytes() / (1024.0 * 1024 * 1024) << "GiB"
+                  << std::endl;
+
+    std::vector<std::unique_ptr<ThreadScratch>> scratch(omp_get_max_threads());
+    auto get_scratch = [&]() -> ThreadScratch & {
+      auto &s = scratch[omp_get_thread_num()];
+      if (s == nullptr)
+        s = std::make_unique<ThreadScratch>(_aligned_dim, _num_pq_chunks, _L,
+                                            _graph.max_degree());
+      return *s;
+    };
+
+    std::exception_ptr error = nullptr;
+#pragma omp parallel for schedule(dynamic, 2048)
+    for (_s64 i = 0; i < (_s64) _num_points; i++) {
+      try {
+        search_and_link((unsigned) i, get_scratch());
+        if (i % 100000 == 0) {
+          diskann::cout << "\r" << (100.0 * i) / _num_points
+                        << "% of PQ-navigated build completed." << std::flush;
+        }
+      } catch (...) {
+#pragma omp critical
+        if (error == nullptr)
+          error = std::current_exception();
+      }
+    }
+    if (error != nullptr)
+      std::rethrow_exception(error);
+    diskann::cout << std::endl
+                  << "Link time: " << timer.elapsed() / 1000000.0 << "s"
+                  << std::endl;
+
+    // bring lists that grew into the slack back to R
+#pragma omp parallel for schedule(dynamic, 2048)
+    for (_s64 i = 0; i < (_s64) _num_points; i++) {
+      try {
+        auto row = _graph[i];
+        if (row.size() <= _R)
+          continue;
+        auto &s = get_scratch();
+        s.des_pool.assign(row.begin(), row.end());
+        copy_vector((unsigned) i, s.query);
+        prune((unsigned) i, s.des_pool, s.des_pruned, s);
+        row.assign(s.des_pruned.begin(), s.des_pruned.end());
+      } catch (...) {
+#pragma omp critical
+        if (error == nullptr)
+          error = std::current_exception();
+      }
+    }
+    if (error != nullptr)
+      std::rethrow_exception(error);
+
+    size_t max = 0, min = SIZE_MAX, total = 0;
+    for (size_t i = 0; i < _num_points; i++) {
+      size_t degree = _graph[i].size();
+      max = std::max(max, degree);
+      min = std::min(min, degree);
+      total += degree;
+    }
+    _max_observed_degree = (unsigned) max;
+    diskann::cout << "PQ-navigated graph built in "
+                  << timer.elapsed() / 1000000.0 << "s with degree: max:" << max
+                  << "  avg:" << (float) total / (float) _num_points
+                  << "  min:" << min << std::endl;
+  }
+
+  template<typename T>
+  void PQVamanaBuilder<T>::search_and_link(unsigned id, ThreadScratch &s) {
+    copy_vector(id, s.query);
+    for (size_t d = 0; d < _dim; d++)
+      s.query_float[d] = (float) s.query[d];
+    _pq_table.preprocess_query(s.query_float);
+    _pq_table.populate_chunk_distances(s.query_float, s.pq_dists);
+
+    // greedy search over the graph built so far, on PQ distances
+    auto &best_l = s.best_l;
+    s.visited.clear();
+    s.expanded.clear();
+
+    float start_dist;
+    pq_dist_lookup(_pq_codes.get() + (size_t) _start * _num_pq_chunks, 1,
+                   _num_pq_chunks, s.pq_dists, &start_dist);
+    best_l[0] = Neighbor(_start, start_dist, true);
+    s.visited.insert(_start);
+    unsigned l = 1;
+
+    unsigned k = 0;
+    while (k < l) {
+      unsigned nk = l;
+      if (best_l[k].flag) {
+        best_l[k].flag = false;
+        unsigned n = best_l[k].id;
+        s.expanded.push_back(n);
+
+        s.nbr_ids.clear();
+        {
+          LockGuard guard(_locks[n]);
+          for (auto nbr : _graph[n])
+            if (s.visited.insert(nbr).second)
+              s.nbr_ids.push_back(nbr);
+        }
+        if (!s.nbr_ids.empty()) {
+          aggregate_coords(s.nbr_ids.data(), s.nbr_ids.size(), _pq_codes.get(),
+                           _num_pq_chunks, s.nbr_codes.data());
+          pq_dist_lookup(s.nbr_codes.data(), s.nbr_ids.size(), _num_pq_chunks,
+                         s.pq_dists, s.nbr_dists.data());
+        }
+        for (size_t m = 0; m < s.nbr_ids.size(); m++) {
+          float dist = s.nbr_dists[m];
+          if (l == _L && dist >= best_l[l - 1].distance)
+            continue;
+          Neighbor nn(s.nbr_ids[m], dist, true);
+          unsigned pos =
+              (unsigned) (std::upper_bound(best_l.begin(), best_l.begin() + l,
+                                           nn) -
+                          best_l.begin());
+          std::copy_backward(best_l.begin() + pos, best_l.begin() + l,
+                             best_l.begin() + l + 1);
+          best_l[pos] = nn;
+          if (l < _L)
+            l++;
+          if (pos < nk)
+            nk = pos;
+        }
+      }
+      if (nk <= k)
+        k = nk;
+      else
+        k++;
+    }
+
+    s.pool.clear();
+    for (auto n : s.expanded)
+      if (n != id)
+        s.pool.push_back(n);
+    if (s.pool.empty())
+      return;
+
+    prune(id, s.pool, s.pruned, s);
+    {
+      LockGuard guard(_locks[id]);
+      _graph[id].assign(s.pruned.begin(), s.pruned.end());
+    }
+    inter_insert(id, s.pruned, s);
+  }
+
+  // expects the full-precision vector of center_id in s.query
+  template<typename T>
+  void PQVamanaBuilder<T>::prune(unsigned center_id, std::vector<unsigned> &pool,
+                                 std::vector<unsigned> &pruned,
+                                 ThreadScratch &        s) {
+    pruned.clear();
+    s.reserve_candidates(pool.size());
+
+    s.batch_ptrs.clear();
+    for (size_t i = 0; i < pool.size(); i++) {
+      T *vec = s.cand_vecs + i * _aligned_dim;
+      copy_vector(pool[i], vec);
+      s.batch_ptrs.push_back(vec);
+    }
+    s.batch_dists.resize(pool.size());
+    _distance->compare_batch(s.query, s.batch_ptrs.data(),
+                             (uint32_t) pool.size(), (uint32_t) _aligned_dim,
+                             s.batch_dists.data());
+
+    // candidates refer to their slot in cand_vecs
+    s.cands.clear();
+    for (size_t i = 0; i < pool.size(); i++)
+      if (pool[i] != center_id)
+        s.cands.emplace_back((unsigned) i, s.batch_dists[i], true);
+    std::sort(s.cands.begin(), s.cands.end());
+    if (s.cands.size() > _C)
+      s.cands.resize(_C);
+
+    auto &occlude_factor = s.occlude_factor;
+    occlude_factor.assign(s.cands.size(), 0);
+    float cur_alpha = 1;
+    while (cur_alpha <= _alpha && pruned.size() < _R) {
+      for (size_t i = 0; pruned.size() < _R && i < s.cands.size(); i++) {
+        if (occlude_factor[i] > cur_alpha)
+          continue;
+        occlude_factor[i] = std::numeric_limits<float>::max();
+        pruned.push_back(pool[s.cands[i].id]);
+
+        s.batch_pos.clear();
+        s.batch_ptrs.clear();
+        for (size_t t = i + 1; t < s.cands.size(); t++) {
+          if (occlude_factor[t] > _alpha)
+            continue;
+          s.batch_pos.push_back((unsigned) t);
+          s.batch_ptrs.push_back(s.cand_vecs +
+                                 (size_t) s.cands[t].id * _aligned_dim);
+        }
+        if (s.batch_pos.empty())
+          continue;
+
+        s.batch_dists.resize(s.batch_pos.size());
+        _distance->compare_batch(
+            s.cand_vecs + (size_t) s.cands[i].id * _aligned_dim,
+            s.batch_ptrs.data(), (uint32_t) s.batch_pos.size(),
+            (uint32_t) _aligned_dim, s.batch_dists.data());
+        for (size_t b = 0; b < s.batch_pos.size(); b++) {
+          auto  t = s.batch_pos[b];
+          float djk = s.batch_dists[b];
+          if (djk == 0.0)
+            occlude_factor[t] = std::numeric_limits<float>::max();
+          else
+            occlude_factor[t] =
+                std::max(occlude_factor[t], s.cands[t].distance / djk);
+        }
+      }
+      cur_alpha *= 1.2f;
+    }
+  }
+
+  template<typename T>
+  void PQVamanaBuilder<T>::inter_insert(unsigned                     id,
+                                        const std::vector<unsigned> &pruned,
+                                        ThreadScratch &              s) {
+    const unsigned max_degree = slack_degree(_R);
+    for (auto des : pruned) {
+      {
+        LockGuard guard(_locks[des]);
+        auto      row = _graph[des];
+        if (std::find(row.begin(), row.end(), id) != row.end())
+          continue;
+        if (row.size() < max_degree) {
+          row.push_back(id);
+          continue;
+        }
+        s.des_pool.assign(row.begin(), row.end());
+      }  // des lock is released while pruning
+
+      s.des_pool.push_back(id);
+      copy_vector(des, s.query);
+      prune(des, s.des_pool, s.des_pruned, s);
+      {
+        LockGuard guard(_locks[des]);
+        _graph[des].assign(s.des_pruned.begin(), s.des_pruned.end());
+      }
+    }
+  }
+
+  // same layout as Index::save_graph, without frozen points
+  template<typename T>
+  _u64 PQVamanaBuilder<T>::save(const std::string &graph_file) {
+    std::ofstream out;
+    open_file_to_write(out, graph_file);
+
+    _u64 index_size = 24;
+    _u64 num_frozen_pts = 0;
+    out.write((char *) &index_size, sizeof(uint64_t));
+    out.write((char *) &_max_observed_degree, sizeof(unsigned));
+    out.write((char *) &_start, sizeof(unsigned));
+    out.write((char *) &num_frozen_pts, sizeof(_u64));
+    for (size_t i = 0; i < _num_points; i++) {
+      auto     nbrs = _graph[i];
+      unsigned GK = (unsigned) nbrs.size();
+      out.write((char *) nbrs.raw(), (GK + 1) * sizeof(unsigned));
+      index_size += (_u64)(sizeof(unsigned) * (GK + 1));
+    }
+    out.seekp(0, out.beg);
+    out.write((char *) &index_size, sizeof(uint64_t));
+    out.close();
+    return index_size;
+  }
+
+  template<typename T>
+  size_t PQVamanaBuilder<T>::memory_bytes() const {
+    return _num_points * _num_pq_chunks + _graph.memory_bytes() +
+           _locks.size() * sizeof(non_recursive_mutex);
+  }
+
+  template DISKANN_DLLEXPORT class PQVamanaBuilder<float>;
+  template DISKANN_DLLEXPORT class PQVamanaBuilder<int8_t>;
+  template DISKANN_DLLEXPORT class PQVamanaBuilder<uint8_t>;
+  template DISKANN_DLLEXPORT class PQVamanaBuilder<float16>;
+}  // namespace diskann
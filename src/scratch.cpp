@@ -41,6 +41,11 @@ namespace diskann {
     _best_l_nodes.resize(l_to_use + 1);
     _inserted_into_pool_rs.reserve(l_to_use * 20);
     _inserted_into_pool_bs = new boost::dynamic_bitset<>();
+
+    _occlude_factor.reserve(l_to_use * 2);
+    _occlude_batch_pos.reserve(l_to_use * 2);
+    _occlude_batch_ptrs.reserve(l_to_use * 2);
+    _occlude_batch_dists.reserve(l_to_use * 2);
   }
 
   template<typename T>
@@ -136,12 +141,15 @@ namespace diskann {
   template DISKANN_DLLEXPORT class InMemQueryScratch<int8_t>;
   template DISKANN_DLLEXPORT class InMemQueryScratch<uint8_t>;
   template DISKANN_DLLEXPORT class InMemQueryScratch<float>;
+  template DISKANN_DLLEXPORT class InMemQueryScratch<float16>;
 
   template DISKANN_DLLEXPORT class SSDQueryScratch<_u8>;
   template DISKANN_DLLEXPORT class SSDQueryScratch<_s8>;
   template DISKANN_DLLEXPORT class SSDQueryScratch<float>;
+  template DISKANN_DLLEXPORT class SSDQueryScratch<float16>;
 
   template DISKANN_DLLEXPORT class SSDThreadData<_u8>;
   template DISKANN_DLLEXPORT class SSDThreadData<_s8>;
   template DISKANN_DLLEXPORT class SSDThreadData<float>;
+  template DISKANN_DLLEXPORT class SSDThreadData<float16>;
 }  // namespace diskann
\ No newline at end of file
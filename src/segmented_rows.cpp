@@ -0,0 +1,44 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <cstring>
+#include <sstream>
+
+#ifndef _WINDOWS
+#include <sys/mman.h>
+#endif
+
+#include "ann_exception.h"
+#include "logger.h"
+#include "segmented_rows.h"
+#include "utils.h"
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+namespace diskann {
+  void *alloc_segment(size_t bytes, bool huge_pages) {
+    size_t align = huge_pages ? HUGE_PAGE_SIZE : 64;
+    bytes = ROUND_UP(std::max(bytes, (size_t) 1), align);
+
+    void *segment = nullptr;
+    alloc_aligned(&segment, bytes, align);
+    if (segment == nullptr) {
+      std::stringstream stream;
+      stream << "Failed to allocate a segment of " << bytes << " bytes";
+      throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
+                                  __LINE__);
+    }
+#ifndef _WINDOWS
+    if (huge_pages && madvise(segment, bytes, MADV_HUGEPAGE) != 0)
+      diskann::cerr << "WARNING: madvise(MADV_HUGEPAGE) failed for a segment, "
+                       "using regular pages"
+                    << std::endl;
+#endif
+    std::memset(segment, 0, bytes);
+    return segment;
+  }
+
+  void free_segment(void *segment) {
+    aligned_free(segment);
+  }
+}  // namespace diskann
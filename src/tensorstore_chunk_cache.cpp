@@ -0,0 +1,360 @@
+#include "tensorstore_chunk_cache.h"
+#include "tensorstore_slice_reader.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "tensorstore/context.h"
+#include "tensorstore/kvstore/kvstore.h"
+#include "tensorstore/kvstore/operations.h"
+#include "tensorstore/util/future.h"
+#include <nlohmann/json.hpp>
+
+namespace fs = std::filesystem;
+
+namespace {
+  static std::string read_local_file(const fs::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+      return "";
+    std::stringstream buf;
+    buf << file.rdbuf();
+    return buf.str();
+  }
+
+  // write to a temporary file first so that a crash never leaves a torn chunk
+  // behind for the zarr driver to decode
+  static void write_local_file(const fs::path &path, const std::string &data) {
+    fs::create_directories(path.parent_path());
+    std::stringstream tmp_name;
+    tmp_name << path.filename().string() << ".tmp."
+             << std::this_thread::get_id();
+    fs::path tmp_path = path.parent_path() / tmp_name.str();
+
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open() || !file.write(data.data(), data.size()))
+      throw TensorStoreANNException("failed to write local chunk file: " +
+                                    tmp_path.string());
+    file.close();
+    fs::rename(tmp_path, path);
+  }
+}  // namespace
+
+TensorStoreChunkCache::TensorStoreChunkCache(ts::Context &      context,
+                                             const std::string &remote_addr,
+                                             const std::string &cache_dir,
+                                             size_t capacity_bytes)
+    : cache_dir(cache_dir), capacity_bytes(capacity_bytes) {
+  auto open_result =
+      ts::kvstore::Open({{"driver", "http"}, {"base_url", remote_addr}},
+                        context)
+          .result();
+  if (!open_result.ok())
+    throw TensorStoreANNException("failed to open remote kvstore: " +
+                                  open_result.status().ToString());
+  remote_store = std::move(open_result.value());
+
+  // the chunk index and the pins live in this process only, so another
+  // process deleting files under it would make reads return fill values
+  fs::create_directories(cache_dir);
+  std::string lock_path = (fs::path(cache_dir) / ".lock").string();
+  lock_fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lock_fd < 0)
+    throw TensorStoreANNException("failed to open local cache lock file: " +
+                                  lock_path);
+  if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+    ::close(lock_fd);
+    throw TensorStoreANNException(
+        "local cache directory is in use by another process: " + cache_dir);
+  }
+}
+
+TensorStoreChunkCache::~TensorStoreChunkCache() {
+  // fetch callbacks still reference this object
+  {
+    std::unique_lock<std::mutex> lock(index_mutex);
+    fetched_cv.wait(lock, [this] { return in_flight.empty(); });
+    collect_garbage_locked();
+  }
+  ::close(lock_fd);
+}
+
+size_t TensorStoreChunkCache::attach(const std::string &tensor_path,
+                                     std::string &      local_path) {
+  auto read_result =
+      ts::kvstore::Read(remote_store, tensor_path + "/.zarray").result();
+  if (!read_result.ok())
+    throw TensorStoreANNException("failed to read remote tensor metadata: " +
+                                  read_result.status().ToString());
+  if (read_result->state != ts::kvstore::ReadResult::kValue)
+    throw TensorStoreANNException("remote tensor metadata missing: " +
+                                  tensor_path);
+  std::string remote_meta(read_result->value);
+  std::string remote_generation = read_result->stamp.generation.value;
+
+  // a rebuilt remote index invalidates everything mirrored of this tensor
+  fs::path dir = fs::path(cache_dir) / tensor_path;
+  // NOTE :: without an etag, the generation is empty and a rebuilt index
+  // whose .zarray is unchanged passes as valid; its stale chunks are served
+  bool valid =
+      read_local_file(dir / ".zarray") == remote_meta &&
+      read_local_file(dir / ".remote_generation") == remote_generation;
+  if (!valid) {
+    fs::remove_all(dir);
+    write_local_file(dir / ".remote_generation", remote_generation);
+    write_local_file(dir / ".zarray", remote_meta);
+  }
+
+  auto       meta_json = ::nlohmann::json::parse(remote_meta);
+  TensorMeta meta;
+  meta.path = tensor_path;
+  meta.separator = meta_json.value("dimension_separator", std::string("."));
+  meta.num_rows = meta_json["shape"][0].get<int64_t>();
+  meta.chunk_rows = meta_json["chunks"][0].get<int64_t>();
+  int64_t num_cols = meta_json["shape"][1].get<int64_t>();
+  int64_t chunk_cols = meta_json["chunks"][1].get<int64_t>();
+  meta.num_col_chunks = (num_cols + chunk_cols - 1) / chunk_cols;
+
+  // index chunks left by earlier runs, oldest first so the newest end up at
+  // the front of the LRU list
+  size_t num_indexed = 0;
+  if (valid) {
+    std::vector<std::pair<fs::file_time_type, fs::path>> chunk_files;
+    for (auto &entry : fs::recursive_directory_iterator(dir)) {
+      if (!entry.is_regular_file())
+        continue;
+      std::string name = entry.path().filename().string();
+      if (name.rfind(".", 0) == 0)
+        continue;
+      if (name.find(".tmp.") != std::string::npos) {
+        fs::remove(entry.path());
+        continue;
+      }
+      chunk_files.emplace_back(entry.last_write_time(), entry.path());
+    }
+    std::sort(chunk_files.begin(), chunk_files.end());
+
+    std::lock_guard<std::mutex> guard(index_mutex);
+    for (auto &chunk_file : chunk_files) {
+      std::string key =
+          tensor_path + "/" +
+          fs::relative(chunk_file.second, dir).generic_string();
+      index_chunk_locked(key, fs::file_size(chunk_file.second));
+      num_indexed++;
+    }
+    evict_locked();
+    collect_garbage_locked();
+  }
+  std::cerr << "Attached local chunk cache: " << dir.string() << " ("
+            << num_indexed << " chunks reused)" << std::endl;
+
+  tensors.push_back(meta);
+  local_path = dir.string();
+  return tensors.size() - 1;
+}
+
+std::vector<std::string> TensorStoreChunkCache::fetch_rows(
+    size_t tensor_id, const std::vector<int64_t> &rows) {
+  const TensorMeta &meta = tensors[tensor_id];
+
+  std::vector<int64_t> row_chunks;
+  row_chunks.reserve(rows.size());
+  for (auto row : rows)
+    row_chunks.push_back(row / meta.chunk_rows);
+  std::sort(row_chunks.begin(), row_chunks.end());
+  row_chunks.erase(std::unique(row_chunks.begin(), row_chunks.end()),
+                   row_chunks.end());
+
+  std::vector<std::string> waits, to_fetch;
+  {
+    std::lock_guard<std::mutex> guard(index_mutex);
+    for (auto i : row_chunks) {
+      for (int64_t j = 0; j < meta.num_col_chunks; ++j) {
+        std::string key = meta.path + "/" + std::to_string(i) +
+                          meta.separator + std::to_string(j);
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+          lru.splice(lru.begin(), lru, it->second.lru_it);
+          stats.hits++;
+          continue;
+        }
+        // evicted but its file is still around
+        auto pd = pending_deletes.find(key);
+        if (pd != pending_deletes.end()) {
+          index_chunk_locked(key, pd->second.bytes);
+          pending_deletes.erase(pd);
+          stats.hits++;
+          continue;
+        }
+
+        waits.push_back(key);
+        if (in_flight.insert(key).second) {
+          failed.erase(key);
+          stats.misses++;
+          to_fetch.push_back(key);
+        }
+      }
+    }
+  }
+
+  // issued outside the lock, as callbacks of ready futures run inline
+  for (auto &key : to_fetch) {
+    ts::kvstore::Read(remote_store, key)
+        .ExecuteWhenReady(
+            [this, key](ts::ReadyFuture<ts::kvstore::ReadResult> ready) {
+              complete_fetch(key, ready.result());
+            });
+  }
+  return waits;
+}
+
+void TensorStoreChunkCache::wait_chunks(const std::vector<std::string> &keys) {
+  std::unique_lock<std::mutex> lock(index_mutex);
+  for (auto &key : keys) {
+    fetched_cv.wait(lock, [&] { return in_flight.count(key) == 0; });
+    // left in place for the other waiters, until the next fetch_rows()
+    auto it = failed.find(key);
+    if (it != failed.end())
+      throw TensorStoreANNException("failed to fetch remote chunk " + key +
+                                    ": " + it->second);
+  }
+}
+
+TensorStoreChunkCache::Pin::Pin(TensorStoreChunkCache *cache, uint64_t epoch)
+    : cache(cache), epoch(epoch) {
+}
+
+TensorStoreChunkCache::Pin::Pin(Pin &&other) noexcept
+    : cache(other.cache), epoch(other.epoch) {
+  other.cache = nullptr;
+}
+
+TensorStoreChunkCache::Pin &TensorStoreChunkCache::Pin::operator=(
+    Pin &&other) noexcept {
+  if (this != &other) {
+    release();
+    cache = other.cache;
+    epoch = other.epoch;
+    other.cache = nullptr;
+  }
+  return *this;
+}
+
+TensorStoreChunkCache::Pin::~Pin() {
+  release();
+}
+
+void TensorStoreChunkCache::Pin::release() {
+  if (cache != nullptr)
+    cache->unpin(epoch);
+  cache = nullptr;
+}
+
+TensorStoreChunkCache::Pin TensorStoreChunkCache::pin() {
+  std::lock_guard<std::mutex> guard(index_mutex);
+  active_pins[epoch]++;
+  return Pin(this, epoch);
+}
+
+void TensorStoreChunkCache::unpin(uint64_t pin_epoch) {
+  // the pin releasing the oldest epoch deletes what only it held on to, so
+  // files are reclaimed even while newer pins keep overlapping
+  std::lock_guard<std::mutex> guard(index_mutex);
+  auto                        it = active_pins.find(pin_epoch);
+  if (--it->second == 0) {
+    bool was_oldest = it == active_pins.begin();
+    active_pins.erase(it);
+    if (was_oldest)
+      collect_garbage_locked();
+  }
+}
+
+TensorStoreChunkCacheStats TensorStoreChunkCache::get_stats() {
+  std::lock_guard<std::mutex> guard(index_mutex);
+  TensorStoreChunkCacheStats  snapshot = stats;
+  snapshot.cached_bytes = total_bytes;
+  return snapshot;
+}
+
+void TensorStoreChunkCache::index_chunk_locked(const std::string &key,
+                                               size_t             bytes) {
+  lru.push_front(key);
+  index[key] = ChunkEntry{bytes, lru.begin()};
+  total_bytes += bytes;
+}
+
+void TensorStoreChunkCache::evict_locked() {
+  if (total_bytes <= capacity_bytes || lru.empty())
+    return;
+  // pins taken from now on cannot reach the chunks evicted here, as
+  // fetch_rows() reindexes a pending chunk instead of reading it
+  while (total_bytes > capacity_bytes && !lru.empty()) {
+    std::string key = lru.back();
+    lru.pop_back();
+    auto it = index.find(key);
+    total_bytes -= it->second.bytes;
+    pending_deletes[key] = PendingDelete{it->second.bytes, epoch};
+    pending_order.emplace_back(epoch, key);
+    index.erase(it);
+    stats.evictions++;
+  }
+  epoch++;
+  collect_garbage_locked();
+}
+
+void TensorStoreChunkCache::collect_garbage_locked() {
+  uint64_t oldest_pin =
+      active_pins.empty() ? epoch : active_pins.begin()->first;
+  while (!pending_order.empty() && pending_order.front().first < oldest_pin) {
+    auto pd = pending_deletes.find(pending_order.front().second);
+    // skip chunks reindexed, or evicted again later, since this entry
+    if (pd != pending_deletes.end() &&
+        pd->second.epoch == pending_order.front().first) {
+      std::error_code ec;
+      fs::remove(fs::path(cache_dir) / pd->first, ec);
+      pending_deletes.erase(pd);
+    }
+    pending_order.pop_front();
+  }
+}
+
+void TensorStoreChunkCache::complete_fetch(
+    const std::string &key, const ts::Result<ts::kvstore::ReadResult> &result) {
+  std::string error;
+  size_t      bytes = 0;
+  if (!result.ok()) {
+    error = result.status().ToString();
+  } else if (result->state == ts::kvstore::ReadResult::kValue) {
+    std::string value(result->value);
+    bytes = value.size();
+    try {
+      write_local_file(fs::path(cache_dir) / key, value);
+    } catch (const std::exception &e) {
+      error = e.what();
+    }
+  }
+  // a missing remote chunk holds only fill values, which is exactly what the
+  // zarr driver reads for a missing local file
+
+  {
+    std::lock_guard<std::mutex> guard(index_mutex);
+    in_flight.erase(key);
+    if (error.empty()) {
+      index_chunk_locked(key, bytes);
+      stats.fetched_bytes += bytes;
+      evict_locked();
+    } else {
+      failed[key] = error;
+    }
+    // under the mutex: once in_flight is empty the destructor may run
+    fetched_cv.notify_all();
+  }
+}
@@ -0,0 +1,293 @@
+#include "tensorstore_index_writer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <omp.h>
+#include <vector>
+
+#include "cached_io.h"
+#include "float16.h"
+#include "tensorstore_slice_reader.h"
+#include "timer.h"
+#include "utils.h"
+
+#include "tensorstore/context.h"
+#include "tensorstore/open.h"
+#include "tensorstore/index_space/dim_expression.h"
+
+namespace {
+  // rows per chunk when none is given: about this many embedding bytes
+  static constexpr size_t DEFAULT_CHUNK_BYTES = 1 << 20;  // ~1MB
+
+  static constexpr size_t GRAPH_READ_CACHE_SIZE = 64 * 1024 * 1024;
+
+  // TensorStore element type of a point element type
+  template<typename T>
+  struct tensor_element {
+    using type = T;
+  };
+  template<>
+  struct tensor_element<diskann::float16> {
+    using type = ts::dtypes::float16_t;
+  };
+
+  template<typename V>
+  static ts::TensorStore<V> create_tensorstore(ts::Context &      context,
+                                               const std::string &filename,
+                                               const std::string &dtype_str,
+                                               int64_t rows, int64_t cols,
+                                               int64_t chunk_rows) {
+    std::vector<int64_t> dims = {rows, cols};
+    std::vector<int64_t> chunks = {chunk_rows, cols};
+
+    auto open_result =
+        ts::Open<V>({{"driver", "zarr"},
+                     {"kvstore", {{"driver", "file"}, {"path", filename}}},
+                     {"metadata",
+                      {{"dtype", dtype_str},
+                       {"shape", dims},
+                       {"chunks", chunks}}}},
+                    context,
+                    ts::OpenMode::create | ts::OpenMode::delete_existing,
+                    ts::ReadWriteMode::write)
+            .result();
+    if (!open_result.ok())
+      throw TensorStoreANNException("failed to create TensorStore instance " +
+                                    filename + ": " +
+                                    open_result.status().ToString());
+
+    return std::move(open_result.value());
+  }
+
+  // submits the write of rows [row_beg, row_beg + array rows) of a tensor
+  template<typename V>
+  static ts::WriteFutures tensor2d_submit_write_rows(
+      ts::TensorStore<V> &store, const ts::SharedArray<V> &array,
+      int64_t row_beg, int64_t num_rows) {
+    return ts::Write(array, store | ts::Dims(0).HalfOpenInterval(
+                                        row_beg, row_beg + num_rows));
+  }
+
+  static void wait_writes(std::vector<ts::WriteFutures> &writes) {
+    for (auto &write : writes) {
+      auto result = write.commit_future.result();
+      if (!result.ok())
+        throw TensorStoreANNException("failed to write tensor chunk: " +
+                                      result.status().ToString());
+    }
+    writes.clear();
+  }
+
+  // reads num_rows rows of a bin file, starting at row_beg
+  template<typename T>
+  static void read_bin_rows(const std::string &filename, size_t num_dims,
+                            size_t row_beg, size_t num_rows, T *buf) {
+    std::ifstream reader(filename, std::ios::binary);
+    reader.seekg(2 * sizeof(uint32_t) + row_beg * num_dims * sizeof(T),
+                 std::ios::beg);
+    if (!reader.read(reinterpret_cast<char *>(buf),
+                     num_rows * num_dims * sizeof(T)))
+      throw TensorStoreANNException("failed to read rows " +
+                                    std::to_string(row_beg) + "+" +
+                                    std::to_string(num_rows) + " of " +
+                                    filename);
+  }
+
+  static void read_bin_header(const std::string &filename, uint32_t &num_pts,
+                              uint32_t &num_dims) {
+    std::ifstream reader(filename, std::ios::binary);
+    if (!reader.read(reinterpret_cast<char *>(&num_pts), sizeof(uint32_t)) ||
+        !reader.read(reinterpret_cast<char *>(&num_dims), sizeof(uint32_t)))
+      throw TensorStoreANNException("failed to read bin file header: " +
+                                    filename);
+  }
+
+  // runs body(chunk) for chunks [0, num_chunks) on the writer threads and
+  // rethrows the first exception
+  template<typename F>
+  static void parallel_chunks(size_t num_chunks, F &&body) {
+    std::exception_ptr error = nullptr;
+#pragma omp parallel for schedule(dynamic, 1)
+    for (int64_t c = 0; c < (int64_t) num_chunks; c++) {
+      if (error != nullptr)
+        continue;
+      try {
+        body((size_t) c);
+      } catch (...) {
+#pragma omp critical
+        if (error == nullptr)
+          error = std::current_exception();
+      }
+    }
+    if (error != nullptr)
+      std::rethrow_exception(error);
+  }
+}  // namespace
+
+template<typename T>
+void write_disk_index_tensors(const std::string &data_file,
+                              const std::string &mem_index_file,
+                              const std::string &tensors_filename_prefix,
+                              const std::string &reorder_data_file,
+                              size_t             chunk_rows) {
+  using V = typename tensor_element<T>::type;
+  diskann::Timer timer;
+
+  uint32_t num_pts, num_dims;
+  read_bin_header(data_file, num_pts, num_dims);
+
+  cached_ifstream graph_reader(mem_index_file, GRAPH_READ_CACHE_SIZE);
+  uint64_t        graph_file_size, num_frozen;
+  uint32_t        max_nbrs_per_pt, medoid;
+  graph_reader.read((char *) &graph_file_size, sizeof(uint64_t));
+  graph_reader.read((char *) &max_nbrs_per_pt, sizeof(uint32_t));
+  graph_reader.read((char *) &medoid, sizeof(uint32_t));
+  graph_reader.read((char *) &num_frozen, sizeof(uint64_t));
+
+  if (chunk_rows == 0)
+    chunk_rows = std::max(
+        (size_t) 1, DEFAULT_CHUNK_BYTES / ((size_t) num_dims * sizeof(T)));
+  chunk_rows = std::min(chunk_rows, (size_t) std::max(num_pts, 1u));
+  // a batch is one chunk per writer thread; chunk buffers in flight are
+  // bounded by two batches
+  size_t num_threads = omp_get_max_threads();
+  size_t batch_rows = chunk_rows * num_threads;
+
+  auto context = ts::Context::Default();
+  auto store_embedding = create_tensorstore<V>(
+      context, tensors_filename_prefix + "_embedding.zarr",
+      tensors_embedding_dtype<T>(), num_pts, num_dims, chunk_rows);
+  auto store_num_nbrs = create_tensorstore<uint32_t>(
+      context, tensors_filename_prefix + "_num_nbrs.zarr", "<u4", num_pts, 1,
+      chunk_rows);
+  auto store_nbrhood = create_tensorstore<uint32_t>(
+      context, tensors_filename_prefix + "_nbrhood.zarr", "<u4", num_pts,
+      max_nbrs_per_pt, chunk_rows);
+
+  std::cout << "Writing tensors of " << num_pts << " points (" << num_dims
+            << " dims, " << max_nbrs_per_pt << " max nbrs) in chunks of "
+            << chunk_rows << " rows with " << num_threads << " threads"
+            << std::endl;
+
+  // graph lists of one batch, zero-padded to max_nbrs_per_pt
+  std::vector<uint32_t>         num_nbrs(batch_rows);
+  std::vector<uint32_t>         nbrhoods(batch_rows * max_nbrs_per_pt);
+  std::vector<uint32_t>         excess;
+  std::vector<ts::WriteFutures> in_flight, issued;
+
+  for (size_t batch_beg = 0; batch_beg < num_pts; batch_beg += batch_rows) {
+    size_t rows = std::min(batch_rows, (size_t) num_pts - batch_beg);
+    std::fill(nbrhoods.begin(), nbrhoods.begin() + rows * max_nbrs_per_pt, 0);
+    for (size_t i = 0; i < rows; i++) {
+      uint32_t k;
+      graph_reader.read((char *) &k, sizeof(uint32_t));
+      uint32_t kept = std::min(k, max_nbrs_per_pt);
+      if (kept > 0)
+        graph_reader.read((char *) (nbrhoods.data() + i * max_nbrs_per_pt),
+                          kept * sizeof(uint32_t));
+      if (k > kept) {
+        excess.resize(k - kept);
+        graph_reader.read((char *) excess.data(),
+                          excess.size() * sizeof(uint32_t));
+      }
+      num_nbrs[i] = kept;
+    }
+
+    size_t num_chunks = DIV_ROUND_UP(rows, chunk_rows);
+    issued.resize(3 * num_chunks);
+    parallel_chunks(num_chunks, [&](size_t c) {
+      size_t  beg = c * chunk_rows;
+      size_t  n = std::min(chunk_rows, rows - beg);
+      int64_t row_beg = (int64_t)(batch_beg + beg);
+
+      auto embedding = ts::AllocateArray<V>(
+          std::vector<int64_t>{(int64_t) n, (int64_t) num_dims});
+      read_bin_rows<T>(data_file, num_dims, batch_beg + beg, n,
+                       reinterpret_cast<T *>(embedding.data()));
+      auto chunk_num_nbrs =
+          ts::AllocateArray<uint32_t>(std::vector<int64_t>{(int64_t) n, 1});
+      memcpy(chunk_num_nbrs.data(), num_nbrs.data() + beg,
+             n * sizeof(uint32_t));
+      auto chunk_nbrhood = ts::AllocateArray<uint32_t>(
+          std::vector<int64_t>{(int64_t) n, (int64_t) max_nbrs_per_pt});
+      memcpy(chunk_nbrhood.data(), nbrhoods.data() + beg * max_nbrs_per_pt,
+             n * max_nbrs_per_pt * sizeof(uint32_t));
+
+      issued[3 * c] = tensor2d_submit_write_rows<V>(store_embedding, embedding,
+                                                    row_beg, n);
+      issued[3 * c + 1] = tensor2d_submit_write_rows<uint32_t>(
+          store_num_nbrs, chunk_num_nbrs, row_beg, n);
+      issued[3 * c + 2] = tensor2d_submit_write_rows<uint32_t>(
+          store_nbrhood, chunk_nbrhood, row_beg, n);
+    });
+
+    // the previous batch committed while this one was assembled
+    wait_writes(in_flight);
+    std::swap(in_flight, issued);
+    std::cout << "  written " << batch_beg + rows << " points..." << std::endl;
+  }
+  wait_writes(in_flight);
+  std::cout << "Wrote embedding & neighborhood tensors in "
+            << timer.elapsed() / 1000000.0 << "s" << std::endl;
+
+  if (reorder_data_file.empty())
+    return;
+
+  timer.reset();
+  uint32_t num_reorder_pts, num_reorder_dims;
+  read_bin_header(reorder_data_file, num_reorder_pts, num_reorder_dims);
+  if (num_reorder_pts != num_pts)
+    throw TensorStoreANNException(
+        "mismatch in num_points between reorder data file and data file");
+  size_t reorder_chunk_rows = std::min(
+      (size_t) num_pts,
+      std::max((size_t) 1,
+               DEFAULT_CHUNK_BYTES / ((size_t) num_reorder_dims * 4)));
+  auto store_reorder = create_tensorstore<float>(
+      context, tensors_filename_prefix + "_reorder.zarr", "<f4", num_pts,
+      num_reorder_dims, reorder_chunk_rows);
+
+  batch_rows = reorder_chunk_rows * num_threads;
+  for (size_t batch_beg = 0; batch_beg < num_pts; batch_beg += batch_rows) {
+    size_t rows = std::min(batch_rows, (size_t) num_pts - batch_beg);
+    size_t num_chunks = DIV_ROUND_UP(rows, reorder_chunk_rows);
+    issued.resize(num_chunks);
+    parallel_chunks(num_chunks, [&](size_t c) {
+      size_t beg = batch_beg + c * reorder_chunk_rows;
+      size_t n = std::min(reorder_chunk_rows, batch_beg + rows - beg);
+      auto   vecs = ts::AllocateArray<float>(
+          std::vector<int64_t>{(int64_t) n, (int64_t) num_reorder_dims});
+      read_bin_rows<float>(reorder_data_file, num_reorder_dims, beg, n,
+                           vecs.data());
+      issued[c] = tensor2d_submit_write_rows<float>(store_reorder, vecs,
+                                                    (int64_t) beg, n);
+    });
+    wait_writes(in_flight);
+    std::swap(in_flight, issued);
+  }
+  wait_writes(in_flight);
+  std::cout << "Wrote reorder tensor in " << timer.elapsed() / 1000000.0 << "s"
+            << std::endl;
+}
+
+template void write_disk_index_tensors<float>(const std::string &,
+                                              const std::string &,
+                                              const std::string &,
+                                              const std::string &, size_t);
+template void write_disk_index_tensors<diskann::float16>(const std::string &,
+                                                         const std::string &,
+                                                         const std::string &,
+                                                         const std::string &,
+                                                         size_t);
+template void write_disk_index_tensors<int8_t>(const std::string &,
+                                               const std::string &,
+                                               const std::string &,
+                                               const std::string &, size_t);
+template void write_disk_index_tensors<uint8_t>(const std::string &,
+                                                const std::string &,
+                                                const std::string &,
+                                                const std::string &, size_t);
@@ -5,55 +5,92 @@
 #include <iostream>
 #include <functional>
 #include <algorithm>
+#include <string_view>
+#include <variant>
 #include "utils.h"
 
 #include "tensorstore/context.h"
 #include "tensorstore/open.h"
 #include "tensorstore/index_space/dim_expression.h"
+#include "tensorstore/internal/metrics/collect.h"
+#include "tensorstore/internal/metrics/registry.h"
 
 namespace {
-  static constexpr size_t TENSORSTORE_CACHE_POOL_SIZE = 5000000000;  // ~5GB
+  // builds the shared context: one named cache pool per tensor plus the
+  // optional concurrency limits
+  static ts::Context make_context(const TensorStoreContextSpec &spec) {
+    ::nlohmann::json context_json = {
+        {"cache_pool#embedding",
+         {{"total_bytes_limit", spec.embedding_cache_bytes}}},
+        {"cache_pool#num_nbrs",
+         {{"total_bytes_limit", spec.num_nbrs_cache_bytes}}},
+        {"cache_pool#nbrhood",
+         {{"total_bytes_limit", spec.nbrhood_cache_bytes}}},
+        {"cache_pool#reorder",
+         {{"total_bytes_limit", spec.reorder_cache_bytes}}}};
+    if (spec.data_copy_concurrency > 0)
+      context_json["data_copy_concurrency"] = {
+          {"limit", spec.data_copy_concurrency}};
+    if (spec.file_io_concurrency > 0)
+      context_json["file_io_concurrency"] = {
+          {"limit", spec.file_io_concurrency}};
+    if (spec.http_request_concurrency > 0)
+      context_json["http_request_concurrency"] = {
+          {"limit", spec.http_request_concurrency}};
+
+    auto context_spec = ts::Context::Spec::FromJson(context_json);
+    if (!context_spec.ok())
+      throw TensorStoreANNException("invalid TensorStore context spec: " +
+                                    context_spec.status().ToString());
+    return ts::Context(context_spec.value());
+  }
+
+  // recheck_cached_data takes either a bool or the string "open"
+  static ::nlohmann::json recheck_cached_data_json(const std::string &policy) {
+    if (policy == "false")
+      return false;
+    if (policy == "true")
+      return true;
+    if (policy == "open")
+      return "open";
+    throw TensorStoreANNException("invalid recheck_cached_data policy: " +
+                                  policy);
+  }
 
   template<typename V>
-  static ts::TensorStore<V> open_tensorstore(ts::Context &      context,
-                                             const std::string &filename,
-                                             const std::vector<int64_t> &dims,
-                                             const char *use_remote_addr) {
-    std::string dtype_str;
-    if constexpr (std::is_same<V, float>::value)
-      dtype_str = "<f4";
-    else if constexpr (std::is_same<V, int8_t>::value)
-      dtype_str = "|i1";
-    else if constexpr (std::is_same<V, int32_t>::value)
-      dtype_str = "<i4";
-    else if constexpr (std::is_same<V, uint8_t>::value)
-      dtype_str = "|u1";
-    else if constexpr (std::is_same<V, uint32_t>::value)
-      dtype_str = "<u4";
+  static ts::TensorStore<V> open_tensorstore(
+      ts::Context &context, const std::string &filename,
+      const std::vector<int64_t> &dims, const char *use_remote_addr,
+      const std::string &cache_pool, const ::nlohmann::json &recheck,
+      std::string dtype_str = "") {
+    if (dtype_str.empty()) {
+      if constexpr (std::is_same<V, float>::value)
+        dtype_str = "<f4";
+      else if constexpr (std::is_same<V, int8_t>::value)
+        dtype_str = "|i1";
+      else if constexpr (std::is_same<V, int32_t>::value)
+        dtype_str = "<i4";
+      else if constexpr (std::is_same<V, uint8_t>::value)
+        dtype_str = "|u1";
+      else if constexpr (std::is_same<V, uint32_t>::value)
+        dtype_str = "<u4";
+    }
+
+    ::nlohmann::json kvstore =
+        use_remote_addr ? ::nlohmann::json({{"driver", "http"},
+                                            {"base_url", use_remote_addr},
+                                            {"path", filename}})
+                        : ::nlohmann::json(
+                              {{"driver", "file"}, {"path", filename}});
 
     auto open_result =
-        use_remote_addr
-            ? ts::Open<V>(
-                  {{"driver", "zarr"},
-                   {"kvstore",
-                    {{"driver", "http"},
-                     {"base_url", use_remote_addr},
-                     {"path", filename}}},
-                   {"cache_pool",
-                    {{"total_bytes_limit", TENSORSTORE_CACHE_POOL_SIZE}}},
-                   {"recheck_cached_data", false},
-                   {"metadata", {{"dtype", dtype_str}, {"shape", dims}}}},
-                  context, ts::OpenMode::open, ts::ReadWriteMode::read)
-                  .result()
-            : ts::Open<V>(
-                  {{"driver", "zarr"},
-                   {"kvstore", {{"driver", "file"}, {"path", filename}}},
-                   {"cache_pool",
-                    {{"total_bytes_limit", TENSORSTORE_CACHE_POOL_SIZE}}},
-                   {"recheck_cached_data", false},
-                   {"metadata", {{"dtype", dtype_str}, {"shape", dims}}}},
-                  context, ts::OpenMode::open, ts::ReadWriteMode::read)
-                  .result();
+        ts::Open<V>({{"driver", "zarr"},
+                     {"kvstore", kvstore},
+                     {"cache_pool", cache_pool},
+                     {"recheck_cached_data", recheck},
+                     {"metadata", {{"dtype", dtype_str}, {"shape", dims}}}},
+                    context, ts::OpenMode::open, ts::ReadWriteMode::read)
+            .result();
     if (!open_result.ok())
       throw TensorStoreANNException("failed to open TensorStore instance: " +
                                     open_result.status().ToString());
@@ -61,6 +98,22 @@ namespace {
     return std::move(open_result.value());
   }
 
+  // sums an integer counter over all its field combinations
+  static int64_t collect_counter(
+      const std::vector<ts::internal_metrics::CollectedMetric> &metrics,
+      std::string_view                                          name) {
+    int64_t total = 0;
+    for (const auto &metric : metrics) {
+      if (metric.metric_name != name)
+        continue;
+      for (const auto &value : metric.values) {
+        if (auto v = std::get_if<int64_t>(&value.value))
+          total += *v;
+      }
+    }
+    return total;
+  }
+
   template<typename V>
   static auto tensor2d_submit_read_slice(ts::TensorStore<V> &store, int64_t dim,
                                          const std::vector<int64_t> &idxs) {
@@ -71,10 +124,10 @@ namespace {
                                  {static_cast<int64_t>(idxs.size())}))));
   }
 
-  template<typename V>
+  template<typename V, typename B>
   static void tensor2d_resolve_read_future(
       ts::Future<ts::Array<ts::Shared<V>>> future,
-      const std::vector<V *> &             bufs) {
+      const std::vector<B *> &             bufs) {
     auto read_result = future.result();
     if (!read_result.ok())
       throw TensorStoreANNException("failed to resolve read future: " +
@@ -89,18 +142,22 @@ namespace {
           "buffers vector has mismatch size: " + std::to_string(bufs.size()) +
           " vs. " + std::to_string(array.shape()[0]));
 
-    // copy data to buffers
-    size_t num_elems_per_buf = array.shape()[1];
+    // copy data to buffers; element size comes from the array's dtype so
+    // this also serves dynamically typed (embedding) tensors
+    size_t      bytes_per_buf = array.shape()[1] * array.dtype().size();
+    const char *data = static_cast<const char *>(
+        static_cast<const void *>(array.data()));
     for (size_t i = 0; i < bufs.size(); ++i) {
       if (bufs[i] != nullptr) {
-        memcpy(bufs[i], &array.data()[i * num_elems_per_buf],
-               num_elems_per_buf * sizeof(V));
+        memcpy(bufs[i], data + i * bytes_per_buf, bytes_per_buf);
       }
     }
   }
 }  // namespace
 
-TensorStoreSliceReader::TensorStoreSliceReader() {
+TensorStoreSliceReader::TensorStoreSliceReader(
+    const TensorStoreContextSpec &ctx_spec)
+    : ctx_spec(ctx_spec) {
 }
 
 TensorStoreSliceReader::~TensorStoreSliceReader() {
@@ -108,29 +165,67 @@ TensorStoreSliceReader::~TensorStoreSliceReader() {
 
 void TensorStoreSliceReader::open(const std::string &tensors_filename_prefix,
                                   size_t num_pts, size_t num_dims,
-                                  size_t      max_nbrs_per_pt,
-                                  const char *use_remote_addr) {
-  auto context = ts::Context::Default();
+                                  size_t             max_nbrs_per_pt,
+                                  const char *       use_remote_addr,
+                                  const std::string &embedding_dtype,
+                                  size_t             num_reorder_dims) {
+  auto context = make_context(ctx_spec);
+  auto recheck = recheck_cached_data_json(ctx_spec.recheck_cached_data);
+
+  // with a local chunk cache, remote tensors are opened from their mirror
+  if (use_remote_addr && !ctx_spec.local_cache_dir.empty())
+    chunk_cache.reset(
+        new TensorStoreChunkCache(context, use_remote_addr,
+                                  ctx_spec.local_cache_dir,
+                                  ctx_spec.local_cache_bytes));
+  const char *open_remote_addr = chunk_cache ? nullptr : use_remote_addr;
+  auto locate = [&](const std::string &filename, size_t &chunks_id) {
+    if (!chunk_cache)
+      return filename;
+    std::string local_path;
+    chunks_id = chunk_cache->attach(filename, local_path);
+    return local_path;
+  };
 
   std::vector<int64_t> embedding_dims = {static_cast<int64_t>(num_pts),
                                          static_cast<int64_t>(num_dims)};
   std::string embedding_filename = tensors_filename_prefix + "_embedding.zarr";
-  store_embedding = open_tensorstore<float>(context, embedding_filename,
-                                            embedding_dims, use_remote_addr);
-  std::cerr << "Opened TensorStore tensor: " << embedding_filename << std::endl;
+  store_embedding = open_tensorstore<void>(
+      context, locate(embedding_filename, embedding_chunks), embedding_dims,
+      open_remote_addr,
+      "cache_pool#embedding", recheck, embedding_dtype);
+  std::cerr << "Opened TensorStore tensor: " << embedding_filename << " ("
+            << embedding_dtype << ")" << std::endl;
 
   std::vector<int64_t> num_nbrs_dims = {static_cast<int64_t>(num_pts), 1};
   std::string num_nbrs_filename = tensors_filename_prefix + "_num_nbrs.zarr";
-  store_num_nbrs = open_tensorstore<uint32_t>(context, num_nbrs_filename,
-                                              num_nbrs_dims, use_remote_addr);
+  store_num_nbrs = open_tensorstore<uint32_t>(
+      context, locate(num_nbrs_filename, num_nbrs_chunks), num_nbrs_dims,
+      open_remote_addr,
+      "cache_pool#num_nbrs", recheck);
   std::cerr << "Opened TensorStore tensor: " << num_nbrs_filename << std::endl;
 
   std::vector<int64_t> nbrhood_dims = {static_cast<int64_t>(num_pts),
                                        static_cast<int64_t>(max_nbrs_per_pt)};
   std::string nbrhood_filename = tensors_filename_prefix + "_nbrhood.zarr";
-  store_nbrhood = open_tensorstore<uint32_t>(context, nbrhood_filename,
-                                             nbrhood_dims, use_remote_addr);
+  store_nbrhood = open_tensorstore<uint32_t>(
+      context, locate(nbrhood_filename, nbrhood_chunks), nbrhood_dims,
+      open_remote_addr,
+      "cache_pool#nbrhood", recheck);
   std::cerr << "Opened TensorStore tensor: " << nbrhood_filename << std::endl;
+
+  has_reorder = num_reorder_dims > 0;
+  if (has_reorder) {
+    std::vector<int64_t> reorder_dims = {
+        static_cast<int64_t>(num_pts), static_cast<int64_t>(num_reorder_dims)};
+    std::string reorder_filename = tensors_filename_prefix + "_reorder.zarr";
+    store_reorder = open_tensorstore<float>(
+        context, locate(reorder_filename, reorder_chunks), reorder_dims,
+        open_remote_addr,
+        "cache_pool#reorder", recheck);
+    std::cerr << "Opened TensorStore tensor: " << reorder_filename
+              << std::endl;
+  }
 }
 
 void TensorStoreSliceReader::read(
@@ -140,7 +235,7 @@ void TensorStoreSliceReader::read(
   // outer vector is a list of such read calls that could be done sync/async
   size_t num_reqs = read_reqs.size();
 
-  std::vector<ts::Future<ts::Array<ts::Shared<float>>>>    embedding_futures;
+  std::vector<ts::Future<ts::Array<ts::Shared<void>>>>     embedding_futures;
   std::vector<ts::Future<ts::Array<ts::Shared<unsigned>>>> num_nbrs_futures;
   std::vector<ts::Future<ts::Array<ts::Shared<unsigned>>>> nbrhood_futures;
   embedding_futures.reserve(num_reqs);
@@ -148,7 +243,7 @@ void TensorStoreSliceReader::read(
   nbrhood_futures.reserve(num_reqs);
 
   std::vector<std::vector<int64_t>>    pt_idxs;
-  std::vector<std::vector<float *>>    embedding_bufs;
+  std::vector<std::vector<void *>>     embedding_bufs;
   std::vector<std::vector<unsigned *>> num_nbrs_bufs;
   std::vector<std::vector<unsigned *>> nbrhood_bufs;
   pt_idxs.reserve(num_reqs);
@@ -174,13 +269,30 @@ void TensorStoreSliceReader::read(
                    std::mem_fn(&TensorsPointSliceRead::nbrhood_buf));
   }
 
+  // every chunk touched by this batch must be local before the zarr reads
+  TensorStoreChunkCache::Pin chunks_pin;
+  if (chunk_cache) {
+    chunks_pin = chunk_cache->pin();
+    std::vector<int64_t> all_idxs;
+    for (auto &idxs : pt_idxs)
+      all_idxs.insert(all_idxs.end(), idxs.begin(), idxs.end());
+    std::vector<size_t> tensor_ids;
+    if (!skip_embedding)
+      tensor_ids.push_back(embedding_chunks);
+    if (!skip_neighbors) {
+      tensor_ids.push_back(num_nbrs_chunks);
+      tensor_ids.push_back(nbrhood_chunks);
+    }
+    fetch_local_chunks(all_idxs, tensor_ids, true);
+  }
+
   for (size_t i = 0; i < num_reqs; ++i) {
     if (!skip_embedding) {
       auto embedding_future =
-          tensor2d_submit_read_slice<float>(store_embedding, 0, pt_idxs[i]);
+          tensor2d_submit_read_slice<void>(store_embedding, 0, pt_idxs[i]);
       if (!async)
-        tensor2d_resolve_read_future<float>(std::move(embedding_future),
-                                            embedding_bufs[i]);
+        tensor2d_resolve_read_future<void>(std::move(embedding_future),
+                                           embedding_bufs[i]);
       else
         embedding_futures.push_back(std::move(embedding_future));
     }
@@ -207,8 +319,8 @@ void TensorStoreSliceReader::read(
   if (async) {
     for (size_t i = 0; i < num_reqs; ++i) {
       if (!skip_embedding) {
-        tensor2d_resolve_read_future<float>(std::move(embedding_futures[i]),
-                                            embedding_bufs[i]);
+        tensor2d_resolve_read_future<void>(std::move(embedding_futures[i]),
+                                           embedding_bufs[i]);
       }
       if (!skip_neighbors) {
         tensor2d_resolve_read_future<unsigned>(std::move(num_nbrs_futures[i]),
@@ -219,3 +331,82 @@ void TensorStoreSliceReader::read(
     }
   }
 }
+
+void TensorStoreSliceReader::read_reorder(const std::vector<int64_t> &pt_idxs,
+                                          const std::vector<float *> &bufs) {
+  if (!has_reorder)
+    throw TensorStoreANNException("reorder tensor was not opened");
+  if (pt_idxs.empty())
+    return;
+
+  TensorStoreChunkCache::Pin chunks_pin;
+  if (chunk_cache) {
+    chunks_pin = chunk_cache->pin();
+    fetch_local_chunks(pt_idxs, {reorder_chunks}, true);
+  }
+
+  tensor2d_resolve_read_future<float>(
+      tensor2d_submit_read_slice<float>(store_reorder, 0, pt_idxs), bufs);
+}
+
+void TensorStoreSliceReader::prefetch(const std::vector<int64_t> &pt_idxs,
+                                      TensorsPrefetchHandle &      handle,
+                                      bool skip_embedding) {
+  if (pt_idxs.empty())
+    return;
+
+  // with a local chunk cache only warm the local disk tier: a zarr read must
+  // not outlive its pin on the local chunk files
+  if (chunk_cache) {
+    if (skip_embedding)
+      fetch_local_chunks(pt_idxs, {num_nbrs_chunks, nbrhood_chunks}, false);
+    else
+      fetch_local_chunks(pt_idxs,
+                         {embedding_chunks, num_nbrs_chunks, nbrhood_chunks},
+                         false);
+    return;
+  }
+
+  // nobody waits on these reads, so the index array must be owned by them
+  auto idxs = ts::AllocateArray<ts::Index>(
+      {static_cast<int64_t>(pt_idxs.size())});
+  std::copy(pt_idxs.begin(), pt_idxs.end(), idxs.data());
+
+  if (!skip_embedding)
+    handle.embedding_futures.push_back(ts::Read<ts::zero_origin>(
+        store_embedding | ts::Dims(0).IndexArraySlice(idxs)));
+  handle.nbrs_futures.push_back(ts::Read<ts::zero_origin>(
+      store_num_nbrs | ts::Dims(0).IndexArraySlice(idxs)));
+  handle.nbrs_futures.push_back(ts::Read<ts::zero_origin>(
+      store_nbrhood | ts::Dims(0).IndexArraySlice(idxs)));
+}
+
+TensorStoreCacheStats TensorStoreSliceReader::get_cache_stats() {
+  auto metrics = ts::internal_metrics::GetMetricRegistry().CollectWithPrefix(
+      "/tensorstore/cache/");
+
+  TensorStoreCacheStats stats;
+  stats.hits = collect_counter(metrics, "/tensorstore/cache/hit_count");
+  stats.misses = collect_counter(metrics, "/tensorstore/cache/miss_count");
+  stats.evictions = collect_counter(metrics, "/tensorstore/cache/evict_count");
+  return stats;
+}
+
+TensorStoreChunkCacheStats TensorStoreSliceReader::get_local_cache_stats() {
+  if (!chunk_cache)
+    return TensorStoreChunkCacheStats();
+  return chunk_cache->get_stats();
+}
+
+void TensorStoreSliceReader::fetch_local_chunks(
+    const std::vector<int64_t> &pt_idxs, const std::vector<size_t> &tensor_ids,
+    bool wait) {
+  // issue all fetches first so that the tensors' chunks arrive in parallel
+  std::vector<std::string> waits;
+  for (auto tensor_id : tensor_ids) {
+    auto tensor_waits = chunk_cache->fetch_rows(tensor_id, pt_idxs);
+    waits.insert(waits.end(), tensor_waits.begin(), tensor_waits.end());
+  }
+  if (wait)
+    chunk_cache->wait_chunks(waits);
+}
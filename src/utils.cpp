@@ -14,6 +14,7 @@ const uint32_t MAX_SIMULTANEOUS_READ_REQUESTS = 128;
 
 #ifdef _WINDOWS
 #include <intrin.h>
+#include <io.h>
 
 // Taken from:
 // https://insufficientlycomplicated.wordpress.com/2011/11/07/detecting-intel-advanced-vector-extensions-avx-in-visual-studio/
@@ -239,6 +240,33 @@ namespace diskann {
     return total_recall / (num_queries);
   }
 
+  void sync_path(const std::string& path, bool directory) {
+#ifdef _WINDOWS
+    // directories cannot be flushed on Windows; renames are journaled
+    if (directory)
+      return;
+    int  fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    bool ok = fd >= 0 && _commit(fd) == 0;
+    if (fd >= 0)
+      _close(fd);
+#else
+    int  fd = open(path.c_str(), (directory ? O_DIRECTORY : 0) | O_RDONLY);
+    bool ok = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0)
+      close(fd);
+#endif
+    if (!ok)
+      throw diskann::ANNException("Failed to sync " + path + " to disk", -1,
+                                  __FUNCSIG__, __FILE__, __LINE__);
+  }
+
+  std::string parent_dir(const std::string& path) {
+    size_t pos = path.find_last_of("/\\");
+    if (pos == std::string::npos)
+      return ".";
+    return pos == 0 ? "/" : path.substr(0, pos);
+  }
+
 #ifdef EXEC_ENV_OLS
   void get_bin_metadata(AlignedFileReader& reader, size_t& npts, size_t& ndim,
                         size_t offset) {
@@ -427,6 +455,9 @@ namespace diskann {
   template DISKANN_DLLEXPORT void load_bin<float>(
       AlignedFileReader& reader, std::unique_ptr<float[]>& data, size_t& npts,
       size_t& ndim, size_t offset);
+  template DISKANN_DLLEXPORT void load_bin<float16>(
+      AlignedFileReader& reader, std::unique_ptr<float16[]>& data,
+      size_t& npts, size_t& ndim, size_t offset);
 
   template DISKANN_DLLEXPORT void load_bin<uint8_t>(AlignedFileReader& reader,
                                                     uint8_t*&          data,
@@ -458,6 +489,9 @@ namespace diskann {
   template DISKANN_DLLEXPORT void copy_aligned_data_from_file<float>(
       AlignedFileReader& reader, float*& data, size_t& npts, size_t& dim,
       const size_t& rounded_dim, size_t offset);
+  template DISKANN_DLLEXPORT void copy_aligned_data_from_file<float16>(
+      AlignedFileReader& reader, float16*& data, size_t& npts, size_t& dim,
+      const size_t& rounded_dim, size_t offset);
 
   template DISKANN_DLLEXPORT void read_array<char>(AlignedFileReader& reader,
                                                    char* data, size_t size,
@@ -475,6 +509,8 @@ namespace diskann {
   template DISKANN_DLLEXPORT void read_array<float>(AlignedFileReader& reader,
                                                     float* data, size_t size,
                                                     size_t offset);
+  template DISKANN_DLLEXPORT void read_array<float16>(
+      AlignedFileReader& reader, float16* data, size_t size, size_t offset);
 
   template DISKANN_DLLEXPORT void read_value<uint8_t>(AlignedFileReader& reader,
                                                       uint8_t&           value,
@@ -485,6 +521,8 @@ namespace diskann {
   template DISKANN_DLLEXPORT void read_value<float>(AlignedFileReader& reader,
                                                     float&             value,
                                                     size_t             offset);
+  template DISKANN_DLLEXPORT void read_value<float16>(
+      AlignedFileReader& reader, float16& value, size_t offset);
   template DISKANN_DLLEXPORT void read_value<uint32_t>(
       AlignedFileReader& reader, uint32_t& value, size_t offset);
   template DISKANN_DLLEXPORT void read_value<uint64_t>(
@@ -14,17 +14,20 @@ namespace po = boost::program_options;
 
 int main(int argc, char** argv) {
   std::string data_type, dist_fn, data_path, index_path_prefix;
-  unsigned    num_threads, R, L, disk_PQ;
+  unsigned    num_threads, R, L, disk_PQ, num_rnds;
   float       B, M;
+  std::string visit_order, tensors_prefix;
   bool        append_reorder_data = false;
   bool        use_opq = false;
+  bool        build_with_pq = false;
+  bool        resume = false;
 
   po::options_description desc{"Arguments"};
   try {
     desc.add_options()("help,h", "Print information on arguments");
     desc.add_options()("data_type",
                        po::value<std::string>(&data_type)->required(),
-                       "data type <int8/uint8/float>");
+                       "data type <int8/uint8/float/float16>");
     desc.add_options()("dist_fn", po::value<std::string>(&dist_fn)->required(),
                        "distance function <l2/mips>");
     desc.add_options()("data_path",
@@ -60,6 +63,25 @@ int main(int argc, char** argv) {
 
     desc.add_options()("use_opq", po::bool_switch()->default_value(false),
                        "Use Optimized Product Quantization (OPQ).");
+    desc.add_options()("num_rnds",
+                       po::value<uint32_t>(&num_rnds)->default_value(1),
+                       "Number of graph build passes; with more than one, the "
+                       "first pass runs at alpha 1 and later passes refine it");
+    desc.add_options()(
+        "visit_order",
+        po::value<std::string>(&visit_order)->default_value("sequential"),
+        "Order in which points are inserted in each pass <sequential/random>");
+    desc.add_options()("build_with_pq", po::bool_switch()->default_value(false),
+                       "Build the graph in one piece over the PQ-compressed "
+                       "vectors instead of merging in-memory shards.");
+    desc.add_options()(
+        "tensors_prefix",
+        po::value<std::string>(&tensors_prefix)->default_value(""),
+        "Write the index as TensorStore tensors with this path prefix "
+        "instead of full disk index sectors");
+    desc.add_options()("resume", po::bool_switch()->default_value(false),
+                       "Resume an interrupted build with the same arguments, "
+                       "skipping the stages it completed.");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -72,6 +94,10 @@ int main(int argc, char** argv) {
       append_reorder_data = true;
     if (vm["use_opq"].as<bool>())
       use_opq = true;
+    if (vm["build_with_pq"].as<bool>())
+      build_with_pq = true;
+    if (vm["resume"].as<bool>())
+      resume = true;
   } catch (const std::exception& ex) {
     std::cerr << ex.what() << '\n';
     return -1;
@@ -113,17 +139,25 @@ int main(int argc, char** argv) {
 
   try {
     if (data_type == std::string("int8"))
-      return diskann::build_disk_index<int8_t>(data_path.c_str(),
-                                               index_path_prefix.c_str(),
-                                               params.c_str(), metric, use_opq);
+      return diskann::build_disk_index<int8_t>(
+          data_path.c_str(), index_path_prefix.c_str(), params.c_str(), metric,
+          use_opq, num_rnds, visit_order, build_with_pq, tensors_prefix,
+          resume);
     else if (data_type == std::string("uint8"))
       return diskann::build_disk_index<uint8_t>(
           data_path.c_str(), index_path_prefix.c_str(), params.c_str(), metric,
-          use_opq);
+          use_opq, num_rnds, visit_order, build_with_pq, tensors_prefix,
+          resume);
     else if (data_type == std::string("float"))
-      return diskann::build_disk_index<float>(data_path.c_str(),
-                                              index_path_prefix.c_str(),
-                                              params.c_str(), metric, use_opq);
+      return diskann::build_disk_index<float>(
+          data_path.c_str(), index_path_prefix.c_str(), params.c_str(), metric,
+          use_opq, num_rnds, visit_order, build_with_pq, tensors_prefix,
+          resume);
+    else if (data_type == std::string("float16"))
+      return diskann::build_disk_index<diskann::float16>(
+          data_path.c_str(), index_path_prefix.c_str(), params.c_str(), metric,
+          use_opq, num_rnds, visit_order, build_with_pq, tensors_prefix,
+          resume);
     else {
       diskann::cerr << "Error. Unsupported data type" << std::endl;
       return -1;
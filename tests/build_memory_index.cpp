@@ -25,7 +25,9 @@ int build_in_memory_index(const diskann::Metric& metric,
                           const std::string& data_path, const unsigned R,
                           const unsigned L, const float alpha,
                           const std::string& save_path,
-                          const unsigned     num_threads) {
+                          const unsigned     num_threads,
+                          const unsigned     num_rnds,
+                          const std::string& visit_order) {
   diskann::Parameters paras;
   paras.Set<unsigned>("R", R);
   paras.Set<unsigned>("L", L);
@@ -34,6 +36,8 @@ int build_in_memory_index(const diskann::Metric& metric,
   paras.Set<float>("alpha", alpha);
   paras.Set<bool>("saturate_graph", 0);
   paras.Set<unsigned>("num_threads", num_threads);
+  paras.Set<unsigned>("num_rnds", num_rnds);
+  paras.Set<std::string>("visit_order", visit_order);
 
   _u64 data_num, data_dim;
   diskann::get_bin_metadata(data_path, data_num, data_dim);
@@ -53,15 +57,16 @@ int build_in_memory_index(const diskann::Metric& metric,
 
 int main(int argc, char** argv) {
   std::string data_type, dist_fn, data_path, index_path_prefix;
-  unsigned    num_threads, R, L;
+  unsigned    num_threads, R, L, num_rnds;
   float       alpha;
+  std::string visit_order;
 
   po::options_description desc{"Arguments"};
   try {
     desc.add_options()("help,h", "Print information on arguments");
     desc.add_options()("data_type",
                        po::value<std::string>(&data_type)->required(),
-                       "data type <int8/uint8/float>");
+                       "data type <int8/uint8/float/float16>");
     desc.add_options()("dist_fn", po::value<std::string>(&dist_fn)->required(),
                        "distance function <l2/mips>");
     desc.add_options()("data_path",
@@ -85,6 +90,14 @@ int main(int argc, char** argv) {
         po::value<uint32_t>(&num_threads)->default_value(omp_get_num_procs()),
         "Number of threads used for building index (defaults to "
         "omp_get_num_procs())");
+    desc.add_options()("num_rnds",
+                       po::value<uint32_t>(&num_rnds)->default_value(1),
+                       "Number of graph build passes; with more than one, the "
+                       "first pass runs at alpha 1 and later passes refine it");
+    desc.add_options()(
+        "visit_order",
+        po::value<std::string>(&visit_order)->default_value("sequential"),
+        "Order in which points are inserted in each pass <sequential/random>");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -115,18 +128,25 @@ int main(int argc, char** argv) {
   try {
     diskann::cout << "Starting index build with R: " << R << "  Lbuild: " << L
                   << "  alpha: " << alpha << "  #threads: " << num_threads
-                  << std::endl;
+                  << "  #passes: " << num_rnds << std::endl;
     if (data_type == std::string("int8"))
       return build_in_memory_index<int8_t>(metric, data_path, R, L, alpha,
-                                           index_path_prefix, num_threads);
+                                           index_path_prefix, num_threads,
+                                           num_rnds, visit_order);
     else if (data_type == std::string("uint8"))
       return build_in_memory_index<uint8_t>(metric, data_path, R, L, alpha,
-                                            index_path_prefix, num_threads);
+                                            index_path_prefix, num_threads,
+                                            num_rnds, visit_order);
     else if (data_type == std::string("float"))
       return build_in_memory_index<float>(metric, data_path, R, L, alpha,
-                                          index_path_prefix, num_threads);
+                                          index_path_prefix, num_threads,
+                                          num_rnds, visit_order);
+    else if (data_type == std::string("float16"))
+      return build_in_memory_index<diskann::float16>(
+          metric, data_path, R, L, alpha, index_path_prefix, num_threads,
+          num_rnds, visit_order);
     else {
-      std::cout << "Unsupported type. Use one of int8, uint8 or float."
+      std::cout << "Unsupported type. Use one of int8, uint8, float or float16."
                 << std::endl;
       return -1;
     }
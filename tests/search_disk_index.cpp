@@ -62,8 +62,11 @@ int search_disk_index(
     const unsigned beamwidth, const unsigned num_nodes_to_cache,
     const _u32 search_io_limit, const std::vector<unsigned>& Lvec,
     const bool use_reorder_data = false, const bool use_tensors_async = false,
-    const char* use_remote_addr = nullptr,
-    size_t      max_query_num = std::numeric_limits<size_t>::max()) {
+    const char*                   use_remote_addr = nullptr,
+    const TensorStoreContextSpec& ts_ctx_spec = TensorStoreContextSpec(),
+    const unsigned ts_prefetch_width = 0,
+    size_t             max_query_num = std::numeric_limits<size_t>::max(),
+    const std::string& delete_list_file = std::string("")) {
   diskann::cout << "Search parameters: #threads: " << num_threads << ", ";
   if (beamwidth <= 0)
     diskann::cout << "beamwidth to be optimized for each L value" << std::flush;
@@ -110,7 +113,7 @@ int search_disk_index(
 #else
   reader.reset(new LinuxAlignedFileReader());
   if (use_tensors)
-    tensor_reader.reset(new TensorStoreSliceReader());
+    tensor_reader.reset(new TensorStoreSliceReader(ts_ctx_spec));
 #endif
 
   std::unique_ptr<diskann::PQFlashIndex<T>> _pFlashIndex(
@@ -123,6 +126,30 @@ int search_disk_index(
   if (res != 0) {
     return res;
   }
+  if (use_tensors)
+    _pFlashIndex->set_tensors_prefetch_width(ts_prefetch_width);
+
+  // tombstone the listed points; recall is then computed on the live ones
+  tsl::robin_set<unsigned> live_ids;
+  if (!delete_list_file.empty()) {
+    _u32*  delete_ids = nullptr;
+    size_t num_deletes, delete_dim;
+    diskann::load_bin<_u32>(delete_list_file, delete_ids, num_deletes,
+                            delete_dim);
+    size_t num_failed = 0;
+    for (size_t i = 0; i < num_deletes * delete_dim; i++) {
+      if (_pFlashIndex->delete_point(delete_ids[i]) != 0)
+        num_failed++;
+    }
+    delete[] delete_ids;
+    for (_u64 id = 0; id < _pFlashIndex->get_num_points(); id++) {
+      if (!_pFlashIndex->is_deleted(id))
+        live_ids.insert((unsigned) id);
+    }
+    diskann::cout << "Deleted " << _pFlashIndex->get_num_deleted()
+                  << " points listed in " << delete_list_file << " ("
+                  << num_failed << " out of range or repeated)" << std::endl;
+  }
   // cache bfs levels
   std::vector<uint32_t> node_list;
   diskann::cout << "Caching " << num_nodes_to_cache
@@ -193,8 +220,11 @@ int search_disk_index(
          "======================================================="
       << std::endl;
 
-  std::vector<std::vector<uint32_t>> query_result_ids(Lvec.size());
-  std::vector<std::vector<float>>    query_result_dists(Lvec.size());
+  std::vector<std::vector<uint32_t>>  query_result_ids(Lvec.size());
+  std::vector<std::vector<float>>     query_result_dists(Lvec.size());
+  std::vector<TensorStoreCacheStats> ts_cache_stats(Lvec.size());
+  std::vector<double>                ts_mean_prefetches(Lvec.size(), 0);
+  std::vector<double>                ts_mean_prefetch_hits(Lvec.size(), 0);
 
   uint32_t optimized_beamwidth = 2;
 
@@ -221,7 +251,10 @@ int search_disk_index(
     auto stats = new diskann::QueryStats[query_num];
 
     std::vector<uint64_t> query_result_ids_64(recall_at * query_num);
-    auto                  s = std::chrono::high_resolution_clock::now();
+    TensorStoreCacheStats ts_cache_before;
+    if (use_tensors)
+      ts_cache_before = TensorStoreSliceReader::get_cache_stats();
+    auto s = std::chrono::high_resolution_clock::now();
 
 #pragma omp parallel for schedule(dynamic, 1)
     for (_s64 i = 0; i < (int64_t) query_num; i++) {
@@ -234,6 +267,9 @@ int search_disk_index(
     auto                          e = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> diff = e - s;
     float qps = (1.0 * query_num) / (1.0 * diff.count());
+    if (use_tensors)
+      ts_cache_stats[test_id] =
+          TensorStoreSliceReader::get_cache_stats() - ts_cache_before;
 
     diskann::convert_types<uint64_t, uint32_t>(query_result_ids_64.data(),
                                                query_result_ids[test_id].data(),
@@ -255,11 +291,36 @@ int search_disk_index(
         stats, query_num,
         [](const diskann::QueryStats& stats) { return stats.cpu_us; });
 
+    if (use_tensors) {
+      ts_mean_prefetches[test_id] = diskann::get_mean_stats<unsigned>(
+          stats, query_num,
+          [](const diskann::QueryStats& stats) { return stats.n_prefetches; });
+      ts_mean_prefetch_hits[test_id] = diskann::get_mean_stats<unsigned>(
+          stats, query_num, [](const diskann::QueryStats& stats) {
+            return stats.n_prefetch_hits;
+          });
+    }
+
     float recall = 0;
-    if (calc_recall_flag) {
+    if (calc_recall_flag && live_ids.empty()) {
       recall = diskann::calculate_recall(query_num, gt_ids, gt_dists, gt_dim,
                                          query_result_ids[test_id].data(),
                                          recall_at, recall_at);
+    } else if (calc_recall_flag) {
+      recall = diskann::calculate_recall(query_num, gt_ids, gt_dists, gt_dim,
+                                         query_result_ids[test_id].data(),
+                                         recall_at, recall_at, live_ids);
+    }
+    if (!live_ids.empty()) {
+      size_t num_deleted_results = 0;
+      for (auto id : query_result_ids[test_id]) {
+        if (id != std::numeric_limits<_u32>::max() &&
+            live_ids.find(id) == live_ids.end())
+          num_deleted_results++;
+      }
+      if (num_deleted_results > 0)
+        diskann::cout << "Warning: " << num_deleted_results
+                      << " deleted points returned with L " << L << std::endl;
     }
 
     diskann::cout << std::setw(6) << L << std::setw(12) << optimized_beamwidth
@@ -273,6 +334,46 @@ int search_disk_index(
     delete[] stats;
   }
 
+  if (use_tensors) {
+    diskann::cout << std::endl
+                  << std::setw(6) << "L" << std::setw(16) << "Cache Hits"
+                  << std::setw(16) << "Cache Misses" << std::setw(16)
+                  << "Evictions" << std::setw(16) << "Hit Rate (%)"
+                  << std::setw(16) << "Mean Prefetch" << std::setw(16)
+                  << "Wasted (%)" << std::endl;
+    diskann::cout << "=============================================="
+                     "=========================================="
+                     "======================"
+                  << std::endl;
+    for (uint32_t test_id = 0; test_id < Lvec.size(); test_id++) {
+      if (Lvec[test_id] < recall_at)
+        continue;
+      const auto& cs = ts_cache_stats[test_id];
+      double      prefetches = ts_mean_prefetches[test_id];
+      double      wasted =
+          prefetches > 0
+              ? 100.0 * (prefetches - ts_mean_prefetch_hits[test_id]) /
+                    prefetches
+              : 0.0;
+      diskann::cout << std::setw(6) << Lvec[test_id] << std::setw(16)
+                    << cs.hits << std::setw(16) << cs.misses << std::setw(16)
+                    << cs.evictions << std::setw(16) << 100.0 * cs.hit_rate()
+                    << std::setw(16) << prefetches << std::setw(16) << wasted
+                    << std::endl;
+    }
+    diskann::cout << std::endl;
+
+    if (!ts_ctx_spec.local_cache_dir.empty()) {
+      auto lcs = tensor_reader->get_local_cache_stats();
+      diskann::cout << "Local chunk cache: " << lcs.hits << " hits, "
+                    << lcs.misses << " misses, " << lcs.evictions
+                    << " evictions, " << lcs.fetched_bytes / 1000000.0
+                    << " MB fetched, " << lcs.cached_bytes / 1000000.0
+                    << " MB cached" << std::endl
+                    << std::endl;
+    }
+  }
+
   diskann::cout << "Done searching. Now saving results " << std::endl;
   _u64 test_id = 0;
   for (auto L : Lvec) {
@@ -306,13 +407,18 @@ int main(int argc, char** argv) {
   bool                  use_tensors_async = false;
   std::string           use_remote_addr;
   size_t                max_query_num = std::numeric_limits<size_t>::max();
+  std::string           delete_list_file;
+  TensorStoreContextSpec ts_ctx_spec;
+  unsigned               ts_prefetch_width = 0;
+  size_t ts_cache_embedding_mb, ts_cache_num_nbrs_mb, ts_cache_nbrhood_mb,
+      ts_cache_reorder_mb, ts_local_cache_mb;
 
   po::options_description desc{"Arguments"};
   try {
     desc.add_options()("help,h", "Print information on arguments");
     desc.add_options()("data_type",
                        po::value<std::string>(&data_type)->required(),
-                       "data type <int8/uint8/float>");
+                       "data type <int8/uint8/float/float16>");
     desc.add_options()("dist_fn", po::value<std::string>(&dist_fn)->required(),
                        "distance function <l2/mips/fast_l2>");
     desc.add_options()("index_path_prefix",
@@ -361,9 +467,67 @@ int main(int argc, char** argv) {
     desc.add_options()(
         "use_remote_addr", po::value<std::string>(&use_remote_addr),
         "Remote URL for tensorstore http kv-store backend if using.");
+    desc.add_options()(
+        "ts_cache_embedding_mb",
+        po::value<size_t>(&ts_cache_embedding_mb)
+            ->default_value(ts_ctx_spec.embedding_cache_bytes / 1000000),
+        "TensorStore cache pool budget of the embedding tensor (MB)");
+    desc.add_options()(
+        "ts_cache_num_nbrs_mb",
+        po::value<size_t>(&ts_cache_num_nbrs_mb)
+            ->default_value(ts_ctx_spec.num_nbrs_cache_bytes / 1000000),
+        "TensorStore cache pool budget of the num_nbrs tensor (MB)");
+    desc.add_options()(
+        "ts_cache_nbrhood_mb",
+        po::value<size_t>(&ts_cache_nbrhood_mb)
+            ->default_value(ts_ctx_spec.nbrhood_cache_bytes / 1000000),
+        "TensorStore cache pool budget of the nbrhood tensor (MB)");
+    desc.add_options()(
+        "ts_cache_reorder_mb",
+        po::value<size_t>(&ts_cache_reorder_mb)
+            ->default_value(ts_ctx_spec.reorder_cache_bytes / 1000000),
+        "TensorStore cache pool budget of the reorder tensor (MB)");
+    desc.add_options()(
+        "ts_data_copy_concurrency",
+        po::value<size_t>(&ts_ctx_spec.data_copy_concurrency)
+            ->default_value(0),
+        "TensorStore data copy concurrency limit (0 for default)");
+    desc.add_options()(
+        "ts_file_io_concurrency",
+        po::value<size_t>(&ts_ctx_spec.file_io_concurrency)->default_value(0),
+        "TensorStore file I/O concurrency limit (0 for default)");
+    desc.add_options()(
+        "ts_http_request_concurrency",
+        po::value<size_t>(&ts_ctx_spec.http_request_concurrency)
+            ->default_value(0),
+        "TensorStore http request concurrency limit (0 for default)");
+    desc.add_options()(
+        "ts_recheck_cached_data",
+        po::value<std::string>(&ts_ctx_spec.recheck_cached_data)
+            ->default_value("false"),
+        "When TensorStore revalidates cached chunks <false/true/open>");
+    desc.add_options()(
+        "ts_local_cache_dir",
+        po::value<std::string>(&ts_ctx_spec.local_cache_dir),
+        "Directory of a persistent local chunk cache for remote tensors");
+    desc.add_options()(
+        "ts_local_cache_mb",
+        po::value<size_t>(&ts_local_cache_mb)
+            ->default_value(ts_ctx_spec.local_cache_bytes / 1000000),
+        "Size bound of the local chunk cache (MB)");
+    desc.add_options()(
+        "ts_prefetch_width",
+        po::value<unsigned>(&ts_prefetch_width)->default_value(0),
+        "#candidates past the beam to speculatively prefetch per hop with "
+        "tensors backend (0 to disable)");
     desc.add_options()(
         "max_query_num", po::value<size_t>(&max_query_num),
         "Maximum number of queries to run (default is to run all)");
+    desc.add_options()(
+        "delete_list", po::value<std::string>(&delete_list_file),
+        "Bin file of point ids to delete before searching; recall is then "
+        "computed on the live points, so gt_file should list more than K "
+        "neighbors");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -376,6 +540,11 @@ int main(int argc, char** argv) {
       use_reorder_data = true;
     if (vm["use_tensors_async"].as<bool>())
       use_tensors_async = true;
+    ts_ctx_spec.embedding_cache_bytes = ts_cache_embedding_mb * 1000000;
+    ts_ctx_spec.num_nbrs_cache_bytes = ts_cache_num_nbrs_mb * 1000000;
+    ts_ctx_spec.nbrhood_cache_bytes = ts_cache_nbrhood_mb * 1000000;
+    ts_ctx_spec.reorder_cache_bytes = ts_cache_reorder_mb * 1000000;
+    ts_ctx_spec.local_cache_bytes = ts_local_cache_mb * 1000000;
   } catch (const std::exception& ex) {
     std::cerr << ex.what() << '\n';
     return -1;
@@ -415,17 +584,6 @@ int main(int argc, char** argv) {
               << std::endl;
     use_tensors = true;
   }
-  if (use_reorder_data && use_tensors) {
-    std::cout << "Error: Reorder data is not compatible with tensors backend."
-              << std::endl;
-    return -1;
-  }
-  if (data_type != std::string("float") && use_tensors) {
-    std::cout << "Error: Search on tensors backend currently only supports "
-                 "float data type."
-              << std::endl;
-    return -1;
-  }
 
   try {
     if (data_type == std::string("float"))
@@ -435,7 +593,7 @@ int main(int argc, char** argv) {
           num_nodes_to_cache, search_io_limit, Lvec, use_reorder_data,
           use_tensors_async,
           use_remote_addr.empty() ? nullptr : use_remote_addr.c_str(),
-          max_query_num);
+          ts_ctx_spec, ts_prefetch_width, max_query_num, delete_list_file);
     else if (data_type == std::string("int8"))
       return search_disk_index<int8_t>(
           metric, index_path_prefix, index_tensors_prefix, use_tensors,
@@ -443,7 +601,7 @@ int main(int argc, char** argv) {
           num_nodes_to_cache, search_io_limit, Lvec, use_reorder_data,
           use_tensors_async,
           use_remote_addr.empty() ? nullptr : use_remote_addr.c_str(),
-          max_query_num);
+          ts_ctx_spec, ts_prefetch_width, max_query_num, delete_list_file);
     else if (data_type == std::string("uint8"))
       return search_disk_index<uint8_t>(
           metric, index_path_prefix, index_tensors_prefix, use_tensors,
@@ -451,9 +609,18 @@ int main(int argc, char** argv) {
           num_nodes_to_cache, search_io_limit, Lvec, use_reorder_data,
           use_tensors_async,
           use_remote_addr.empty() ? nullptr : use_remote_addr.c_str(),
-          max_query_num);
+          ts_ctx_spec, ts_prefetch_width, max_query_num, delete_list_file);
+    else if (data_type == std::string("float16"))
+      return search_disk_index<diskann::float16>(
+          metric, index_path_prefix, index_tensors_prefix, use_tensors,
+          result_path_prefix, query_file, gt_file, num_threads, K, W,
+          num_nodes_to_cache, search_io_limit, Lvec, use_reorder_data,
+          use_tensors_async,
+          use_remote_addr.empty() ? nullptr : use_remote_addr.c_str(),
+          ts_ctx_spec, ts_prefetch_width, max_query_num, delete_list_file);
     else {
-      std::cerr << "Unsupported data type. Use float or int8 or uint8"
+      std::cerr << "Unsupported data type. Use float or float16 or int8 or "
+                   "uint8"
                 << std::endl;
       return -1;
     }
@@ -0,0 +1,273 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Measures how saving a dynamic index holds up the searches and inserts that
+// run alongside it. An index is built on the first build_points points of the
+// base file; then, for each save mode, search threads replay the queries and
+// an insert thread streams in further base points while the index is saved
+// with save() or save_snapshot(). Reports the latency of the searches started
+// during the save against those started before it, and checks that the saved
+// index loads.
+
+#include <index.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <numeric>
+#include <omp.h>
+#include <thread>
+#include <timer.h>
+#include <boost/program_options.hpp>
+
+#include "utils.h"
+
+namespace po = boost::program_options;
+
+using steady_clock = std::chrono::steady_clock;
+
+struct search_sample {
+  steady_clock::time_point start;
+  double                   latency_us;
+};
+
+void report_latencies(const std::string& label, std::vector<double> latencies) {
+  if (latencies.empty()) {
+    std::cout << label << ": no searches" << std::endl;
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[(size_t)(p * (latencies.size() - 1))] / 1000.0;
+  };
+  std::cout << label << ": " << latencies.size() << " searches, median "
+            << percentile(0.5) << "ms, p99 " << percentile(0.99) << "ms, max "
+            << latencies.back() / 1000.0 << "ms" << std::endl;
+}
+
+template<typename T, typename TagT>
+void save_under_load(diskann::Index<T, TagT>& index, bool snapshot,
+                     const std::string& save_path, const T* data,
+                     size_t aligned_dim, size_t end_point, size_t& next_point,
+                     const T* queries, size_t num_queries,
+                     size_t query_aligned_dim, unsigned search_threads,
+                     unsigned L, unsigned K, unsigned warmup_ms) {
+  std::atomic<bool>                       stop(false);
+  std::vector<std::vector<search_sample>> samples(search_threads);
+  std::vector<std::thread>                searchers;
+  for (unsigned t = 0; t < search_threads; t++) {
+    searchers.emplace_back([&, t]() {
+      std::vector<TagT>  ids(K);
+      std::vector<float> dists(K);
+      for (size_t q = t; !stop; q += search_threads) {
+        auto start = steady_clock::now();
+        index.search(queries + (q % num_queries) * query_aligned_dim, K, L,
+                     ids.data(), dists.data());
+        double latency_us = std::chrono::duration<double, std::micro>(
+                                steady_clock::now() - start)
+                                .count();
+        samples[t].push_back(search_sample{start, latency_us});
+      }
+    });
+  }
+
+  std::atomic<size_t> inserted(0);
+  auto                insert_task = std::async(std::launch::async, [&]() {
+    for (; !stop && next_point < end_point; next_point++) {
+      if (index.insert_point(data + next_point * aligned_dim,
+                             1 + static_cast<TagT>(next_point)) == 0)
+        inserted++;
+    }
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(warmup_ms));
+  size_t inserted_before = inserted;
+  auto   save_start = steady_clock::now();
+  if (snapshot)
+    index.save_snapshot(save_path.c_str());
+  else
+    index.save(save_path.c_str());
+  auto   save_end = steady_clock::now();
+  size_t inserted_during = inserted - inserted_before;
+
+  // let the searches held up by the save finish
+  std::this_thread::sleep_for(std::chrono::milliseconds(warmup_ms));
+  stop = true;
+  for (auto& searcher : searchers)
+    searcher.join();
+  insert_task.wait();
+
+  std::vector<double> before, during;
+  for (auto& thread_samples : samples) {
+    for (auto& sample : thread_samples) {
+      if (sample.start < save_start)
+        before.push_back(sample.latency_us);
+      else if (sample.start < save_end)
+        during.push_back(sample.latency_us);
+    }
+  }
+  std::cout << (snapshot ? "save_snapshot" : "save") << " took "
+            << std::chrono::duration<double>(save_end - save_start).count()
+            << "s, " << inserted_during << " points inserted meanwhile"
+            << std::endl;
+  report_latencies("  before the save", before);
+  report_latencies("  during the save", during);
+}
+
+template<typename T>
+int run(const std::string& data_path, const std::string& query_path,
+        const std::string& save_path, const std::string& save_mode,
+        unsigned R, unsigned L, float alpha, unsigned num_threads,
+        unsigned search_threads, unsigned Ls, unsigned K, size_t build_points,
+        unsigned warmup_ms) {
+  using TagT = uint32_t;
+
+  T*     data = nullptr;
+  T*     queries = nullptr;
+  size_t num_points, dim, aligned_dim;
+  size_t num_queries, query_dim, query_aligned_dim;
+  diskann::load_aligned_bin<T>(data_path, data, num_points, dim, aligned_dim);
+  diskann::load_aligned_bin<T>(query_path, queries, num_queries, query_dim,
+                               query_aligned_dim);
+  if (query_dim != dim) {
+    std::cerr << "Queries have " << query_dim << " dimensions, base points "
+              << dim << std::endl;
+    return -1;
+  }
+  if (build_points == 0 || build_points > num_points)
+    build_points = num_points;
+
+  diskann::Parameters params;
+  params.Set<unsigned>("L", L);
+  params.Set<unsigned>("R", R);
+  params.Set<unsigned>("C", 500);
+  params.Set<float>("alpha", alpha);
+  params.Set<bool>("saturate_graph", false);
+  params.Set<unsigned>("num_rnds", 1);
+  params.Set<unsigned>("num_threads", num_threads);
+  diskann::Parameters search_params;
+  search_params.Set<unsigned>("L", Ls);
+  search_params.Set<unsigned>("num_threads", search_threads);
+
+  diskann::Index<T, TagT> index(diskann::L2, dim, num_points, true, params,
+                                search_params, true, true);
+  std::vector<TagT> tags(build_points);
+  std::iota(tags.begin(), tags.end(), static_cast<TagT>(1));
+  index.build(data, build_points, params, tags);
+  index.enable_delete();
+
+  // the points left out of the build are shared out among the saves
+  std::vector<bool> modes;
+  if (save_mode != "snapshot")
+    modes.push_back(false);
+  if (save_mode != "save")
+    modes.push_back(true);
+  size_t next_point = build_points;
+  for (size_t i = 0; i < modes.size(); i++) {
+    size_t end_point =
+        build_points + (num_points - build_points) * (i + 1) / modes.size();
+    save_under_load(index, modes[i], save_path, data, aligned_dim, end_point,
+                    next_point, queries, num_queries, query_aligned_dim,
+                    search_threads, Ls, K, warmup_ms);
+
+    diskann::Index<T, TagT> loaded(diskann::L2, dim, num_points, true, params,
+                                   search_params, true, true);
+    loaded.load(save_path.c_str(), search_threads, Ls);
+    std::cout << "  saved index loads with " << loaded.get_num_points()
+              << " points" << std::endl;
+  }
+
+  diskann::aligned_free(data);
+  diskann::aligned_free(queries);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  std::string data_type, data_path, query_path, save_path, save_mode;
+  unsigned    R, L, num_threads, search_threads, Ls, K, warmup_ms;
+  float       alpha;
+  size_t      build_points;
+
+  po::options_description desc{"Arguments"};
+  try {
+    desc.add_options()("help,h", "Print information on arguments");
+    desc.add_options()("data_type",
+                       po::value<std::string>(&data_type)->required(),
+                       "data type <int8/uint8/float>");
+    desc.add_options()("data_path",
+                       po::value<std::string>(&data_path)->required(),
+                       "Base file in bin format");
+    desc.add_options()("query_file",
+                       po::value<std::string>(&query_path)->required(),
+                       "Queries replayed during the saves, in bin format");
+    desc.add_options()("index_path_prefix",
+                       po::value<std::string>(&save_path)->required(),
+                       "Path prefix of the saved index");
+    desc.add_options()(
+        "save_mode", po::value<std::string>(&save_mode)->default_value("both"),
+        "Save with <save/snapshot/both>");
+    desc.add_options()("max_degree,R",
+                       po::value<uint32_t>(&R)->default_value(64),
+                       "Maximum graph degree");
+    desc.add_options()("Lbuild,L", po::value<uint32_t>(&L)->default_value(100),
+                       "Build complexity");
+    desc.add_options()("alpha", po::value<float>(&alpha)->default_value(1.2f),
+                       "alpha of the graph build");
+    desc.add_options()(
+        "num_threads,T",
+        po::value<uint32_t>(&num_threads)->default_value(omp_get_num_procs()),
+        "Number of threads used for the build and the snapshot");
+    desc.add_options()("search_threads",
+                       po::value<uint32_t>(&search_threads)->default_value(2),
+                       "Number of threads searching during the saves");
+    desc.add_options()("search_list",
+                       po::value<uint32_t>(&Ls)->default_value(100),
+                       "Search list size");
+    desc.add_options()("recall_at,K",
+                       po::value<uint32_t>(&K)->default_value(10),
+                       "Number of neighbors searched");
+    desc.add_options()(
+        "build_points", po::value<uint64_t>(&build_points)->default_value(0),
+        "Build the index on this many points and insert the rest during the "
+        "saves (0 for all)");
+    desc.add_options()(
+        "warmup_ms", po::value<uint32_t>(&warmup_ms)->default_value(1000),
+        "Milliseconds of searches before and after each save");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      std::cout << desc;
+      return 0;
+    }
+    po::notify(vm);
+    if (save_mode != "save" && save_mode != "snapshot" && save_mode != "both") {
+      std::cerr << "save_mode must be save, snapshot or both" << std::endl;
+      return -1;
+    }
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << '\n';
+    return -1;
+  }
+
+  try {
+    if (data_type == std::string("int8"))
+      return run<int8_t>(data_path, query_path, save_path, save_mode, R, L,
+                         alpha, num_threads, search_threads, Ls, K,
+                         build_points, warmup_ms);
+    else if (data_type == std::string("uint8"))
+      return run<uint8_t>(data_path, query_path, save_path, save_mode, R, L,
+                          alpha, num_threads, search_threads, Ls, K,
+                          build_points, warmup_ms);
+    else if (data_type == std::string("float"))
+      return run<float>(data_path, query_path, save_path, save_mode, R, L,
+                        alpha, num_threads, search_threads, Ls, K,
+                        build_points, warmup_ms);
+    else
+      std::cout << "Unsupported type. Use float/int8/uint8" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "Caught exception: " << e.what() << std::endl;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,176 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Grows a dynamic index whose data is not compacted. An index is built, full,
+// on the first build_points points of the base file (tagged by their ids + 1),
+// and its first delete_points points are lazily deleted and consolidated, so
+// that live points sit past the number of points in the index. A batch
+// bigger than the free slots then makes insert_points grow the index, which
+// moves the frozen point: first a retried batch of points that are all in
+// already, so that nothing takes the old frozen location, then the remaining
+// base points. Checks that no edge is left to a free location.
+
+#include <index.h>
+#include <numeric>
+#include <omp.h>
+#include <timer.h>
+#include <boost/program_options.hpp>
+
+#include "utils.h"
+
+namespace po = boost::program_options;
+
+template<typename T>
+int run(const std::string& data_path, size_t build_points,
+        size_t delete_points, unsigned R, unsigned L, float alpha,
+        unsigned num_threads) {
+  using TagT = uint32_t;
+  T*     data = nullptr;
+  size_t num_points, dim, aligned_dim;
+  diskann::load_aligned_bin<T>(data_path, data, num_points, dim, aligned_dim);
+  if (build_points > num_points || delete_points * 2 + 1 > build_points) {
+    std::cerr << "Need delete_points * 2 < build_points <= #base points"
+              << std::endl;
+    diskann::aligned_free(data);
+    return -1;
+  }
+
+  diskann::Parameters params;
+  params.Set<unsigned>("L", L);
+  params.Set<unsigned>("R", R);
+  params.Set<unsigned>("C", 500);
+  params.Set<float>("alpha", alpha);
+  params.Set<bool>("saturate_graph", false);
+  params.Set<unsigned>("num_rnds", 1);
+  params.Set<unsigned>("num_threads", num_threads);
+
+  diskann::Index<T, TagT> index(diskann::L2, dim, build_points, true, params,
+                                params, true);
+  std::vector<TagT> tags(build_points);
+  std::iota(tags.begin(), tags.end(), 1);
+  index.build(data, build_points, params, tags);
+  index.enable_delete();
+
+  for (size_t i = 0; i < delete_points; i++)
+    index.lazy_delete((TagT)(i + 1));
+  auto report = index.consolidate_deletes(params);
+  std::cout << "Consolidated " << report._slots_released << " deletes, "
+            << report._active_points << " points in " << report._max_points
+            << " slots" << std::endl;
+
+  int  result = 0;
+  auto check = [&](const std::string& label) {
+    size_t num_dangling = index.count_dangling_edges();
+    std::cout << label << ": " << index.get_num_points() << " points in "
+              << index.get_max_points() << " slots, " << num_dangling
+              << " edges to free locations" << std::endl;
+    if (num_dangling > 0)
+      result = -1;
+  };
+
+  // points delete_points .. 2 * delete_points, which are in already
+  size_t            max_points = index.get_max_points();
+  std::vector<TagT> batch_tags(delete_points + 1), failed_tags;
+  std::iota(batch_tags.begin(), batch_tags.end(), (TagT)(delete_points + 1));
+  index.insert_points(data + delete_points * aligned_dim, batch_tags,
+                      failed_tags, num_threads);
+  if (failed_tags.size() != batch_tags.size() ||
+      index.get_max_points() == max_points) {
+    std::cout << "The retried batch did not grow the index" << std::endl;
+    result = -1;
+  }
+  check("After the retried batch");
+
+  if (build_points < num_points) {
+    batch_tags.resize(num_points - build_points);
+    std::iota(batch_tags.begin(), batch_tags.end(), (TagT)(build_points + 1));
+    failed_tags.clear();
+    diskann::Timer timer;
+    index.insert_points(data + build_points * aligned_dim, batch_tags,
+                        failed_tags, num_threads);
+    std::cout << "Inserted " << batch_tags.size() - failed_tags.size()
+              << " points in " << timer.elapsed() / 1000000.0 << "s"
+              << std::endl;
+    check("After the new points");
+
+    // each new point should find itself
+    std::vector<TagT>  result_tags(1);
+    std::vector<float> result_dists(1);
+    std::vector<T*>    res_vectors;
+    size_t             found = 0;
+    for (size_t i = build_points; i < num_points; i++) {
+      index.search_with_tags(data + i * aligned_dim, 1, L, result_tags.data(),
+                             result_dists.data(), res_vectors);
+      found += result_tags[0] == (TagT)(i + 1);
+    }
+    std::cout << "New points found by a search for them: " << found << "/"
+              << num_points - build_points << std::endl;
+  }
+
+  diskann::aligned_free(data);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  std::string data_type, data_path;
+  unsigned    R, L, num_threads;
+  float       alpha;
+  size_t      build_points, delete_points;
+
+  po::options_description desc{"Arguments"};
+  try {
+    desc.add_options()("help,h", "Print information on arguments");
+    desc.add_options()("data_type",
+                       po::value<std::string>(&data_type)->required(),
+                       "data type <int8/uint8/float>");
+    desc.add_options()("data_path",
+                       po::value<std::string>(&data_path)->required(),
+                       "Base file in bin format");
+    desc.add_options()("build_points",
+                       po::value<uint64_t>(&build_points)->required(),
+                       "Number of base points the index is built on");
+    desc.add_options()("delete_points",
+                       po::value<uint64_t>(&delete_points)->required(),
+                       "Number of built points deleted before growing");
+    desc.add_options()("max_degree,R",
+                       po::value<uint32_t>(&R)->default_value(64),
+                       "Maximum graph degree");
+    desc.add_options()("Lbuild,L", po::value<uint32_t>(&L)->default_value(100),
+                       "Build complexity");
+    desc.add_options()("alpha", po::value<float>(&alpha)->default_value(1.2f),
+                       "alpha controls density and diameter of graph");
+    desc.add_options()(
+        "num_threads,T",
+        po::value<uint32_t>(&num_threads)->default_value(omp_get_num_procs()),
+        "Number of threads used for building and inserting");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      std::cout << desc;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << '\n';
+    return -1;
+  }
+
+  try {
+    if (data_type == std::string("int8"))
+      return run<int8_t>(data_path, build_points, delete_points, R, L, alpha,
+                         num_threads);
+    else if (data_type == std::string("uint8"))
+      return run<uint8_t>(data_path, build_points, delete_points, R, L, alpha,
+                          num_threads);
+    else if (data_type == std::string("float"))
+      return run<float>(data_path, build_points, delete_points, R, L, alpha,
+                        num_threads);
+    else
+      std::cout << "Unsupported type. Use float/int8/uint8" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "Caught exception: " << e.what() << std::endl;
+    return -1;
+  }
+  return 0;
+}
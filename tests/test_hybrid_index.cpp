@@ -0,0 +1,330 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Streams updates into a disk index through a HybridIndex. The disk index must
+// have been built on the first disk_points points of the base file, which are
+// tagged by their ids. The remaining base points are inserted (tagged by their
+// ids) and every delete_stride-th disk point is deleted, while search threads
+// replay the queries; the delta is then merged into the disk index, with the
+// searches still running. Reports the search latencies before, during and
+// after the merge, and checks that no search returns a deleted tag and that
+// the recall of the first recall_queries queries, against an exact search of
+// the live points, holds up through the merge. Finally a disk point is
+// updated and two others deleted, so that the update takes a lower slot than
+// its old one, and after another merge the update must be deletable.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <omp.h>
+#include <thread>
+#include <boost/program_options.hpp>
+
+#include "hybrid_index.h"
+#include "timer.h"
+#include "utils.h"
+
+namespace po = boost::program_options;
+
+using steady_clock = std::chrono::steady_clock;
+
+// percent of the exact K nearest live points (by tag) found by the index
+template<typename T>
+double check_recall(diskann::HybridIndex<T>& index, const T* data,
+                    size_t num_points, size_t aligned_dim, const T* queries,
+                    size_t num_queries, size_t query_aligned_dim, size_t dim,
+                    const std::vector<bool>& live, unsigned Ls,
+                    unsigned beam_width, unsigned K) {
+  size_t hits = 0;
+#pragma omp parallel for schedule(dynamic, 1) reduction(+ : hits)
+  for (int64_t q = 0; q < (int64_t) num_queries; q++) {
+    const T* query = queries + q * query_aligned_dim;
+    std::vector<std::pair<float, uint32_t>> exact;
+    for (size_t i = 0; i < num_points; i++) {
+      if (!live[i])
+        continue;
+      float dist = 0;
+      for (size_t d = 0; d < dim; d++) {
+        float diff = (float) data[i * aligned_dim + d] - (float) query[d];
+        dist += diff * diff;
+      }
+      exact.emplace_back(dist, (uint32_t) i);
+    }
+    size_t num_exact = (std::min)((size_t) K, exact.size());
+    std::partial_sort(exact.begin(), exact.begin() + num_exact, exact.end());
+
+    std::vector<uint32_t> tags(K);
+    size_t n = index.search(query, K, Ls, beam_width, tags.data(), nullptr);
+    for (size_t i = 0; i < num_exact; i++)
+      if (std::find(tags.begin(), tags.begin() + n, exact[i].second) !=
+          tags.begin() + n)
+        hits++;
+  }
+  return 100.0 * hits / (num_queries * K);
+}
+
+void report_latencies(const std::string& label, std::vector<double> latencies) {
+  if (latencies.empty()) {
+    std::cout << label << ": no searches" << std::endl;
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) {
+    return latencies[(size_t)(p * (latencies.size() - 1))] / 1000.0;
+  };
+  std::cout << label << ": " << latencies.size() << " searches, median "
+            << percentile(0.5) << "ms, p99 " << percentile(0.99) << "ms, max "
+            << latencies.back() / 1000.0 << "ms" << std::endl;
+}
+
+template<typename T>
+int run(const std::string& data_path, const std::string& query_path,
+        const std::string& index_prefix, size_t disk_points,
+        size_t delete_stride, unsigned R, unsigned L, float alpha,
+        unsigned num_threads, unsigned search_threads, unsigned Ls,
+        unsigned beam_width, unsigned K, size_t recall_queries,
+        double min_recall) {
+  T*     data = nullptr;
+  T*     queries = nullptr;
+  size_t num_points, dim, aligned_dim;
+  size_t num_queries, query_dim, query_aligned_dim;
+  diskann::load_aligned_bin<T>(data_path, data, num_points, dim, aligned_dim);
+  diskann::load_aligned_bin<T>(query_path, queries, num_queries, query_dim,
+                               query_aligned_dim);
+  if (query_dim != dim || disk_points > num_points) {
+    std::cerr << "Queries or disk_points do not match the base file"
+              << std::endl;
+    return -1;
+  }
+
+  diskann::Parameters delta_params;
+  delta_params.Set<unsigned>("L", L);
+  delta_params.Set<unsigned>("R", R);
+  delta_params.Set<unsigned>("C", 500);
+  delta_params.Set<float>("alpha", alpha);
+  delta_params.Set<unsigned>("num_threads", num_threads);
+  diskann::HybridIndex<T> index(index_prefix, num_threads + search_threads,
+                                delta_params, num_points - disk_points + 1);
+
+  // phases: 0 updates, 1 merge, 2 after the merge
+  std::atomic<int>                 phase(0);
+  std::atomic<bool>                stop(false);
+  std::atomic<size_t>              deleted_returned(0);
+  std::vector<std::vector<double>> latencies(3 * search_threads);
+  std::vector<std::thread>         searchers;
+  for (unsigned t = 0; t < search_threads; t++) {
+    searchers.emplace_back([&, t]() {
+      std::vector<uint32_t> tags(K);
+      std::vector<float>    dists(K);
+      for (size_t q = t; !stop; q += search_threads) {
+        int    cur_phase = phase;
+        auto   start = steady_clock::now();
+        size_t n = index.search(queries + (q % num_queries) * query_aligned_dim,
+                                K, Ls, beam_width, tags.data(), dists.data());
+        latencies[3 * t + cur_phase].push_back(
+            std::chrono::duration<double, std::micro>(steady_clock::now() -
+                                                      start)
+                .count());
+        // only deletes that finished before the search started count
+        if (cur_phase > 0)
+          for (size_t i = 0; i < n; i++)
+            if (tags[i] < disk_points && tags[i] % delete_stride == 0)
+              deleted_returned++;
+      }
+    });
+  }
+
+  diskann::Timer timer;
+#pragma omp parallel for num_threads(num_threads) schedule(dynamic, 64)
+  for (int64_t i = (int64_t) disk_points; i < (int64_t) num_points; i++)
+    index.insert_point(data + i * aligned_dim, (uint32_t) i);
+  for (size_t i = 0; i < disk_points; i += delete_stride)
+    index.lazy_delete((uint32_t) i);
+  std::cout << "Inserted " << num_points - disk_points << " points and deleted "
+            << DIV_ROUND_UP(disk_points, delete_stride) << " in "
+            << timer.elapsed() / 1000000.0 << "s" << std::endl;
+
+  std::vector<bool> live(num_points, true);
+  for (size_t i = 0; i < disk_points; i += delete_stride)
+    live[i] = false;
+  recall_queries = (std::min)(recall_queries, num_queries);
+  double recall_before =
+      check_recall(index, data, num_points, aligned_dim, queries,
+                   recall_queries, query_aligned_dim, dim, live, Ls,
+                   beam_width, K);
+
+  phase = 1;
+  diskann::Parameters merge_params;
+  merge_params.Set<unsigned>("L", L);
+  merge_params.Set<float>("alpha", alpha);
+  merge_params.Set<unsigned>("beam_width", beam_width);
+  merge_params.Set<unsigned>("num_threads", num_threads);
+  index.merge(merge_params);
+  phase = 2;
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  stop = true;
+  for (auto& searcher : searchers)
+    searcher.join();
+  double recall_after =
+      check_recall(index, data, num_points, aligned_dim, queries,
+                   recall_queries, query_aligned_dim, dim, live, Ls,
+                   beam_width, K);
+
+  const char* labels[] = {"  during the updates", "  during the merge",
+                          "  after the merge"};
+  for (int p = 0; p < 3; p++) {
+    std::vector<double> phase_latencies;
+    for (unsigned t = 0; t < search_threads; t++)
+      phase_latencies.insert(phase_latencies.end(),
+                             latencies[3 * t + p].begin(),
+                             latencies[3 * t + p].end());
+    report_latencies(labels[p], phase_latencies);
+  }
+  std::cout << "Disk index has " << index.get_num_disk_points()
+            << " points, the delta " << index.get_num_delta_points()
+            << "; deleted tags returned: " << deleted_returned << std::endl;
+  std::cout << "Recall@" << K << " of " << recall_queries
+            << " queries: " << recall_before << " before the merge, "
+            << recall_after << " after it" << std::endl;
+
+  // The update goes to the lowest free slot after the merge, the slot of the
+  // first deleted point, while its old slot stays deleted and unused.
+  int64_t updated = (int64_t) disk_points - 1;
+  while (updated > 0 && !live[updated])
+    updated--;
+  std::vector<uint32_t> deleted;
+  for (size_t i = 1; i < (size_t) updated && deleted.size() < 2; i++)
+    if (live[i])
+      deleted.push_back((uint32_t) i);
+  bool update_ok = true;
+  if (deleted.size() == 2) {
+    index.insert_point(data + updated * aligned_dim, (uint32_t) updated);
+    for (auto tag : deleted) {
+      index.lazy_delete(tag);
+      live[tag] = false;
+    }
+    index.merge(merge_params);
+    update_ok = index.lazy_delete((uint32_t) updated) == 0;
+
+    std::vector<uint32_t> tags(K);
+    for (int64_t point :
+         {updated, (int64_t) deleted[0], (int64_t) deleted[1]}) {
+      size_t n = index.search(data + point * aligned_dim, K, Ls, beam_width,
+                              tags.data(), nullptr);
+      if (std::find(tags.begin(), tags.begin() + n, (uint32_t) point) !=
+          tags.begin() + n)
+        update_ok = false;
+    }
+    std::cout << "Updated tag " << updated << " and deleted tags "
+              << deleted[0] << ", " << deleted[1] << "; after a merge the "
+              << (update_ok ? "update was deleted" : "update was NOT deleted")
+              << std::endl;
+  }
+
+  diskann::aligned_free(data);
+  diskann::aligned_free(queries);
+  return deleted_returned == 0 && recall_after >= min_recall && update_ok
+             ? 0
+             : -1;
+}
+
+int main(int argc, char** argv) {
+  std::string data_type, data_path, query_path, index_prefix;
+  unsigned    R, L, num_threads, search_threads, Ls, beam_width, K;
+  float       alpha;
+  size_t      disk_points, delete_stride, recall_queries;
+  double      min_recall;
+
+  po::options_description desc{"Arguments"};
+  try {
+    desc.add_options()("help,h", "Print information on arguments");
+    desc.add_options()("data_type",
+                       po::value<std::string>(&data_type)->required(),
+                       "data type <int8/uint8/float>");
+    desc.add_options()("data_path",
+                       po::value<std::string>(&data_path)->required(),
+                       "Base file in bin format");
+    desc.add_options()("query_file",
+                       po::value<std::string>(&query_path)->required(),
+                       "Queries replayed during the updates, in bin format");
+    desc.add_options()("index_path_prefix",
+                       po::value<std::string>(&index_prefix)->required(),
+                       "Path prefix of the disk index, which is replaced");
+    desc.add_options()("disk_points",
+                       po::value<uint64_t>(&disk_points)->required(),
+                       "Number of base points in the disk index");
+    desc.add_options()(
+        "delete_stride", po::value<uint64_t>(&delete_stride)->default_value(10),
+        "Delete the disk points whose ids are multiples of this");
+    desc.add_options()("max_degree,R",
+                       po::value<uint32_t>(&R)->default_value(64),
+                       "Maximum degree of the delta graph");
+    desc.add_options()("Lbuild,L", po::value<uint32_t>(&L)->default_value(100),
+                       "Complexity of the inserts and the merge");
+    desc.add_options()("alpha", po::value<float>(&alpha)->default_value(1.2f),
+                       "alpha of the inserts and the merge");
+    desc.add_options()(
+        "num_threads,T",
+        po::value<uint32_t>(&num_threads)->default_value(omp_get_num_procs()),
+        "Number of threads used for the inserts and the merge");
+    desc.add_options()("search_threads",
+                       po::value<uint32_t>(&search_threads)->default_value(2),
+                       "Number of threads searching meanwhile");
+    desc.add_options()("search_list",
+                       po::value<uint32_t>(&Ls)->default_value(100),
+                       "Search list size");
+    desc.add_options()("beamwidth,W",
+                       po::value<uint32_t>(&beam_width)->default_value(4),
+                       "Beamwidth of the disk searches");
+    desc.add_options()("recall_at,K",
+                       po::value<uint32_t>(&K)->default_value(10),
+                       "Number of neighbors searched");
+    desc.add_options()(
+        "recall_queries",
+        po::value<uint64_t>(&recall_queries)->default_value(100),
+        "Number of queries whose recall is checked against an exact search");
+    desc.add_options()(
+        "min_recall", po::value<double>(&min_recall)->default_value(80),
+        "Fail if the recall (in percent) after the merge is lower");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      std::cout << desc;
+      return 0;
+    }
+    po::notify(vm);
+    if (delete_stride == 0) {
+      std::cerr << "delete_stride must be positive" << std::endl;
+      return -1;
+    }
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << '\n';
+    return -1;
+  }
+
+  try {
+    if (data_type == std::string("int8"))
+      return run<int8_t>(data_path, query_path, index_prefix, disk_points,
+                         delete_stride, R, L, alpha, num_threads,
+                         search_threads, Ls, beam_width, K, recall_queries,
+                         min_recall);
+    else if (data_type == std::string("uint8"))
+      return run<uint8_t>(data_path, query_path, index_prefix, disk_points,
+                          delete_stride, R, L, alpha, num_threads,
+                          search_threads, Ls, beam_width, K, recall_queries,
+                          min_recall);
+    else if (data_type == std::string("float"))
+      return run<float>(data_path, query_path, index_prefix, disk_points,
+                        delete_stride, R, L, alpha, num_threads,
+                        search_threads, Ls, beam_width, K, recall_queries,
+                        min_recall);
+    else
+      std::cout << "Unsupported type. Use float/int8/uint8" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << "Caught exception: " << e.what() << std::endl;
+    return -1;
+  }
+  return 0;
+}
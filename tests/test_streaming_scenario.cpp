@@ -85,20 +85,28 @@ std::string get_save_filename(const std::string& save_path,
 
 template<typename T, typename TagT>
 void insert_next_batch(diskann::Index<T, TagT>& index, size_t start, size_t end,
-                       size_t insert_threads, T* data, size_t aligned_dim) {
+                       size_t insert_threads, T* data, size_t aligned_dim,
+                       bool batch_insert) {
   try {
     diskann::Timer insert_timer;
     std::cout << std::endl
               << "Inserting from " << start << " to " << end << std::endl;
 
     size_t num_failed = 0;
+    if (batch_insert) {
+      std::vector<TagT> tags(end - start), failed_tags;
+      std::iota(tags.begin(), tags.end(), 1 + static_cast<TagT>(start));
+      index.insert_points(data, tags, failed_tags, (uint32_t) insert_threads);
+      num_failed = failed_tags.size();
+    } else {
 #pragma omp parallel for num_threads(insert_threads) schedule(dynamic) \
     reduction(+:num_failed)
-    for (int64_t j = start; j < (int64_t) end; j++) {
-      if (index.insert_point(&data[(j - start) * aligned_dim],
-                             1 + static_cast<TagT>(j)) != 0) {
-        std::cerr << "Insert failed " << j << std::endl;
-        num_failed++;
+      for (int64_t j = start; j < (int64_t) end; j++) {
+        if (index.insert_point(&data[(j - start) * aligned_dim],
+                               1 + static_cast<TagT>(j)) != 0) {
+          std::cerr << "Insert failed " << j << std::endl;
+          num_failed++;
+        }
       }
     }
     const double elapsedSeconds = insert_timer.elapsed() / 1000000.0;
@@ -119,13 +127,15 @@ void insert_next_batch(diskann::Index<T, TagT>& index, size_t start, size_t end,
 template<typename T, typename TagT>
 void delete_and_consolidate(diskann::Index<T, TagT>& index,
                             diskann::Parameters& delete_params, size_t start,
-                            size_t end) {
+                            size_t end, bool consolidate) {
   try {
     std::cout << std::endl
               << "Lazy deleting points " << start << " to " << end << "... ";
     for (size_t i = start; i < end; ++i)
       index.lazy_delete(1 + i);
     std::cout << "lazy delete done." << std::endl;
+    if (!consolidate)
+      return;
 
     auto report = index.consolidate_deletes(delete_params);
     while (report._status !=
@@ -177,6 +187,10 @@ void build_incremental_index(const std::string& data_path, const unsigned L,
                              size_t max_points_to_insert, size_t active_window,
                              size_t             consolidate_interval,
                              const float        start_point_norm,
+                             const unsigned     reverse_list_cap,
+                             const unsigned     full_sweep_interval,
+                             const bool         background_consolidation,
+                             const bool         batch_insert,
                              const std::string& save_path) {
   const unsigned C = 500;
   const bool     saturate_graph = false;
@@ -189,6 +203,8 @@ void build_incremental_index(const std::string& data_path, const unsigned L,
   params.Set<bool>("saturate_graph", saturate_graph);
   params.Set<unsigned>("num_rnds", 1);
   params.Set<unsigned>("num_threads", insert_threads);
+  params.Set<unsigned>("reverse_list_cap", reverse_list_cap);
+  params.Set<unsigned>("full_sweep_interval", full_sweep_interval);
   diskann::Parameters delete_params;
   delete_params.Set<unsigned>("L", L);
   delete_params.Set<unsigned>("R", R);
@@ -254,17 +270,22 @@ void build_incremental_index(const std::string& data_path, const unsigned L,
   auto insert_task = std::async(std::launch::async, [&]() {
     load_aligned_bin_part(data_path, data, 0, active_window);
     insert_next_batch(index, 0, active_window, insert_threads, data,
-                      aligned_dim);
+                      aligned_dim, batch_insert);
   });
   insert_task.wait();
 
+  // the index consolidates on its own; the delete tasks only lazy delete
+  if (background_consolidation)
+    index.start_background_consolidation(delete_params);
+
   for (size_t start = active_window;
        start + consolidate_interval <= max_points_to_insert;
        start += consolidate_interval) {
     auto end = std::min(start + consolidate_interval, max_points_to_insert);
     auto insert_task = std::async(std::launch::async, [&]() {
       load_aligned_bin_part(data_path, data, start, end - start);
-      insert_next_batch(index, start, end, insert_threads, data, aligned_dim);
+      insert_next_batch(index, start, end, insert_threads, data, aligned_dim,
+                        batch_insert);
     });
     insert_task.wait();
 
@@ -277,13 +298,32 @@ void build_incremental_index(const std::string& data_path, const unsigned L,
       params.Set<unsigned>("num_threads", consolidate_threads);
 
       delete_tasks.emplace_back(std::async(std::launch::async, [&]() {
-        delete_and_consolidate(index, delete_params, start_del, end_del);
+        delete_and_consolidate(index, delete_params, start_del, end_del,
+                               !background_consolidation);
       }));
     }
   }
   if (delete_tasks.size() > 0)
     delete_tasks[delete_tasks.size() - 1].wait();
 
+  if (background_consolidation) {
+    index.stop_background_consolidation();
+    auto stats = index.get_background_consolidation_stats();
+    std::cout << "Background consolidation: " << stats._slices << " slices ("
+              << stats._failed_slices << " failed) released "
+              << stats._slots_released << " slots in " << stats._busy_time
+              << "s, " << stats._pending_deletes << " deletes pending"
+              << std::endl;
+  }
+
+  // deletes deferred by localized consolidations, or left pending by the
+  // background thread, block the compaction
+  if (background_consolidation ||
+      (reverse_list_cap > 0 && full_sweep_interval > 0)) {
+    delete_params.Set<bool>("full_sweep", true);
+    index.consolidate_deletes(delete_params);
+  }
+
   std::cout << "Time Elapsed " << timer.elapsed() / 1000 << "ms\n";
   const auto save_path_inc =
       get_save_filename(save_path + ".after-streaming-", active_window,
@@ -296,7 +336,8 @@ void build_incremental_index(const std::string& data_path, const unsigned L,
 int main(int argc, char** argv) {
   std::string data_type, dist_fn, data_path, index_path_prefix;
   unsigned    insert_threads, consolidate_threads;
-  unsigned    R, L;
+  unsigned    R, L, reverse_list_cap, full_sweep_interval;
+  bool        background_consolidation, batch_insert;
   float       alpha, start_point_norm;
   size_t      max_points_to_insert, active_window, consolidate_interval;
 
@@ -352,6 +393,27 @@ int main(int argc, char** argv) {
     desc.add_options()(
         "start_point_norm", po::value<float>(&start_point_norm)->required(),
         "Set the start point to a random point on a sphere of this radius");
+    desc.add_options()(
+        "reverse_list_cap",
+        po::value<uint32_t>(&reverse_list_cap)->default_value(0),
+        "Keep up to this many in-neighbors per point so that consolidation "
+        "only repairs the in-neighbors of deleted points (0 to sweep all "
+        "points on every consolidation)");
+    desc.add_options()(
+        "full_sweep_interval",
+        po::value<uint32_t>(&full_sweep_interval)->default_value(0),
+        "With reverse_list_cap, sweep all points every this many "
+        "consolidations and defer deletes with overflowed in-neighbor lists "
+        "until then (0 to sweep only when such a point is deleted)");
+    desc.add_options()(
+        "background_consolidation",
+        po::bool_switch(&background_consolidation)->default_value(false),
+        "Let the index consolidate deletes from its background thread instead "
+        "of consolidating after every batch of deletes");
+    desc.add_options()(
+        "batch_insert", po::bool_switch(&batch_insert)->default_value(false),
+        "Insert every batch with one insert_points call instead of parallel "
+        "insert_point calls");
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -376,17 +438,24 @@ int main(int argc, char** argv) {
       build_incremental_index<int8_t>(data_path, L, R, alpha, insert_threads,
                                       consolidate_threads, max_points_to_insert,
                                       active_window, consolidate_interval,
-                                      start_point_norm, index_path_prefix);
+                                      start_point_norm, reverse_list_cap,
+                                      full_sweep_interval,
+                                      background_consolidation, batch_insert,
+                                      index_path_prefix);
     else if (data_type == std::string("uint8"))
       build_incremental_index<uint8_t>(
           data_path, L, R, alpha, insert_threads, consolidate_threads,
           max_points_to_insert, active_window, consolidate_interval,
-          start_point_norm, index_path_prefix);
+          start_point_norm, reverse_list_cap, full_sweep_interval,
+          background_consolidation, batch_insert, index_path_prefix);
     else if (data_type == std::string("float"))
       build_incremental_index<float>(data_path, L, R, alpha, insert_threads,
                                      consolidate_threads, max_points_to_insert,
                                      active_window, consolidate_interval,
-                                     start_point_norm, index_path_prefix);
+                                     start_point_norm, reverse_list_cap,
+                                     full_sweep_interval,
+                                     background_consolidation, batch_insert,
+                                     index_path_prefix);
     else
       std::cout << "Unsupported type. Use float/int8/uint8" << std::endl;
   } catch (const std::exception& e) {
@@ -0,0 +1,164 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Checks kmeans::run_lloyds against plain Lloyd iterations (repeated
+// kmeans::lloyds_iter with the same stopping rule) started from the same
+// k-means++ pivots on a random sample of a base file, and reports the time
+// and quantization error of both. Exits with an error if the quantization
+// error of run_lloyds exceeds the plain one by more than the tolerance.
+
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include "math_utils.h"
+#include "partition.h"
+#include "timer.h"
+#include "utils.h"
+
+namespace po = boost::program_options;
+
+float plain_lloyds(float* data, size_t num_points, size_t dim, float* centers,
+                   size_t num_centers, size_t max_reps) {
+  std::vector<size_t>* closest_docs = new std::vector<size_t>[num_centers];
+  uint32_t*            closest_center = new uint32_t[num_points];
+  float*               docs_l2sq = new float[num_points];
+  math_utils::compute_vecs_l2sq(docs_l2sq, data, num_points, dim);
+
+  float residual = std::numeric_limits<float>::max();
+  for (size_t i = 0; i < max_reps; ++i) {
+    float old_residual = residual;
+    residual = kmeans::lloyds_iter(data, num_points, dim, centers, num_centers,
+                                   docs_l2sq, closest_docs, closest_center);
+    if (((i != 0) && ((old_residual - residual) / residual) < 0.00001) ||
+        (residual < std::numeric_limits<float>::epsilon()))
+      break;
+  }
+  delete[] docs_l2sq;
+  delete[] closest_center;
+  delete[] closest_docs;
+  return residual;
+}
+
+template<typename T>
+int compare(const std::string& data_file, double sampling_rate,
+            size_t num_centers, size_t max_reps, size_t chunk_dims,
+            double tolerance) {
+  float* sample = nullptr;
+  size_t num_train, full_dim;
+  gen_random_slice<T>(data_file, sampling_rate, sample, num_train, full_dim);
+
+  // cluster only the first chunk_dims dimensions, like one PQ chunk
+  size_t dim = (chunk_dims == 0 || chunk_dims > full_dim) ? full_dim
+                                                          : chunk_dims;
+  std::vector<float> train(num_train * dim);
+  for (size_t i = 0; i < num_train; i++)
+    std::memcpy(train.data() + i * dim, sample + i * full_dim,
+                dim * sizeof(float));
+  delete[] sample;
+
+  if (num_centers > num_train) {
+    std::cerr << "Sample of " << num_train << " points is smaller than "
+              << num_centers << " centers" << std::endl;
+    return -1;
+  }
+  std::cout << "Clustering " << num_train << " points of " << dim
+            << " dimensions into " << num_centers << " centers" << std::endl;
+
+  diskann::Timer     timer;
+  std::vector<float> seeds(num_centers * dim);
+  kmeans::kmeanspp_selecting_pivots(train.data(), num_train, dim, seeds.data(),
+                                    num_centers);
+  std::cout << "k-means++ seeding: " << timer.elapsed() / 1000000.0 << "s"
+            << std::endl;
+
+  std::vector<float> centers(seeds);
+  timer.reset();
+  float plain_residual = plain_lloyds(train.data(), num_train, dim,
+                                      centers.data(), num_centers, max_reps);
+  double plain_secs = timer.elapsed() / 1000000.0;
+
+  centers = seeds;
+  timer.reset();
+  float residual = kmeans::run_lloyds(train.data(), num_train, dim,
+                                      centers.data(), num_centers, max_reps,
+                                      NULL, NULL);
+  double secs = timer.elapsed() / 1000000.0;
+
+  std::cout << "plain Lloyd: residual " << plain_residual << " in "
+            << plain_secs << "s" << std::endl;
+  std::cout << "run_lloyds:  residual " << residual << " in " << secs << "s"
+            << std::endl;
+
+  if (residual > plain_residual * (1 + tolerance)) {
+    std::cerr << "Quantization error of run_lloyds exceeds plain Lloyd by "
+              << 100.0 * (residual / plain_residual - 1) << "%" << std::endl;
+    return -1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  std::string data_type, data_file;
+  double      sampling_rate, tolerance;
+  size_t      num_centers, max_reps, chunk_dims;
+
+  po::options_description desc{"Arguments"};
+  try {
+    desc.add_options()("help,h", "Print information on arguments");
+    desc.add_options()("data_type",
+                       po::value<std::string>(&data_type)->required(),
+                       "data type <int8/uint8/float>");
+    desc.add_options()("data_file",
+                       po::value<std::string>(&data_file)->required(),
+                       "Base file in bin format");
+    desc.add_options()("sampling_rate",
+                       po::value<double>(&sampling_rate)->default_value(0.1),
+                       "Fraction of the points clustered");
+    desc.add_options()("num_centers",
+                       po::value<size_t>(&num_centers)->default_value(256),
+                       "Number of centers");
+    desc.add_options()("max_reps",
+                       po::value<size_t>(&max_reps)->default_value(12),
+                       "Maximum number of Lloyd iterations");
+    desc.add_options()(
+        "chunk_dims", po::value<size_t>(&chunk_dims)->default_value(0),
+        "Cluster only the first chunk_dims dimensions (0 for all)");
+    desc.add_options()("tolerance",
+                       po::value<double>(&tolerance)->default_value(0.01),
+                       "Allowed relative excess of quantization error");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      std::cout << desc;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << '\n';
+    return -1;
+  }
+
+  try {
+    if (data_type == std::string("float"))
+      return compare<float>(data_file, sampling_rate, num_centers, max_reps,
+                            chunk_dims, tolerance);
+    else if (data_type == std::string("int8"))
+      return compare<int8_t>(data_file, sampling_rate, num_centers, max_reps,
+                             chunk_dims, tolerance);
+    else if (data_type == std::string("uint8"))
+      return compare<uint8_t>(data_file, sampling_rate, num_centers, max_reps,
+                              chunk_dims, tolerance);
+    else {
+      std::cerr << "Unsupported data type. Use float/int8/uint8" << std::endl;
+      return -1;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+}
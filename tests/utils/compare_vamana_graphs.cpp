@@ -0,0 +1,148 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Compares two vamana graphs of the same points, e.g. one built from merged
+// shards and one built with --build_with_pq: degree statistics, reachability
+// from the start point, and how many neighbors the lists of a point share.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+
+#include "utils.h"
+
+namespace po = boost::program_options;
+
+struct VamanaGraph {
+  unsigned                           max_degree = 0;
+  unsigned                           start = 0;
+  std::vector<std::vector<unsigned>> nbrs;
+};
+
+void load_graph(const std::string& path, VamanaGraph& graph) {
+  std::ifstream in;
+  in.exceptions(std::ios::badbit | std::ios::failbit);
+  in.open(path, std::ios::binary);
+
+  _u64 file_size, num_frozen_pts;
+  in.read((char*) &file_size, sizeof(_u64));
+  in.read((char*) &graph.max_degree, sizeof(unsigned));
+  in.read((char*) &graph.start, sizeof(unsigned));
+  in.read((char*) &num_frozen_pts, sizeof(_u64));
+
+  _u64 bytes_read = 24;
+  while (bytes_read != file_size) {
+    unsigned k;
+    in.read((char*) &k, sizeof(unsigned));
+    std::vector<unsigned> list(k);
+    if (k > 0)
+      in.read((char*) list.data(), k * sizeof(unsigned));
+    graph.nbrs.emplace_back(std::move(list));
+    bytes_read += sizeof(unsigned) * ((_u64) k + 1);
+  }
+}
+
+void print_stats(const std::string& name, const VamanaGraph& graph) {
+  size_t num_points = graph.nbrs.size();
+  size_t max = 0, min = SIZE_MAX, total = 0, num_empty = 0;
+  for (auto& list : graph.nbrs) {
+    max = std::max(max, list.size());
+    min = std::min(min, list.size());
+    total += list.size();
+    if (list.empty())
+      num_empty++;
+  }
+
+  std::vector<bool>    visited(num_points, false);
+  std::queue<unsigned> frontier;
+  size_t               num_reached = 0, depth = 0;
+  frontier.push(graph.start);
+  visited[graph.start] = true;
+  while (!frontier.empty()) {
+    size_t level_size = frontier.size();
+    for (size_t i = 0; i < level_size; i++) {
+      unsigned id = frontier.front();
+      frontier.pop();
+      num_reached++;
+      for (auto nbr : graph.nbrs[id]) {
+        if (nbr < num_points && !visited[nbr]) {
+          visited[nbr] = true;
+          frontier.push(nbr);
+        }
+      }
+    }
+    depth++;
+  }
+
+  std::cout << name << ": " << num_points << " points, start " << graph.start
+            << ", degree max:" << max << " avg:" << (double) total / num_points
+            << " min:" << min << ", " << num_empty << " empty lists, "
+            << num_reached << " points reachable from start in " << depth
+            << " BFS levels" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  std::string graph_a_path, graph_b_path;
+
+  po::options_description desc{"Arguments"};
+  try {
+    desc.add_options()("help,h", "Print information on arguments");
+    desc.add_options()("graph_a",
+                       po::value<std::string>(&graph_a_path)->required(),
+                       "First vamana graph (<index_prefix>_mem.index)");
+    desc.add_options()("graph_b",
+                       po::value<std::string>(&graph_b_path)->required(),
+                       "Second vamana graph of the same points");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      std::cout << desc;
+      return 0;
+    }
+    po::notify(vm);
+  } catch (const std::exception& ex) {
+    std::cerr << ex.what() << '\n';
+    return -1;
+  }
+
+  try {
+    VamanaGraph graph_a, graph_b;
+    load_graph(graph_a_path, graph_a);
+    load_graph(graph_b_path, graph_b);
+    print_stats("graph_a", graph_a);
+    print_stats("graph_b", graph_b);
+
+    if (graph_a.nbrs.size() != graph_b.nbrs.size()) {
+      std::cerr << "Graphs have different numbers of points" << std::endl;
+      return -1;
+    }
+
+    // fraction of the neighbors of graph_a also present in graph_b
+    double total_overlap = 0;
+    size_t num_compared = 0;
+    for (size_t i = 0; i < graph_a.nbrs.size(); i++) {
+      auto a = graph_a.nbrs[i], b = graph_b.nbrs[i];
+      if (a.empty())
+        continue;
+      std::sort(a.begin(), a.end());
+      std::sort(b.begin(), b.end());
+      std::vector<unsigned> common;
+      std::set_intersection(a.begin(), a.end(), b.begin(), b.end(),
+                            std::back_inserter(common));
+      total_overlap += (double) common.size() / a.size();
+      num_compared++;
+    }
+    std::cout << "Average neighbor overlap: "
+              << (num_compared ? 100.0 * total_overlap / num_compared : 0)
+              << "% over " << num_compared << " points" << std::endl;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+  return 0;
+}
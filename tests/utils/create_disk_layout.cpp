@@ -24,7 +24,7 @@ int create_disk_layout(char **argv) {
 int main(int argc, char **argv) {
   if (argc != 5) {
     std::cout << argv[0]
-              << " data_type <float/int8/uint8> data_bin "
+              << " data_type <float/float16/int8/uint8> data_bin "
                  "vamana_index_file output_diskann_index_file"
               << std::endl;
     exit(-1);
@@ -33,12 +33,14 @@ int main(int argc, char **argv) {
   int ret_val = -1;
   if (std::string(argv[1]) == std::string("float"))
     ret_val = create_disk_layout<float>(argv);
+  else if (std::string(argv[1]) == std::string("float16"))
+    ret_val = create_disk_layout<diskann::float16>(argv);
   else if (std::string(argv[1]) == std::string("int8"))
     ret_val = create_disk_layout<int8_t>(argv);
   else if (std::string(argv[1]) == std::string("uint8"))
     ret_val = create_disk_layout<uint8_t>(argv);
   else {
-    std::cout << "unsupported type. use int8/uint8/float " << std::endl;
+    std::cout << "unsupported type. use int8/uint8/float/float16 " << std::endl;
     ret_val = -2;
   }
   return ret_val;
@@ -5,6 +5,7 @@
 #include <cassert>
 
 #include "tensorstore/context.h"
+#include "tensorstore/data_type.h"
 #include "tensorstore/open.h"
 #include "tensorstore/index_space/dim_expression.h"
 
@@ -70,6 +71,8 @@ static ts::TensorStore<V> open_tensorstore(ts::Context&                context,
   std::string dtype_str;
   if constexpr (std::is_same<V, float>::value)
     dtype_str = "<f4";
+  else if constexpr (std::is_same<V, ts::dtypes::float16_t>::value)
+    dtype_str = "<f2";
   else if constexpr (std::is_same<V, int8_t>::value)
     dtype_str = "|i1";
   else if constexpr (std::is_same<V, int32_t>::value)
@@ -116,6 +119,7 @@ static auto tensor2d_read_slices(ts::TensorStore<V>& store, int64_t dim,
  * Disk index binary file format constants.
  */
 static constexpr int32_t DISK_INDEX_META_NR = 9;
+static constexpr int32_t DISK_INDEX_META_NR_REORDER = 12;
 static constexpr int32_t DISK_INDEX_META_NC = 1;
 static constexpr size_t  DISK_INDEX_META_SIZE =
     DISK_INDEX_META_NR * sizeof(uint64_t);
@@ -283,6 +287,90 @@ static void compare_points_data(std::ifstream&             disk_index_file,
   delete[] nbrhood_buf;
 }
 
+/**
+ * Reorder data sectors sweeper.
+ */
+static void compare_reorder_data(std::ifstream&          disk_index_file,
+                                 ts::TensorStore<float>& store_reorder,
+                                 size_t num_pts, size_t num_vecs_per_sector,
+                                 size_t num_reorder_dims) {
+  char*  sector_buf = new char[DISK_INDEX_SECTOR_LEN];
+  size_t done_pts = 0, buffer_pts = 0, buffer_start = 0;
+  size_t vec_len = num_reorder_dims * sizeof(float);
+
+  // use read batching
+  size_t num_pts_to_buffer = READ_BATCH_TOTAL_LIMIT / vec_len;
+  if (num_pts_to_buffer > num_pts)
+    num_pts_to_buffer = num_pts;
+  assert(num_pts_to_buffer > 0);
+  float* reorder_buf = new float[num_reorder_dims * num_pts_to_buffer];
+
+  auto compare_vectors_batch = [&]() {
+    auto reorder_array = tensor2d_read_slices<float>(
+        store_reorder, 0, buffer_start, buffer_start + buffer_pts);
+
+    if (reorder_array.rank() != 2)
+      throw TensorStoreANNException(
+          "reorder array [" + std::to_string(buffer_start) + ":" +
+          std::to_string(buffer_start + buffer_pts) +
+          "] wrong rank: " + std::to_string(reorder_array.rank()));
+    if (reorder_array.shape()[0] != buffer_pts)
+      throw TensorStoreANNException(
+          "reorder array [" + std::to_string(buffer_start) + ":" +
+          std::to_string(buffer_start + buffer_pts) +
+          "] wrong #points: " + std::to_string(reorder_array.shape()[0]));
+    if (reorder_array.shape()[1] != num_reorder_dims)
+      throw TensorStoreANNException(
+          "reorder array [" + std::to_string(buffer_start) + ":" +
+          std::to_string(buffer_start + buffer_pts) +
+          "] wrong #values: " + std::to_string(reorder_array.shape()[1]));
+    for (size_t p = 0; p < buffer_pts; ++p) {
+      for (size_t j = 0; j < num_reorder_dims; ++j) {
+        if (reorder_array.data()[p * num_reorder_dims + j] !=
+            reorder_buf[p * num_reorder_dims + j])
+          throw TensorStoreANNException(
+              "reorder array [" + std::to_string(buffer_start + p) +
+              "] wrong value @ " + std::to_string(j) + ": " +
+              std::to_string(reorder_array.data()[p * num_reorder_dims + j]) +
+              " vs. " + std::to_string(reorder_buf[p * num_reorder_dims + j]));
+      }
+    }
+  };
+
+  // reorder vectors are packed num_vecs_per_sector per sector, in point order
+  while (done_pts < num_pts) {
+    size_t sector_pts = num_vecs_per_sector;
+    if (done_pts + sector_pts > num_pts)
+      sector_pts = num_pts - done_pts;
+
+    read_binary_file<char>(disk_index_file, sector_buf, DISK_INDEX_SECTOR_LEN);
+
+    for (size_t i = 0; i < sector_pts; ++i) {
+      memcpy(reorder_buf + num_reorder_dims * buffer_pts,
+             &sector_buf[i * vec_len], vec_len);
+      done_pts++;
+      buffer_pts++;
+
+      if (buffer_pts == num_pts_to_buffer) {
+        compare_vectors_batch();
+        buffer_start += buffer_pts;
+        buffer_pts = 0;
+      }
+
+      if (done_pts % num_pts_to_buffer == 0)
+        std::cout << "  compared " << done_pts << " vectors..." << std::endl;
+    }
+  }
+
+  if (buffer_pts > 0)
+    compare_vectors_batch();
+
+  std::cout << "  comparison of " << num_pts << " vectors SUCCESS"
+            << std::endl;
+  delete[] sector_buf;
+  delete[] reorder_buf;
+}
+
 /**
  * Main body.
  */
@@ -302,16 +390,18 @@ void compare_disk_index_and_tensors(
   // read metadata
   int32_t meta_nr = 0, meta_nc = 0;
   read_binary_file<int32_t>(disk_index_file, &meta_nr, sizeof(int32_t));
-  if (meta_nr != DISK_INDEX_META_NR)
-    throw TensorStoreANNException("disk_index meta_nr != " +
-                                  std::to_string(DISK_INDEX_META_NR));
+  if (meta_nr != DISK_INDEX_META_NR && meta_nr != DISK_INDEX_META_NR_REORDER)
+    throw TensorStoreANNException(
+        "disk_index meta_nr not in {" + std::to_string(DISK_INDEX_META_NR) +
+        ", " + std::to_string(DISK_INDEX_META_NR_REORDER) + "}");
   read_binary_file<int32_t>(disk_index_file, &meta_nc, sizeof(int32_t));
   if (meta_nc != DISK_INDEX_META_NC)
     throw TensorStoreANNException("disk_index meta_nc != " +
                                   std::to_string(DISK_INDEX_META_NC));
 
-  uint64_t metadata[DISK_INDEX_META_NR];
-  read_binary_file<uint64_t>(disk_index_file, metadata, DISK_INDEX_META_SIZE);
+  uint64_t metadata[DISK_INDEX_META_NR_REORDER];
+  read_binary_file<uint64_t>(disk_index_file, metadata,
+                             meta_nr * sizeof(uint64_t));
 
   uint64_t num_pts = metadata[0];
   uint64_t num_dims = metadata[1];
@@ -321,7 +411,18 @@ void compare_disk_index_and_tensors(
   uint64_t vamana_frozen_num = metadata[5];
   uint64_t vamana_frozen_loc = metadata[6];
   uint64_t append_reorder_data = metadata[7];
-  uint64_t file_size = metadata[8];
+  uint64_t reorder_start_sector = 0, num_reorder_dims = 0,
+           num_vecs_per_sector = 0;
+  if (append_reorder_data) {
+    if (meta_nr != DISK_INDEX_META_NR_REORDER)
+      throw TensorStoreANNException(
+          "disk_index has reorder data but meta_nr != " +
+          std::to_string(DISK_INDEX_META_NR_REORDER));
+    reorder_start_sector = metadata[8];
+    num_reorder_dims = metadata[9];
+    num_vecs_per_sector = metadata[10];
+  }
+  uint64_t file_size = metadata[meta_nr - 1];
   if (file_size != disk_index_filesize)
     throw TensorStoreANNException(
         "disk_index metadata filesize field mismatch: " +
@@ -342,6 +443,11 @@ void compare_disk_index_and_tensors(
             << "  vamana frozen loc:  " << vamana_frozen_loc << std::endl
             << "  append reorder:     " << append_reorder_data << std::endl
             << "  file size:          " << file_size << std::endl;
+  if (append_reorder_data)
+    std::cout << "  reorder start sector: " << reorder_start_sector << std::endl
+              << "  reorder #dims:        " << num_reorder_dims << std::endl
+              << "  #vectors per sector:  " << num_vecs_per_sector
+              << std::endl;
 
   // open tensorstore tensors
   auto context = ts::Context::Default();
@@ -389,6 +495,20 @@ void compare_disk_index_and_tensors(
   compare_points_data<V>(disk_index_file, store_embedding, store_num_nbrs,
                          store_nbrhood, num_pts, num_pts_per_sector, max_pt_len,
                          num_dims, max_nbrs_per_pt);
+
+  if (append_reorder_data) {
+    std::vector<int64_t> reorder_dims = {
+        static_cast<int64_t>(num_pts), static_cast<int64_t>(num_reorder_dims)};
+    std::string reorder_filename = tensors_filename_prefix + "_reorder.zarr";
+    auto        store_reorder =
+        open_tensorstore<float>(context, reorder_filename, reorder_dims);
+
+    disk_index_file.seekg(reorder_start_sector * DISK_INDEX_SECTOR_LEN,
+                          std::ios::beg);
+    std::cout << "Comparing reorder data --" << std::endl;
+    compare_reorder_data(disk_index_file, store_reorder, num_pts,
+                         num_vecs_per_sector, num_reorder_dims);
+  }
 }
 
 int main(int argc, char* argv[]) {
@@ -396,7 +516,10 @@ int main(int argc, char* argv[]) {
     std::cout << "Usage: " << std::string(argv[0])
               << " <data_type> <disk_index_filename> <output_filename_prefix>"
               << std::endl;
-    std::cout << "  valid data_type: float | int8 | uint8" << std::endl;
+    std::cout << "  valid data_type: float | float16 | int8 | uint8 | disk_pq"
+              << std::endl;
+    std::cout << "  (use disk_pq for indexes built with disk PQ codes)"
+              << std::endl;
     return 1;
   }
 
@@ -407,10 +530,13 @@ int main(int argc, char* argv[]) {
   if (data_type == "float")
     compare_disk_index_and_tensors<float>(disk_index_filename,
                                           tensors_filename_prefix);
+  else if (data_type == "float16")
+    compare_disk_index_and_tensors<ts::dtypes::float16_t>(
+        disk_index_filename, tensors_filename_prefix);
   else if (data_type == "int8")
     compare_disk_index_and_tensors<int8_t>(disk_index_filename,
                                            tensors_filename_prefix);
-  else if (data_type == "uint8")
+  else if (data_type == "uint8" || data_type == "disk_pq")
     compare_disk_index_and_tensors<uint8_t>(disk_index_filename,
                                             tensors_filename_prefix);
   else
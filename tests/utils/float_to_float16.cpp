@@ -0,0 +1,21 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <iostream>
+#include "utils.h"
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cout << argv[0] << " input_float_bin output_float16_bin" << std::endl;
+    exit(-1);
+  }
+
+  float* input;
+  size_t npts, nd;
+  diskann::load_bin<float>(argv[1], input, npts, nd);
+  diskann::float16* output = new diskann::float16[npts * nd];
+  diskann::convert_types<float, diskann::float16>(input, output, npts, nd);
+  diskann::save_bin<diskann::float16>(argv[2], output, npts, nd);
+  delete[] output;
+  delete[] input;
+}